@@ -0,0 +1,183 @@
+#include "bench.h"
+#include "gatt_service.h"
+#include "mesh_node.h"
+#include "node_tracker.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <stdio.h>
+#include <string.h>
+
+#define TAG "BENCH"
+
+#if CONFIG_MESH_BENCHMARK
+
+#include "host/ble_hs.h"
+
+#define BENCH_RETRY_LIMIT 200 // Consecutive full-queue retries before giving up
+
+static TaskHandle_t burst_task = NULL;
+static volatile bool burst_running = false;
+static uint32_t burst_count;
+static uint16_t burst_len;
+
+// ============== Mesh Ping / Pong ==============
+esp_err_t bench_ping(uint16_t dst, uint16_t len) {
+  static uint16_t seq = 0;
+  uint8_t buf[BENCH_PING_MAX_LEN];
+
+  if (len < sizeof(vnd_ping_t))
+    len = sizeof(vnd_ping_t);
+  if (len > sizeof(buf))
+    len = sizeof(buf);
+
+  vnd_ping_t ping = {
+      .seq = seq++,
+      .t0_us = (uint32_t)esp_timer_get_time(),
+  };
+  memset(buf, 0x55, len);
+  memcpy(buf, &ping, sizeof(ping));
+  return mesh_tx_submit_op(dst, VND_OP_PING, buf, len) ? ESP_OK
+                                                       : ESP_ERR_NO_MEM;
+}
+
+// Server role: echo immediately from the mesh callback
+void bench_on_ping(esp_ble_mesh_msg_ctx_t *ctx, const uint8_t *msg,
+                   uint16_t len) {
+  uint32_t rx_us = (uint32_t)esp_timer_get_time();
+  uint8_t buf[sizeof(vnd_pong_t) + BENCH_PING_MAX_LEN];
+  vnd_ping_t ping;
+
+  if (len < sizeof(ping))
+    return;
+  memcpy(&ping, msg, sizeof(ping));
+  uint16_t pad = len - sizeof(ping);
+  if (pad > BENCH_PING_MAX_LEN)
+    pad = BENCH_PING_MAX_LEN;
+
+  int node_id = node_id_of(node_state.addr);
+  vnd_pong_t pong = {
+      .seq = ping.seq,
+      .node_id = node_id < 0 ? 0 : node_id,
+      .t0_us = ping.t0_us,
+      .rx_us = rx_us,
+  };
+  memcpy(buf + sizeof(pong), msg + sizeof(ping), pad);
+  pong.tx_us = (uint32_t)esp_timer_get_time();
+  memcpy(buf, &pong, sizeof(pong));
+
+  if (vendor_server_send(ctx, VND_OP_PONG, buf, sizeof(pong) + pad) != ESP_OK)
+    ESP_LOGW(TAG, "PONG #%u to 0x%04x failed", ping.seq, ctx->addr);
+}
+
+// Client role (gateway): report to the Pi
+void bench_on_pong(esp_ble_mesh_msg_ctx_t *ctx, const uint8_t *msg,
+                   uint16_t len) {
+  uint32_t now_us = (uint32_t)esp_timer_get_time();
+  vnd_pong_t pong;
+
+  if (len < sizeof(pong))
+    return;
+  memcpy(&pong, msg, sizeof(pong));
+
+  uint8_t relays =
+      (ctx->recv_ttl <= VND_RSP_TTL) ? VND_RSP_TTL - ctx->recv_ttl : 0;
+  char buf[96];
+  int n = snprintf(buf, sizeof(buf),
+                   "PONG:NODE%d:SEQ:%u:RTT:%lu:SRV:%lu:HOPS:%u:LEN:%u",
+                   node_id_of(ctx->addr), pong.seq,
+                   (unsigned long)(now_us - pong.t0_us),
+                   (unsigned long)(pong.tx_us - pong.rx_us), relays + 1,
+                   (unsigned)(len - sizeof(pong) + sizeof(vnd_ping_t)));
+  gatt_notify_sensor_data(buf, n);
+}
+
+// ============== GATT Notify Burst ==============
+static void bench_burst_task(void *arg) {
+  char buf[SENSOR_DATA_MAX_LEN];
+
+  while (1) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+    uint32_t sent = 0, retries = 0;
+    int64_t start = esp_timer_get_time();
+    while (sent < burst_count) {
+      int n = snprintf(buf, sizeof(buf), "BN:%lu:%lu:", (unsigned long)sent,
+                       (unsigned long)(esp_timer_get_time() - start));
+      if (n < burst_len) {
+        memset(buf + n, 'x', burst_len - n);
+        n = burst_len;
+      }
+      gatt_seg_t seg = {.data = buf, .len = n};
+
+      int rc = gatt_notify_segs(&seg, 1);
+      int spins = 0;
+      while (rc == BLE_HS_EBUSY && spins++ < BENCH_RETRY_LIMIT) {
+        // Queue full: the TX task is the bottleneck we're measuring
+        retries++;
+        vTaskDelay(1);
+        rc = gatt_notify_segs(&seg, 1);
+      }
+      if (rc != 0) {
+        ESP_LOGW(TAG, "Burst stopped at %lu: %d", (unsigned long)sent, rc);
+        break;
+      }
+      sent++;
+    }
+
+    int n = snprintf(buf, sizeof(buf), "BENCH:DONE:%lu:%lu:%lu",
+                     (unsigned long)sent,
+                     (unsigned long)(esp_timer_get_time() - start),
+                     (unsigned long)retries);
+    gatt_notify_sensor_data(buf, n);
+    ESP_LOGI(TAG, "%s", buf);
+    burst_running = false;
+  }
+}
+
+esp_err_t bench_notify_start(uint32_t count, uint16_t len) {
+  if (burst_task == NULL)
+    return ESP_ERR_INVALID_STATE;
+  if (burst_running)
+    return ESP_ERR_INVALID_STATE;
+  if (count == 0 || count > BENCH_NOTIFY_MAX)
+    return ESP_ERR_INVALID_ARG;
+  if (len >= SENSOR_DATA_MAX_LEN)
+    len = SENSOR_DATA_MAX_LEN - 1;
+
+  burst_count = count;
+  burst_len = len;
+  burst_running = true;
+  xTaskNotifyGive(burst_task);
+  return ESP_OK;
+}
+
+esp_err_t bench_init(void) {
+  if (xTaskCreate(bench_burst_task, "bench", 3072, NULL, 4, &burst_task) !=
+      pdPASS)
+    return ESP_ERR_NO_MEM;
+  ESP_LOGI(TAG, "Benchmark mode enabled");
+  return ESP_OK;
+}
+
+#else /* !CONFIG_MESH_BENCHMARK */
+
+esp_err_t bench_init(void) { return ESP_OK; }
+
+esp_err_t bench_ping(uint16_t dst, uint16_t len) {
+  return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t bench_notify_start(uint32_t count, uint16_t len) {
+  return ESP_ERR_NOT_SUPPORTED;
+}
+
+void bench_on_ping(esp_ble_mesh_msg_ctx_t *ctx, const uint8_t *msg,
+                   uint16_t len) {}
+
+void bench_on_pong(esp_ble_mesh_msg_ctx_t *ctx, const uint8_t *msg,
+                   uint16_t len) {}
+
+#endif /* CONFIG_MESH_BENCHMARK */
@@ -0,0 +1,59 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+#include "esp_ble_mesh_defs.h"
+#include "esp_err.h"
+#include "mesh_tx.h"
+
+// ============== Benchmark Mode (CONFIG_MESH_BENCHMARK) ==============
+// Measurement hooks for the Pi's bench.py driver, kept out of the normal
+// command path so a run doesn't perturb what it measures:
+//
+// - Mesh RTT: "N:PING[:<len>]" sends VND_OP_PING (vnd_ping_t + padding up to
+//   <len> bytes) through the TX queue. The target answers straight from the
+//   mesh callback with VND_OP_PONG (its receive / send times + the same
+//   padding), and the gateway notifies
+//     "PONG:NODE<id>:SEQ:<seq>:RTT:<us>:SRV:<us>:HOPS:<n>:LEN:<bytes>"
+//   RTT is submit -> PONG on the gateway clock (queueing included), SRV the
+//   time the target held the ping.
+// - GATT throughput: "ALL:BENCH:<count>:<len>" notifies <count> messages
+//     "BN:<seq>:<t_us>:xxxx..." (<len> bytes each) as fast as the notify
+//   queue takes them, then "BENCH:DONE:<sent>:<us>:<retries>".
+//
+// With CONFIG_MESH_BENCHMARK off the opcodes aren't registered and the calls
+// below return ESP_ERR_NOT_SUPPORTED.
+
+#define BENCH_PING_MAX_LEN MESH_TX_MAX_PAYLOAD
+#define BENCH_NOTIFY_MAX 10000
+
+typedef struct {
+  uint16_t seq;
+  uint32_t t0_us; // Sender's esp_timer, echoed back
+} __attribute__((packed)) vnd_ping_t;
+
+typedef struct {
+  uint16_t seq;
+  uint8_t node_id;
+  uint32_t t0_us;
+  uint32_t rx_us; // Responder's esp_timer at receive / send
+  uint32_t tx_us;
+} __attribute__((packed)) vnd_pong_t;
+
+// Create the notify burst task. Call once after gatt_register_services().
+esp_err_t bench_init(void);
+
+// Queue a ping to a unicast node; len is the total payload (clamped to
+// sizeof(vnd_ping_t)..BENCH_PING_MAX_LEN).
+esp_err_t bench_ping(uint16_t dst, uint16_t len);
+
+// Start a notify burst; ESP_ERR_INVALID_STATE while one is running
+esp_err_t bench_notify_start(uint32_t count, uint16_t len);
+
+// Vendor model hooks (custom_model_cb)
+void bench_on_ping(esp_ble_mesh_msg_ctx_t *ctx, const uint8_t *msg,
+                   uint16_t len);
+void bench_on_pong(esp_ble_mesh_msg_ctx_t *ctx, const uint8_t *msg,
+                   uint16_t len);
+
+#endif /* BENCH_H */
@@ -0,0 +1,223 @@
+#include "cmd_worker.h"
+#include "command.h"
+#include "command_parser.h"
+#include "gatt_service.h"
+#include "mesh_node.h"
+#include "mesh_tx.h"
+#include "node_tracker.h"
+
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "freertos/timers.h"
+#include <stdio.h>
+#include <string.h>
+
+#define TAG "CMD_WORKER"
+
+#define CMD_BUSY_REPLY "ERR:BUSY"
+
+typedef enum {
+  CMD_SRC_MESH,
+  CMD_SRC_GATT,
+  CMD_SRC_LOCAL,  // Run locally, notify the Pi
+  CMD_SRC_REPORT, // Reading after a fade/profile step
+  CMD_SRC_REPLY,  // Deferred group reply whose slot came up
+} cmd_src_t;
+
+#define CMD_RESPONSE_LEN 128
+
+typedef struct {
+  cmd_src_t src;
+  uint8_t tid;     // Mesh only
+  uint16_t len;    // GATT: cmd length (cmd is NUL-terminated either way),
+                   // REPLY: deferred[] index
+  TickType_t rx_tick;         // Mesh only: when the request arrived
+  esp_ble_mesh_msg_ctx_t ctx; // Mesh only: where to send the STATUS
+  char cmd[COMMAND_MAX_LEN + 1];
+} cmd_job_t;
+
+// A group reply waiting for its slot
+typedef struct {
+  TimerHandle_t timer;
+  bool used;
+  uint8_t tid;
+  int len;
+  esp_ble_mesh_msg_ctx_t ctx;
+  char response[CMD_RESPONSE_LEN];
+} deferred_reply_t;
+
+static QueueHandle_t cmd_queue = NULL;
+
+// Claimed and released by the worker; the timer only hands it back
+static portMUX_TYPE deferred_lock = portMUX_INITIALIZER_UNLOCKED;
+static deferred_reply_t deferred[GROUP_REPLY_MAX_PENDING];
+
+uint32_t group_reply_delay_ms(void) {
+  int id = node_id_of(node_state.addr);
+  return id > 0 ? (uint32_t)id * GROUP_REPLY_SLOT_MS : 0;
+}
+
+// Timer daemon: only queue the send, the worker does it
+static void deferred_reply_cb(TimerHandle_t timer) {
+  deferred_reply_t *d = pvTimerGetTimerID(timer);
+  cmd_job_t job = {.src = CMD_SRC_REPLY, .len = (uint16_t)(d - deferred)};
+  if (xQueueSend(cmd_queue, &job, 0) != pdTRUE)
+    xTimerChangePeriod(timer, 1, 0); // Worker backed up: next tick
+}
+
+static void send_deferred(uint16_t idx) {
+  deferred_reply_t *d = &deferred[idx];
+  vendor_server_reply(&d->ctx, d->tid, d->response, d->len,
+                      sizeof(d->response));
+  taskENTER_CRITICAL(&deferred_lock);
+  d->used = false;
+  taskEXIT_CRITICAL(&deferred_lock);
+}
+
+// Hold a group reply until our slot. Returns false (caller replies at once)
+// when the slot has already passed or every entry is in use.
+static bool defer_reply(const cmd_job_t *job, const char *response, int len) {
+  TickType_t due = job->rx_tick + pdMS_TO_TICKS(group_reply_delay_ms());
+  TickType_t wait = due - xTaskGetTickCount();
+  if ((int32_t)wait <= 0)
+    return false;
+
+  deferred_reply_t *d = NULL;
+  taskENTER_CRITICAL(&deferred_lock);
+  for (int i = 0; i < GROUP_REPLY_MAX_PENDING && !d; i++) {
+    if (!deferred[i].used && deferred[i].timer) {
+      d = &deferred[i];
+      d->used = true;
+    }
+  }
+  taskEXIT_CRITICAL(&deferred_lock);
+  if (!d) {
+    ESP_LOGW(TAG, "No free reply slot, replying now");
+    return false;
+  }
+
+  d->ctx = job->ctx;
+  d->tid = job->tid;
+  d->len = len;
+  memcpy(d->response, response, len);
+  if (xTimerChangePeriod(d->timer, wait, 0) != pdPASS) {
+    d->used = false;
+    return false;
+  }
+  return true;
+}
+
+static void run_mesh_job(cmd_job_t *job) {
+  char response[CMD_RESPONSE_LEN];
+  int resp_len = process_command(job->cmd, response, sizeof(response));
+  // Group-addressed: every member got it at once, spread the replies
+  if (ESP_BLE_MESH_ADDR_IS_GROUP(job->ctx.recv_dst) &&
+      defer_reply(job, response, resp_len))
+    return;
+  vendor_server_reply(&job->ctx, job->tid, response, resp_len,
+                      sizeof(response));
+}
+
+static void cmd_worker_task(void *pvParameters) {
+  cmd_job_t job;
+  for (;;) {
+    if (xQueueReceive(cmd_queue, &job, portMAX_DELAY) != pdTRUE)
+      continue;
+    if (job.src == CMD_SRC_MESH) {
+      run_mesh_job(&job);
+    } else if (job.src == CMD_SRC_LOCAL) {
+      process_local_and_notify(job.cmd);
+    } else if (job.src == CMD_SRC_REPORT) {
+      report_reading(job.cmd);
+    } else if (job.src == CMD_SRC_REPLY) {
+      send_deferred(job.len);
+    } else {
+      process_gatt_command(job.cmd, job.len);
+    }
+  }
+}
+
+esp_err_t cmd_worker_init(void) {
+  cmd_queue = xQueueCreate(CMD_WORKER_QUEUE_LEN, sizeof(cmd_job_t));
+  if (cmd_queue == NULL) {
+    ESP_LOGE(TAG, "Queue create failed");
+    return ESP_ERR_NO_MEM;
+  }
+  for (int i = 0; i < GROUP_REPLY_MAX_PENDING; i++) {
+    // Missing timers only cost collisions - those replies go out at once
+    deferred[i].timer = xTimerCreate("grp_reply", 1, pdFALSE, &deferred[i],
+                                     deferred_reply_cb);
+  }
+  if (xTaskCreate(cmd_worker_task, "cmd_worker", CMD_WORKER_STACK_SIZE, NULL,
+                  CMD_WORKER_PRIORITY, NULL) != pdPASS) {
+    ESP_LOGE(TAG, "Task create failed");
+    return ESP_ERR_NO_MEM;
+  }
+  return ESP_OK;
+}
+
+esp_err_t cmd_worker_submit_mesh(const esp_ble_mesh_msg_ctx_t *ctx,
+                                 const char *cmd, uint8_t tid) {
+  if (cmd_queue == NULL)
+    return ESP_ERR_INVALID_STATE;
+  cmd_job_t job = {.src = CMD_SRC_MESH,
+                   .tid = tid,
+                   .rx_tick = xTaskGetTickCount(),
+                   .ctx = *ctx};
+  snprintf(job.cmd, sizeof(job.cmd), "%s", cmd);
+
+  if (xQueueSend(cmd_queue, &job, 0) != pdTRUE) {
+    // Refuse now so the sender's lane frees instead of timing out
+    ESP_LOGW(TAG, "Queue full, refusing '%s' from 0x%04x", cmd, ctx->addr);
+    char busy[sizeof(CMD_BUSY_REPLY) + MESH_TX_TID_SUFFIX_LEN] = CMD_BUSY_REPLY;
+    vendor_server_reply(ctx, tid, busy, strlen(CMD_BUSY_REPLY), sizeof(busy));
+    return ESP_ERR_NO_MEM;
+  }
+  return ESP_OK;
+}
+
+esp_err_t cmd_worker_submit_gatt(const char *cmd, uint16_t len) {
+  if (cmd_queue == NULL)
+    return ESP_ERR_INVALID_STATE;
+  cmd_job_t job = {.src = CMD_SRC_GATT};
+  if (len > COMMAND_MAX_LEN)
+    len = COMMAND_MAX_LEN;
+  memcpy(job.cmd, cmd, len);
+  job.cmd[len] = '\0';
+  job.len = len;
+
+  if (xQueueSend(cmd_queue, &job, 0) != pdTRUE) {
+    ESP_LOGW(TAG, "Queue full, refusing GATT command");
+    gatt_notify_sensor_data("ERROR:BUSY", 10);
+    return ESP_ERR_NO_MEM;
+  }
+  return ESP_OK;
+}
+
+esp_err_t cmd_worker_submit_local(const char *cmd) {
+  if (cmd_queue == NULL)
+    return ESP_ERR_INVALID_STATE;
+  cmd_job_t job = {.src = CMD_SRC_LOCAL};
+  snprintf(job.cmd, sizeof(job.cmd), "%s", cmd);
+
+  if (xQueueSend(cmd_queue, &job, 0) != pdTRUE) {
+    ESP_LOGW(TAG, "Queue full, skipping local '%s'", cmd);
+    return ESP_ERR_NO_MEM;
+  }
+  return ESP_OK;
+}
+
+esp_err_t cmd_worker_submit_report(const char *label) {
+  if (cmd_queue == NULL)
+    return ESP_ERR_INVALID_STATE;
+  cmd_job_t job = {.src = CMD_SRC_REPORT};
+  snprintf(job.cmd, sizeof(job.cmd), "%s", label);
+
+  if (xQueueSend(cmd_queue, &job, 0) != pdTRUE) {
+    ESP_LOGW(TAG, "Queue full, dropping step report");
+    return ESP_ERR_NO_MEM;
+  }
+  return ESP_OK;
+}
@@ -0,0 +1,53 @@
+#ifndef CMD_WORKER_H
+#define CMD_WORKER_H
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_ble_mesh_defs.h"
+#include "sdkconfig.h"
+
+// ============== Command Worker ==============
+// Commands from the mesh (vendor SEND to our server) and from the Pi (GATT
+// write) run on one worker task instead of inside the BLE mesh / NimBLE host
+// callbacks. Callbacks only copy the command and its reply context into a
+// bounded queue, so a slow command (I2C timeout, fallback OnOff loop, ...)
+// never holds up radio processing or relaying. When the queue is full the
+// command is refused with a busy reply rather than blocking.
+// Grows with the site: the Pi addresses nodes one write each (per-node
+// targets, reads), so a burst scales with the node count
+#define CMD_WORKER_QUEUE_LEN (8 + CONFIG_MESH_MAX_NODES / 8)
+#define CMD_WORKER_STACK_SIZE 4096
+#define CMD_WORKER_PRIORITY 4 // Below mesh TX / BT host tasks
+
+// Replies to group-addressed commands are held until this node's slot
+// (node id x GROUP_REPLY_SLOT_MS after reception); a timer marks the slot
+// and the worker sends the reply.
+// Ids are dense, so every node of a group gets its own slot.
+#define GROUP_REPLY_SLOT_MS CONFIG_MESH_GROUP_REPLY_SLOT_MS
+#define GROUP_REPLY_MAX_PENDING CMD_WORKER_QUEUE_LEN
+
+// Delay of our reply slot after a group command is received
+uint32_t group_reply_delay_ms(void);
+
+// Create the queue and worker task. Call once before ble_mesh_init().
+esp_err_t cmd_worker_init(void);
+
+// Vendor SEND received by our server: run cmd, reply VND_OP_STATUS to ctx
+// echoing tid. Returns ESP_ERR_NO_MEM (after replying busy) if full.
+esp_err_t cmd_worker_submit_mesh(const esp_ble_mesh_msg_ctx_t *ctx,
+                                 const char *cmd, uint8_t tid);
+
+// GATT write from the Pi: run process_gatt_command() on the worker
+esp_err_t cmd_worker_submit_gatt(const char *cmd, uint16_t len);
+
+// Our own reading for the Pi (monitor timer): process_local_and_notify(cmd)
+// on the worker. Returns ESP_ERR_NO_MEM if full - the caller tries again
+// next round.
+esp_err_t cmd_worker_submit_local(const char *cmd);
+
+// Fade or profile step finished (timer task): report_reading(label) on
+// the worker, queued behind the reply of the command that started it.
+// Dropped with a warning if full.
+esp_err_t cmd_worker_submit_report(const char *label);
+
+#endif /* CMD_WORKER_H */
@@ -1,6 +1,14 @@
 #include "command.h"
+#include "cmd_worker.h"
 #include "sensor.h"
 #include "load_control.h"
+#include "mesh_node.h"
+#include "node_tracker.h"
+#include "telemetry_pub.h"
+#include "history.h"
+#include "sensor_stats.h"
+#include "perf.h"
+#include "esp_timer.h"
 #include "esp_log.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
@@ -20,28 +28,99 @@ int format_sensor_response(char *buf, size_t buf_size) {
                   get_current_duty(), voltage, current, power);
 }
 
+int format_sensor_frame(uint8_t *buf, size_t buf_size) {
+  static uint8_t frame_seq = 0;
+  telemetry_frame_t frame = {
+      .version = TELEMETRY_FRAME_V1,
+      .node_id = (node_state.addr >= NODE_BASE_ADDR)
+                     ? (node_state.addr - NODE_BASE_ADDR)
+                     : 0,
+      .seq = frame_seq++,
+      .duty = (uint8_t)get_current_duty(),
+  };
+
+  if (buf_size < sizeof(frame))
+    return 0;
+
+  uint16_t vbus_raw;
+  int16_t current_raw;
+  ina260_read_raw(&vbus_raw, &current_raw);
+  frame.vbus_raw = vbus_raw;
+  frame.current_raw = current_raw;
+  memcpy(buf, &frame, sizeof(frame));
+  return sizeof(frame);
+}
+
+bool is_telemetry_frame(const uint8_t *data, uint16_t len) {
+  return len == TELEMETRY_FRAME_LEN && data[0] == TELEMETRY_FRAME_V1;
+}
+
+bool is_binary_frame(const uint8_t *data, uint16_t len) {
+  return is_telemetry_frame(data, len) || is_history_frame(data, len) ||
+         is_stats_frame(data, len);
+}
+
+void report_reading(const char *label) {
+  char buf[64];
+  int len = format_sensor_response(buf, sizeof(buf));
+  if (label[0] != '\0')
+    ESP_LOGI(TAG, "  %s: %s", label, buf);
+  else if (vendor_server_report(buf, len) != ESP_OK)
+    ESP_LOGI(TAG, "%s", buf); // Not provisioned: console only
+}
+
+// Fade/profile callbacks run on the timer task: the reading itself is
+// taken and sent by the command worker, after the command's own reply
+static void profile_step_done(int step, int duty, bool last) {
+  char label[24] = "";
+  if (!last)
+    snprintf(label, sizeof(label), "Step %d (%d%%)", step, duty);
+  else
+    ESP_LOGI(TAG, "Profile complete");
+  cmd_worker_submit_report(label);
+}
+
+static void fade_done_report(void *arg) { cmd_worker_submit_report(""); }
+
 // Returns response length, writes response to buf
-int process_command(const char *cmd, char *response, size_t resp_size) {
+static int run_command(const char *cmd, char *response, size_t resp_size) {
   int len;
 
   if (strcmp(cmd, "s") == 0 || strcmp(cmd, "stop") == 0) {
     set_duty(0);
     len = format_sensor_response(response, resp_size);
 
-  } else if (strcmp(cmd, "r") == 0 || strcmp(cmd, "ramp") == 0) {
-    // Ramp: step through duty levels, return final reading
-    ESP_LOGI(TAG, "Ramp test starting...");
-    char step_buf[128];
-    for (int d = 0; d <= 100; d += 25) {
-      set_duty(d);
-      vTaskDelay(pdMS_TO_TICKS(500));
-      format_sensor_response(step_buf, sizeof(step_buf));
-      ESP_LOGI(TAG, "  Ramp %d%%: %s", d, step_buf);
+  } else if (strcmp(cmd, "r") == 0 || strcmp(cmd, "ramp") == 0 ||
+             strncmp(cmd, "prof:", 5) == 0) {
+    // Ramp / named profile: runs on the fade engine, the final reading is
+    // reported when it completes (see profile_step_done)
+    const char *name = (cmd[0] == 'p') ? cmd + 5 : "ramp";
+    if (load_profile_start(name, profile_step_done) == ESP_OK)
+      len = snprintf(response, resp_size, "PROF:%s:STARTED", name);
+    else
+      len = snprintf(response, resp_size, "ERR:PROF:%s", name);
+
+  } else if (strncmp(cmd, "fade:", 5) == 0) {
+    // "fade:<duty>[:<ms>]" - hardware-faded transition, reading on
+    // completion. One that completes at once replies with the reading.
+    char *endptr, *ms_end;
+    long duty_val = strtol(cmd + 5, &endptr, 10);
+    long fade_ms = 0;
+    bool ok = (endptr != cmd + 5 && duty_val >= 0 && duty_val <= 100);
+    if (ok && *endptr == ':') {
+      fade_ms = strtol(endptr + 1, &ms_end, 10);
+      ok = (ms_end != endptr + 1 && *ms_end == '\0' && fade_ms >= 0 &&
+            fade_ms <= UINT16_MAX);
+    } else if (*endptr != '\0') {
+      ok = false;
     }
-    set_duty(0);
-    vTaskDelay(pdMS_TO_TICKS(200));
-    len = format_sensor_response(response, resp_size);
-    ESP_LOGI(TAG, "Ramp complete");
+    if (!ok)
+      len = snprintf(response, resp_size, "ERR:FADE:%s", cmd + 5);
+    else if (set_duty_fade((int)duty_val, (uint32_t)fade_ms, fade_done_report,
+                           NULL))
+      len = snprintf(response, resp_size, "FADE:%ld:%ld", duty_val, fade_ms);
+    else
+      len = format_sensor_response(response, resp_size);
 
   } else if (strncmp(cmd, "duty:", 5) == 0) {
     int duty_val = atoi(cmd + 5);
@@ -51,6 +130,41 @@ int process_command(const char *cmd, char *response, size_t resp_size) {
   } else if (strcmp(cmd, "read") == 0 || strcmp(cmd, "status") == 0) {
     len = format_sensor_response(response, resp_size);
 
+  } else if (strcmp(cmd, "rb") == 0) {
+    // Binary read: response is a telemetry_frame_t, not a C string
+    len = format_sensor_frame((uint8_t *)response, resp_size);
+
+  } else if (strcmp(cmd, "hist") == 0 || strncmp(cmd, "hist:", 5) == 0) {
+    // Binary too: one history frame (see history.h)
+    len = history_command(cmd[4] == ':' ? cmd + 5 : "", (uint8_t *)response,
+                          resp_size);
+
+  } else if (strcmp(cmd, "stats") == 0 || strncmp(cmd, "stats:", 6) == 0) {
+    // Binary: rolling window summary (see sensor_stats.h)
+    len = sensor_stats_command(cmd[5] == ':' ? cmd + 6 : "",
+                               (uint8_t *)response, resp_size);
+    if (len == 0)
+      len = snprintf(response, resp_size, "ERR:STATS:%s", cmd + 5);
+
+  } else if (strcmp(cmd, "perf") == 0 || strncmp(cmd, "perf:", 5) == 0) {
+    len = perf_command(cmd[4] == ':' ? cmd + 5 : "", response, resp_size);
+
+  } else if (strcmp(cmd, "zones") == 0) {
+    // Zone groups the provisioner subscribed us to (gateway bookkeeping)
+    len = snprintf(response, resp_size, "ZONES:0x%02x", mesh_node_zones());
+
+  } else if (strcmp(cmd, "sp") == 0 || strncmp(cmd, "sp:", 3) == 0) {
+    len = sensor_profile_command(cmd[2] == ':' ? cmd + 3 : "", response,
+                                 resp_size);
+
+  } else if (strcmp(cmd, "lim") == 0 || strncmp(cmd, "lim:", 4) == 0) {
+    len = load_limit_command(cmd[3] == ':' ? cmd + 4 : "", response,
+                             resp_size);
+
+  } else if (strcmp(cmd, "pub") == 0 || strncmp(cmd, "pub:", 4) == 0) {
+    len = telemetry_pub_command(cmd[3] == ':' ? cmd + 4 : "", response,
+                                resp_size);
+
   } else {
     // Try parsing as a bare number (e.g., "50" = duty:50)
     char *endptr;
@@ -66,6 +180,13 @@ int process_command(const char *cmd, char *response, size_t resp_size) {
   return len;
 }
 
+int process_command(const char *cmd, char *response, size_t resp_size) {
+  int64_t start = esp_timer_get_time();
+  int len = run_command(cmd, response, resp_size);
+  perf_record_cmd((uint32_t)(esp_timer_get_time() - start));
+  return len;
+}
+
 // Type commands into idf.py monitor for local testing without mesh
 void console_task(void *pvParameters) {
   char line[64];
@@ -74,10 +195,17 @@ void console_task(void *pvParameters) {
   ESP_LOGI(TAG, "");
   ESP_LOGI(TAG, "Console ready. Commands:");
   ESP_LOGI(TAG, "  read     - read INA260 voltage/current");
+  ESP_LOGI(TAG, "  rb       - same, as binary telemetry frame");
   ESP_LOGI(TAG, "  duty:50  - set PWM to 50%%");
   ESP_LOGI(TAG, "  50       - same as duty:50");
   ESP_LOGI(TAG, "  r        - ramp test (0->25->50->75->100%%)");
+  ESP_LOGI(TAG, "  fade:80:1000 - fade to 80%% over 1000 ms");
+  ESP_LOGI(TAG, "  prof:sweep - run a profile (ramp, sweep)");
   ESP_LOGI(TAG, "  s        - stop (duty 0)");
+  ESP_LOGI(TAG, "  pub:50:5 - publish on 50mW change, heartbeat 5 periods");
+  ESP_LOGI(TAG, "  sp:fast  - sensor profile (fast/balanced/accurate)");
+  ESP_LOGI(TAG, "  lim:2000 - local power limit in mW (lim:0 = off)");
+  ESP_LOGI(TAG, "  zones    - zone groups this node is subscribed to");
   ESP_LOGI(TAG, "  scan     - I2C bus scan");
   ESP_LOGI(TAG, "");
 
@@ -96,8 +224,12 @@ void console_task(void *pvParameters) {
           i2c_scan();
         } else {
           char response[128];
-          process_command(line, response, sizeof(response));
-          ESP_LOGI(TAG, ">> %s", response);
+          int resp_len = process_command(line, response, sizeof(response));
+          if (is_binary_frame((uint8_t *)response, resp_len)) {
+            ESP_LOG_BUFFER_HEX(TAG, response, resp_len);
+          } else {
+            ESP_LOGI(TAG, ">> %s", response);
+          }
         }
         pos = 0;
       }
@@ -1,11 +1,54 @@
 #ifndef COMMAND_H
 #define COMMAND_H
 
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+
+// ============== Binary Telemetry Frame ==============
+// Compact alternative to the text reading, requested with "rb". 8 bytes so it
+// fits one unsegmented vendor message (3-byte opcode + 8) and one 20-byte
+// GATT notify. Multi-byte fields are little-endian (native on ESP32-C6).
+#define TELEMETRY_FRAME_V1 0xA1
+#define TELEMETRY_FRAME_LEN 8
+// Same frame, forwarded to the Pi after it was published on
+// MESH_TELEMETRY_ADDR (not a reply): the gateway rewrites the version byte
+// so the Pi can tell the node reports on its own
+#define TELEMETRY_FRAME_PUB 0xA6
+
+typedef struct {
+  uint8_t version;     // TELEMETRY_FRAME_V1
+  uint8_t node_id;     // unicast - NODE_BASE_ADDR
+  uint8_t seq;         // frame counter, or the request TID when solicited
+                       // with one (see mesh_tx.h)
+  uint8_t duty;        // current PWM duty, 0-100
+  uint16_t vbus_raw;   // INA260 bus voltage register (1.25 mV/LSB)
+  int16_t current_raw; // INA260 current register (1.25 mA/LSB, signed)
+} __attribute__((packed)) telemetry_frame_t;
+
+_Static_assert(sizeof(telemetry_frame_t) == TELEMETRY_FRAME_LEN,
+               "telemetry frame must stay 8 bytes");
 
 // Format sensor data as "D:50%,V:12.003V,I:250.00mA,P:3000.8mW"
 int format_sensor_response(char *buf, size_t buf_size);
 
+// Fill buf with a telemetry_frame_t. Returns TELEMETRY_FRAME_LEN, or 0 if
+// buf is too small.
+int format_sensor_frame(uint8_t *buf, size_t buf_size);
+
+// True if data looks like a binary telemetry frame (version + length match)
+bool is_telemetry_frame(const uint8_t *data, uint16_t len);
+
+// Binary replies (telemetry, history, stats frames) all start with
+// [version][node_id][tid]; text replies carry the TID in a suffix instead
+#define BINARY_FRAME_TID_OFFSET 2
+bool is_binary_frame(const uint8_t *data, uint16_t len);
+
+// Take a reading after a fade/profile step (command worker, see
+// cmd_worker_submit_report): label "" reports it to the gateway, anything
+// else only logs it under that label
+void report_reading(const char *label);
+
 // Process a text command (read, duty:50, r, s, etc.)
 // Writes response to buf, returns response length.
 int process_command(const char *cmd, char *response, size_t resp_size);
@@ -8,6 +8,11 @@
 #include "node_tracker.h"
 #include "monitor.h"
 #include "command.h"
+#include "poll_aggregator.h"
+#include "power_ctrl.h"
+#include "bench.h"
+#include "gw_sync.h"
+#include "node_list.h"
 
 #include "esp_log.h"
 #include "freertos/FreeRTOS.h"
@@ -16,10 +21,22 @@
 #define TAG "CMD_PARSE"
 
 // Helper: process command locally and notify Pi 5 via GATT
-static void process_local_and_notify(const char *pico_cmd) {
+void process_local_and_notify(const char *pico_cmd) {
   char response[128];
   int resp_len = process_command(pico_cmd, response, sizeof(response));
 
+  // Binary frames carry their own node id - forward as-is (or hand to the
+  // group-READ batch when one is open)
+  if (is_telemetry_frame((uint8_t *)response, resp_len)) {
+    if (!poll_agg_offer(node_state.addr, (uint8_t *)response, resp_len))
+      gatt_notify_sensor_data(response, resp_len);
+    return;
+  }
+  if (is_binary_frame((uint8_t *)response, resp_len)) {
+    gatt_notify_sensor_data(response, resp_len);
+    return;
+  }
+
   char buf[SENSOR_DATA_MAX_LEN];
   int node_num = (node_state.addr >= NODE_BASE_ADDR)
                      ? (node_state.addr - NODE_BASE_ADDR)
@@ -32,18 +49,190 @@ static void process_local_and_notify(const char *pico_cmd) {
   }
 }
 
+// The controller treats a user duty as the ceiling of every node it reaches
+static void note_user_duty(uint16_t dst, int duty) {
+  node_mask_t ids;
+  if (!power_ctrl_active())
+    return;
+  node_members(dst, &ids);
+  for (int id = 0; id < MAX_NODES; id++) {
+    if (node_mask_test(&ids, id))
+      power_ctrl_set_target(id, duty);
+  }
+}
+
+// Bit of a zone group address in a zone bitmap
+static uint8_t zone_bit(uint16_t zone_addr) {
+  return 1 << (zone_addr - MESH_ZONE_BASE_ADDR);
+}
+
+// First node id covered by an entry's target bitmap
+static int bcmd_first_id(const gatt_bcmd_entry_t *e) {
+  return (e->opcode >> GATT_BCMD_WINDOW_SHIFT) * GATT_BCMD_WINDOW_NODES;
+}
+
+// ============== Binary Command Batch ==============
+// Vendor command for one batch entry. Returns false for an unknown opcode.
+static bool bcmd_to_pico(const gatt_bcmd_entry_t *e, uint16_t read_addr,
+                         char *pico_cmd, size_t size) {
+  switch (e->opcode & GATT_BCMD_OP_MASK) {
+  case GATT_BCMD_OP_DUTY:
+    snprintf(pico_cmd, size, "duty:%d", e->value > 100 ? 100 : e->value);
+    return true;
+  case GATT_BCMD_OP_STOP:
+    snprintf(pico_cmd, size, "s");
+    return true;
+  case GATT_BCMD_OP_RAMP:
+    snprintf(pico_cmd, size, "r");
+    return true;
+  case GATT_BCMD_OP_READ:
+    snprintf(pico_cmd, size, "%s", node_read_cmd(read_addr));
+    return true;
+  case GATT_BCMD_OP_LIMIT:
+    snprintf(pico_cmd, size, "lim:%u", e->value);
+    return true;
+  default:
+    return false;
+  }
+}
+
+// Fan one entry out through the vendor model. Returns messages sent.
+static int run_bcmd_entry(const gatt_bcmd_entry_t *e) {
+  char pico_cmd[COMMAND_MAX_LEN];
+  uint8_t op = e->opcode & GATT_BCMD_OP_MASK; // High bits pick the window
+  int sent = 0;
+
+  if (e->target == GATT_BCMD_TARGET_ALL && bcmd_first_id(e) == 0) {
+    if (!bcmd_to_pico(e, MESH_GROUP_ADDR, pico_cmd, sizeof(pico_cmd)))
+      return -1;
+    if (op == GATT_BCMD_OP_DUTY)
+      note_user_duty(MESH_GROUP_ADDR, e->value);
+    if (op == GATT_BCMD_OP_READ && strcmp(pico_cmd, "rb") == 0)
+      poll_agg_begin(MESH_GROUP_ADDR, -1);
+    process_local_and_notify(pico_cmd);
+    send_vendor_command(MESH_GROUP_ADDR, pico_cmd, strlen(pico_cmd));
+    return 1;
+  }
+
+  int base = bcmd_first_id(e);
+  for (int bit = 0; bit < GATT_BCMD_WINDOW_NODES; bit++) {
+    int i = base + bit;
+    if (!(e->target & (1u << bit)) || i >= MAX_NODES)
+      continue;
+    uint16_t addr = NODE_BASE_ADDR + i;
+    if (!bcmd_to_pico(e, addr, pico_cmd, sizeof(pico_cmd)))
+      return -1;
+    if (op == GATT_BCMD_OP_DUTY)
+      note_user_duty(addr, e->value);
+    if (addr == node_state.addr)
+      process_local_and_notify(pico_cmd);
+    else
+      send_vendor_command(addr, pico_cmd, strlen(pico_cmd));
+    sent++;
+  }
+  return sent;
+}
+
+// Add a DUTY entry's remote nodes to vec (a later entry for the same node
+// wins); our own duty is applied here. Returns the new vec length.
+static int add_duty_entries(const gatt_bcmd_entry_t *e, vnd_duty_entry_t *vec,
+                            int n_vec) {
+  uint8_t duty = e->value > 100 ? 100 : e->value;
+  int base = bcmd_first_id(e);
+  for (int bit = 0; bit < GATT_BCMD_WINDOW_NODES; bit++) {
+    int i = base + bit;
+    if (!(e->target & (1u << bit)) || i >= MAX_NODES)
+      continue;
+    note_user_duty(NODE_BASE_ADDR + i, duty);
+    if (NODE_BASE_ADDR + i == node_state.addr) {
+      char pico_cmd[16];
+      snprintf(pico_cmd, sizeof(pico_cmd), "duty:%d", duty);
+      process_local_and_notify(pico_cmd);
+      continue;
+    }
+    int j = 0;
+    while (j < n_vec && vec[j].node_id != i)
+      j++;
+    vec[j].node_id = i;
+    vec[j].duty = duty;
+    if (j == n_vec)
+      n_vec++;
+  }
+  return n_vec;
+}
+
+static void process_gatt_batch(const uint8_t *data, uint16_t len) {
+  int count = data[1];
+  if (len != GATT_BCMD_HDR_LEN + count * sizeof(gatt_bcmd_entry_t)) {
+    ESP_LOGW(TAG, "Bad batch: %d entries in %d bytes", count, len);
+    gatt_notify_sensor_data("ERROR:BAD_BATCH", 15);
+    return;
+  }
+  if (!vnd_bound) {
+    gatt_notify_sensor_data("ERROR:NOT_READY", 15);
+    return;
+  }
+  if (monitor_active())
+    monitor_stop();
+
+  // Per-node DUTY entries are merged into one group duty vector
+  vnd_duty_entry_t vec[MAX_NODES];
+  int n_vec = 0;
+  int sent = 0;
+  for (int i = 0; i < count; i++) {
+    gatt_bcmd_entry_t e;
+    memcpy(&e, data + GATT_BCMD_HDR_LEN + i * sizeof(e), sizeof(e));
+    if ((e.opcode & GATT_BCMD_OP_MASK) == GATT_BCMD_OP_DUTY &&
+        !(e.target == GATT_BCMD_TARGET_ALL && bcmd_first_id(&e) == 0)) {
+      n_vec = add_duty_entries(&e, vec, n_vec);
+      continue;
+    }
+    int n = run_bcmd_entry(&e);
+    if (n < 0) {
+      char resp[32];
+      snprintf(resp, sizeof(resp), "ERROR:BAD_OP:0x%02x", e.opcode);
+      gatt_notify_sensor_data(resp, strlen(resp));
+      continue;
+    }
+    sent += n;
+  }
+  if (n_vec > 1) {
+    send_duty_vector(vec, n_vec);
+    sent++;
+  } else if (n_vec == 1) {
+    char pico_cmd[16];
+    snprintf(pico_cmd, sizeof(pico_cmd), "duty:%d", vec[0].duty);
+    send_vendor_command(NODE_BASE_ADDR + vec[0].node_id, pico_cmd,
+                        strlen(pico_cmd));
+    sent++;
+  }
+  ESP_LOGI(TAG, "Pi5 batch: %d entries -> %d message(s)", count, sent);
+
+  char resp[32];
+  snprintf(resp, sizeof(resp), "SENT:BATCH:%d", sent);
+  gatt_notify_sensor_data(resp, strlen(resp));
+}
+
 // ============== Parse Pi 5 Command ==============
-// Format: "NODE_ID:COMMAND" or "NODE_ID:COMMAND:VALUE"
-// Examples: "1:RAMP", "2:STOP", "1:DUTY:50", "ALL:RAMP"
+// Format: "TARGET:COMMAND" or "TARGET:COMMAND:VALUE" (binary batches above)
+// TARGET is a node id, ALL (group 0xC000) or Z<n> (zone group, its members
+// only). Examples: "1:RAMP", "2:STOP", "1:DUTY:50", "ALL:RAMP", "Z2:READ"
+// PING / BENCH are benchmark-mode measurements (bench.h)
 void process_gatt_command(const char *cmd, uint16_t len) {
   char buf[COMMAND_MAX_LEN + 1];
   char *token;
   int node_id = -1;
   uint16_t target_addr = 0;
   bool is_all = false;
+  bool is_group = false; // ALL or a zone: target_addr is a group address
+  int read_gen = -1; // Group READ batch generation (-1 = local)
 
   if (len > COMMAND_MAX_LEN)
     len = COMMAND_MAX_LEN;
+  if (len >= GATT_BCMD_HDR_LEN && (uint8_t)cmd[0] == GATT_BCMD_V1) {
+    process_gatt_batch((const uint8_t *)cmd, len);
+    return;
+  }
   memcpy(buf, cmd, len);
   buf[len] = '\0';
 
@@ -57,7 +246,17 @@ void process_gatt_command(const char *cmd, uint16_t len) {
   }
 
   if (strcasecmp(token, "ALL") == 0) {
-    is_all = true;
+    is_all = is_group = true;
+    target_addr = MESH_GROUP_ADDR;
+  } else if (token[0] == 'Z' || token[0] == 'z') {
+    char *end;
+    long zone = strtol(token + 1, &end, 10);
+    if (end == token + 1 || *end || zone < 0 || zone >= MESH_MAX_ZONES) {
+      gatt_notify_sensor_data("ERROR:INVALID_ZONE", 18);
+      return;
+    }
+    is_group = true;
+    target_addr = MESH_ZONE_ADDR(zone);
   } else {
     node_id = atoi(token);
     if (node_id < 0 || node_id >= MAX_NODES) {
@@ -80,15 +279,9 @@ void process_gatt_command(const char *cmd, uint16_t len) {
 
   // Stop any active monitor when sending a new command (except MONITOR itself)
   bool is_monitor = (strcasecmp(token, "MONITOR") == 0);
-  if (!is_monitor && monitor_target_addr != 0) {
+  // (an in-flight monitor read just completes; the TX queue orders the rest)
+  if (!is_monitor && monitor_active()) {
     monitor_stop();
-    int wait_ms = 0;
-    while (vnd_send_busy && wait_ms < 3000) {
-      vTaskDelay(pdMS_TO_TICKS(100));
-      wait_ms += 100;
-    }
-    vnd_send_busy = false;
-    vnd_send_target_addr = 0x0000;
   }
 
   if (strcasecmp(token, "RAMP") == 0) {
@@ -100,16 +293,149 @@ void process_gatt_command(const char *cmd, uint16_t len) {
   } else if (strcasecmp(token, "DUTY") == 0) {
     int duty = value_token ? atoi(value_token) : 50;
     snprintf(pico_cmd, sizeof(pico_cmd), "duty:%d", duty);
+    note_user_duty(target_addr, duty);
+  } else if (strcasecmp(token, "FADE") == 0) {
+    // "N:FADE:<duty>:<ms>" hardware-faded duty change
+    char *ms_token = strtok(NULL, ":");
+    snprintf(pico_cmd, sizeof(pico_cmd), "fade:%d:%d",
+             value_token ? atoi(value_token) : 0,
+             ms_token ? atoi(ms_token) : 1000);
+  } else if (strcasecmp(token, "RUN") == 0) {
+    // "N:RUN:<profile>" - duty profile from load_control's table
+    snprintf(pico_cmd, sizeof(pico_cmd), "prof:%s",
+             value_token ? value_token : "ramp");
+  } else if (strcasecmp(token, "LIMIT") == 0) {
+    // "N:LIMIT[:<mW>]" local power limit on the node (0 = off)
+    if (value_token)
+      snprintf(pico_cmd, sizeof(pico_cmd), "lim:%s", value_token);
+    else
+      snprintf(pico_cmd, sizeof(pico_cmd), "lim");
+  } else if (strcasecmp(token, "PM") == 0) {
+    // On-node power controller (handled here, never forwarded):
+    //   "ALL:PM" status, "ALL:PM:<mW>" threshold (0/OFF = off),
+    //   "N:PM:PRIORITY" / "ALL:PM:PRIORITY" set / clear priority
+    char resp[48];
+    if (is_group && !is_all) {
+      gatt_notify_sensor_data("ERROR:PM_ZONE", 13); // Balances all nodes
+      return;
+    }
+    if (value_token && strcasecmp(value_token, "PRIORITY") == 0) {
+      power_ctrl_set_priority(is_all ? PCTRL_PRIORITY_NONE : node_id);
+    } else if (value_token) {
+      power_ctrl_set_threshold(strcasecmp(value_token, "OFF") == 0
+                                   ? 0
+                                   : strtoul(value_token, NULL, 10));
+    }
+    int resp_len = power_ctrl_status(resp, sizeof(resp));
+    gatt_notify_sensor_data(resp, resp_len);
+    return;
   } else if (strcasecmp(token, "STATUS") == 0 ||
              strcasecmp(token, "READ") == 0) {
-    snprintf(pico_cmd, sizeof(pico_cmd), "read");
+    // Binary frame unless the target has shown it only speaks text.
+    // "ALL:READ:<gen>" numbers the batch (poll_aggregator.h)
+    snprintf(pico_cmd, sizeof(pico_cmd), "%s", node_read_cmd(target_addr));
+    if (value_token)
+      read_gen = atoi(value_token) & 0xFF;
+  } else if (strcasecmp(token, "HISTORY") == 0) {
+    // "N:HISTORY[:<since|*>[:<max_age_s>]]" one frame of buffered samples
+    char *age_token = strtok(NULL, ":");
+    if (is_group) {
+      gatt_notify_sensor_data("ERROR:HISTORY_GROUP", 19); // One node per ask
+      return;
+    }
+    if (age_token)
+      snprintf(pico_cmd, sizeof(pico_cmd), "hist:%s:%s",
+               value_token ? value_token : "*", age_token);
+    else if (value_token)
+      snprintf(pico_cmd, sizeof(pico_cmd), "hist:%s", value_token);
+    else
+      snprintf(pico_cmd, sizeof(pico_cmd), "hist");
+  } else if (strcasecmp(token, "STATS") == 0) {
+    // "N:STATS[:<seconds>]" min/max/mean power, RMS current, energy
+    if (value_token)
+      snprintf(pico_cmd, sizeof(pico_cmd), "stats:%s", value_token);
+    else
+      snprintf(pico_cmd, sizeof(pico_cmd), "stats");
+  } else if (strcasecmp(token, "PERF") == 0) {
+    // "N:PERF[:rtt[:<from>]|h:<cmd|i2c|rtt<id>>|clr]" node health counters
+    char *arg_token = strtok(NULL, ":");
+    if (value_token && arg_token)
+      snprintf(pico_cmd, sizeof(pico_cmd), "perf:%s:%s", value_token,
+               arg_token);
+    else if (value_token)
+      snprintf(pico_cmd, sizeof(pico_cmd), "perf:%s", value_token);
+    else
+      snprintf(pico_cmd, sizeof(pico_cmd), "perf");
+  } else if (strcasecmp(token, "ZONES") == 0) {
+    // Re-learn zone membership (replies update node_tracker on the way)
+    snprintf(pico_cmd, sizeof(pico_cmd), "zones");
+  } else if (strcasecmp(token, "PROFILE") == 0) {
+    // "N:PROFILE[:fast|balanced|accurate|<avg>:<vbus_us>:<ish_us>[:t]]"
+    char *rest = strtok(NULL, "");
+    if (!value_token)
+      snprintf(pico_cmd, sizeof(pico_cmd), "sp");
+    else if (rest)
+      snprintf(pico_cmd, sizeof(pico_cmd), "sp:%s:%s", value_token, rest);
+    else
+      snprintf(pico_cmd, sizeof(pico_cmd), "sp:%s", value_token);
+  } else if (strcasecmp(token, "GW") == 0) {
+    // "ALL:GW[:ACTIVE|STANDBY|OFF]" this link's gateway role (gw_sync.h),
+    // handled here whatever the target
+    char resp[48];
+    int resp_len = gw_sync_command(value_token, resp, sizeof(resp));
+    gatt_notify_sensor_data(resp, resp_len);
+    return;
+  } else if (strcasecmp(token, "NODES") == 0) {
+    // "ALL:NODES" this gateway's node list and where it came from
+    // (node_list.h), handled here whatever the target
+    char resp[64];
+    int resp_len = node_list_command(resp, sizeof(resp));
+    gatt_notify_sensor_data(resp, resp_len);
+    return;
+  } else if (strcasecmp(token, "PING") == 0) {
+    // "N:PING[:<bytes>]" benchmark echo (bench.h); the PONG is the only reply
+    esp_err_t err = ESP_ERR_INVALID_ARG;
+    if (!is_group && target_addr != node_state.addr && vnd_bound)
+      err = bench_ping(target_addr, value_token ? atoi(value_token) : 0);
+    if (err == ESP_ERR_NOT_SUPPORTED)
+      gatt_notify_sensor_data("ERROR:NO_BENCH", 14);
+    else if (err == ESP_ERR_NO_MEM)
+      gatt_notify_sensor_data("ERROR:BUSY", 10);
+    else if (err != ESP_OK && !vnd_bound)
+      gatt_notify_sensor_data("ERROR:NOT_READY", 15);
+    else if (err != ESP_OK)
+      gatt_notify_sensor_data("ERROR:PING_TARGET", 17);
+    return;
+  } else if (strcasecmp(token, "BENCH") == 0) {
+    // "ALL:BENCH:<count>:<bytes>" GATT notify burst from this node
+    char *len_token = strtok(NULL, ":");
+    esp_err_t err = bench_notify_start(
+        value_token ? strtoul(value_token, NULL, 10) : 100,
+        len_token ? atoi(len_token) : GATT_MAX_PAYLOAD);
+    if (err == ESP_ERR_NOT_SUPPORTED)
+      gatt_notify_sensor_data("ERROR:NO_BENCH", 14);
+    else if (err == ESP_ERR_INVALID_STATE)
+      gatt_notify_sensor_data("ERROR:BUSY", 10);
+    else if (err != ESP_OK)
+      gatt_notify_sensor_data("ERROR:BENCH_ARGS", 16);
+    return;
   } else if (is_monitor) {
+    // "ALL:MONITOR[:interval_ms[:node_mask]]", "Z<n>:MONITOR[:interval_ms]"
+    // or "N:MONITOR[:interval_ms]"
     if (vnd_bound) {
+      uint32_t interval_ms = value_token ? strtoul(value_token, NULL, 10) : 0;
       if (is_all) {
-        uint16_t addr = known_node_count > 0 ? known_nodes[0] : NODE_BASE_ADDR + 1;
-        monitor_start(addr);
+        char *mask_token = strtok(NULL, ":");
+        node_mask_t mask;
+        if (mask_token && !node_mask_parse(mask_token, &mask)) {
+          gatt_notify_sensor_data("ERROR:BAD_MASK", 14);
+          return;
+        }
+        monitor_start_set(mask_token ? &mask : NULL, interval_ms);
       } else {
-        monitor_start(target_addr);
+        node_mask_t mask;
+        node_members(target_addr, &mask);
+        monitor_start_set(&mask, interval_ms);
       }
       gatt_notify_sensor_data("SENT:MONITOR", 12);
     } else {
@@ -124,18 +450,22 @@ void process_gatt_command(const char *cmd, uint16_t len) {
   }
 
   // ---- Self-addressing: if targeting this node, process locally ----
-  if (!is_all && target_addr == node_state.addr) {
+  if (!is_group && target_addr == node_state.addr) {
     process_local_and_notify(pico_cmd);
     return;
   }
 
   // Route through vendor model if bound, else fall back to OnOff
   if (vnd_bound) {
-    if (is_all) {
+    if (is_group) {
+      // Group READ: collect the replies into one batched notify stream
+      if (strcmp(pico_cmd, "rb") == 0)
+        poll_agg_begin(target_addr, read_gen);
       // Process locally first (group send doesn't reach local server)
-      process_local_and_notify(pico_cmd);
+      if (is_all || (mesh_node_zones() & zone_bit(target_addr)))
+        process_local_and_notify(pico_cmd);
       // Then send to mesh group for other nodes
-      send_vendor_command(MESH_GROUP_ADDR, pico_cmd, strlen(pico_cmd));
+      send_vendor_command(target_addr, pico_cmd, strlen(pico_cmd));
     } else {
       send_vendor_command(target_addr, pico_cmd, strlen(pico_cmd));
     }
@@ -148,7 +478,14 @@ void process_gatt_command(const char *cmd, uint16_t len) {
                      strcasecmp(token, "OFF") == 0)
                         ? 0
                         : 1;
-    if (is_all) {
+    if (is_group && !is_all) {
+      node_mask_t ids;
+      node_members(target_addr, &ids);
+      for (int id = 0; id < MAX_NODES; id++) {
+        if (node_mask_test(&ids, id) && NODE_BASE_ADDR + id != node_state.addr)
+          send_mesh_onoff(NODE_BASE_ADDR + id, onoff);
+      }
+    } else if (is_all) {
       if (known_node_count > 0) {
         for (int i = 0; i < known_node_count; i++) {
           send_mesh_onoff(known_nodes[i], onoff);
@@ -3,6 +3,38 @@
 
 #include <stdint.h>
 
+// ============== Binary Command Batch ==============
+// Compact alternative to the text commands on the COMMAND characteristic,
+// so one GATT write can carry a whole balance step. Little-endian:
+//   [GATT_BCMD_V1][n_entries] + n_entries * gatt_bcmd_entry_t
+// Each entry applies opcode/value to every node in target (bit i = node
+// 16 * window + i, window = opcode high nibble), or to the mesh group when
+// target is GATT_BCMD_TARGET_ALL (window 0). Per-node DUTY
+// entries go out together as one VND_OP_DUTY_VEC group message. The batch
+// is acknowledged with one "SENT:BATCH:<messages>" notify.
+#define GATT_BCMD_V1 0xB0
+#define GATT_BCMD_HDR_LEN 2
+#define GATT_BCMD_TARGET_ALL 0xFFFF
+#define GATT_BCMD_OP_MASK 0x0F
+#define GATT_BCMD_WINDOW_SHIFT 4 // Node ids 16 * window .. + 15
+#define GATT_BCMD_WINDOW_NODES 16
+
+#define GATT_BCMD_OP_DUTY 0x01  // value = duty %
+#define GATT_BCMD_OP_STOP 0x02
+#define GATT_BCMD_OP_RAMP 0x03
+#define GATT_BCMD_OP_READ 0x04
+#define GATT_BCMD_OP_LIMIT 0x05 // value = local power limit in mW (0 = off)
+
+typedef struct {
+  uint8_t opcode;
+  uint16_t target; // Node bitmap, or GATT_BCMD_TARGET_ALL
+  uint16_t value;
+} __attribute__((packed)) gatt_bcmd_entry_t;
+
+// Text commands ("1:DUTY:50") or a binary batch (first byte GATT_BCMD_V1)
 void process_gatt_command(const char *cmd, uint16_t len);
 
+// Run a node command on this node and notify the result to the Pi
+void process_local_and_notify(const char *pico_cmd);
+
 #endif /* COMMAND_PARSER_H */
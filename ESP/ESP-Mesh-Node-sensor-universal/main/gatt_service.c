@@ -2,8 +2,13 @@
 
 #include "gatt_service.h"
 #include "command_parser.h"
+#include "cmd_worker.h"
+#include "perf.h"
 
 #include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/ringbuf.h"
+#include "freertos/task.h"
 
 // NimBLE GATT includes
 #include "host/ble_hs.h"
@@ -17,79 +22,246 @@
 
 uint16_t gatt_conn_handle = BLE_HS_CONN_HANDLE_NONE;
 static uint16_t sensor_char_val_handle;
-static char sensor_data[SENSOR_DATA_MAX_LEN] = "NODE_READY";
-static uint16_t sensor_data_len = 10;
+// ATT MTU of gatt_conn_handle. Only connections that came through our own
+// GAP handler (direct to the Pi) use it; a handle captured from the mesh
+// proxy stays on the default 20-byte payload.
+static uint16_t gatt_att_mtu = BLE_ATT_MTU_DFLT;
+static bool gatt_conn_direct = false;
+
+#define GATT_READ_VALUE "NODE_READY"
 
 // ============== GATT Notify Function ==============
-// MTU through BLE Mesh GATT Proxy is hard-limited to 23 (20 bytes payload).
-// Messages > 20 bytes are split into chunks:
-//   - Continuation chunks: '+' prefix + 19 bytes data
-//   - Final (or only) chunk: no prefix, up to 20 bytes
-// Pi 5 reassembles by accumulating '+'-prefixed chunks.
+// MTU through BLE Mesh GATT Proxy is hard-limited to 23 (20 bytes payload);
+// direct connections negotiate up to 185 (see gatt_register_services).
+// A lone message that fits gatt_notify_payload_len() goes out as-is. Anything
+// else is sent as a stream of length-prefixed messages:
+//   [GATT_FRAME_MARK][len lo][len hi] + data, back to back
+// A message that doesn't fit the rest of a notification continues as raw
+// bytes at the start of the next one. Pi 5 reassembles by byte count.
+//
+// Callers only queue the message; gatt_tx_task is the one sender. It lets a
+// burst collect for GATT_TX_COALESCE_MS so several small messages share one
+// notification, and when the host runs out of mbufs it keeps the message
+// and retries (woken by BLE_GAP_EVENT_NOTIFY_TX) instead of giving up on the
+// connection.
+//
+// The queue is a no-split ring buffer: callers copy their segments straight
+// into a ring slot, and the task appends from the slot into the notification
+// mbuf - two copies in all. Queuing the caller's own mbuf chain would save
+// one more, but queued messages would then sit in the host's msys pool: a
+// backlog would take the very mbufs a notification needs, and the ENOMEM
+// retry could never make progress.
+// A fan-out brings one reply per node in quick succession
+#define GATT_TX_RING_SIZE ((CONFIG_MESH_MAX_NODES + 8) * 64)
+#define GATT_TX_BATCH_MAX 8
+#define GATT_TX_COALESCE_MS 10
+#define GATT_TX_RETRY_MS 20
+#define GATT_TX_STACK_SIZE 3072
+#define GATT_TX_PRIORITY 5
+
+// A message received from the ring, returned to it once sent
+typedef struct {
+  uint8_t *data;
+  size_t len;
+} gatt_msg_t;
+
+static RingbufHandle_t notify_ring = NULL;
+static TaskHandle_t notify_task = NULL;
+
+// Owned by gatt_tx_task: messages pulled off the ring, oldest first
+static gatt_msg_t tx_msgs[GATT_TX_BATCH_MAX];
+static int tx_count = 0;
+static uint16_t tx_head_off = 0; // Bytes of tx_msgs[0] already sent
+
+uint16_t gatt_notify_payload_len(void) {
+  if (!gatt_conn_direct || gatt_att_mtu <= BLE_ATT_MTU_DFLT)
+    return GATT_MAX_PAYLOAD;
+  uint16_t payload = gatt_att_mtu - 3; // ATT notify header
+  if (payload > GATT_FRAME_HDR_LEN + SENSOR_DATA_MAX_LEN)
+    payload = GATT_FRAME_HDR_LEN + SENSOR_DATA_MAX_LEN;
+  return payload;
+}
 
-void gatt_notify_sensor_data(const char *data, uint16_t len) {
-  if (gatt_conn_handle == BLE_HS_CONN_HANDLE_NONE) {
-    ESP_LOGW(TAG, "GATT notify skipped (no connection): %.*s", len, data);
-    return;
+// Build the next notification from tx_msgs without consuming anything, so
+// it can be rebuilt if the send fails. *done / *off receive the cursor to
+// commit once it has been sent.
+static struct os_mbuf *build_notify(uint16_t payload, int *done,
+                                    uint16_t *off) {
+  struct os_mbuf *om = ble_hs_mbuf_att_pkt();
+  if (!om)
+    return NULL;
+
+  // Lone message that fits: no framing, so old gateways still parse it
+  if (tx_count == 1 && tx_head_off == 0 && tx_msgs[0].len <= payload) {
+    if (os_mbuf_append(om, tx_msgs[0].data, tx_msgs[0].len) != 0)
+      goto fail;
+    *done = 1;
+    *off = 0;
+    return om;
   }
 
-  if (len >= SENSOR_DATA_MAX_LEN)
-    len = SENSOR_DATA_MAX_LEN - 1;
-  memcpy(sensor_data, data, len);
-  sensor_data[len] = '\0';
-  sensor_data_len = len;
-
-  if (len <= GATT_MAX_PAYLOAD) {
-    // Fits in a single notification
-    struct os_mbuf *om = ble_hs_mbuf_from_flat(sensor_data, len);
-    if (om) {
-      int rc = ble_gatts_notify_custom(gatt_conn_handle, sensor_char_val_handle, om);
-      if (rc == 0) {
-        ESP_LOGI(TAG, "GATT notify (%d bytes): %s", len, sensor_data);
-      } else {
-        ESP_LOGW(TAG, "GATT notify failed (rc=%d), clearing conn_handle", rc);
-        gatt_conn_handle = BLE_HS_CONN_HANDLE_NONE;
-      }
+  uint16_t room = payload;
+  int i = 0;
+  uint16_t o = tx_head_off;
+  while (i < tx_count) {
+    uint16_t mlen = tx_msgs[i].len;
+    if (o == 0) {
+      if (room <= GATT_FRAME_HDR_LEN)
+        break;
+      uint8_t hdr[GATT_FRAME_HDR_LEN] = {GATT_FRAME_MARK, mlen & 0xFF,
+                                         mlen >> 8};
+      if (os_mbuf_append(om, hdr, sizeof(hdr)) != 0)
+        goto fail;
+      room -= GATT_FRAME_HDR_LEN;
     }
-  } else {
-    // Split into chunked notifications
-    uint16_t offset = 0;
-    int chunk_num = 0;
-    while (offset < len) {
-      uint8_t chunk[GATT_MAX_PAYLOAD];
-      uint16_t chunk_len;
-      uint16_t remaining = len - offset;
-
-      if (remaining > GATT_MAX_PAYLOAD) {
-        // Continuation chunk: '+' prefix + 19 bytes of data
-        chunk[0] = '+';
-        uint16_t data_in_chunk = GATT_MAX_PAYLOAD - 1;
-        memcpy(chunk + 1, sensor_data + offset, data_in_chunk);
-        chunk_len = GATT_MAX_PAYLOAD;
-        offset += data_in_chunk;
-      } else {
-        // Final chunk: no prefix, just data
-        memcpy(chunk, sensor_data + offset, remaining);
-        chunk_len = remaining;
-        offset += remaining;
-      }
+    uint16_t n = mlen - o;
+    if (n > room)
+      n = room;
+    if (os_mbuf_append(om, tx_msgs[i].data + o, n) != 0)
+      goto fail;
+    room -= n;
+    o += n;
+    if (o < mlen)
+      break; // Continues in the next notification
+    i++;
+    o = 0;
+  }
+  *done = i;
+  *off = o;
+  return om;
+
+fail:
+  os_mbuf_free_chain(om);
+  return NULL;
+}
+
+// Pull one more message off the ring into tx_msgs
+static bool tx_take(TickType_t wait) {
+  size_t len;
+  uint8_t *data = xRingbufferReceive(notify_ring, &len, wait);
+  if (!data)
+    return false;
+  tx_msgs[tx_count].data = data;
+  tx_msgs[tx_count].len = len;
+  tx_count++;
+  return true;
+}
+
+static void tx_commit(int done, uint16_t off) {
+  for (int i = 0; i < done; i++)
+    vRingbufferReturnItem(notify_ring, tx_msgs[i].data);
+  memmove(tx_msgs, tx_msgs + done, (tx_count - done) * sizeof(tx_msgs[0]));
+  tx_count -= done;
+  tx_head_off = off;
+}
+
+static void tx_drop_all(const char *why) {
+  int dropped = tx_count;
+  tx_commit(tx_count, 0);
+  while (tx_take(0)) {
+    tx_commit(1, 0);
+    dropped++;
+  }
+  if (dropped)
+    ESP_LOGW(TAG, "Dropped %d queued notification(s): %s", dropped, why);
+}
 
-      struct os_mbuf *om = ble_hs_mbuf_from_flat(chunk, chunk_len);
-      if (om) {
-        int rc = ble_gatts_notify_custom(gatt_conn_handle, sensor_char_val_handle, om);
-        if (rc != 0) {
-          ESP_LOGW(TAG, "GATT chunk %d notify failed (rc=%d)", chunk_num, rc);
-          gatt_conn_handle = BLE_HS_CONN_HANDLE_NONE;
-          return;
-        }
+static void gatt_tx_task(void *pvParameters) {
+  int backoffs = 0;
+  for (;;) {
+    if (tx_count == 0) {
+      if (!tx_take(portMAX_DELAY))
+        continue;
+      // Let the rest of a burst (group-READ replies, SENT + DATA) land so
+      // it shares this notification
+      vTaskDelay(pdMS_TO_TICKS(GATT_TX_COALESCE_MS));
+    }
+    while (tx_count < GATT_TX_BATCH_MAX && tx_take(0))
+      ;
+
+    uint16_t conn = gatt_conn_handle;
+    if (conn == BLE_HS_CONN_HANDLE_NONE) {
+      tx_drop_all("no connection");
+      continue;
+    }
+
+    int done;
+    uint16_t off;
+    struct os_mbuf *om = build_notify(gatt_notify_payload_len(), &done, &off);
+    // Consumes om on success and failure
+    int rc = om ? ble_gatts_notify_custom(conn, sensor_char_val_handle, om)
+                : BLE_HS_ENOMEM;
+    if (rc == 0) {
+      perf_count(PERF_NTF_CHUNKS);
+      tx_commit(done, off);
+      if (backoffs) {
+        ESP_LOGI(TAG, "GATT notify resumed after %d backoff(s)", backoffs);
+        backoffs = 0;
       }
-      chunk_num++;
+    } else if (rc == BLE_HS_ENOMEM) {
+      // Host buffers exhausted - the link is fine, wait for one to free up
+      perf_count(PERF_NTF_BACKOFFS);
+      if (backoffs++ == 0)
+        ESP_LOGW(TAG, "GATT notify out of mbufs, backing off");
+      ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(GATT_TX_RETRY_MS));
+    } else {
+      perf_count(PERF_NTF_FAILS);
+      ESP_LOGW(TAG, "GATT notify failed (rc=%d), clearing conn_handle", rc);
+      gatt_conn_handle = BLE_HS_CONN_HANDLE_NONE;
+      backoffs = 0;
+      tx_drop_all("notify failed");
     }
-    ESP_LOGI(TAG, "GATT notify chunked (%d chunks, %d bytes): %s",
-             chunk_num, len, sensor_data);
   }
 }
 
+int gatt_notify_segs(const gatt_seg_t *segs, int nsegs) {
+  uint16_t len = 0;
+  for (int i = 0; i < nsegs; i++)
+    len += segs[i].len;
+
+  if (gatt_conn_handle == BLE_HS_CONN_HANDLE_NONE) {
+    perf_count(PERF_NTF_DROPS);
+    ESP_LOGW(TAG, "GATT notify skipped (no connection, %d bytes)", len);
+    return BLE_HS_ENOTCONN;
+  }
+  if (notify_ring == NULL || len == 0)
+    return BLE_HS_EINVAL;
+  if (len > SENSOR_DATA_MAX_LEN) {
+    // Never cut: a truncated reply would parse as a different reading
+    perf_count(PERF_NTF_DROPS);
+    ESP_LOGE(TAG, "GATT notify rejected (%d bytes > %d)", len,
+             SENSOR_DATA_MAX_LEN);
+    return BLE_HS_EMSGSIZE;
+  }
+
+  uint8_t *slot;
+  if (xRingbufferSendAcquire(notify_ring, (void **)&slot, len, 0) != pdTRUE) {
+    perf_count(PERF_NTF_DROPS);
+    ESP_LOGW(TAG, "GATT notify queue full, dropped %d bytes", len);
+    return BLE_HS_EBUSY;
+  }
+  uint16_t copied = 0;
+  for (int i = 0; i < nsegs; i++) {
+    memcpy(slot + copied, segs[i].data, segs[i].len);
+    copied += segs[i].len;
+  }
+  // Log before handing the slot over: the task may return it right away
+  if (slot[0] >= 0x20 && slot[0] < 0x7F) {
+    ESP_LOGI(TAG, "GATT notify (%d bytes): %.*s", len, len,
+             (const char *)slot);
+  } else {
+    ESP_LOGI(TAG, "GATT notify (%d bytes, binary)", len);
+  }
+  xRingbufferSendComplete(notify_ring, slot);
+  perf_count(PERF_NTF_MSGS);
+  return 0;
+}
+
+void gatt_notify_sensor_data(const char *data, uint16_t len) {
+  gatt_seg_t seg = {.data = data, .len = len};
+  gatt_notify_segs(&seg, 1);
+}
+
 // ============== GATT Callbacks ==============
 static int sensor_data_access_cb(uint16_t conn_handle, uint16_t attr_handle,
                                  struct ble_gatt_access_ctxt *ctxt, void *arg) {
@@ -98,9 +270,12 @@ static int sensor_data_access_cb(uint16_t conn_handle, uint16_t attr_handle,
     if (conn_handle != BLE_HS_CONN_HANDLE_NONE &&
         gatt_conn_handle == BLE_HS_CONN_HANDLE_NONE) {
       gatt_conn_handle = conn_handle;
+      gatt_conn_direct = false;
       ESP_LOGI(TAG, "GATT conn_handle captured from read: %d", conn_handle);
     }
-    int rc = os_mbuf_append(ctxt->om, sensor_data, sensor_data_len);
+    // Live data only goes out as notifications; reads just report liveness
+    int rc = os_mbuf_append(ctxt->om, GATT_READ_VALUE,
+                            strlen(GATT_READ_VALUE));
     return rc == 0 ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
   }
   return 0;
@@ -113,6 +288,7 @@ static int command_access_cb(uint16_t conn_handle, uint16_t attr_handle,
     if (conn_handle != BLE_HS_CONN_HANDLE_NONE) {
       if (gatt_conn_handle != conn_handle) {
         gatt_conn_handle = conn_handle;
+        gatt_conn_direct = false;
         ESP_LOGI(TAG, "GATT conn_handle captured from write: %d", conn_handle);
       }
     }
@@ -129,8 +305,8 @@ static int command_access_cb(uint16_t conn_handle, uint16_t attr_handle,
 
     buf[len] = '\0';
 
-    // Process command from Pi 5
-    process_gatt_command(buf, len);
+    // Process command from Pi 5 (on the worker, not the host task)
+    cmd_worker_submit_gatt(buf, len);
   }
   return 0;
 }
@@ -163,6 +339,8 @@ static int ble_gap_event(struct ble_gap_event *event, void *arg) {
   case BLE_GAP_EVENT_CONNECT:
     if (event->connect.status == 0) {
       gatt_conn_handle = event->connect.conn_handle;
+      gatt_conn_direct = true;
+      gatt_att_mtu = ble_att_mtu(gatt_conn_handle);
       ESP_LOGI(TAG, "Pi 5 connected!");
       gatt_notify_sensor_data("GATEWAY_CONNECTED", 17);
     } else {
@@ -173,6 +351,8 @@ static int ble_gap_event(struct ble_gap_event *event, void *arg) {
   case BLE_GAP_EVENT_DISCONNECT:
     ESP_LOGI(TAG, "Pi 5 disconnected");
     gatt_conn_handle = BLE_HS_CONN_HANDLE_NONE;
+    gatt_conn_direct = false;
+    gatt_att_mtu = BLE_ATT_MTU_DFLT;
     // Restart advertising
     ble_gap_adv_start(BLE_OWN_ADDR_PUBLIC, NULL, BLE_HS_FOREVER, NULL,
                       ble_gap_event, NULL);
@@ -182,14 +362,27 @@ static int ble_gap_event(struct ble_gap_event *event, void *arg) {
     ESP_LOGI(TAG, "Pi 5 subscribed to notifications (handle=%d)",
              event->subscribe.conn_handle);
     // Also capture handle from subscribe event (proxy connection fallback)
-    if (event->subscribe.conn_handle != BLE_HS_CONN_HANDLE_NONE) {
+    if (event->subscribe.conn_handle != BLE_HS_CONN_HANDLE_NONE &&
+        event->subscribe.conn_handle != gatt_conn_handle) {
       gatt_conn_handle = event->subscribe.conn_handle;
+      gatt_conn_direct = false;
     }
     break;
 
+  case BLE_GAP_EVENT_NOTIFY_TX:
+    // A notification left the host - buffers may be free for a backed-off send
+    if (notify_task)
+      xTaskNotifyGive(notify_task);
+    break;
+
   case BLE_GAP_EVENT_MTU:
     ESP_LOGI(TAG, "MTU updated: conn_handle=%d, mtu=%d",
              event->mtu.conn_handle, event->mtu.value);
+    if (event->mtu.conn_handle == gatt_conn_handle) {
+      gatt_att_mtu = event->mtu.value;
+      ESP_LOGI(TAG, "Notify payload now %d bytes%s", gatt_notify_payload_len(),
+               gatt_conn_direct ? "" : " (proxy, fixed)");
+    }
     break;
   }
   return 0;
@@ -229,6 +422,14 @@ esp_err_t gatt_register_services(void) {
   int rc_mtu = ble_att_set_preferred_mtu(185);
   ESP_LOGI(TAG, "Set preferred MTU=185, rc=%d", rc_mtu);
 
+  notify_ring = xRingbufferCreate(GATT_TX_RING_SIZE, RINGBUF_TYPE_NOSPLIT);
+  if (notify_ring == NULL ||
+      xTaskCreate(gatt_tx_task, "gatt_tx", GATT_TX_STACK_SIZE, NULL,
+                  GATT_TX_PRIORITY, &notify_task) != pdPASS) {
+    ESP_LOGE(TAG, "Notify queue/task create failed");
+    return ESP_ERR_NO_MEM;
+  }
+
   // Set device name
   ble_svc_gap_device_name_set("DC-Monitor");
 
@@ -10,10 +10,28 @@
 
 #define SENSOR_DATA_MAX_LEN 128
 #define COMMAND_MAX_LEN 64
-#define GATT_MAX_PAYLOAD 20
+#define GATT_MAX_PAYLOAD 20 // Notify payload at the default MTU (mesh proxy)
+
+// Length-prefixed framing for messages longer than one notification
+#define GATT_FRAME_MARK 0xA0
+#define GATT_FRAME_HDR_LEN 3 // mark + u16 length (little-endian)
 
 extern uint16_t gatt_conn_handle;
 
+// One piece of a notification; pieces are sent back to back
+typedef struct {
+  const void *data;
+  uint16_t len;
+} gatt_seg_t;
+
+// Payload bytes per notification on the current connection
+uint16_t gatt_notify_payload_len(void);
+
+// Queue the concatenation of segs for notification (see gatt_tx_task). Safe
+// from the mesh, NimBLE host and worker tasks. Returns 0, BLE_HS_ENOTCONN,
+// BLE_HS_EBUSY if the queue is full, or BLE_HS_EMSGSIZE if the message is
+// longer than SENSOR_DATA_MAX_LEN (never truncated).
+int gatt_notify_segs(const gatt_seg_t *segs, int nsegs);
 void gatt_notify_sensor_data(const char *data, uint16_t len);
 esp_err_t gatt_register_services(void);
 void gatt_start_advertising(void);
@@ -0,0 +1,310 @@
+#include "gw_sync.h"
+#include "gatt_service.h"
+#include "mesh_node.h"
+#include "mesh_tx.h"
+#include "node_tracker.h"
+#include "power_ctrl.h"
+
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "host/ble_hs.h"
+#include <stdio.h>
+#include <string.h>
+
+#define TAG "GW_SYNC"
+
+#define GW_SYNC_NODES_PER_MSG                                                  \
+  ((MESH_TX_MAX_PAYLOAD - sizeof(gw_sync_hdr_t) - sizeof(gw_sync_pctrl_t)) /   \
+   sizeof(gw_sync_node_t))
+
+static gw_role_t role = GW_ROLE_OFF;
+
+// Sender side (ACTIVE)
+static uint8_t gen = 0;
+static uint32_t state_digest = 0;
+static int beats_since_full = GW_SYNC_FULL_EVERY;
+
+// Receiver side: last sync heard from the active gateway
+static uint16_t active_addr = 0;
+static TickType_t last_heard = 0;
+static uint8_t heard_gen = 0;
+static bool heard_any = false;
+static bool lost_reported = false;
+static bool gen_reported = false;
+static gw_sync_pctrl_t synced_pctrl = {.priority = PCTRL_PRIORITY_NONE};
+static bool synced_pctrl_on = false;
+static uint8_t synced_target[MAX_NODES]; // Applied on promotion
+static node_mask_t synced_target_mask;
+
+static const char *role_name(gw_role_t r) {
+  switch (r) {
+  case GW_ROLE_ACTIVE:
+    return "ACTIVE";
+  case GW_ROLE_STANDBY:
+    return "STANDBY";
+  default:
+    return "OFF";
+  }
+}
+
+// ============== Sender ==============
+static void fill_node(gw_sync_node_t *e, int id, const pctrl_config_t *pc) {
+  uint16_t addr = NODE_BASE_ADDR + id;
+  e->node_id = id;
+  e->fmt = (addr == node_state.addr) ? NODE_FMT_BINARY : get_node_format(addr);
+  e->zones = get_node_zones(addr);
+  e->target = node_mask_test(&pc->target_set_mask, id) ? pc->targets[id]
+                                                       : GW_SYNC_TARGET_NONE;
+}
+
+// Ids in the sync: every known node plus ourselves
+static void sync_ids(node_mask_t *ids) {
+  *ids = known_mask;
+  int self = node_id_of(node_state.addr);
+  if (self >= 0)
+    node_mask_set(ids, self);
+}
+
+// FNV-1a over everything a full sync carries
+static uint32_t digest_state(const node_mask_t *ids, const pctrl_config_t *pc) {
+  uint32_t h = 2166136261u;
+#define MIX(b) (h = (h ^ (uint8_t)(b)) * 16777619u)
+  for (int id = 0; id < MAX_NODES; id++) {
+    if (!node_mask_test(ids, id))
+      continue;
+    gw_sync_node_t e;
+    fill_node(&e, id, pc);
+    MIX(e.node_id);
+    MIX(e.fmt);
+    MIX(e.zones);
+    MIX(e.target);
+  }
+  for (int i = 0; i < 4; i++)
+    MIX(pc->threshold_mw >> (8 * i));
+  MIX(pc->priority);
+  MIX(discovery_complete);
+#undef MIX
+  return h;
+}
+
+static void send_sync(bool full) {
+  uint8_t buf[MESH_TX_MAX_PAYLOAD];
+  gw_sync_hdr_t hdr = {
+      .version = GW_SYNC_V1,
+      .gen = gen,
+      .flags = (power_ctrl_active() ? GW_SYNC_FLAG_PCTRL : 0) |
+               (discovery_complete ? GW_SYNC_FLAG_DISCOVERED : 0),
+  };
+
+  if (!full) {
+    memcpy(buf, &hdr, sizeof(hdr));
+    mesh_tx_submit_op(MESH_GROUP_ADDR, VND_OP_GW_SYNC, buf, sizeof(hdr));
+    return;
+  }
+
+  pctrl_config_t pc = power_ctrl_config();
+  gw_sync_pctrl_t pctrl = {.threshold_mw = pc.threshold_mw,
+                           .priority = pc.priority};
+  node_mask_t ids;
+  sync_ids(&ids);
+  hdr.flags |= GW_SYNC_FLAG_FULL;
+
+  // One message per GW_SYNC_NODES_PER_MSG entries (at least one message)
+  int id = 0;
+  do {
+    uint16_t len = sizeof(hdr) + sizeof(pctrl);
+    hdr.count = 0;
+    for (; id < MAX_NODES && hdr.count < GW_SYNC_NODES_PER_MSG; id++) {
+      if (!node_mask_test(&ids, id))
+        continue;
+      gw_sync_node_t e;
+      fill_node(&e, id, &pc);
+      memcpy(buf + len, &e, sizeof(e));
+      len += sizeof(e);
+      hdr.count++;
+    }
+    memcpy(buf, &hdr, sizeof(hdr));
+    memcpy(buf + sizeof(hdr), &pctrl, sizeof(pctrl));
+    if (!mesh_tx_submit_op(MESH_GROUP_ADDR, VND_OP_GW_SYNC, buf, len)) {
+      ESP_LOGW(TAG, "TX queue full, full sync deferred");
+      beats_since_full = GW_SYNC_FULL_EVERY; // Retry next beat
+      return;
+    }
+  } while (id < MAX_NODES);
+  beats_since_full = 0;
+}
+
+static void active_beat(void) {
+  pctrl_config_t pc = power_ctrl_config();
+  node_mask_t ids;
+  sync_ids(&ids);
+  uint32_t d = digest_state(&ids, &pc);
+  if (d != state_digest) {
+    state_digest = d;
+    gen++;
+    beats_since_full = GW_SYNC_FULL_EVERY;
+  }
+  send_sync(++beats_since_full > GW_SYNC_FULL_EVERY);
+}
+
+// ============== Receiver ==============
+static void notify_pi(const char *fmt_str, int a, int b, int c) {
+  char buf[48];
+  int len = snprintf(buf, sizeof(buf), fmt_str, a, b, c);
+  gatt_notify_sensor_data(buf, len);
+}
+
+static void standby_beat(void) {
+  if (!heard_any || lost_reported)
+    return;
+  TickType_t silent = xTaskGetTickCount() - last_heard;
+  if (silent >= pdMS_TO_TICKS(GW_SYNC_LOST_BEATS *
+                              CONFIG_MESH_GW_HEARTBEAT_MS)) {
+    lost_reported = true;
+    ESP_LOGW(TAG, "Active gateway 0x%04x silent for %lu ms", active_addr,
+             (unsigned long)pdTICKS_TO_MS(silent));
+    notify_pi("GW:LOST:%d", node_id_of(active_addr), 0, 0);
+  }
+}
+
+void gw_sync_on_msg(const esp_ble_mesh_msg_ctx_t *ctx, const uint8_t *msg,
+                    uint16_t len) {
+  gw_sync_hdr_t hdr;
+  if (len < sizeof(hdr) || msg[0] != GW_SYNC_V1)
+    return;
+  memcpy(&hdr, msg, sizeof(hdr));
+  if (role == GW_ROLE_ACTIVE) {
+    // Two ACTIVE gateways: the lower node id keeps the role
+    if (ctx->addr > node_state.addr) {
+      ESP_LOGW(TAG, "Sync from 0x%04x while ACTIVE ignored", ctx->addr);
+      return;
+    }
+    ESP_LOGW(TAG, "0x%04x is ACTIVE too, stepping down", ctx->addr);
+    role = GW_ROLE_STANDBY;
+    gen_reported = false;
+    notify_pi("GW:DEMOTED:%d", node_id_of(ctx->addr), 0, 0);
+  }
+
+  if (active_addr != ctx->addr || heard_gen != hdr.gen)
+    gen_reported = false;
+  active_addr = ctx->addr;
+  last_heard = xTaskGetTickCount();
+  heard_gen = hdr.gen;
+  heard_any = true;
+  lost_reported = false;
+
+  // The controller follows the active gateway
+  if ((hdr.flags & GW_SYNC_FLAG_PCTRL) && power_ctrl_active())
+    power_ctrl_handover();
+
+  if (!(hdr.flags & GW_SYNC_FLAG_FULL) ||
+      len < sizeof(hdr) + sizeof(gw_sync_pctrl_t) +
+                hdr.count * sizeof(gw_sync_node_t))
+    return;
+
+  memcpy(&synced_pctrl, msg + sizeof(hdr), sizeof(synced_pctrl));
+  synced_pctrl_on = (hdr.flags & GW_SYNC_FLAG_PCTRL) != 0;
+  const uint8_t *p = msg + sizeof(hdr) + sizeof(gw_sync_pctrl_t);
+  for (int i = 0; i < hdr.count; i++, p += sizeof(gw_sync_node_t)) {
+    gw_sync_node_t e;
+    memcpy(&e, p, sizeof(e));
+    if (e.node_id >= MAX_NODES)
+      continue;
+    uint16_t addr = NODE_BASE_ADDR + e.node_id;
+    register_known_node(addr); // Ignores ourselves
+    if (e.fmt != NODE_FMT_UNKNOWN)
+      set_node_format(addr, e.fmt);
+    set_node_zones(addr, e.zones);
+    if (e.target != GW_SYNC_TARGET_NONE) {
+      synced_target[e.node_id] = e.target;
+      node_mask_set(&synced_target_mask, e.node_id);
+    }
+  }
+  if (hdr.flags & GW_SYNC_FLAG_DISCOVERED)
+    discovery_complete = true;
+
+  if (role == GW_ROLE_STANDBY && !gen_reported) {
+    gen_reported = true;
+    notify_pi("GW:SYNC:%d:%d:%d", node_id_of(active_addr), hdr.gen,
+              known_node_count);
+  }
+}
+
+// ============== Role / Task ==============
+// Own task rather than a timer: a full sync walks every node id and builds
+// the messages on the stack
+static void gw_sync_task(void *pvParameters) {
+  TickType_t wake = xTaskGetTickCount();
+  for (;;) {
+    vTaskDelayUntil(&wake, pdMS_TO_TICKS(CONFIG_MESH_GW_HEARTBEAT_MS));
+    if (role != GW_ROLE_OFF && gatt_conn_handle == BLE_HS_CONN_HANDLE_NONE) {
+      ESP_LOGI(TAG, "Pi link gone, %s -> OFF", role_name(role));
+      role = GW_ROLE_OFF;
+    }
+    if (!vnd_bound)
+      continue;
+    if (role == GW_ROLE_ACTIVE)
+      active_beat();
+    else if (role == GW_ROLE_STANDBY)
+      standby_beat();
+  }
+}
+
+static void promote(void) {
+  // Carry on the old gateway's controller from its last full sync
+  if (synced_pctrl_on && synced_pctrl.threshold_mw && !power_ctrl_active()) {
+    for (int id = 0; id < MAX_NODES; id++) {
+      if (node_mask_test(&synced_target_mask, id))
+        power_ctrl_set_target(id, synced_target[id]);
+    }
+    power_ctrl_set_priority(synced_pctrl.priority);
+    power_ctrl_set_threshold(synced_pctrl.threshold_mw);
+    ESP_LOGI(TAG, "Took over power controller (%lu mW)",
+             (unsigned long)synced_pctrl.threshold_mw);
+  }
+  role = GW_ROLE_ACTIVE;
+  heard_any = false;
+  beats_since_full = GW_SYNC_FULL_EVERY; // Full sync on the next beat
+}
+
+gw_role_t gw_sync_role(void) { return role; }
+
+int gw_sync_command(const char *arg, char *resp, size_t resp_size) {
+  if (arg) {
+    if (strcasecmp(arg, "ACTIVE") == 0) {
+      if (role != GW_ROLE_ACTIVE)
+        promote();
+    } else if (strcasecmp(arg, "STANDBY") == 0) {
+      role = GW_ROLE_STANDBY;
+      gen_reported = false;
+    } else if (strcasecmp(arg, "OFF") == 0) {
+      role = GW_ROLE_OFF;
+    } else {
+      return snprintf(resp, resp_size, "ERROR:GW_ROLE:%s", arg);
+    }
+    ESP_LOGI(TAG, "Role %s", role_name(role));
+  }
+
+  int len = snprintf(resp, resp_size, "GW:%s:", role_name(role));
+  if (role == GW_ROLE_ACTIVE)
+    len += snprintf(resp + len, resp_size - len, "%d",
+                    node_id_of(node_state.addr));
+  else if (heard_any)
+    len += snprintf(resp + len, resp_size - len, "%d",
+                    node_id_of(active_addr));
+  else
+    len += snprintf(resp + len, resp_size - len, "-");
+  return len + snprintf(resp + len, resp_size - len, ":%d:%u",
+                        known_node_count,
+                        role == GW_ROLE_ACTIVE ? gen : heard_gen);
+}
+
+esp_err_t gw_sync_init(void) {
+  if (xTaskCreate(gw_sync_task, "gw_sync", GW_SYNC_STACK_SIZE, NULL,
+                  GW_SYNC_PRIORITY, NULL) != pdPASS) {
+    ESP_LOGE(TAG, "Task create failed");
+    return ESP_ERR_NO_MEM;
+  }
+  return ESP_OK;
+}
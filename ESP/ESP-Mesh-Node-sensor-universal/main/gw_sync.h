@@ -0,0 +1,86 @@
+#ifndef GW_SYNC_H
+#define GW_SYNC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_ble_mesh_defs.h"
+#include "esp_err.h"
+
+// ============== Hot-standby Gateway Sync ==============
+// Every universal node can be the Pi's GATT gateway. The Pi marks the node
+// it talks through ACTIVE and keeps a second connection warm to a STANDBY
+// node ("ALL:GW:ACTIVE" / "ALL:GW:STANDBY" on each link). The active
+// gateway sends VND_OP_GW_SYNC to MESH_GROUP_ADDR every
+// CONFIG_MESH_GW_HEARTBEAT_MS:
+//   [GW_SYNC_V1][gen][flags][count]                        heartbeat
+//   ... + gw_sync_pctrl_t + count * gw_sync_node_t         full state
+// Full state (its known_nodes[] with reply format, zones and controller
+// targets, plus the power controller settings) goes out when gen changes
+// and every GW_SYNC_FULL_EVERY beats, split over several messages when it
+// doesn't fit one. Every other node applies it, so whichever node the Pi
+// fails over to already knows the mesh and needs no rediscovery.
+//
+// Requests in flight on the old gateway aren't moved: their replies are
+// addressed to it. The Pi re-sends what it was waiting for.
+//
+// A STANDBY node tells its Pi link "GW:SYNC:<id>:<gen>:<known>" when the
+// state changes and "GW:LOST:<id>" after GW_SYNC_LOST_BEATS silent beats.
+// On promotion it takes over the power controller if the old gateway ran
+// it; the old one hands it over when it hears the new gateway's sync.
+// ACTIVE / STANDBY fall back to OFF when the Pi link drops.
+//
+// Two ACTIVE gateways (a lingering old link, a second Pi) settle on their
+// own: the one with the higher node id steps down to STANDBY when it hears
+// the other, tells its Pi "GW:DEMOTED:<winner id>" and, like any standby,
+// hands the power controller over if the winner runs one.
+#define GW_SYNC_V1 0xA5
+#define GW_SYNC_FULL_EVERY 10
+#define GW_SYNC_LOST_BEATS 3
+#define GW_SYNC_STACK_SIZE 3072
+#define GW_SYNC_PRIORITY 3 // Below the command worker
+
+#define GW_SYNC_FLAG_FULL 0x01  // pctrl + node entries follow the header
+#define GW_SYNC_FLAG_PCTRL 0x02 // Sender runs the power controller
+#define GW_SYNC_FLAG_DISCOVERED 0x04
+
+#define GW_SYNC_TARGET_NONE 0xFF // No controller ceiling set for the node
+
+typedef enum {
+  GW_ROLE_OFF = 0, // Not part of a Pi gateway pair (legacy behaviour)
+  GW_ROLE_ACTIVE,
+  GW_ROLE_STANDBY,
+} gw_role_t;
+
+typedef struct {
+  uint8_t version; // GW_SYNC_V1
+  uint8_t gen;     // Bumped when the full state changes
+  uint8_t flags;
+  uint8_t count; // gw_sync_node_t entries in this message
+} __attribute__((packed)) gw_sync_hdr_t;
+
+typedef struct {
+  uint32_t threshold_mw; // 0 = controller off
+  uint8_t priority;      // Node id or PCTRL_PRIORITY_NONE
+} __attribute__((packed)) gw_sync_pctrl_t;
+
+typedef struct {
+  uint8_t node_id;
+  uint8_t fmt;    // node_fmt_t
+  uint8_t zones;  // Zone bitmap
+  uint8_t target; // Controller ceiling or GW_SYNC_TARGET_NONE
+} __attribute__((packed)) gw_sync_node_t;
+
+// Create the heartbeat task. Call after ble_mesh_init().
+esp_err_t gw_sync_init(void);
+
+gw_role_t gw_sync_role(void);
+
+// "GW[:ACTIVE|STANDBY|OFF]" from the Pi. Returns the response length:
+// "GW:<role>:<active gateway id|->:<known nodes>:<gen>"
+int gw_sync_command(const char *arg, char *resp, size_t resp_size);
+
+// VND_OP_GW_SYNC from another node (custom_model_cb)
+void gw_sync_on_msg(const esp_ble_mesh_msg_ctx_t *ctx, const uint8_t *msg,
+                    uint16_t len);
+
+#endif /* GW_SYNC_H */
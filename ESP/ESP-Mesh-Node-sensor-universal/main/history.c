@@ -0,0 +1,132 @@
+#include "history.h"
+#include "load_control.h"
+#include "mesh_node.h"
+#include "node_tracker.h"
+#include "sensor.h"
+
+#include "esp_log.h"
+#include "esp_random.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/timers.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define TAG "HISTORY"
+
+typedef struct {
+  uint32_t t_ms; // Uptime at sample time
+  uint8_t duty;
+  uint16_t vbus_raw;
+  int16_t current_raw;
+} history_entry_t;
+
+static history_entry_t ring[HISTORY_LEN];
+static uint16_t next_seq = 0; // Seq of the next sample; ring[seq & (LEN-1)]
+static uint16_t count = 0;    // Valid entries, up to HISTORY_LEN
+static uint8_t boot_id = 0;
+static portMUX_TYPE history_lock = portMUX_INITIALIZER_UNLOCKED;
+static TimerHandle_t history_timer = NULL;
+
+static void history_timer_cb(TimerHandle_t xTimer) {
+  history_entry_t e = {
+      .t_ms = pdTICKS_TO_MS(xTaskGetTickCount()),
+      .duty = (uint8_t)get_current_duty(),
+  };
+  ina260_sample_t s;
+  if (ina260_latest(&s)) { // Zeroed without a sensor, like the READ frame
+    e.vbus_raw = s.vbus_raw;
+    e.current_raw = s.current_raw;
+  }
+
+  taskENTER_CRITICAL(&history_lock);
+  ring[next_seq & (HISTORY_LEN - 1)] = e;
+  next_seq++;
+  if (count < HISTORY_LEN)
+    count++;
+  taskEXIT_CRITICAL(&history_lock);
+}
+
+void history_init(void) {
+  boot_id = (uint8_t)esp_random();
+  history_timer = xTimerCreate("history", pdMS_TO_TICKS(HISTORY_PERIOD_MS),
+                               pdTRUE, NULL, history_timer_cb);
+  if (history_timer)
+    xTimerStart(history_timer, 0);
+  ESP_LOGI(TAG, "%d samples every %d ms, boot id 0x%02x", HISTORY_LEN,
+           HISTORY_PERIOD_MS, boot_id);
+}
+
+static uint16_t age_ds(uint32_t now_ms, const history_entry_t *e) {
+  uint32_t ds = (now_ms - e->t_ms) / 100;
+  return ds > UINT16_MAX ? UINT16_MAX : (uint16_t)ds;
+}
+
+int history_command(const char *args, uint8_t *buf, size_t buf_size) {
+  bool have_since = false;
+  uint16_t since = 0;
+  uint32_t max_age_ds = UINT32_MAX;
+  char *endptr = (char *)args;
+
+  if (args[0] != '\0' && args[0] != '*') {
+    since = (uint16_t)strtoul(args, &endptr, 10);
+    have_since = endptr != args;
+  } else if (args[0] == '*') {
+    endptr++;
+  }
+  if (*endptr == ':')
+    max_age_ds = strtoul(endptr + 1, NULL, 10) * 10;
+
+  if (buf_size < HISTORY_HDR_LEN)
+    return 0;
+  int room = (buf_size - HISTORY_HDR_LEN) / HISTORY_SAMPLE_LEN;
+  if (room > HISTORY_FRAME_MAX_SAMPLES)
+    room = HISTORY_FRAME_MAX_SAMPLES;
+
+  int node_id = node_id_of(node_state.addr);
+  history_hdr_t hdr = {
+      .version = HISTORY_FRAME_V1,
+      .node_id = node_id < 0 ? 0 : node_id,
+      .boot_id = boot_id,
+  };
+  history_sample_t *out = (history_sample_t *)(buf + HISTORY_HDR_LEN);
+  uint32_t now_ms = pdTICKS_TO_MS(xTaskGetTickCount());
+
+  taskENTER_CRITICAL(&history_lock);
+  uint16_t seq = next_seq - count; // Oldest kept sample
+  if (have_since) {
+    // Samples after since; more than we keep means it was overwritten
+    uint16_t ahead = next_seq - (uint16_t)(since + 1);
+    if (ahead <= count)
+      seq = since + 1;
+    else
+      hdr.flags |= HISTORY_FLAG_GAP;
+  }
+  while (seq != next_seq &&
+         age_ds(now_ms, &ring[seq & (HISTORY_LEN - 1)]) > max_age_ds)
+    seq++;
+  hdr.first_seq = seq;
+  for (; hdr.n < room && seq != next_seq; hdr.n++, seq++) {
+    const history_entry_t *e = &ring[seq & (HISTORY_LEN - 1)];
+    history_sample_t s = {
+        .age_ds = age_ds(now_ms, e),
+        .duty = e->duty,
+        .vbus_raw = e->vbus_raw,
+        .current_raw = e->current_raw,
+    };
+    memcpy(&out[hdr.n], &s, sizeof(s));
+  }
+  if (seq != next_seq)
+    hdr.flags |= HISTORY_FLAG_MORE;
+  taskEXIT_CRITICAL(&history_lock);
+
+  memcpy(buf, &hdr, sizeof(hdr));
+  ESP_LOGD(TAG, "Frame: %u samples from seq %u, flags 0x%02x", hdr.n,
+           hdr.first_seq, hdr.flags);
+  return HISTORY_HDR_LEN + hdr.n * HISTORY_SAMPLE_LEN;
+}
+
+bool is_history_frame(const uint8_t *data, uint16_t len) {
+  return len >= HISTORY_HDR_LEN && data[0] == HISTORY_FRAME_V1 &&
+         len == HISTORY_HDR_LEN + data[3] * HISTORY_SAMPLE_LEN;
+}
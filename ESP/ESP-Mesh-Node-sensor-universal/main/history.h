@@ -0,0 +1,61 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// ============== Telemetry History ==============
+// Every HISTORY_PERIOD_MS a timer copies the latest INA260 sample and the
+// current duty into a RAM ring of HISTORY_LEN entries (~17 min at 2 s), each
+// numbered with a 16-bit sequence. After a GATT outage the Pi asks for the
+// samples it missed with "hist" and backfills its database, one dense frame
+// per request:
+//   [HISTORY_FRAME_V1][node_id][tid][n][flags][boot_id][first_seq u16]
+//   + n * history_sample_t (consecutive seqs from first_seq)
+// Ages are relative to the reply, so the Pi needs no clock on the node.
+// boot_id is random per boot: a change tells the Pi the seqs restarted.
+// Samples live in RAM only and do not survive a reboot.
+#define HISTORY_FRAME_V1 0xA3
+#define HISTORY_HDR_LEN 8
+#define HISTORY_SAMPLE_LEN 7
+#define HISTORY_FRAME_MAX_SAMPLES 17 // 8 + 17 * 7 = 127 (one GATT message)
+#define HISTORY_LEN 512              // Power of two
+#define HISTORY_PERIOD_MS 2000
+#define HISTORY_FLAG_MORE 0x01 // Newer samples remain, ask again from the last
+#define HISTORY_FLAG_GAP 0x02  // since was overwritten; starts at the oldest
+
+typedef struct {
+  uint8_t version; // HISTORY_FRAME_V1
+  uint8_t node_id; // unicast - NODE_BASE_ADDR
+  uint8_t tid;     // request TID (see mesh_tx.h), 0 if none
+  uint8_t n;       // samples that follow
+  uint8_t flags;   // HISTORY_FLAG_*
+  uint8_t boot_id;
+  uint16_t first_seq; // seq of the first sample (next seq when n == 0)
+} __attribute__((packed)) history_hdr_t;
+
+typedef struct {
+  uint16_t age_ds; // 0.1 s before the reply (saturates at 0xFFFF)
+  uint8_t duty;
+  uint16_t vbus_raw;   // INA260 registers, as in telemetry_frame_t
+  int16_t current_raw;
+} __attribute__((packed)) history_sample_t;
+
+_Static_assert(sizeof(history_hdr_t) == HISTORY_HDR_LEN,
+               "history header must stay 8 bytes");
+_Static_assert(sizeof(history_sample_t) == HISTORY_SAMPLE_LEN,
+               "history sample must stay 7 bytes");
+
+// Pick the boot id and start the sampling timer
+void history_init(void);
+
+// "hist" command: "" returns from the oldest kept sample, "<since>" the
+// samples after seq since, "<since|*>:<max_age_s>" only those newer than
+// max_age_s. Fills buf with one frame; returns its length.
+int history_command(const char *args, uint8_t *buf, size_t buf_size);
+
+// True if data looks like a history frame (version + length match)
+bool is_history_frame(const uint8_t *data, uint16_t len);
+
+#endif /* HISTORY_H */
@@ -1,7 +1,16 @@
 #include "load_control.h"
+#include "mesh_node.h"
+#include "nvs_store.h"
+#include "sensor.h"
 #include "driver/gpio.h"
 #include "driver/ledc.h"
 #include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/timers.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 static const char *TAG = "LOAD_CTRL";
 
@@ -11,10 +20,69 @@ static const char *TAG = "LOAD_CTRL";
 #define PWM_RESOLUTION LEDC_TIMER_13_BIT // 8192 steps
 #define PWM_MAX_DUTY 8191                // (2^13 - 1)
 
-static int current_duty = 0;   // 0-100%
+static int current_duty = 0;   // 0-100%, applied (fade target once it ends)
+static int requested_duty = 0; // 0-100%, last set_duty()
+
+// ============== Limiter State ==============
+static portMUX_TYPE limit_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t limit_mw = 0;    // 0 = off
+static int limit_ceiling = 100;  // Duty cap while clamped
+static int settle_samples = 0;
+static TickType_t last_report = 0;
+
+// ============== Fade State ==============
+// fade_gen tags each hardware fade so a late FADE_END from a superseded
+// fade is ignored.
+static volatile bool fade_active = false;
+static volatile uint32_t fade_gen = 0;
+static int fade_target = 0;
+static load_fade_done_cb_t fade_done = NULL;
+static void *fade_done_arg = NULL;
+
+static bool fade_end_isr(const ledc_cb_param_t *param, void *arg);
+static void hold_expired(TimerHandle_t xTimer);
+
+// ============== Profile Table ==============
+// "ramp" reproduces the old stepped test (0/25/50/75/100%, then off), now
+// with short hardware fades between the levels.
+static const load_step_t ramp_steps[] = {
+    {0, 0, 500},     {25, 250, 500}, {50, 250, 500},
+    {75, 250, 500},  {100, 250, 500}, {0, 0, 200},
+};
+static const load_step_t sweep_steps[] = {
+    {0, 0, 200}, {100, 2000, 500}, {0, 2000, 200},
+};
+
+static const struct {
+  const char *name;
+  const load_step_t *steps;
+  uint8_t n_steps;
+} profiles[] = {
+    {"ramp", ramp_steps, sizeof(ramp_steps) / sizeof(ramp_steps[0])},
+    {"sweep", sweep_steps, sizeof(sweep_steps) / sizeof(sweep_steps[0])},
+};
+
+// Profile state is touched by the timer task (fade end, hold expiry) and by
+// whoever starts or stops a profile (command worker, power controller)
+static portMUX_TYPE profile_lock = portMUX_INITIALIZER_UNLOCKED;
+static TimerHandle_t hold_timer = NULL;
+static int profile_idx = -1; // -1 = no profile running
+static int profile_step = 0;
+static uint32_t profile_gen = 0;
+static uint32_t hold_gen = 0; // profile_gen of the armed hold
+static load_profile_cb_t profile_cb = NULL;
+
+static int ledc_percent(uint32_t value);
 
 int get_current_duty(void) {
-    return current_duty;
+  // Mid-fade current_duty is still the start level: read the hardware
+  if (fade_active)
+    return ledc_percent(ledc_get_duty(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_0));
+  return current_duty;
+}
+
+int get_requested_duty(void) {
+    return requested_duty;
 }
 
 void pwm_init(void) {
@@ -37,22 +105,336 @@ void pwm_init(void) {
   };
   ESP_ERROR_CHECK(ledc_channel_config(&channel));
 
+  // Hardware fades: completion comes back through fade_end_isr
+  ESP_ERROR_CHECK(ledc_fade_func_install(0));
+  ledc_cbs_t cbs = {.fade_cb = fade_end_isr};
+  ESP_ERROR_CHECK(ledc_cb_register(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_0, &cbs, NULL));
+  hold_timer = xTimerCreate("load_hold", 1, pdFALSE, NULL, hold_expired);
+
   current_duty = 0;
   ESP_LOGI(TAG, "PWM: %d Hz on GPIO%d (inverted, load OFF)", PWM_FREQ_HZ,
            PWM_GPIO);
 }
 
+// Inverted: 0% load = full HIGH output, 100% load = full LOW output
+static uint32_t ledc_value(int percent) {
+  return ((100 - percent) * PWM_MAX_DUTY) / 100;
+}
+
+static int ledc_percent(uint32_t value) {
+  return 100 - (int)((value * 100 + PWM_MAX_DUTY / 2) / PWM_MAX_DUTY);
+}
+
+// Stop a running hardware fade. Returns its completion callback (to be run
+// by the caller when the interruption should count as "done"), or NULL.
+static load_fade_done_cb_t halt_fade(void **arg) {
+  if (!fade_active)
+    return NULL;
+  ledc_fade_stop(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_0);
+  taskENTER_CRITICAL(&limit_lock);
+  fade_active = false;
+  fade_gen++;
+  load_fade_done_cb_t cb = fade_done;
+  *arg = fade_done_arg;
+  fade_done = NULL;
+  taskEXIT_CRITICAL(&limit_lock);
+  return cb;
+}
+
+// Called from the sampler, command worker, power controller and timer
+// tasks. With the fade service installed ledc_set_duty_and_update() is the
+// thread-safe setter (ledc_set_duty + ledc_update_duty is not).
+static void apply_duty(int percent) {
+  void *arg;
+  load_fade_done_cb_t cb = halt_fade(&arg);
+  ledc_set_duty_and_update(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_0,
+                           ledc_value(percent), 0);
+  current_duty = percent;
+  if (cb)
+    cb(arg); // Interrupted fades (limiter clamp) still complete
+}
+
+// Timer task context, pended from the LEDC ISR
+static void fade_finished(void *unused, uint32_t gen) {
+  taskENTER_CRITICAL(&limit_lock);
+  if (!fade_active || gen != fade_gen) {
+    taskEXIT_CRITICAL(&limit_lock);
+    return; // Superseded or stopped
+  }
+  fade_active = false;
+  current_duty = fade_target;
+  load_fade_done_cb_t cb = fade_done;
+  void *arg = fade_done_arg;
+  fade_done = NULL;
+  taskEXIT_CRITICAL(&limit_lock);
+
+  if (cb)
+    cb(arg);
+}
+
+static bool IRAM_ATTR fade_end_isr(const ledc_cb_param_t *param, void *arg) {
+  BaseType_t woken = pdFALSE;
+  if (param->event == LEDC_FADE_END_EVT)
+    xTimerPendFunctionCallFromISR(fade_finished, NULL, fade_gen, &woken);
+  return woken == pdTRUE;
+}
+
+// Fade to percent (already clamped) without touching any running profile.
+// Returns true if the fade runs (done follows from the timer task); false
+// if the duty was applied at once (done is not called).
+static bool start_fade(int percent, uint32_t duration_ms,
+                       load_fade_done_cb_t done, void *arg) {
+  taskENTER_CRITICAL(&limit_lock);
+  requested_duty = percent;
+  int applied = (percent > limit_ceiling) ? limit_ceiling : percent;
+  taskEXIT_CRITICAL(&limit_lock);
+
+  void *old_arg;
+  halt_fade(&old_arg); // Superseded - its callback is dropped
+
+  if (duration_ms > 0 && applied != current_duty) {
+    taskENTER_CRITICAL(&limit_lock);
+    fade_gen++;
+    fade_target = applied;
+    fade_done = done;
+    fade_done_arg = arg;
+    fade_active = true;
+    taskEXIT_CRITICAL(&limit_lock);
+
+    esp_err_t err =
+        ledc_set_fade_with_time(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_0,
+                                ledc_value(applied), duration_ms);
+    if (err == ESP_OK)
+      err = ledc_fade_start(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_0,
+                            LEDC_FADE_NO_WAIT);
+    if (err == ESP_OK)
+      return true;
+
+    ESP_LOGW(TAG, "Fade failed (%d), stepping to %d%%", err, applied);
+    taskENTER_CRITICAL(&limit_lock);
+    fade_active = false;
+    fade_done = NULL;
+    taskEXIT_CRITICAL(&limit_lock);
+  }
+
+  // Instant transition (or fade unavailable): complete right away
+  apply_duty(applied);
+  return false;
+}
+
+bool set_duty_fade(int percent, uint32_t duration_ms,
+                   load_fade_done_cb_t done, void *arg) {
+  if (percent < 0)
+    percent = 0;
+  if (percent > 100)
+    percent = 100;
+  load_profile_stop();
+  ESP_LOGI(TAG, "Fade to %d%% over %lu ms", percent,
+           (unsigned long)duration_ms);
+  return start_fade(percent, duration_ms, done, arg);
+}
+
 void set_duty(int percent) {
   if (percent < 0)
     percent = 0;
   if (percent > 100)
     percent = 100;
-  // Inverted: 0% load = full HIGH output, 100% load = full LOW output
-  int inverted = 100 - percent;
-  uint32_t duty_val = (inverted * PWM_MAX_DUTY) / 100;
-  ledc_set_duty(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_0, duty_val);
-  ledc_update_duty(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_0);
-  current_duty = percent;
-  ESP_LOGI(TAG, "Duty set: %d%% (LEDC duty=%lu)", percent,
-           (unsigned long)duty_val);
+  load_profile_stop();
+
+  taskENTER_CRITICAL(&limit_lock);
+  requested_duty = percent;
+  int applied = (percent > limit_ceiling) ? limit_ceiling : percent;
+  taskEXIT_CRITICAL(&limit_lock);
+
+  apply_duty(applied);
+  if (applied != percent) {
+    ESP_LOGI(TAG, "Duty set: %d%% (limited to %d%%)", percent, applied);
+  } else {
+    ESP_LOGI(TAG, "Duty set: %d%%", percent);
+  }
+}
+
+// ============== Local Power Limiter ==============
+// Sampler task context: one decision per fresh sample
+static void limit_on_sample(const ina260_sample_t *sample) {
+  if (limit_mw == 0)
+    return;
+
+  uint32_t power = ina260_power_mw(sample->vbus_raw, sample->current_raw);
+  int duty = get_current_duty(); // Live, also mid-fade
+  bool clamped_now = false;
+  int applied = -1;
+
+  taskENTER_CRITICAL(&limit_lock);
+  if (settle_samples > 0) {
+    settle_samples--;
+  } else if (power > limit_mw && duty > 0) {
+    // Cut in proportion to the overshoot, at least one step
+    int target = (int)((uint64_t)duty * limit_mw / power);
+    if (target >= duty)
+      target = duty - 1;
+    clamped_now = (limit_ceiling >= requested_duty);
+    limit_ceiling = target;
+    applied = target;
+    settle_samples = LOAD_LIMIT_SETTLE_SAMPLES;
+  } else if (limit_ceiling < 100 &&
+             power < (uint64_t)limit_mw * LOAD_LIMIT_RELEASE_PCT / 100) {
+    limit_ceiling += LOAD_LIMIT_RELEASE_STEP;
+    if (limit_ceiling > 100)
+      limit_ceiling = 100;
+    int want = (requested_duty > limit_ceiling) ? limit_ceiling : requested_duty;
+    if (want != duty) {
+      applied = want;
+      settle_samples = LOAD_LIMIT_SETTLE_SAMPLES;
+    }
+  }
+  int requested = requested_duty;
+  taskEXIT_CRITICAL(&limit_lock);
+
+  if (applied < 0)
+    return;
+  apply_duty(applied);
+
+  // Report once per clamp episode start, rate limited
+  TickType_t now = xTaskGetTickCount();
+  if (clamped_now &&
+      now - last_report >= pdMS_TO_TICKS(LOAD_LIMIT_REPORT_MS)) {
+    char msg[40];
+    int len = snprintf(msg, sizeof(msg), "LIMIT:%lu>%lumW,D:%d->%d%%",
+                       (unsigned long)power, (unsigned long)limit_mw,
+                       requested, applied);
+    ESP_LOGW(TAG, "%s", msg);
+    vendor_server_report(msg, len);
+    last_report = now;
+  }
+}
+
+void load_limit_set(uint32_t max_mw) {
+  taskENTER_CRITICAL(&limit_lock);
+  limit_mw = max_mw;
+  if (max_mw == 0)
+    limit_ceiling = 100;
+  int restore = (max_mw == 0 && requested_duty != current_duty)
+                    ? requested_duty
+                    : -1;
+  taskEXIT_CRITICAL(&limit_lock);
+
+  if (restore >= 0)
+    apply_duty(restore);
+  save_load_limit(max_mw);
+  ESP_LOGI(TAG, "Power limit: %lu mW%s", (unsigned long)max_mw,
+           max_mw ? "" : " (off)");
+}
+
+void load_limit_init(void) {
+  limit_mw = restore_load_limit();
+  sensor_add_sample_cb(limit_on_sample);
+  if (limit_mw)
+    ESP_LOGI(TAG, "Power limit restored: %lu mW", (unsigned long)limit_mw);
+}
+
+int load_limit_command(const char *args, char *resp, size_t resp_size) {
+  if (args[0] != '\0') {
+    char *endptr;
+    long mw = strtol(args, &endptr, 10);
+    if (endptr == args || *endptr != '\0' || mw < 0)
+      return snprintf(resp, resp_size, "ERR:LIM:%s", args);
+    load_limit_set((uint32_t)mw);
+  }
+  return snprintf(resp, resp_size, "LIM:%lumW,D:%d/%d%%",
+                  (unsigned long)limit_mw, get_current_duty(), requested_duty);
+}
+
+// ============== Profile Runner ==============
+static void run_step(int idx, int step, uint32_t gen);
+
+// Fade into the step done: hold it (long enough for a fresh reading)
+static void step_reached(void *arg) {
+  uint32_t gen = (uint32_t)(uintptr_t)arg;
+  taskENTER_CRITICAL(&profile_lock);
+  bool current = (gen == profile_gen && profile_idx >= 0);
+  uint32_t hold_ms = 0;
+  if (current) {
+    hold_ms = profiles[profile_idx].steps[profile_step].hold_ms;
+    hold_gen = gen;
+  }
+  taskEXIT_CRITICAL(&profile_lock);
+  if (!current)
+    return;
+
+  uint32_t settle_ms = 2 * sensor_conversion_ms() + INA260_SAMPLE_SLACK_MS;
+  if (hold_ms < settle_ms)
+    hold_ms = settle_ms;
+  xTimerChangePeriod(hold_timer, pdMS_TO_TICKS(hold_ms), 0);
+}
+
+static void hold_expired(TimerHandle_t xTimer) {
+  taskENTER_CRITICAL(&profile_lock);
+  if (profile_idx < 0 || hold_gen != profile_gen) {
+    taskEXIT_CRITICAL(&profile_lock);
+    return; // Stopped or restarted meanwhile
+  }
+  int idx = profile_idx;
+  int step = profile_step;
+  uint32_t gen = profile_gen;
+  bool last = (step + 1 >= profiles[idx].n_steps);
+  load_profile_cb_t cb = profile_cb;
+  if (last)
+    profile_idx = -1;
+  else
+    profile_step++;
+  taskEXIT_CRITICAL(&profile_lock);
+
+  if (cb)
+    cb(step, current_duty, last);
+  if (!last)
+    run_step(idx, step + 1, gen);
+}
+
+static void run_step(int idx, int step, uint32_t gen) {
+  const load_step_t *s = &profiles[idx].steps[step];
+  void *arg = (void *)(uintptr_t)gen;
+  if (!start_fade(s->duty, s->fade_ms, step_reached, arg))
+    step_reached(arg); // Instant step: start the hold now
+}
+
+esp_err_t load_profile_start(const char *name, load_profile_cb_t cb) {
+  int idx = -1;
+  for (int i = 0; i < (int)(sizeof(profiles) / sizeof(profiles[0])); i++) {
+    if (strcmp(profiles[i].name, name) == 0)
+      idx = i;
+  }
+  if (idx < 0)
+    return ESP_ERR_NOT_FOUND;
+
+  load_profile_stop();
+  taskENTER_CRITICAL(&profile_lock);
+  uint32_t gen = ++profile_gen;
+  profile_cb = cb;
+  profile_step = 0;
+  profile_idx = idx;
+  taskEXIT_CRITICAL(&profile_lock);
+  ESP_LOGI(TAG, "Profile '%s' started (%d steps)", name,
+           profiles[idx].n_steps);
+  run_step(idx, 0, gen);
+  return ESP_OK;
+}
+
+void load_profile_stop(void) {
+  taskENTER_CRITICAL(&profile_lock);
+  bool running = (profile_idx >= 0);
+  profile_idx = -1;
+  profile_gen++;
+  taskEXIT_CRITICAL(&profile_lock);
+  if (!running)
+    return;
+  xTimerStop(hold_timer, 0);
+  ESP_LOGI(TAG, "Profile stopped");
+}
+
+bool load_profile_running(void) {
+  taskENTER_CRITICAL(&profile_lock);
+  bool running = (profile_idx >= 0);
+  taskEXIT_CRITICAL(&profile_lock);
+  return running;
 }
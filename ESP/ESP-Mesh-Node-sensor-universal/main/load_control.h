@@ -1,13 +1,72 @@
 #ifndef LOAD_CONTROL_H
 #define LOAD_CONTROL_H
 
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
 // Initialize LEDC PWM for load control. Starts with load OFF (0%).
 void pwm_init(void);
 
 // Set load duty cycle (0-100%). Clamped to valid range.
 void set_duty(int percent);
 
-// Get current duty cycle percentage (0-100%).
+// Get current (applied) duty cycle percentage (0-100%).
 int get_current_duty(void);
 
+// ============== Faded Transitions ==============
+// Duty changes can run on the LEDC fade engine instead of stepping. Nothing
+// here blocks: completion is reported through a callback on the timer task,
+// so callbacks must stay short (post anything heavier to the command
+// worker). A new duty command of any kind supersedes a running fade
+// without calling its callback; a limiter clamp ends it early and does.
+typedef void (*load_fade_done_cb_t)(void *arg);
+
+// Returns true if a fade was started (done follows). False if the duty was
+// applied at once (0 ms, already there, or the fade engine refused): done is
+// not called then, the caller reports the new duty with its own reply.
+bool set_duty_fade(int percent, uint32_t duration_ms,
+                   load_fade_done_cb_t done, void *arg);
+
+// Profiles: a table of steps, each faded into and then held. The hold is
+// stretched to at least two sensor conversions so every step gets a fresh
+// reading. cb runs after each step's hold (timer task, same rules as the
+// fade callback); last is set on the final one.
+typedef struct {
+  uint8_t duty;
+  uint16_t fade_ms;
+  uint16_t hold_ms;
+} load_step_t;
+
+typedef void (*load_profile_cb_t)(int step, int duty, bool last);
+
+// Start a named profile ("ramp", "sweep"). ESP_ERR_NOT_FOUND if unknown.
+esp_err_t load_profile_start(const char *name, load_profile_cb_t cb);
+void load_profile_stop(void);
+bool load_profile_running(void);
+
+// ============== Local Power Limiter ==============
+// Optional per-node max power, pushed by the gateway ("lim:<mW>") and kept in
+// NVS. Runs on every sensor sample: above the limit the applied duty is cut
+// proportionally at once; below LOAD_LIMIT_RELEASE_PCT of it the ceiling is
+// raised again step by step until the requested duty is restored. Clamp
+// events are reported to the gateway as "LIMIT:..." on the telemetry group.
+#define LOAD_LIMIT_RELEASE_PCT 90
+#define LOAD_LIMIT_RELEASE_STEP 2  // % ceiling raised per sample
+#define LOAD_LIMIT_SETTLE_SAMPLES 1 // Skip samples averaged over the old duty
+#define LOAD_LIMIT_REPORT_MS 1000   // Min spacing between clamp reports
+
+// Restore the saved limit and hook the sampler. Call after pwm_init().
+void load_limit_init(void);
+
+// max_mw 0 disables the limiter
+void load_limit_set(uint32_t max_mw);
+
+// Duty last asked for by set_duty(); may exceed the applied duty when clamped
+int get_requested_duty(void);
+
+// "lim" command: "" reports, "<mW>" sets (0 = off). Returns response length.
+int load_limit_command(const char *args, char *resp, size_t resp_size);
+
 #endif // LOAD_CONTROL_H
@@ -16,6 +16,13 @@
 #include "nvs_store.h"
 #include "command.h"
 #include "gatt_service.h"
+#include "mesh_tx.h"
+#include "power_ctrl.h"
+#include "cmd_worker.h"
+#include "history.h"
+#include "sensor_stats.h"
+#include "bench.h"
+#include "gw_sync.h"
 
 #define TAG "MAIN"
 
@@ -45,15 +52,33 @@ void app_main(void) {
   ble_mesh_get_dev_uuid(dev_uuid);
 
   sensor_init();
+  sensor_sampler_start();
   pwm_init();
+  load_limit_init();
+  sensor_stats_init();
 
   // Register GATT services BEFORE mesh init (mesh locks GATT table)
   err = gatt_register_services();
   if (err) { ESP_LOGE(TAG, "GATT register failed"); return; }
 
+  err = mesh_tx_init();
+  if (err) { ESP_LOGE(TAG, "Mesh TX init failed"); return; }
+
+  err = cmd_worker_init();
+  if (err) { ESP_LOGE(TAG, "Command worker init failed"); return; }
+
+  err = bench_init();
+  if (err) { ESP_LOGE(TAG, "Benchmark init failed"); return; }
+
   err = ble_mesh_init();
   if (err) { ESP_LOGE(TAG, "Mesh init failed"); return; }
 
+  power_ctrl_init();
+  history_init();
+
+  err = gw_sync_init();
+  if (err) { ESP_LOGE(TAG, "Gateway sync init failed"); return; }
+
   // Start GATT advertising AFTER mesh init
   gatt_start_advertising();
 
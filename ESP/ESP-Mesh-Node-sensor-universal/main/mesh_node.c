@@ -1,9 +1,20 @@
 #include "mesh_node.h"
 #include "nvs_store.h"
 #include "command.h"
+#include "sensor.h"
 #include "load_control.h"
 #include "gatt_service.h"
 #include "node_tracker.h"
+#include "poll_aggregator.h"
+#include "mesh_tx.h"
+#include "telemetry_pub.h"
+#include "monitor.h"
+#include "power_ctrl.h"
+#include "cmd_worker.h"
+#include "perf.h"
+#include "bench.h"
+#include "gw_sync.h"
+#include "node_list.h"
 #include "esp_log.h"
 #include "esp_ble_mesh_common_api.h"
 #include "esp_ble_mesh_config_model_api.h"
@@ -12,6 +23,7 @@
 #include "esp_ble_mesh_provisioning_api.h"
 #include "ble_mesh_example_init.h"
 #include <inttypes.h>
+#include <stdlib.h>
 #include <string.h>
 
 static const char *TAG = "MESH_NODE";
@@ -35,26 +47,32 @@ uint16_t cached_app_idx = 0xFFFF;
 
 // Vendor client state
 bool vnd_bound = false;
-bool vnd_send_busy = false;
-uint16_t vnd_send_target_addr = 0x0000;
-static TickType_t vnd_send_start_tick = 0;
 
-// Monitor mode state (shared with monitor.c and command_parser.c)
-uint16_t monitor_target_addr = 0;
-bool monitor_waiting_response = false;
+// What a pre-binary node answers to "rb" (see process_command)
+#define READ_BINARY_REJECT "ERR:UNKNOWN:rb"
+#define ZONES_REPLY "ZONES:"
 
 // ============== Mesh Models ==============
 static esp_ble_mesh_client_t onoff_client;
 
-// --- Vendor SERVER model: receives commands from mesh ---
+// --- Vendor SERVER model: receives commands from mesh, publishes readings ---
 static esp_ble_mesh_model_op_t vnd_srv_op[] = {
     ESP_BLE_MESH_MODEL_OP(VND_OP_SEND, 1),
+    ESP_BLE_MESH_MODEL_OP(VND_OP_DUTY_VEC, sizeof(vnd_duty_entry_t)),
+    ESP_BLE_MESH_MODEL_OP(VND_OP_GW_SYNC, sizeof(gw_sync_hdr_t)),
+#if CONFIG_MESH_BENCHMARK
+    ESP_BLE_MESH_MODEL_OP(VND_OP_PING, sizeof(vnd_ping_t)),
+#endif
     ESP_BLE_MESH_MODEL_OP_END,
 };
 
 // --- Vendor CLIENT model: sends commands TO other mesh nodes ---
 static const esp_ble_mesh_client_op_pair_t vnd_op_pair[] = {
     {VND_OP_SEND, VND_OP_STATUS},
+    {VND_OP_NODE_LIST_GET, VND_OP_NODE_LIST},
+#if CONFIG_MESH_BENCHMARK
+    {VND_OP_PING, VND_OP_PONG},
+#endif
 };
 
 static esp_ble_mesh_client_t vendor_client = {
@@ -64,6 +82,10 @@ static esp_ble_mesh_client_t vendor_client = {
 
 static esp_ble_mesh_model_op_t vnd_cli_op[] = {
     ESP_BLE_MESH_MODEL_OP(VND_OP_STATUS, 1),
+    ESP_BLE_MESH_MODEL_OP(VND_OP_NODE_LIST, sizeof(node_list_hdr_t)),
+#if CONFIG_MESH_BENCHMARK
+    ESP_BLE_MESH_MODEL_OP(VND_OP_PONG, sizeof(vnd_pong_t)),
+#endif
     ESP_BLE_MESH_MODEL_OP_END,
 };
 
@@ -87,6 +109,8 @@ static esp_ble_mesh_cfg_srv_t config_server = {
 
 ESP_BLE_MESH_MODEL_PUB_DEFINE(onoff_cli_pub, 2 + 1, ROLE_NODE);
 ESP_BLE_MESH_MODEL_PUB_DEFINE(onoff_srv_pub, 2 + 3, ROLE_NODE);
+// Opcode (3) + telemetry frame - stays a single unsegmented PDU
+ESP_BLE_MESH_MODEL_PUB_DEFINE(vnd_srv_pub, 3 + TELEMETRY_FRAME_LEN, ROLE_NODE);
 
 static esp_ble_mesh_gen_onoff_srv_t onoff_server = {
     .rsp_ctrl =
@@ -104,7 +128,7 @@ static esp_ble_mesh_model_t root_models[] = {
 
 // Both vendor models on the same element
 static esp_ble_mesh_model_t vnd_models[] = {
-    ESP_BLE_MESH_VENDOR_MODEL(CID_ESP, VND_MODEL_ID_SERVER, vnd_srv_op, NULL, NULL),
+    ESP_BLE_MESH_VENDOR_MODEL(CID_ESP, VND_MODEL_ID_SERVER, vnd_srv_op, &vnd_srv_pub, NULL),
     ESP_BLE_MESH_VENDOR_MODEL(CID_ESP, VND_MODEL_ID_CLIENT, vnd_cli_op, NULL, &vendor_client),
 };
 
@@ -141,8 +165,12 @@ esp_err_t send_mesh_onoff(uint16_t target_addr, uint8_t onoff) {
   common.ctx.net_idx = cached_net_idx;
   common.ctx.app_idx = cached_app_idx;
   common.ctx.addr = target_addr;
-  common.ctx.send_ttl = 3;
-  common.msg_timeout = 2000;
+  // Fallback defaults until the vendor path has measured this node
+  uint8_t ttl = 3;
+  int32_t timeout_ms = 2000;
+  node_link_params(target_addr, &ttl, &timeout_ms);
+  common.ctx.send_ttl = ttl;
+  common.msg_timeout = timeout_ms;
 
   set.onoff_set.op_en = false;
   set.onoff_set.onoff = onoff;
@@ -152,50 +180,52 @@ esp_err_t send_mesh_onoff(uint16_t target_addr, uint8_t onoff) {
 }
 
 // ============== Send Vendor Command ==============
+// Queue for the mesh TX task - never blocks the caller
 esp_err_t send_vendor_command(uint16_t target_addr, const char *cmd,
                               uint16_t len) {
-  bool is_group = (target_addr == MESH_GROUP_ADDR);
-
-  // Skip busy-wait for group sends - multiple nodes respond asynchronously
-  if (!is_group) {
-    int wait_loops = 0;
-    while (vnd_send_busy && wait_loops < 50) {
-      TickType_t elapsed = xTaskGetTickCount() - vnd_send_start_tick;
-      if (elapsed > pdMS_TO_TICKS(VND_SEND_TIMEOUT_MS)) {
-        ESP_LOGW(TAG, "Send busy timeout (%lu ms), clearing flag",
-                 (unsigned long)(elapsed * portTICK_PERIOD_MS));
-        vnd_send_busy = false;
-        vnd_send_target_addr = 0x0000;
-        break;
-      }
-      vTaskDelay(pdMS_TO_TICKS(100));
-      wait_loops++;
-    }
+  mesh_tx_id_t id = mesh_tx_submit(target_addr, (const uint8_t *)cmd, len);
+  if (id == 0)
+    return ESP_ERR_NO_MEM;
+  ESP_LOGI(TAG, "Vendor SEND #%u queued for 0x%04x: %.*s", id, target_addr,
+           len, cmd);
+  return ESP_OK;
+}
+
+esp_err_t send_duty_vector(const vnd_duty_entry_t *entries, int count) {
+  if (count <= 0)
+    return ESP_ERR_INVALID_ARG;
+  // Sites past VND_DUTY_VEC_MAX nodes take one group message per chunk
+  for (int off = 0; off < count; off += VND_DUTY_VEC_MAX) {
+    int n = count - off;
+    if (n > VND_DUTY_VEC_MAX)
+      n = VND_DUTY_VEC_MAX;
+    mesh_tx_id_t id =
+        mesh_tx_submit_op(MESH_GROUP_ADDR, VND_OP_DUTY_VEC,
+                          (const uint8_t *)(entries + off), n * sizeof(*entries));
+    if (id == 0)
+      return ESP_ERR_NO_MEM;
+    ESP_LOGI(TAG, "Duty vector #%u queued: %d node(s)", id, n);
   }
+  return ESP_OK;
+}
 
+// Called by the mesh TX task only (one in flight per destination)
+esp_err_t vendor_client_send(uint16_t target_addr, uint32_t opcode,
+                             const uint8_t *msg, uint16_t len, bool need_rsp,
+                             uint8_t ttl, int32_t timeout_ms) {
   esp_ble_mesh_msg_ctx_t ctx = {0};
   ctx.net_idx = cached_net_idx;
   ctx.app_idx = cached_app_idx;
   ctx.addr = target_addr;
-  ctx.send_ttl = 7;
-
-  ESP_LOGI(TAG, "Vendor SEND to 0x%04x: %.*s", target_addr, len, cmd);
-
-  if (!is_group) {
-    vnd_send_busy = true;
-    vnd_send_target_addr = target_addr;
-    vnd_send_start_tick = xTaskGetTickCount();
-  }
+  ctx.send_ttl = ttl;
 
+  ESP_LOGD(TAG, "Vendor send to 0x%04x: ttl=%d, timeout=%ld ms", target_addr,
+           ttl, (long)timeout_ms);
   esp_err_t err = esp_ble_mesh_client_model_send_msg(
-      vendor_client.model, &ctx, VND_OP_SEND, len, (uint8_t *)cmd,
-      5000, true, ROLE_NODE);
+      vendor_client.model, &ctx, opcode, len, (uint8_t *)msg,
+      timeout_ms, need_rsp, ROLE_NODE);
   if (err != ESP_OK) {
     ESP_LOGE(TAG, "Vendor send_msg failed: %d", err);
-    if (!is_group) {
-      vnd_send_busy = false;
-      vnd_send_target_addr = 0x0000;
-    }
   }
   return err;
 }
@@ -403,6 +433,150 @@ static void generic_client_cb(esp_ble_mesh_generic_client_cb_event_t event,
 }
 
 // ============== Vendor Model Callback (Dual Role) ==============
+// CLIENT role: forward a STATUS reply to Pi 5 via GATT notify.
+// Binary frames go out as-is (they carry the node id), telemetry frames
+// may join the open group-READ batch instead; text
+// replies get the "NODE<id>:DATA:" header.
+static void forward_status_to_gatt(const esp_ble_mesh_msg_ctx_t *ctx,
+                                   const uint8_t *msg, uint16_t len,
+                                   bool matched) {
+  uint16_t src = ctx->addr;
+  int node_id = (src >= NODE_BASE_ADDR) ? (src - NODE_BASE_ADDR) : 0;
+  uint8_t tid;
+
+  // Binary frames echo the TID in byte 2; text replies carry the "\0<tid>"
+  // suffix
+  if (is_binary_frame(msg, len)) {
+    tid = msg[BINARY_FRAME_TID_OFFSET];
+  } else {
+    len = mesh_tx_strip_tid(msg, len, &tid);
+  }
+  // Published telemetry isn't a reply to anything we sent
+  if (ctx->recv_dst != MESH_TELEMETRY_ADDR)
+    mesh_tx_on_status(src, tid, matched, ctx->recv_ttl);
+  if (register_known_node(src))
+    send_vendor_command(src, "zones", 5); // Learn its zone membership
+
+  if (is_telemetry_frame(msg, len)) {
+    telemetry_frame_t frame;
+    memcpy(&frame, msg, sizeof(frame));
+    set_node_format(src, NODE_FMT_BINARY);
+    power_ctrl_on_reading(src, frame.duty,
+                          ina260_power_mw(frame.vbus_raw, frame.current_raw));
+    if (ctx->recv_dst == MESH_TELEMETRY_ADDR) {
+      frame.version = TELEMETRY_FRAME_PUB; // No poll asked for this one
+      gatt_notify_sensor_data((const char *)&frame, sizeof(frame));
+    } else if (!poll_agg_offer(src, msg, len)) {
+      gatt_notify_sensor_data((const char *)msg, len);
+    }
+  } else if (is_binary_frame(msg, len)) {
+    gatt_notify_sensor_data((const char *)msg, len);
+  } else if (len == strlen(READ_BINARY_REJECT) &&
+             memcmp(msg, READ_BINARY_REJECT, len) == 0) {
+    // Older firmware without "rb" - fall back to text reads for this node
+    set_node_format(src, NODE_FMT_TEXT);
+    send_vendor_command(src, "read", 4);
+  } else {
+    char hdr[16];
+    int hdr_len = snprintf(hdr, sizeof(hdr), "NODE%d:DATA:", node_id);
+    gatt_seg_t segs[] = {{hdr, hdr_len}, {msg, len}};
+    gatt_notify_segs(segs, 2);
+
+    // Duty replies / text reads: "D:50%,V:12.003V,I:250.00mA,P:3000.8mW"
+    if (len > 2 && msg[0] == 'D' && msg[1] == ':') {
+      char text[64];
+      int duty;
+      float power;
+      snprintf(text, sizeof(text), "%.*s", len, (const char *)msg);
+      if (sscanf(text, "D:%d%%,V:%*fV,I:%*fmA,P:%fmW", &duty, &power) == 2)
+        power_ctrl_on_reading(src, duty, (uint32_t)power);
+    } else if (len > strlen(ZONES_REPLY) &&
+               memcmp(msg, ZONES_REPLY, strlen(ZONES_REPLY)) == 0) {
+      // Zone membership: "ZONES:0x05"
+      char text[16];
+      snprintf(text, sizeof(text), "%.*s", len, (const char *)msg);
+      set_node_zones(src, strtoul(text + strlen(ZONES_REPLY), NULL, 16));
+    }
+  }
+
+  ESP_LOGI(TAG, "Vendor STATUS%s from 0x%04x (%d bytes, tid %u)",
+           matched ? "" : " (publish)", src, len, tid);
+
+  monitor_on_response(src);
+}
+
+esp_err_t vendor_server_reply(const esp_ble_mesh_msg_ctx_t *req_ctx,
+                              uint8_t tid, char *response, int resp_len,
+                              size_t resp_size) {
+  // Echo the request TID so the sender can match this reply
+  if (tid != MESH_TX_TID_NONE) {
+    if (is_binary_frame((uint8_t *)response, resp_len)) {
+      response[BINARY_FRAME_TID_OFFSET] = tid;
+    } else if (resp_len + MESH_TX_TID_SUFFIX_LEN <= (int)resp_size) {
+      response[resp_len++] = '\0';
+      response[resp_len++] = tid;
+    }
+  }
+
+  esp_err_t err = vendor_server_send(req_ctx, VND_OP_STATUS,
+                                     (uint8_t *)response, resp_len);
+  if (err) {
+    ESP_LOGE(TAG, "Vendor STATUS send failed: %d", err);
+  } else if (is_binary_frame((uint8_t *)response, resp_len)) {
+    ESP_LOGI(TAG, "Response -> 0x%04x: binary frame (%d bytes)",
+             req_ctx->addr, resp_len);
+  } else {
+    ESP_LOGI(TAG, "Response -> 0x%04x: %s", req_ctx->addr, response);
+  }
+  return err;
+}
+
+esp_err_t vendor_server_send(const esp_ble_mesh_msg_ctx_t *req_ctx,
+                             uint32_t opcode, const uint8_t *msg,
+                             uint16_t len) {
+  esp_ble_mesh_msg_ctx_t ctx = *req_ctx;
+  // When message arrived via group address, override recv_dst with unicast
+  if (ctx.recv_dst != node_state.addr) {
+    ctx.recv_dst = node_state.addr;
+  }
+  // Fixed reply TTL lets the client derive our hop count from recv_ttl
+  ctx.send_ttl = VND_RSP_TTL;
+  esp_err_t err = esp_ble_mesh_server_model_send_msg(&vnd_models[0], &ctx,
+                                                     opcode, len, (uint8_t *)msg);
+  if (err) {
+    perf_count(PERF_TX_ERRORS);
+    if (err == ESP_ERR_NO_MEM)
+      perf_count(PERF_TX_NOBUF);
+  }
+  return err;
+}
+
+uint8_t mesh_node_zones(void) {
+  const esp_ble_mesh_model_t *srv = &vnd_models[0];
+  uint8_t zones = 0;
+  for (int i = 0; i < sizeof(srv->groups) / sizeof(srv->groups[0]); i++) {
+    if (MESH_IS_ZONE_ADDR(srv->groups[i]))
+      zones |= 1 << (srv->groups[i] - MESH_ZONE_BASE_ADDR);
+  }
+  return zones;
+}
+
+esp_err_t vendor_server_report(const char *msg, uint16_t len) {
+  if (cached_app_idx == 0xFFFF)
+    return ESP_ERR_INVALID_STATE;
+  esp_ble_mesh_msg_ctx_t ctx = {
+      .net_idx = cached_net_idx,
+      .app_idx = cached_app_idx,
+      .addr = MESH_TELEMETRY_ADDR,
+      .send_ttl = VND_RSP_TTL,
+  };
+  esp_err_t err = esp_ble_mesh_server_model_send_msg(
+      &vnd_models[0], &ctx, VND_OP_STATUS, len, (uint8_t *)msg);
+  if (err)
+    ESP_LOGW(TAG, "Vendor report failed: %d", err);
+  return err;
+}
+
 // SERVER role: receives commands from mesh, processes locally, responds
 // CLIENT role: receives responses from other nodes, forwards to Pi 5 via GATT
 static void custom_model_cb(esp_ble_mesh_model_cb_event_t event,
@@ -422,7 +596,9 @@ static void custom_model_cb(esp_ble_mesh_model_cb_event_t event,
       }
 
       char cmd[64];
-      uint16_t len = param->model_operation.length;
+      uint8_t tid;
+      uint16_t len = mesh_tx_strip_tid(param->model_operation.msg,
+                                       param->model_operation.length, &tid);
       if (len >= sizeof(cmd))
         len = sizeof(cmd) - 1;
       memcpy(cmd, param->model_operation.msg, len);
@@ -431,81 +607,91 @@ static void custom_model_cb(esp_ble_mesh_model_cb_event_t event,
       ESP_LOGI(TAG, "Vendor SEND from 0x%04x: %s",
                src_addr, cmd);
 
-      char response[128];
-      int resp_len = process_command(cmd, response, sizeof(response));
-
-      esp_ble_mesh_msg_ctx_t ctx = *param->model_operation.ctx;
-      // When message arrived via group address, override recv_dst with unicast
-      if (ctx.recv_dst != node_state.addr) {
-        ctx.recv_dst = node_state.addr;
-      }
-      esp_err_t err = esp_ble_mesh_server_model_send_msg(
-          &vnd_models[0], &ctx, VND_OP_STATUS, resp_len, (uint8_t *)response);
-
-      if (err) {
-        ESP_LOGE(TAG, "Vendor STATUS send failed: %d", err);
-      } else {
-        ESP_LOGI(TAG, "Response -> 0x%04x: %s", ctx.addr, response);
+      // Run on the command worker - never block the mesh task
+      cmd_worker_submit_mesh(param->model_operation.ctx, cmd, tid);
+    } else if (param->model_operation.opcode == VND_OP_DUTY_VEC) {
+      // ---- SERVER role: pick our entry out of a group duty vector ----
+      uint16_t src_addr = param->model_operation.ctx->addr;
+      if (src_addr == node_state.addr)
+        break; // Sender already applied its own entry
+
+      const vnd_duty_entry_t *entries =
+          (const vnd_duty_entry_t *)param->model_operation.msg;
+      int count = param->model_operation.length / sizeof(*entries);
+      int self_id = node_state.addr - NODE_BASE_ADDR;
+      for (int i = 0; i < count; i++) {
+        if (entries[i].node_id != self_id)
+          continue;
+        char cmd[16];
+        snprintf(cmd, sizeof(cmd), "duty:%d", entries[i].duty);
+        ESP_LOGI(TAG, "Duty vector from 0x%04x: %s (%d entries)", src_addr,
+                 cmd, count);
+        // Tagged so the sender doesn't take it for a unicast reply
+        cmd_worker_submit_mesh(param->model_operation.ctx, cmd,
+                               MESH_TX_TID_GROUP);
+        break;
       }
+    } else if (param->model_operation.opcode == VND_OP_GW_SYNC) {
+      // ---- SERVER role: the active gateway's state ----
+      if (param->model_operation.ctx->addr != node_state.addr)
+        gw_sync_on_msg(param->model_operation.ctx, param->model_operation.msg,
+                       param->model_operation.length);
+#if CONFIG_MESH_BENCHMARK
+    } else if (param->model_operation.opcode == VND_OP_PING) {
+      // ---- SERVER role: answer at once, from the mesh task ----
+      bench_on_ping(param->model_operation.ctx, param->model_operation.msg,
+                    param->model_operation.length);
+    } else if (param->model_operation.opcode == VND_OP_PONG) {
+      // ---- CLIENT role: completes the PING's lane like a STATUS ----
+      mesh_tx_on_status(param->model_operation.ctx->addr, MESH_TX_TID_NONE,
+                        true, param->model_operation.ctx->recv_ttl);
+      bench_on_pong(param->model_operation.ctx, param->model_operation.msg,
+                    param->model_operation.length);
+#endif
+    } else if (param->model_operation.opcode == VND_OP_NODE_LIST) {
+      // ---- CLIENT role: the provisioner answered our NODE_LIST_GET ----
+      mesh_tx_on_status(param->model_operation.ctx->addr, MESH_TX_TID_NONE,
+                        true, param->model_operation.ctx->recv_ttl);
+      node_list_on_msg(param->model_operation.ctx, param->model_operation.msg,
+                       param->model_operation.length);
     } else if (param->model_operation.opcode == VND_OP_STATUS) {
       // ---- CLIENT role: received response from another node ----
-      // Forward to Pi 5 via GATT notify
-      char buf[SENSOR_DATA_MAX_LEN];
-      uint16_t len = param->model_operation.length;
-      uint16_t src = param->model_operation.ctx->addr;
-
-      if (len >= sizeof(buf))
-        len = sizeof(buf) - 1;
-      int node_id = (src >= NODE_BASE_ADDR) ? (src - NODE_BASE_ADDR) : 0;
-
-      if (src == vnd_send_target_addr || vnd_send_target_addr == 0x0000) {
-        vnd_send_busy = false;
-        vnd_send_target_addr = 0x0000;
-      }
-
-      register_known_node(src);
-
-      int hdr_len = snprintf(buf, sizeof(buf), "NODE%d:DATA:", node_id);
-      if (hdr_len + len < (int)sizeof(buf)) {
-        memcpy(buf + hdr_len, param->model_operation.msg, len);
-        buf[hdr_len + len] = '\0';
-        gatt_notify_sensor_data(buf, hdr_len + len);
-      }
-
-      ESP_LOGI(TAG, "Vendor STATUS from 0x%04x (%d bytes)", src, len);
-
-      if (monitor_target_addr != 0) {
-        monitor_waiting_response = false;
-      }
+      forward_status_to_gatt(param->model_operation.ctx,
+                             param->model_operation.msg,
+                             param->model_operation.length, true);
     }
     break;
 
   case ESP_BLE_MESH_MODEL_SEND_COMP_EVT:
+    if (param->model_send_comp.model == vendor_client.model) {
+      mesh_tx_on_send_done(param->model_send_comp.ctx->addr,
+                           param->model_send_comp.err_code);
+    }
     if (param->model_send_comp.err_code) {
       ESP_LOGE(TAG, "Vendor send COMP err=%d", param->model_send_comp.err_code);
-      vnd_send_busy = false;
-      vnd_send_target_addr = 0x0000;
-      gatt_notify_sensor_data("ERROR:MESH_SEND_FAIL", 20);
+      // Only commands can be something the Pi waits on (not our replies,
+      // heartbeats or pings), and only outside monitor mode, as for timeouts
+      uint32_t op = param->model_send_comp.opcode;
+      if (param->model_send_comp.model == vendor_client.model &&
+          (op == VND_OP_SEND || op == VND_OP_DUTY_VEC) && !monitor_active())
+        gatt_notify_sensor_data("ERROR:MESH_SEND_FAIL", 20);
     } else {
       ESP_LOGI(TAG, "Vendor send COMP OK");
     }
     break;
 
   case ESP_BLE_MESH_CLIENT_MODEL_SEND_TIMEOUT_EVT: {
-    uint16_t timeout_target = vnd_send_target_addr;
-    if (timeout_target == 0x0000 && !vnd_send_busy) {
-      ESP_LOGI(TAG, "Group send timeout (expected, responses already received)");
-      break;
-    }
+    uint16_t timeout_target = param->client_send_timeout.ctx->addr;
+    mesh_tx_on_timeout(timeout_target);
     ESP_LOGW(TAG, "Vendor message timeout (target was 0x%04x)", timeout_target);
+    if (timeout_target == NODE_LIST_PROV_ADDR)
+      break; // No provisioner running - nothing the Pi is waiting for
     if (timeout_target > NODE_BASE_ADDR + known_node_count) {
       discovery_complete = true;
       ESP_LOGI(TAG, "Discovery complete (no node at 0x%04x)", timeout_target);
     }
-    vnd_send_busy = false;
-    vnd_send_target_addr = 0x0000;
-    monitor_waiting_response = false;
-    if (monitor_target_addr == 0) {
+    monitor_on_timeout(timeout_target);
+    if (!monitor_active()) {
       gatt_notify_sensor_data("ERROR:MESH_TIMEOUT", 18);
     }
     break;
@@ -513,33 +699,20 @@ static void custom_model_cb(esp_ble_mesh_model_cb_event_t event,
 
   case ESP_BLE_MESH_CLIENT_MODEL_RECV_PUBLISH_MSG_EVT:
     if (param->client_recv_publish_msg.opcode == VND_OP_STATUS) {
-      char buf[SENSOR_DATA_MAX_LEN];
-      uint16_t len = param->client_recv_publish_msg.length;
-      uint16_t src = param->client_recv_publish_msg.ctx->addr;
-
-      if (len >= sizeof(buf))
-        len = sizeof(buf) - 1;
-      int node_id = (src >= NODE_BASE_ADDR) ? (src - NODE_BASE_ADDR) : 0;
-
-      if (src == vnd_send_target_addr || vnd_send_target_addr == 0x0000) {
-        vnd_send_busy = false;
-        vnd_send_target_addr = 0x0000;
-      }
-
-      register_known_node(src);
-
-      int hdr_len = snprintf(buf, sizeof(buf), "NODE%d:DATA:", node_id);
-      if (hdr_len + len < (int)sizeof(buf)) {
-        memcpy(buf + hdr_len, param->client_recv_publish_msg.msg, len);
-        buf[hdr_len + len] = '\0';
-        gatt_notify_sensor_data(buf, hdr_len + len);
-      }
-
-      ESP_LOGI(TAG, "Vendor STATUS (publish) from 0x%04x (%d bytes)", src, len);
+      forward_status_to_gatt(param->client_recv_publish_msg.ctx,
+                             param->client_recv_publish_msg.msg,
+                             param->client_recv_publish_msg.length, false);
+    } else if (param->client_recv_publish_msg.opcode == VND_OP_NODE_LIST) {
+      // Pushed by the provisioner, unicast or as a delta to telemetry
+      node_list_on_msg(param->client_recv_publish_msg.ctx,
+                       param->client_recv_publish_msg.msg,
+                       param->client_recv_publish_msg.length);
+    }
+    break;
 
-      if (monitor_target_addr != 0) {
-        monitor_waiting_response = false;
-      }
+  case ESP_BLE_MESH_MODEL_PUBLISH_UPDATE_EVT:
+    if (param->model_publish_update.model == &vnd_models[0]) {
+      telemetry_pub_update(param->model_publish_update.model);
     }
     break;
 
@@ -16,8 +16,35 @@
 // Vendor opcodes
 #define VND_OP_SEND   ESP_BLE_MESH_MODEL_OP_3(0x00, CID_ESP)
 #define VND_OP_STATUS ESP_BLE_MESH_MODEL_OP_3(0x01, CID_ESP)
+// Per-node duties in one group message: n * vnd_duty_entry_t. Each server
+// applies its own entry (if any) and replies STATUS like for "duty:<n>".
+#define VND_OP_DUTY_VEC ESP_BLE_MESH_MODEL_OP_3(0x02, CID_ESP)
+#define VND_DUTY_VEC_MAX 16
+// Benchmark echo (CONFIG_MESH_BENCHMARK, see bench.h): vnd_ping_t + padding,
+// answered with vnd_pong_t + the same padding
+#define VND_OP_PING ESP_BLE_MESH_MODEL_OP_3(0x03, CID_ESP)
+#define VND_OP_PONG ESP_BLE_MESH_MODEL_OP_3(0x04, CID_ESP)
+// Active gateway state / heartbeat to MESH_GROUP_ADDR (gw_sync.h)
+#define VND_OP_GW_SYNC ESP_BLE_MESH_MODEL_OP_3(0x05, CID_ESP)
+// Provisioner's node list, full or delta, and the gateway's request for
+// it (node_list.h)
+#define VND_OP_NODE_LIST ESP_BLE_MESH_MODEL_OP_3(0x06, CID_ESP)
+#define VND_OP_NODE_LIST_GET ESP_BLE_MESH_MODEL_OP_3(0x07, CID_ESP)
+
+typedef struct {
+  uint8_t node_id; // unicast - NODE_BASE_ADDR
+  uint8_t duty;    // 0-100
+} __attribute__((packed)) vnd_duty_entry_t;
 
 #define MESH_GROUP_ADDR 0xC000
+#define MESH_TELEMETRY_ADDR 0xC001 // Vendor servers publish readings here
+// Zone groups, one per bus segment ("Z<n>:" targets). The provisioner
+// subscribes vendor servers to their zones on top of MESH_GROUP_ADDR.
+#define MESH_ZONE_BASE_ADDR 0xC100
+#define MESH_MAX_ZONES 8
+#define MESH_ZONE_ADDR(z) (MESH_ZONE_BASE_ADDR + (z))
+#define MESH_IS_ZONE_ADDR(a)                                                   \
+  ((a) >= MESH_ZONE_BASE_ADDR && (a) < MESH_ZONE_BASE_ADDR + MESH_MAX_ZONES)
 #define VND_SEND_TIMEOUT_MS 5000
 
 // Mesh node state - persisted to NVS
@@ -38,18 +65,43 @@ extern uint8_t dev_uuid[16];
 
 // Vendor client state (used by command_parser, monitor, etc.)
 extern bool vnd_bound;
-extern bool vnd_send_busy;
-extern uint16_t vnd_send_target_addr;
-extern uint16_t monitor_target_addr;
-extern bool monitor_waiting_response;
 
 // Initialize BLE Mesh stack, register callbacks, enable provisioning
 esp_err_t ble_mesh_init(void);
 
+// Send our server's VND_OP_STATUS reply for a request received with req_ctx,
+// echoing tid (response needs MESH_TX_TID_SUFFIX_LEN spare bytes for text).
+esp_err_t vendor_server_reply(const esp_ble_mesh_msg_ctx_t *req_ctx,
+                              uint8_t tid, char *response, int resp_len,
+                              size_t resp_size);
+
+// Send msg with opcode from our server to the source of req_ctx (reply TTL
+// VND_RSP_TTL, unicast source even if req_ctx arrived on a group)
+esp_err_t vendor_server_send(const esp_ble_mesh_msg_ctx_t *req_ctx,
+                             uint32_t opcode, const uint8_t *msg, uint16_t len);
+
+// Unsolicited vendor STATUS from our server to MESH_TELEMETRY_ADDR (events
+// such as limiter clamps). The gateway forwards it like any other reply.
+esp_err_t vendor_server_report(const char *msg, uint16_t len);
+
+// Zones our vendor server is subscribed to (bit z = MESH_ZONE_ADDR(z))
+uint8_t mesh_node_zones(void);
+
 // Send OnOff command to a mesh node (fallback path)
 esp_err_t send_mesh_onoff(uint16_t target_addr, uint8_t onoff);
 
-// Send vendor command to a mesh node or group
+// Queue vendor command to a mesh node or group (see mesh_tx.h). Returns
+// immediately; ESP_ERR_NO_MEM if the TX queue is full.
 esp_err_t send_vendor_command(uint16_t target_addr, const char *cmd, uint16_t len);
 
+// Queue VND_OP_DUTY_VEC group messages (VND_DUTY_VEC_MAX entries each).
+// Entries for this node are not applied here - callers set their own duty
+// directly.
+esp_err_t send_duty_vector(const vnd_duty_entry_t *entries, int count);
+
+// Raw vendor client send, used by the mesh TX task
+esp_err_t vendor_client_send(uint16_t target_addr, uint32_t opcode,
+                             const uint8_t *msg, uint16_t len, bool need_rsp,
+                             uint8_t ttl, int32_t timeout_ms);
+
 #endif // MESH_NODE_H
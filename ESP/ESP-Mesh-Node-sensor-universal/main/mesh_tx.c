@@ -0,0 +1,422 @@
+#include "mesh_tx.h"
+#include "mesh_node.h"
+#include "node_tracker.h"
+#include "gatt_service.h"
+#include "perf.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#define TAG "MESH_TX"
+
+// Submits are capped at MESH_TX_MAX_PENDING (see accepted). Completions get
+// their own queue: each in-flight lane posts at most a send-done and a
+// status or timeout before the task drains it.
+#define MESH_TX_QUEUE_LEN MESH_TX_MAX_PENDING
+#define MESH_TX_DONE_QUEUE_LEN (2 * LANE_COUNT)
+// Per-entry deadline = client timeout + this guard. Normally the stack's own
+// timeout fires first; this covers replies the stack paired with the wrong
+// request (no timeout follows)
+#define MESH_TX_DEADLINE_GUARD_MS 500
+
+// Lanes: one per node address, one for the group, one for anything else
+#define LANE_GROUP MAX_NODES
+#define LANE_OTHER (MAX_NODES + 1)
+#define LANE_COUNT (MAX_NODES + 2)
+
+typedef enum {
+  TX_EVT_STATUS,
+  TX_EVT_TIMEOUT,
+  TX_EVT_SEND_DONE,
+} tx_evt_type_t;
+
+typedef struct {
+  uint16_t addr;
+  mesh_tx_id_t id;
+  uint32_t opcode;
+  uint16_t len;
+  uint8_t payload[MESH_TX_MAX_PAYLOAD];
+} tx_submit_t;
+
+// Completion from the mesh stack's callbacks (no payload)
+typedef struct {
+  uint8_t type; // tx_evt_type_t
+  uint16_t addr;
+  int err_code;
+  uint8_t tid;
+  bool matched;
+  uint8_t recv_ttl;
+} tx_evt_t;
+
+typedef struct {
+  mesh_tx_id_t id; // 0 = free
+  uint16_t dst;
+  uint32_t opcode;
+  uint16_t len;
+  uint8_t payload[MESH_TX_MAX_PAYLOAD];
+} tx_pending_t;
+
+typedef struct {
+  mesh_tx_id_t id; // 0 = idle
+  uint16_t dst;
+  uint8_t tid;      // TID of the in-flight request
+  uint8_t prev_tid; // TID of the request before it (late replies carry this)
+  TickType_t start;
+  TickType_t deadline;
+  int64_t start_us; // esp_timer time of the send, for the RTT histogram
+} tx_lane_t;
+
+static QueueHandle_t tx_queue = NULL;   // tx_submit_t
+static QueueHandle_t done_queue = NULL; // tx_evt_t
+static TaskHandle_t tx_task = NULL;     // Notified after every post
+static uint32_t done_drops = 0;         // Completions lost to a full queue
+
+// Owned by mesh_tx_task only
+static tx_pending_t pending[MESH_TX_MAX_PENDING];
+static int pending_count = 0;
+static tx_lane_t lanes[LANE_COUNT];
+
+// Accepted by mesh_tx_submit_op() and not yet handed to the stack (in the
+// queue or pending[]). Claimed before posting, released on dispatch.
+static uint32_t accepted = 0;
+
+// Published by the task for mesh_tx_is_idle(): bit set = lane queued/in flight
+#define LANE_MASK_WORDS ((LANE_COUNT + 31) / 32)
+static volatile uint32_t lane_busy_mask[LANE_MASK_WORDS] = {0};
+
+static bool is_group_addr(uint16_t addr) {
+  return addr == MESH_GROUP_ADDR || MESH_IS_ZONE_ADDR(addr);
+}
+
+// ALL and zone sends share one lane, so group sends stay in order
+static int lane_for(uint16_t addr) {
+  if (is_group_addr(addr))
+    return LANE_GROUP;
+  int id = node_id_of(addr);
+  return id >= 0 ? id : LANE_OTHER;
+}
+
+static void lane_release(int lane, const char *why) {
+  if (lanes[lane].id == 0)
+    return;
+  ESP_LOGD(TAG, "#%u to 0x%04x done (%s, %lu ms)", lanes[lane].id,
+           lanes[lane].dst, why,
+           (unsigned long)((xTaskGetTickCount() - lanes[lane].start) *
+                           portTICK_PERIOD_MS));
+  lanes[lane].id = 0;
+}
+
+static uint8_t next_tid(void) {
+  static uint8_t tid = MESH_TX_TID_NONE;
+  do {
+    ++tid;
+  } while (tid == MESH_TX_TID_NONE || tid == MESH_TX_TID_GROUP);
+  return tid;
+}
+
+// Send every pending entry whose lane is idle, oldest first. Entries for a
+// busy lane keep their place, so per-destination order is preserved.
+static void dispatch_pending(void) {
+  int kept = 0;
+  for (int i = 0; i < pending_count; i++) {
+    tx_pending_t *p = &pending[i];
+    int lane = lane_for(p->dst);
+
+    if (lanes[lane].id != 0) {
+      if (kept != i)
+        pending[kept] = *p;
+      kept++;
+      continue;
+    }
+
+    // Group replies aren't tracked: group SENDs carry MESH_TX_TID_GROUP so
+    // their replies can be told apart from a unicast request's
+    bool is_group = is_group_addr(p->dst);
+    uint8_t wire[MESH_TX_MAX_PAYLOAD + MESH_TX_TID_SUFFIX_LEN];
+    uint16_t wire_len = p->len;
+    uint8_t tid = MESH_TX_TID_NONE;
+    uint8_t ttl = VND_RSP_TTL;
+    int32_t timeout_ms = VND_SEND_TIMEOUT_MS;
+    node_link_params(p->dst, &ttl, &timeout_ms);
+    memcpy(wire, p->payload, p->len);
+    if (p->opcode == VND_OP_SEND) {
+      tid = is_group ? MESH_TX_TID_GROUP : next_tid();
+      wire[wire_len++] = '\0';
+      wire[wire_len++] = tid;
+    }
+
+    esp_err_t err = vendor_client_send(p->dst, p->opcode, wire, wire_len,
+                                       !is_group, ttl, timeout_ms);
+    if (err == ESP_OK) {
+      perf_count(PERF_TX_SENT);
+      lanes[lane].start_us = esp_timer_get_time();
+      lanes[lane].id = p->id;
+      lanes[lane].dst = p->dst;
+      lanes[lane].prev_tid = lanes[lane].tid;
+      lanes[lane].tid = tid;
+      lanes[lane].start = xTaskGetTickCount();
+      lanes[lane].deadline =
+          lanes[lane].start +
+          pdMS_TO_TICKS(timeout_ms + MESH_TX_DEADLINE_GUARD_MS);
+    } else {
+      perf_count(PERF_TX_ERRORS);
+      if (err == ESP_ERR_NO_MEM)
+        perf_count(PERF_TX_NOBUF);
+      ESP_LOGE(TAG, "#%u to 0x%04x send failed: %d", p->id, p->dst, err);
+    }
+    __atomic_sub_fetch(&accepted, 1, __ATOMIC_RELAXED);
+  }
+  pending_count = kept;
+}
+
+static void expire_stuck_lanes(void) {
+  TickType_t now = xTaskGetTickCount();
+  for (int i = 0; i < LANE_COUNT; i++) {
+    if (lanes[i].id != 0 && (int32_t)(now - lanes[i].deadline) >= 0) {
+      ESP_LOGW(TAG, "#%u to 0x%04x (tid %u) past deadline, releasing lane",
+               lanes[i].id, lanes[i].dst, lanes[i].tid);
+      lanes[i].id = 0;
+    }
+  }
+}
+
+static void publish_busy_mask(void) {
+  uint32_t mask[LANE_MASK_WORDS] = {0};
+  for (int i = 0; i < LANE_COUNT; i++) {
+    if (lanes[i].id != 0)
+      mask[i >> 5] |= 1u << (i & 31);
+  }
+  for (int i = 0; i < pending_count; i++) {
+    int lane = lane_for(pending[i].dst);
+    mask[lane >> 5] |= 1u << (lane & 31);
+  }
+  for (int i = 0; i < LANE_MASK_WORDS; i++)
+    lane_busy_mask[i] = mask[i];
+}
+
+// Tell the Pi the node's current estimate (HOPS 0 = unmeasured, defaults)
+static void report_link(uint16_t dst) {
+  node_link_t link = node_link_get(dst);
+  uint8_t ttl = VND_RSP_TTL;
+  int32_t timeout_ms = VND_SEND_TIMEOUT_MS;
+  node_link_params(dst, &ttl, &timeout_ms);
+
+  char buf[64];
+  int len = snprintf(buf, sizeof(buf), "LINK:NODE%d:RTT:%u:VAR:%u:HOPS:%u:TO:%ld",
+                     dst - NODE_BASE_ADDR, link.srtt_ms, link.rttvar_ms,
+                     link.samples ? link.relays + 1 : 0, (long)timeout_ms);
+  gatt_notify_sensor_data(buf, len);
+}
+
+// Feed the node's RTT / hop estimate from a completed request and tell the
+// Pi when it has moved noticeably
+static void sample_link(const tx_lane_t *l, uint8_t recv_ttl) {
+  uint32_t rtt_ms = (xTaskGetTickCount() - l->start) * portTICK_PERIOD_MS;
+  perf_record_rtt(l->dst, (uint32_t)(esp_timer_get_time() - l->start_us));
+  if (node_link_sample(l->dst, rtt_ms, recv_ttl))
+    report_link(l->dst);
+}
+
+// No reply to the lane's request: back the node's estimate off
+static void timeout_link(int lane) {
+  if (lane < MAX_NODES && node_link_timeout(lanes[lane].dst))
+    report_link(lanes[lane].dst);
+}
+
+static void handle_submit(const tx_submit_t *sub) {
+  if (pending_count >= MESH_TX_MAX_PENDING) {
+    // Can't happen while submit claims a slot first (see accepted)
+    ESP_LOGE(TAG, "Pending full, dropping #%u to 0x%04x", sub->id, sub->addr);
+    __atomic_sub_fetch(&accepted, 1, __ATOMIC_RELAXED);
+    return;
+  }
+  pending[pending_count].id = sub->id;
+  pending[pending_count].dst = sub->addr;
+  pending[pending_count].opcode = sub->opcode;
+  pending[pending_count].len = sub->len;
+  memcpy(pending[pending_count].payload, sub->payload, sub->len);
+  pending_count++;
+}
+
+static void handle_event(const tx_evt_t *evt) {
+  int lane = lane_for(evt->addr);
+
+  switch (evt->type) {
+  case TX_EVT_STATUS: {
+    // Group replies arrive from unicast sources - only unicast lanes complete
+    tx_lane_t *l = &lanes[lane];
+    if (lane == LANE_GROUP || l->id == 0 || l->dst != evt->addr)
+      break;
+    if (evt->tid == MESH_TX_TID_GROUP)
+      break; // Answers a group command, not this lane's request
+    if (evt->tid != MESH_TX_TID_NONE && evt->tid == l->tid) {
+      sample_link(l, evt->recv_ttl);
+      lane_release(lane, "status");
+    } else if (evt->matched && (evt->tid == MESH_TX_TID_NONE ||
+                                evt->tid != l->prev_tid)) {
+      // Paired by the client model; no TID means an older node
+      if (lane != LANE_OTHER)
+        sample_link(l, evt->recv_ttl);
+      lane_release(lane, "status (untagged)");
+    } else {
+      ESP_LOGW(TAG, "Stale reply from 0x%04x (tid %u, waiting for %u)",
+               evt->addr, evt->tid, l->tid);
+    }
+    break;
+  }
+
+  case TX_EVT_TIMEOUT:
+    perf_count(PERF_TX_TIMEOUTS);
+    if (lanes[lane].id != 0 && lanes[lane].dst == evt->addr)
+      timeout_link(lane);
+    lane_release(lane, "timeout");
+    break;
+
+  case TX_EVT_SEND_DONE:
+    // Unicast waits for STATUS; group (no response expected) and failed
+    // sends are finished once the stack has sent them
+    if (evt->err_code != 0) {
+      perf_count(PERF_TX_ERRORS);
+      // No advertising buffer / segmented TX context free
+      if (evt->err_code == -ENOBUFS || evt->err_code == -ENOMEM ||
+          evt->err_code == -EBUSY)
+        perf_count(PERF_TX_NOBUF);
+    }
+    if (evt->err_code != 0 || lane == LANE_GROUP)
+      lane_release(lane, evt->err_code ? "send error" : "sent");
+    break;
+  }
+}
+
+static void mesh_tx_task(void *pvParameters) {
+  tx_evt_t evt;
+  tx_submit_t sub;
+
+  while (1) {
+    // Every post notifies; drain both queues before dispatching
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(500));
+    while (xQueueReceive(done_queue, &evt, 0) == pdTRUE)
+      handle_event(&evt);
+    while (xQueueReceive(tx_queue, &sub, 0) == pdTRUE)
+      handle_submit(&sub);
+    expire_stuck_lanes();
+    dispatch_pending();
+    publish_busy_mask();
+  }
+}
+
+esp_err_t mesh_tx_init(void) {
+  tx_queue = xQueueCreate(MESH_TX_QUEUE_LEN, sizeof(tx_submit_t));
+  done_queue = xQueueCreate(MESH_TX_DONE_QUEUE_LEN, sizeof(tx_evt_t));
+  if (tx_queue == NULL || done_queue == NULL) {
+    ESP_LOGE(TAG, "Queue create failed");
+    return ESP_ERR_NO_MEM;
+  }
+  if (xTaskCreate(mesh_tx_task, "mesh_tx", 3072, NULL, 5, &tx_task) != pdPASS) {
+    ESP_LOGE(TAG, "Task create failed");
+    return ESP_ERR_NO_MEM;
+  }
+  return ESP_OK;
+}
+
+static bool post_submit(const tx_submit_t *sub) {
+  if (tx_queue == NULL || xQueueSend(tx_queue, sub, 0) != pdTRUE)
+    return false;
+  xTaskNotifyGive(tx_task);
+  return true;
+}
+
+// A lost completion leaves its lane busy until the deadline guard
+static void post_event(const tx_evt_t *evt) {
+  if (done_queue != NULL && xQueueSend(done_queue, evt, 0) == pdTRUE) {
+    xTaskNotifyGive(tx_task);
+    return;
+  }
+  uint32_t drops = __atomic_add_fetch(&done_drops, 1, __ATOMIC_RELAXED);
+  ESP_LOGW(TAG, "Event queue full, lost completion %u from 0x%04x (%lu lost)",
+           evt->type, evt->addr, (unsigned long)drops);
+}
+
+mesh_tx_id_t mesh_tx_submit(uint16_t dst, const uint8_t *payload,
+                            uint16_t len) {
+  return mesh_tx_submit_op(dst, VND_OP_SEND, payload, len);
+}
+
+mesh_tx_id_t mesh_tx_submit_op(uint16_t dst, uint32_t opcode,
+                               const uint8_t *payload, uint16_t len) {
+  static uint16_t next_id = 0;
+
+  if (len > MESH_TX_MAX_PAYLOAD)
+    return 0;
+
+  tx_submit_t evt = {
+      .addr = dst,
+      .opcode = opcode,
+      .len = len,
+  };
+  // Several tasks submit - take the id atomically, skipping 0
+  do {
+    evt.id = __atomic_add_fetch(&next_id, 1, __ATOMIC_RELAXED);
+  } while (evt.id == 0);
+  memcpy(evt.payload, payload, len);
+
+  // Claim a pending slot first: the task must never have to drop one
+  if (__atomic_add_fetch(&accepted, 1, __ATOMIC_RELAXED) >
+      MESH_TX_MAX_PENDING) {
+    __atomic_sub_fetch(&accepted, 1, __ATOMIC_RELAXED);
+    ESP_LOGW(TAG, "Pending full, refusing send to 0x%04x", dst);
+    return 0;
+  }
+  if (!post_submit(&evt)) {
+    __atomic_sub_fetch(&accepted, 1, __ATOMIC_RELAXED);
+    ESP_LOGW(TAG, "Queue full, dropping send to 0x%04x", dst);
+    return 0;
+  }
+  // Mark busy now so a caller polling mesh_tx_is_idle() doesn't double-queue
+  int lane = lane_for(dst);
+  __atomic_or_fetch(&lane_busy_mask[lane >> 5], 1u << (lane & 31),
+                    __ATOMIC_RELAXED);
+  return evt.id;
+}
+
+bool mesh_tx_is_idle(uint16_t dst) {
+  int lane = lane_for(dst);
+  return (lane_busy_mask[lane >> 5] & (1u << (lane & 31))) == 0;
+}
+
+uint16_t mesh_tx_strip_tid(const uint8_t *msg, uint16_t len, uint8_t *tid) {
+  *tid = MESH_TX_TID_NONE;
+  if (len >= MESH_TX_TID_SUFFIX_LEN &&
+      msg[len - MESH_TX_TID_SUFFIX_LEN] == '\0' &&
+      memchr(msg, '\0', len - MESH_TX_TID_SUFFIX_LEN) == NULL) {
+    *tid = msg[len - 1];
+    return len - MESH_TX_TID_SUFFIX_LEN;
+  }
+  return len;
+}
+
+void mesh_tx_on_status(uint16_t src, uint8_t tid, bool matched,
+                       uint8_t recv_ttl) {
+  tx_evt_t evt = {.type = TX_EVT_STATUS,
+                  .addr = src,
+                  .tid = tid,
+                  .matched = matched,
+                  .recv_ttl = recv_ttl};
+  post_event(&evt);
+}
+
+void mesh_tx_on_timeout(uint16_t dst) {
+  tx_evt_t evt = {.type = TX_EVT_TIMEOUT, .addr = dst};
+  post_event(&evt);
+}
+
+void mesh_tx_on_send_done(uint16_t dst, int err_code) {
+  tx_evt_t evt = {.type = TX_EVT_SEND_DONE, .addr = dst, .err_code = err_code};
+  post_event(&evt);
+}
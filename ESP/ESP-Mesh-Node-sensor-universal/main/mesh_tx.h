@@ -0,0 +1,68 @@
+#ifndef MESH_TX_H
+#define MESH_TX_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+// ============== Vendor Command TX Queue ==============
+// All vendor client sends go through one TX task. Callers enqueue and return
+// immediately with a request id; the task keeps at most one message in flight
+// per destination (the mesh client rejects a second pending message to the
+// same address) and pipelines different destinations. In-flight entries are
+// completed by STATUS / timeout / send-failure events from custom_model_cb.
+//
+// Unicast sends carry a correlation TID after the command text:
+//   "<cmd>\0<tid>"
+// Older nodes stop at the NUL and never see it. Newer nodes echo it the same
+// way after a text reply, or in the tid byte of a binary frame, so
+// a late reply to an earlier request can't complete the current one.
+// Group commands (SEND to a group, duty vectors) carry MESH_TX_TID_GROUP:
+// their replies come from unicast sources but answer no unicast request,
+// so they must never complete the lane of a request in flight to that node.
+//
+// TTL and client timeout come from the per-node link estimate in
+// node_tracker.h once a node has answered at least once; timeouts back it
+// off (node_link_timeout()).
+
+#define MESH_TX_MAX_PAYLOAD 64 // Matches COMMAND_MAX_LEN
+// Room for one request per node at once (an ALL: fan-out, a controller
+// round of reads) plus a few of our own. Submissions past it are refused
+// up front, never dropped later.
+#define MESH_TX_MAX_PENDING (CONFIG_MESH_MAX_NODES + 8)
+#define MESH_TX_TID_NONE 0
+#define MESH_TX_TID_GROUP 0xFF // Reply to a group command (never allocated)
+#define MESH_TX_TID_SUFFIX_LEN 2 // NUL + tid
+
+typedef uint16_t mesh_tx_id_t; // 0 = not queued
+
+// Create the TX queue and task. Call once before ble_mesh_init().
+esp_err_t mesh_tx_init(void);
+
+// Queue a vendor SEND to dst. Returns the request id, or 0 if
+// MESH_TX_MAX_PENDING requests are already waiting or len is too large.
+mesh_tx_id_t mesh_tx_submit(uint16_t dst, const uint8_t *payload, uint16_t len);
+
+// Same, with another vendor opcode (sent as-is: only SEND carries a TID)
+mesh_tx_id_t mesh_tx_submit_op(uint16_t dst, uint32_t opcode,
+                               const uint8_t *payload, uint16_t len);
+
+// True if nothing is queued or in flight for dst
+bool mesh_tx_is_idle(uint16_t dst);
+
+// Split "<text>\0<tid>" into text length and TID. Returns the text length;
+// *tid is MESH_TX_TID_NONE if no suffix is present.
+uint16_t mesh_tx_strip_tid(const uint8_t *msg, uint16_t len, uint8_t *tid);
+
+// Completion hooks (called from mesh callbacks)
+// tid: echoed TID, or MESH_TX_TID_NONE. matched: the client model paired the
+// reply with its pending request (OPERATION_EVT) rather than treating it as a
+// publish.
+// recv_ttl feeds the per-node hop estimate (node_link_sample).
+void mesh_tx_on_status(uint16_t src, uint8_t tid, bool matched,
+                       uint8_t recv_ttl);
+void mesh_tx_on_timeout(uint16_t dst);
+void mesh_tx_on_send_done(uint16_t dst, int err_code);
+
+#endif /* MESH_TX_H */
@@ -1,42 +1,171 @@
 #include "monitor.h"
 #include "mesh_node.h"
+#include "node_tracker.h"
+#include "mesh_tx.h"
+#include "cmd_worker.h"
 
 #include "esp_log.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/timers.h"
+#include <string.h>
 
 #define TAG "MONITOR"
 
+// Extra time past the link timeout before we stop waiting on a lost reply
+#define MONITOR_WAIT_GUARD_MS 500
+
 static TimerHandle_t monitor_timer = NULL;
-#define MONITOR_INTERVAL_MS 1000
+static portMUX_TYPE monitor_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static bool active = false;
+static bool target_all = true; // Follow known_mask (grows with discovery)
+static node_mask_t target_mask;
+static TickType_t interval_ticks = 0;
+static TickType_t next_due[MAX_NODES]; // By node id
+static uint8_t slots[MAX_NODES];       // Node ids in the rotation
+static int slot_count = 0;
+static int next_slot = 0; // Round-robin cursor
+
+// One request on air at a time
+static uint16_t waiting_addr = 0;
+static TickType_t waiting_deadline = 0;
+
+// Rebuild the rotation from the target set; schedules live in next_due[]
+static void refresh_slots(void) {
+  int self = node_id_of(node_state.addr);
+  int n = 0;
+
+  for (int id = 0; id < MAX_NODES; id++) {
+    bool wanted = target_all
+                      ? (id == self || node_mask_test(&known_mask, id))
+                      : node_mask_test(&target_mask, id);
+    if (wanted)
+      slots[n++] = id;
+  }
+  if (next_slot >= n)
+    next_slot = 0;
+  slot_count = n;
+}
 
-// ============== Monitor Mode (gateway-side polling) ==============
 static void monitor_timer_cb(TimerHandle_t xTimer) {
-  // Guard: skip this tick if a command send is already in-flight.
-  // The timer runs on the FreeRTOS timer daemon task, while GATT commands
-  // run on the NimBLE host task - both can call send_vendor_command().
-  if (monitor_target_addr != 0 && vnd_bound && !monitor_waiting_response && !vnd_send_busy) {
-    monitor_waiting_response = true;
-    send_vendor_command(monitor_target_addr, "read", 4);
+  if (!vnd_bound)
+    return;
+
+  TickType_t now = xTaskGetTickCount();
+  uint16_t send_addr = 0;
+
+  taskENTER_CRITICAL(&monitor_lock);
+  if (!active) {
+    taskEXIT_CRITICAL(&monitor_lock);
+    return;
+  }
+  if (waiting_addr != 0 && (int32_t)(now - waiting_deadline) < 0) {
+    taskEXIT_CRITICAL(&monitor_lock);
+    return;
+  }
+  waiting_addr = 0;
+
+  if (target_all || slot_count == 0)
+    refresh_slots();
+
+  for (int k = 0; k < slot_count; k++) {
+    int i = (next_slot + k) % slot_count;
+    uint16_t addr = NODE_BASE_ADDR + slots[i];
+    if ((int32_t)(now - next_due[slots[i]]) < 0 || !mesh_tx_is_idle(addr))
+      continue;
+    next_due[slots[i]] = now + interval_ticks;
+    next_slot = (i + 1) % slot_count;
+    send_addr = addr;
+    break;
+  }
+
+  if (send_addr != 0 && send_addr != node_state.addr) {
+    uint8_t ttl;
+    int32_t timeout_ms = VND_SEND_TIMEOUT_MS;
+    node_link_params(send_addr, &ttl, &timeout_ms);
+    waiting_addr = send_addr;
+    waiting_deadline = now + pdMS_TO_TICKS(timeout_ms + MONITOR_WAIT_GUARD_MS);
+  }
+  taskEXIT_CRITICAL(&monitor_lock);
+
+  if (send_addr == 0)
+    return;
+  const char *read_cmd = node_read_cmd(send_addr);
+  if (send_addr == node_state.addr) {
+    // Our own reading never crosses the mesh. The sensor read and notify
+    // run on the worker, not on the timer daemon's small stack.
+    if (cmd_worker_submit_local(read_cmd) != ESP_OK) {
+      taskENTER_CRITICAL(&monitor_lock);
+      next_due[node_id_of(send_addr)] = now; // Try again next tick
+      taskEXIT_CRITICAL(&monitor_lock);
+    }
+  } else {
+    send_vendor_command(send_addr, read_cmd, strlen(read_cmd));
   }
 }
 
-void monitor_start(uint16_t target_addr) {
-  monitor_target_addr = target_addr;
+void monitor_start_set(const node_mask_t *node_mask, uint32_t interval_ms) {
+  if (interval_ms == 0)
+    interval_ms = MONITOR_INTERVAL_MS;
+  if (interval_ms < MONITOR_INTERVAL_MIN_MS)
+    interval_ms = MONITOR_INTERVAL_MIN_MS;
+
+  taskENTER_CRITICAL(&monitor_lock);
+  target_all = (node_mask == NULL);
+  if (node_mask)
+    target_mask = *node_mask;
+  interval_ticks = pdMS_TO_TICKS(interval_ms);
+  memset(next_due, 0, sizeof(next_due));
+  slot_count = 0;
+  next_slot = 0;
+  waiting_addr = 0;
+  active = true;
+  refresh_slots();
+  taskEXIT_CRITICAL(&monitor_lock);
+
   if (monitor_timer == NULL) {
-    monitor_timer = xTimerCreate("monitor", pdMS_TO_TICKS(MONITOR_INTERVAL_MS),
+    monitor_timer = xTimerCreate("monitor", pdMS_TO_TICKS(MONITOR_TICK_MS),
                                   pdTRUE, NULL, monitor_timer_cb);
   }
   xTimerStart(monitor_timer, 0);
-  ESP_LOGI(TAG, "Monitor started: polling 0x%04x every %d ms",
-           target_addr, MONITOR_INTERVAL_MS);
+  if (node_mask == NULL) {
+    ESP_LOGI(TAG, "Monitor started: all known nodes, every %lu ms each",
+             (unsigned long)interval_ms);
+  } else {
+    ESP_LOGI(TAG, "Monitor started: %d node(s), every %lu ms each",
+             slot_count, (unsigned long)interval_ms);
+  }
+}
+
+void monitor_start(uint16_t target_addr) {
+  node_mask_t mask = {0};
+  int id = node_id_of(target_addr);
+  if (id < 0) {
+    ESP_LOGW(TAG, "Monitor target 0x%04x out of range", target_addr);
+    return;
+  }
+  node_mask_set(&mask, id);
+  monitor_start_set(&mask, MONITOR_INTERVAL_MS);
 }
 
 void monitor_stop(void) {
   if (monitor_timer != NULL) {
     xTimerStop(monitor_timer, 0);
   }
-  monitor_target_addr = 0;
-  monitor_waiting_response = false;
+  taskENTER_CRITICAL(&monitor_lock);
+  active = false;
+  waiting_addr = 0;
+  taskEXIT_CRITICAL(&monitor_lock);
   ESP_LOGI(TAG, "Monitor stopped");
 }
+
+bool monitor_active(void) { return active; }
+
+void monitor_on_response(uint16_t src) {
+  taskENTER_CRITICAL(&monitor_lock);
+  if (waiting_addr == src)
+    waiting_addr = 0;
+  taskEXIT_CRITICAL(&monitor_lock);
+}
+
+void monitor_on_timeout(uint16_t dst) { monitor_on_response(dst); }
@@ -1,9 +1,30 @@
 #ifndef MONITOR_H
 #define MONITOR_H
 
+#include <stdbool.h>
 #include <stdint.h>
+#include "node_tracker.h"
 
+// ============== Monitor Scheduler ==============
+// Cycles READs round-robin through a target set, each target at most once
+// per interval. Only one monitor request is on air at a time (so relays
+// never carry two polls at once), and targets with a queued or in-flight
+// command are skipped until their lane is idle.
+#define MONITOR_INTERVAL_MS 1000 // Default per-target interval
+#define MONITOR_INTERVAL_MIN_MS 200
+#define MONITOR_TICK_MS 100
+
+// Monitor a single node (legacy "<id>:MONITOR")
 void monitor_start(uint16_t target_addr);
+
+// Monitor a set of node ids, or every known node (following discovery) when
+// node_mask is NULL. interval_ms 0 = MONITOR_INTERVAL_MS.
+void monitor_start_set(const node_mask_t *node_mask, uint32_t interval_ms);
 void monitor_stop(void);
+bool monitor_active(void);
+
+// Reply / timeout hooks from the vendor client - release the on-air slot
+void monitor_on_response(uint16_t src);
+void monitor_on_timeout(uint16_t dst);
 
 #endif /* MONITOR_H */
@@ -0,0 +1,143 @@
+#include "node_list.h"
+#include "gatt_service.h"
+#include "mesh_node.h"
+#include "mesh_tx.h"
+#include "node_tracker.h"
+
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "host/ble_hs.h"
+#include <stdio.h>
+#include <string.h>
+
+#define TAG "NODE_LIST"
+
+static bool authoritative = false; // A full list arrived
+static bool list_open = false;     // FIRST seen, LAST not yet
+static uint8_t list_seq;           // Next message index expected
+static int list_entries;           // Entries received so far
+static node_mask_t list_ids;       // Vendor servers named so far
+static bool list_gap = false;      // Last full list lost a message
+static TickType_t last_get = 0;
+static bool get_sent = false;
+
+// Ask the provisioner for its list (the reply goes to node_list_on_msg)
+static void request_list(void) {
+  TickType_t now = xTaskGetTickCount();
+  if (!vnd_bound || (get_sent && now - last_get <
+                                     pdMS_TO_TICKS(NODE_LIST_GET_INTERVAL_MS)))
+    return;
+  uint8_t version = NODE_LIST_V2;
+  if (mesh_tx_submit_op(NODE_LIST_PROV_ADDR, VND_OP_NODE_LIST_GET, &version,
+                        sizeof(version))) {
+    get_sent = true;
+    last_get = now;
+    ESP_LOGI(TAG, "Asked the provisioner for its node list");
+  }
+}
+
+static int format_view(char *resp, size_t resp_size) {
+  int len = snprintf(resp, resp_size, "NODES:%s:%d:%d:",
+                     authoritative ? "PROV" : "SCAN",
+                     node_id_of(node_state.addr), known_node_count);
+  // Hex mask, most significant word first without leading zero words
+  int w = NODE_MASK_WORDS - 1;
+  while (w > 0 && known_mask.w[w] == 0)
+    w--;
+  len += snprintf(resp + len, resp_size - len, "%lx",
+                  (unsigned long)known_mask.w[w]);
+  while (--w >= 0 && len < (int)resp_size)
+    len += snprintf(resp + len, resp_size - len, "%08lx",
+                    (unsigned long)known_mask.w[w]);
+  return len < (int)resp_size ? len : (int)resp_size - 1;
+}
+
+int node_list_command(char *resp, size_t resp_size) {
+  if (!authoritative || list_gap)
+    request_list();
+  return format_view(resp, resp_size);
+}
+
+static void notify_pi(void) {
+  if (gatt_conn_handle == BLE_HS_CONN_HANDLE_NONE)
+    return;
+  char buf[64];
+  int len = format_view(buf, sizeof(buf));
+  gatt_notify_sensor_data(buf, len);
+}
+
+void node_list_on_msg(const esp_ble_mesh_msg_ctx_t *ctx, const uint8_t *msg,
+                      uint16_t len) {
+  node_list_hdr_t hdr;
+  if (ctx->addr != NODE_LIST_PROV_ADDR || len < sizeof(hdr) ||
+      msg[0] != NODE_LIST_V2)
+    return;
+  memcpy(&hdr, msg, sizeof(hdr));
+  if (len < sizeof(hdr) + hdr.count * sizeof(node_list_entry_t))
+    return;
+
+  bool in_list = false;
+  if (hdr.flags & NODE_LIST_FLAG_FULL) {
+    if (hdr.flags & NODE_LIST_FLAG_FIRST) {
+      list_open = true;
+      list_seq = 0;
+      list_entries = 0;
+      memset(&list_ids, 0, sizeof(list_ids));
+    }
+    if (list_open && hdr.seq == list_seq) {
+      in_list = true;
+      list_seq++;
+      list_entries += hdr.count;
+    } else {
+      // Missed the FIRST or a message in between: this list can't count
+      ESP_LOGW(TAG, "Node list: got message %d, expected %d", hdr.seq,
+               list_open ? list_seq : 0);
+      list_open = false;
+      list_gap = true;
+      request_list();
+    }
+  }
+
+  bool added = false;
+  const uint8_t *p = msg + sizeof(hdr);
+  for (int i = 0; i < hdr.count; i++, p += sizeof(node_list_entry_t)) {
+    node_list_entry_t e;
+    memcpy(&e, p, sizeof(e));
+    if (!(e.models & NODE_LIST_MODEL_SRV))
+      continue; // Nothing to command there
+    int id = node_id_of(e.unicast);
+    if (in_list && id >= 0)
+      node_mask_set(&list_ids, id);
+    if (register_known_node(e.unicast)) // Ignores ourselves
+      added = true;
+    if (e.unicast != node_state.addr)
+      set_node_zones(e.unicast, e.zones);
+  }
+
+  bool full = false;
+  if (in_list && (hdr.flags & NODE_LIST_FLAG_LAST)) {
+    list_open = false;
+    if (list_entries == hdr.total) {
+      full = true;
+      authoritative = true;
+      list_gap = false;
+      int dropped = prune_known_nodes(&list_ids);
+      ESP_LOGI(TAG, "Node list from provisioner: %d node(s), %d dropped",
+               known_node_count, dropped);
+    } else {
+      ESP_LOGW(TAG, "Node list: %d of %d entries arrived", list_entries,
+               hdr.total);
+      list_gap = true;
+      request_list();
+    }
+  } else if (hdr.flags == 0 && added) {
+    ESP_LOGI(TAG, "Node list delta: %d entr%s", hdr.count,
+             hdr.count == 1 ? "y" : "ies");
+  }
+  // register_known_node() re-opens discovery; the list says there's no more
+  if (authoritative && !list_open)
+    discovery_complete = true;
+  if (full || (authoritative && added))
+    notify_pi();
+}
@@ -0,0 +1,70 @@
+#ifndef NODE_LIST_H
+#define NODE_LIST_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_ble_mesh_defs.h"
+
+// ============== Provisioner Node List ==============
+// The provisioner knows every node it configured (node_registry.c), so it
+// pushes that list to each gateway-capable node once the node is
+// configured, as VND_OP_NODE_LIST to its vendor client:
+//   [NODE_LIST_V2][flags][count][seq][total] + count * node_list_entry_t
+// A full list is split over several messages when it doesn't fit one. Each
+// carries NODE_LIST_FLAG_FULL, its index in seq and the entry count of the
+// whole list in total; the first also has NODE_LIST_FLAG_FIRST, the last
+// NODE_LIST_FLAG_LAST. A node that joins later, or whose zones change, goes
+// out as a one-entry delta (no flags, seq/total 0) to MESH_TELEMETRY_ADDR,
+// where every vendor client listens.
+//
+// Listed vendor servers are registered straight away. A full list only
+// counts once every message arrived in order and the entries add up to
+// total; then known nodes it doesn't name are dropped and discovery is
+// marked complete, so neither this node nor the Pi has to probe addresses
+// and wait out a timeout for each one that isn't there. A list with a gap
+// is asked for again (NODE_LIST_GET). Without a list
+// (older provisioner, or none running) discovery works as before.
+// Secondary elements (elem_num > 1) are never registered: only a node's
+// primary address takes commands.
+//
+// "ALL:NODES" asks for the current view:
+//   "NODES:<PROV|SCAN>:<self id>:<known>:<hex node mask>"
+// PROV once a full list arrived (also sent unprompted when the list
+// changes), SCAN while nodes are only learned from their replies. A SCAN
+// gateway also asks the provisioner for the list (VND_OP_NODE_LIST_GET,
+// at most every NODE_LIST_GET_INTERVAL_MS), e.g. after a reboot.
+#define NODE_LIST_V2 0x4D
+#define NODE_LIST_PROV_ADDR 0x0001 // Lists are only taken from the provisioner
+#define NODE_LIST_GET_INTERVAL_MS 10000
+
+#define NODE_LIST_FLAG_FIRST 0x01 // Starts a full list
+#define NODE_LIST_FLAG_LAST 0x02  // Full list complete
+#define NODE_LIST_FLAG_FULL 0x04  // Part of a full list (seq/total valid)
+
+#define NODE_LIST_MODEL_SRV 0x01 // Node has the vendor server
+#define NODE_LIST_MODEL_CLI 0x02 // ...and the vendor client (gateway-capable)
+
+typedef struct {
+  uint8_t version; // NODE_LIST_V2
+  uint8_t flags;
+  uint8_t count; // node_list_entry_t entries in this message
+  uint8_t seq;   // Message index within a full list, from 0
+  uint8_t total; // Entries in the whole full list
+} __attribute__((packed)) node_list_hdr_t;
+
+typedef struct {
+  uint16_t unicast; // Primary element address
+  uint8_t elem_num;
+  uint8_t models; // NODE_LIST_MODEL_*
+  uint8_t zones;  // Zone bitmap the provisioner subscribed it to
+} __attribute__((packed)) node_list_entry_t;
+
+// "ALL:NODES" from the Pi (see above). Returns the response length.
+int node_list_command(char *resp, size_t resp_size);
+
+// VND_OP_NODE_LIST received by the vendor client (custom_model_cb)
+void node_list_on_msg(const esp_ble_mesh_msg_ctx_t *ctx, const uint8_t *msg,
+                      uint16_t len);
+
+#endif /* NODE_LIST_H */
@@ -2,24 +2,233 @@
 #include "mesh_node.h"
 
 #include "esp_log.h"
+#include <ctype.h>
+#include <string.h>
 
 #define TAG "NODE_TRACK"
 
+// Each node has to track a replay entry for every other node's traffic
+#if defined(CONFIG_BLE_MESH_CRPL) && CONFIG_BLE_MESH_CRPL < MAX_NODES
+#error "CONFIG_BLE_MESH_CRPL must be at least CONFIG_MESH_MAX_NODES"
+#endif
+
 uint16_t known_nodes[MAX_NODES] = {0}; // Unicast addrs of discovered nodes
+node_mask_t known_mask = {0};
 int known_node_count = 0;
-bool discovery_complete = false; // Set true when probe times out (no more nodes)
+bool discovery_complete = false; // Probe timed out or provisioner list (no more nodes)
+
+// Indexed by node_id (addr - NODE_BASE_ADDR)
+static uint8_t node_format[MAX_NODES] = {0};
+static uint8_t node_zones[MAX_NODES] = {0};
+static node_link_t node_links[MAX_NODES] = {0};
+// Timeout last reported to the Pi, per node (0 = never reported)
+static uint16_t link_reported_ms[MAX_NODES] = {0};
+
+bool node_mask_parse(const char *s, node_mask_t *m) {
+  memset(m, 0, sizeof(*m));
+  if (s[0] == '0' && (s[1] == 'x' || s[1] == 'X'))
+    s += 2;
+  int bit = 0;
+  for (int i = strlen(s) - 1; i >= 0; i--, bit += 4) {
+    if (!isxdigit((unsigned char)s[i]))
+      return false;
+    int v = isdigit((unsigned char)s[i]) ? s[i] - '0'
+                                         : tolower((unsigned char)s[i]) - 'a' + 10;
+    for (int b = 0; b < 4; b++) {
+      if ((v & (1 << b)) && bit + b < MAX_NODES)
+        node_mask_set(m, bit + b);
+    }
+  }
+  return true;
+}
 
-void register_known_node(uint16_t addr) {
+bool register_known_node(uint16_t addr) {
+  int id = node_id_of(addr);
   // Don't register our own address
+  if (addr == node_state.addr || id < 0)
+    return false;
+  if (node_mask_test(&known_mask, id))
+    return false; // Already known
+  if (known_node_count >= MAX_NODES)
+    return false;
+  node_mask_set(&known_mask, id);
+  known_nodes[known_node_count++] = addr;
+  discovery_complete = false; // New node found - re-enable probing
+  ESP_LOGI(TAG, "Registered node 0x%04x (total: %d)", addr, known_node_count);
+  return true;
+}
+
+int prune_known_nodes(const node_mask_t *keep) {
+  int kept = 0;
+  for (int i = 0; i < known_node_count; i++) {
+    uint16_t addr = known_nodes[i];
+    int id = node_id_of(addr);
+    if (node_mask_test(keep, id)) {
+      known_nodes[kept++] = addr;
+      continue;
+    }
+    known_mask.w[id >> 5] &= ~(1u << (id & 31));
+    node_zones[id] = 0;
+    node_format[id] = NODE_FMT_UNKNOWN;
+    memset(&node_links[id], 0, sizeof(node_links[id]));
+    link_reported_ms[id] = 0;
+    ESP_LOGI(TAG, "Dropped node 0x%04x", addr);
+  }
+  int dropped = known_node_count - kept;
+  known_node_count = kept;
+  return dropped;
+}
+
+void set_node_zones(uint16_t addr, uint8_t zones) {
+  int id = node_id_of(addr);
+  if (id < 0 || node_zones[id] == zones)
+    return;
+  node_zones[id] = zones;
+  ESP_LOGI(TAG, "Node 0x%04x zones: 0x%02x", addr, zones);
+}
+
+uint8_t get_node_zones(uint16_t addr) {
+  int id = node_id_of(addr);
   if (addr == node_state.addr)
+    return mesh_node_zones();
+  return id < 0 ? 0 : node_zones[id];
+}
+
+void node_members(uint16_t dst, node_mask_t *ids) {
+  memset(ids, 0, sizeof(*ids));
+  if (node_id_of(dst) >= 0) {
+    node_mask_set(ids, node_id_of(dst));
+    return;
+  }
+  bool is_zone = MESH_IS_ZONE_ADDR(dst);
+  if (!is_zone && dst != MESH_GROUP_ADDR)
     return;
+  uint8_t bit = is_zone ? 1 << (dst - MESH_ZONE_BASE_ADDR) : 0;
+
+  int self = node_id_of(node_state.addr);
+  if (self >= 0 && (!is_zone || (mesh_node_zones() & bit)))
+    node_mask_set(ids, self);
   for (int i = 0; i < known_node_count; i++) {
-    if (known_nodes[i] == addr)
-      return; // Already known
+    int id = node_id_of(known_nodes[i]);
+    if (!is_zone || (node_zones[id] & bit))
+      node_mask_set(ids, id);
   }
-  if (known_node_count < MAX_NODES) {
-    known_nodes[known_node_count++] = addr;
-    discovery_complete = false; // New node found - re-enable probing
-    ESP_LOGI(TAG, "Registered node 0x%04x (total: %d)", addr, known_node_count);
+}
+
+void set_node_format(uint16_t addr, node_fmt_t fmt) {
+  int id = node_id_of(addr);
+  if (id < 0)
+    return;
+  uint8_t *slot = &node_format[id];
+  if (*slot != fmt) {
+    *slot = fmt;
+    ESP_LOGI(TAG, "Node 0x%04x reply format: %s", addr,
+             fmt == NODE_FMT_BINARY ? "binary" : "text");
   }
 }
+
+node_fmt_t get_node_format(uint16_t addr) {
+  int id = node_id_of(addr);
+  return id < 0 ? NODE_FMT_UNKNOWN : node_format[id];
+}
+
+const char *node_read_cmd(uint16_t addr) {
+  node_mask_t ids;
+  node_members(addr, &ids);
+  for (int id = 0; id < MAX_NODES; id++) {
+    if (node_mask_test(&ids, id) && node_format[id] == NODE_FMT_TEXT)
+      return "read";
+  }
+  return "rb";
+}
+
+static int32_t link_timeout_ms(const node_link_t *l) {
+  // ~2x RTT for a steady link, more when RTT is jittery
+  int32_t rto = l->srtt_ms + 4 * l->rttvar_ms;
+  if (rto < 2 * l->srtt_ms)
+    rto = 2 * l->srtt_ms;
+  if (rto < LINK_TIMEOUT_MIN_MS)
+    rto = LINK_TIMEOUT_MIN_MS;
+  rto <<= l->backoff; // backoff < LINK_TIMEOUT_RESET, no overflow
+  if (rto > LINK_TIMEOUT_MAX_MS)
+    rto = LINK_TIMEOUT_MAX_MS;
+  return rto;
+}
+
+// Report on path change or a >25% timeout move since the last report
+static bool link_report_due(int slot, bool path_changed) {
+  int32_t rto = link_timeout_ms(&node_links[slot]);
+  int32_t last = link_reported_ms[slot];
+  if (path_changed || last == 0 || rto * 4 > last * 5 || rto * 4 < last * 3) {
+    link_reported_ms[slot] = rto;
+    return true;
+  }
+  return false;
+}
+
+bool node_link_sample(uint16_t addr, uint32_t rtt_ms, uint8_t recv_ttl) {
+  int slot = node_id_of(addr);
+  if (slot < 0)
+    return false;
+  node_link_t *l = &node_links[slot];
+
+  if (rtt_ms > UINT16_MAX)
+    rtt_ms = UINT16_MAX;
+  uint8_t relays = (recv_ttl <= VND_RSP_TTL) ? VND_RSP_TTL - recv_ttl : 0;
+  bool path_changed = (l->samples == 0 || l->relays != relays);
+  l->relays = relays;
+
+  if (l->samples == 0) {
+    l->srtt_ms = rtt_ms;
+    l->rttvar_ms = rtt_ms / 2;
+  } else {
+    int32_t err = (int32_t)rtt_ms - l->srtt_ms;
+    int32_t abs_err = err < 0 ? -err : err;
+    l->rttvar_ms = (3 * l->rttvar_ms + abs_err) / 4;
+    l->srtt_ms = (7 * l->srtt_ms + (int32_t)rtt_ms) / 8;
+  }
+  if (l->samples < UINT8_MAX)
+    l->samples++;
+  l->backoff = 0;
+
+  return link_report_due(slot, path_changed);
+}
+
+bool node_link_timeout(uint16_t addr) {
+  int slot = node_id_of(addr);
+  if (slot < 0 || node_links[slot].samples == 0)
+    return false; // Already on the defaults
+  node_link_t *l = &node_links[slot];
+
+  if (++l->backoff >= LINK_TIMEOUT_RESET) {
+    ESP_LOGW(TAG, "Node 0x%04x: %d timeouts in a row, link estimate reset",
+             addr, l->backoff);
+    memset(l, 0, sizeof(*l));
+    link_reported_ms[slot] = 0;
+    return true;
+  }
+  return link_report_due(slot, false);
+}
+
+bool node_link_params(uint16_t addr, uint8_t *ttl, int32_t *timeout_ms) {
+  int slot = node_id_of(addr);
+  if (slot < 0 || node_links[slot].samples == 0)
+    return false;
+  const node_link_t *l = &node_links[slot];
+
+  // A message survives (ttl - 1) relays; TTL 1 is never relayed, use 2+
+  uint8_t t = l->relays + 1 + LINK_TTL_MARGIN;
+  if (t < 2)
+    t = 2;
+  if (t > VND_RSP_TTL)
+    t = VND_RSP_TTL;
+  *ttl = t;
+  *timeout_ms = link_timeout_ms(l);
+  return true;
+}
+
+node_link_t node_link_get(uint16_t addr) {
+  int slot = node_id_of(addr);
+  node_link_t none = {0};
+  return slot < 0 ? none : node_links[slot];
+}
@@ -3,14 +3,131 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include "sdkconfig.h"
 
-#define MAX_NODES 10
+// Node ids are dense (unicast - NODE_BASE_ADDR; the provisioner assigns
+// addresses that way), so every per-node table is indexed by id directly.
+#define MAX_NODES CONFIG_MESH_MAX_NODES
 #define NODE_BASE_ADDR 0x0005
 
-extern uint16_t known_nodes[MAX_NODES];
+// Node id for a unicast address, -1 outside the node range
+static inline int node_id_of(uint16_t addr) {
+  return (addr >= NODE_BASE_ADDR && addr < NODE_BASE_ADDR + MAX_NODES)
+             ? addr - NODE_BASE_ADDR
+             : -1;
+}
+
+// ============== Node Bitmaps ==============
+#define NODE_MASK_WORDS ((MAX_NODES + 31) / 32)
+
+typedef struct {
+  uint32_t w[NODE_MASK_WORDS];
+} node_mask_t;
+
+static inline void node_mask_set(node_mask_t *m, int id) {
+  m->w[id >> 5] |= 1u << (id & 31);
+}
+
+static inline bool node_mask_test(const node_mask_t *m, int id) {
+  return (m->w[id >> 5] >> (id & 31)) & 1;
+}
+
+static inline bool node_mask_empty(const node_mask_t *m) {
+  for (int i = 0; i < NODE_MASK_WORDS; i++) {
+    if (m->w[i])
+      return false;
+  }
+  return true;
+}
+
+// True if every id in sub is also in m
+static inline bool node_mask_covers(const node_mask_t *m,
+                                    const node_mask_t *sub) {
+  for (int i = 0; i < NODE_MASK_WORDS; i++) {
+    if (sub->w[i] & ~m->w[i])
+      return false;
+  }
+  return true;
+}
+
+// Parse a hex node mask of any length ("0x1f", "3ff00000000"). Bits past
+// MAX_NODES are ignored. Returns false on a non-hex character.
+bool node_mask_parse(const char *s, node_mask_t *m);
+
+// Sensor reply format each node has shown it supports. Nodes start UNKNOWN
+// and are asked for binary frames; a node that answers "ERR:UNKNOWN:rb" is
+// running older firmware and gets the text "read" from then on.
+typedef enum {
+  NODE_FMT_UNKNOWN = 0,
+  NODE_FMT_TEXT,
+  NODE_FMT_BINARY,
+} node_fmt_t;
+
+extern uint16_t known_nodes[MAX_NODES]; // In discovery order
+extern node_mask_t known_mask;          // Same set, by node id
 extern int known_node_count;
 extern bool discovery_complete;
 
-void register_known_node(uint16_t addr);
+// Returns true if addr was not known before
+bool register_known_node(uint16_t addr);
+
+// Forget every known node whose id is not in keep (and its zones, format
+// and link estimate). Returns the number dropped.
+int prune_known_nodes(const node_mask_t *keep);
+
+void set_node_format(uint16_t addr, node_fmt_t fmt);
+node_fmt_t get_node_format(uint16_t addr);
+
+// ============== Zone Membership ==============
+// Learned from each node's "ZONES:<hex>" reply (queried when it is first
+// registered, or on "N:ZONES" / "ALL:ZONES"). Our own zones come straight
+// from the vendor server's subscription list.
+void set_node_zones(uint16_t addr, uint8_t zones);
+uint8_t get_node_zones(uint16_t addr);
+
+// Node ids a message to dst reaches, this node included: the id itself for
+// a unicast address, every known node for MESH_GROUP_ADDR, the members of a
+// zone group
+void node_members(uint16_t dst, node_mask_t *ids);
+
+// ============== Per-node Link Estimate ==============
+// Smoothed RTT (RFC 6298 style, alpha 1/8, beta 1/4) and relay count per
+// node, measured from vendor request/STATUS pairs. Used to pick the send TTL
+// and client timeout instead of the fixed 7 / VND_SEND_TIMEOUT_MS.
+#define VND_RSP_TTL 7          // Servers reply with this TTL (hop measurement)
+#define LINK_TTL_MARGIN 2      // Extra relays allowed beyond the observed path
+#define LINK_TIMEOUT_MIN_MS 400
+#define LINK_TIMEOUT_MAX_MS 5000 // VND_SEND_TIMEOUT_MS
+#define LINK_TIMEOUT_RESET 3     // Timeouts in a row that drop the estimate
+
+typedef struct {
+  uint16_t srtt_ms;
+  uint16_t rttvar_ms;
+  uint8_t relays;  // VND_RSP_TTL - recv_ttl of the last reply
+  uint8_t samples; // Saturates at 255
+  uint8_t backoff; // Timeouts since the last sample (timeout doubled each)
+} node_link_t;
+
+// Record one RTT sample and the reply's received TTL. Returns true when the
+// estimate moved enough to be worth reporting to the Pi.
+bool node_link_sample(uint16_t addr, uint32_t rtt_ms, uint8_t recv_ttl);
+
+// A request to addr got no reply. Replies that miss the timeout are never
+// sampled, so back off instead (RFC 6298 5.5 / Karn): double the timeout,
+// up to LINK_TIMEOUT_MAX_MS, and after LINK_TIMEOUT_RESET in a row drop the
+// estimate so the default TTL and timeout apply until a reply is measured
+// again. Returns true when the timeout moved enough to report.
+bool node_link_timeout(uint16_t addr);
+
+// TTL and timeout to use for addr. Leaves *ttl / *timeout_ms untouched and
+// returns false if the node has no samples yet (caller keeps its defaults).
+bool node_link_params(uint16_t addr, uint8_t *ttl, int32_t *timeout_ms);
+
+// Copy of the estimate for addr (zeroed if unknown)
+node_link_t node_link_get(uint16_t addr);
+
+// Read command to send to addr: "rb" unless the target (or, for a group
+// address, any member) is text-only.
+const char *node_read_cmd(uint16_t addr);
 
 #endif /* NODE_TRACKER_H */
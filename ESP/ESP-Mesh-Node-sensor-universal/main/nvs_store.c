@@ -4,6 +4,10 @@
 
 nvs_handle_t NVS_HANDLE;
 static const char *NVS_KEY = "mesh_node";
+static const char *NVS_KEY_INA260 = "ina260_addr";
+static const char *NVS_KEY_SENSOR_CFG = "ina260_cfg";
+static const char *NVS_KEY_PCTRL = "pwr_ctrl";
+static const char *NVS_KEY_LIMIT = "load_limit";
 
 void save_node_state(void) {
   ble_mesh_nvs_store(NVS_HANDLE, NVS_KEY, &node_state, sizeof(node_state));
@@ -27,3 +31,56 @@ void restore_node_state(void) {
     }
   }
 }
+
+void save_ina260_addr(uint8_t addr) {
+  esp_err_t err = nvs_set_u8(NVS_HANDLE, NVS_KEY_INA260, addr);
+  if (err == ESP_OK)
+    err = nvs_commit(NVS_HANDLE);
+  if (err != ESP_OK)
+    ESP_LOGW("NVS", "INA260 address save failed: %d", err);
+}
+
+uint8_t restore_ina260_addr(void) {
+  uint8_t addr = 0;
+  if (nvs_get_u8(NVS_HANDLE, NVS_KEY_INA260, &addr) != ESP_OK)
+    return 0;
+  return addr;
+}
+
+void save_sensor_config(uint16_t config) {
+  esp_err_t err = nvs_set_u16(NVS_HANDLE, NVS_KEY_SENSOR_CFG, config);
+  if (err == ESP_OK)
+    err = nvs_commit(NVS_HANDLE);
+  if (err != ESP_OK)
+    ESP_LOGW("NVS", "Sensor config save failed: %d", err);
+}
+
+uint16_t restore_sensor_config(void) {
+  uint16_t config = 0;
+  if (nvs_get_u16(NVS_HANDLE, NVS_KEY_SENSOR_CFG, &config) != ESP_OK)
+    return 0;
+  return config;
+}
+
+void save_pctrl_config(const pctrl_config_t *config) {
+  ble_mesh_nvs_store(NVS_HANDLE, NVS_KEY_PCTRL, config, sizeof(*config));
+}
+
+bool restore_pctrl_config(pctrl_config_t *config) {
+  bool exist = false;
+  esp_err_t err = ble_mesh_nvs_restore(NVS_HANDLE, NVS_KEY_PCTRL, config,
+                                       sizeof(*config), &exist);
+  return err == ESP_OK && exist;
+}
+
+void save_load_limit(uint32_t max_mw) {
+  ble_mesh_nvs_store(NVS_HANDLE, NVS_KEY_LIMIT, &max_mw, sizeof(max_mw));
+}
+
+uint32_t restore_load_limit(void) {
+  uint32_t max_mw = 0;
+  bool exist = false;
+  esp_err_t err = ble_mesh_nvs_restore(NVS_HANDLE, NVS_KEY_LIMIT, &max_mw,
+                                       sizeof(max_mw), &exist);
+  return (err == ESP_OK && exist) ? max_mw : 0;
+}
@@ -3,6 +3,7 @@
 
 #include "nvs_flash.h"
 #include "ble_mesh_example_nvs.h"
+#include "power_ctrl.h"
 
 // NVS handle — opened in app_main(), used by save/restore functions
 extern nvs_handle_t NVS_HANDLE;
@@ -13,4 +14,20 @@ void save_node_state(void);
 // Restore mesh node state from NVS. Updates cached_net_idx/app_idx.
 void restore_node_state(void);
 
+// INA260 I2C address found on a previous boot (0 = none cached)
+void save_ina260_addr(uint8_t addr);
+uint8_t restore_ina260_addr(void);
+
+// INA260 config register (sensor profile), 0 = none saved
+void save_sensor_config(uint16_t config);
+uint16_t restore_sensor_config(void);
+
+// Local power limit in mW (load_control.c), 0 = off / none saved
+void save_load_limit(uint32_t max_mw);
+uint32_t restore_load_limit(void);
+
+// On-node power controller settings. restore returns false if none saved.
+void save_pctrl_config(const pctrl_config_t *config);
+bool restore_pctrl_config(pctrl_config_t *config);
+
 #endif // NVS_STORE_H
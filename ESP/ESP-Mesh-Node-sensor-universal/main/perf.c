@@ -0,0 +1,159 @@
+#include "perf.h"
+#include "mesh_tx.h"
+#include "node_tracker.h"
+
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TAG "PERF"
+
+typedef struct {
+  uint32_t n;
+  uint32_t max;
+  uint64_t sum;
+  uint16_t b[PERF_HIST_BUCKETS]; // Saturating
+} perf_hist_t;
+
+static struct {
+  uint32_t counters[PERF_COUNTER_COUNT];
+  perf_hist_t cmd_us;
+  perf_hist_t i2c_us;
+  perf_hist_t rtt_ms[MAX_NODES];
+} perf;
+
+static portMUX_TYPE perf_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static void hist_add(perf_hist_t *h, uint32_t v) {
+  int b = v < 2 ? 0 : 31 - __builtin_clz(v);
+  if (b >= PERF_HIST_BUCKETS)
+    b = PERF_HIST_BUCKETS - 1;
+
+  taskENTER_CRITICAL(&perf_lock);
+  h->n++;
+  h->sum += v;
+  if (v > h->max)
+    h->max = v;
+  if (h->b[b] < UINT16_MAX)
+    h->b[b]++;
+  taskEXIT_CRITICAL(&perf_lock);
+}
+
+void perf_count(perf_counter_t c) {
+  taskENTER_CRITICAL(&perf_lock);
+  perf.counters[c]++;
+  taskEXIT_CRITICAL(&perf_lock);
+}
+
+void perf_record_cmd(uint32_t us) { hist_add(&perf.cmd_us, us); }
+void perf_record_i2c(uint32_t us) { hist_add(&perf.i2c_us, us); }
+
+void perf_record_rtt(uint16_t dst, uint32_t us) {
+  int id = node_id_of(dst);
+  if (id >= 0)
+    hist_add(&perf.rtt_ms[id], us / 1000);
+}
+
+static unsigned long hist_avg(const perf_hist_t *h) {
+  return h->n ? (unsigned long)(h->sum / h->n) : 0;
+}
+
+static int format_summary(char *resp, size_t resp_size) {
+  uint32_t c[PERF_COUNTER_COUNT];
+  perf_hist_t cmd, i2c;
+  taskENTER_CRITICAL(&perf_lock);
+  memcpy(c, perf.counters, sizeof(c));
+  cmd = perf.cmd_us;
+  i2c = perf.i2c_us;
+  taskEXIT_CRITICAL(&perf_lock);
+
+  return snprintf(
+      resp, resp_size,
+      "PERF:UP:%lu,HEAP:%lu/%lu,CMD:%lu/%lu,I2C:%lu/%lu,"
+      "NTF:%lu/%lu/%lu/%lu/%lu,TX:%lu/%lu/%lu/%lu",
+      (unsigned long)(esp_timer_get_time() / 1000000),
+      (unsigned long)esp_get_free_heap_size(),
+      (unsigned long)esp_get_minimum_free_heap_size(), hist_avg(&cmd),
+      (unsigned long)cmd.max, hist_avg(&i2c), (unsigned long)i2c.max,
+      (unsigned long)c[PERF_NTF_MSGS], (unsigned long)c[PERF_NTF_CHUNKS],
+      (unsigned long)c[PERF_NTF_DROPS], (unsigned long)c[PERF_NTF_BACKOFFS],
+      (unsigned long)c[PERF_NTF_FAILS], (unsigned long)c[PERF_TX_SENT],
+      (unsigned long)c[PERF_TX_ERRORS], (unsigned long)c[PERF_TX_NOBUF],
+      (unsigned long)c[PERF_TX_TIMEOUTS]);
+}
+
+static int format_rtt(int from, char *resp, size_t resp_size) {
+  // Leave room for ",+<next>" and the reply's TID suffix
+  size_t limit = resp_size - 6 - MESH_TX_TID_SUFFIX_LEN;
+  int len = snprintf(resp, resp_size, "RTT:");
+  bool first = true;
+
+  for (int id = from < 0 ? 0 : from; id < MAX_NODES; id++) {
+    perf_hist_t h;
+    taskENTER_CRITICAL(&perf_lock);
+    h = perf.rtt_ms[id];
+    taskEXIT_CRITICAL(&perf_lock);
+    if (h.n == 0)
+      continue;
+
+    char entry[24];
+    int n = snprintf(entry, sizeof(entry), "%s%d=%lu/%lu", first ? "" : ",",
+                     id, hist_avg(&h), (unsigned long)h.max);
+    if (len + n > (int)limit)
+      return len + snprintf(resp + len, resp_size - len, ",+%d", id);
+    memcpy(resp + len, entry, n + 1);
+    len += n;
+    first = false;
+  }
+  return len;
+}
+
+static int format_hist(const char *name, char *resp, size_t resp_size) {
+  const perf_hist_t *src = NULL;
+  if (strcmp(name, "cmd") == 0) {
+    src = &perf.cmd_us;
+  } else if (strcmp(name, "i2c") == 0) {
+    src = &perf.i2c_us;
+  } else if (strncmp(name, "rtt", 3) == 0) {
+    char *endptr;
+    long id = strtol(name + 3, &endptr, 10);
+    if (endptr != name + 3 && *endptr == '\0' && id >= 0 && id < MAX_NODES)
+      src = &perf.rtt_ms[id];
+  }
+  if (!src)
+    return snprintf(resp, resp_size, "ERR:PERF:h:%s", name);
+
+  perf_hist_t h;
+  taskENTER_CRITICAL(&perf_lock);
+  h = *src;
+  taskEXIT_CRITICAL(&perf_lock);
+
+  int len = snprintf(resp, resp_size, "HIST:%s:%lu:", name, (unsigned long)h.n);
+  for (int i = 0; i < PERF_HIST_BUCKETS && len < (int)resp_size; i++)
+    len += snprintf(resp + len, resp_size - len, i ? "/%u" : "%u", h.b[i]);
+  return len < (int)resp_size ? len : (int)resp_size - 1;
+}
+
+int perf_command(const char *args, char *resp, size_t resp_size) {
+  if (args[0] == '\0')
+    return format_summary(resp, resp_size);
+  if (strcmp(args, "rtt") == 0)
+    return format_rtt(0, resp, resp_size);
+  if (strncmp(args, "rtt:", 4) == 0)
+    return format_rtt(atoi(args + 4), resp, resp_size);
+  if (strncmp(args, "h:", 2) == 0)
+    return format_hist(args + 2, resp, resp_size);
+  if (strcmp(args, "clr") == 0) {
+    taskENTER_CRITICAL(&perf_lock);
+    memset(&perf, 0, sizeof(perf));
+    taskEXIT_CRITICAL(&perf_lock);
+    ESP_LOGI(TAG, "Counters cleared");
+    return snprintf(resp, resp_size, "PERF:CLEARED");
+  }
+  return snprintf(resp, resp_size, "ERR:PERF:%s", args);
+}
@@ -0,0 +1,43 @@
+#ifndef PERF_H
+#define PERF_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// ============== Hot-path Instrumentation ==============
+// Counters and log2 latency histograms in one static struct (no allocation),
+// timed with esp_timer_get_time(). Dumped with the "perf" command:
+//   ""         "PERF:UP:<s>,HEAP:<free>/<min>,CMD:<avg>/<max>,I2C:<avg>/<max>,
+//               NTF:<msgs>/<chunks>/<drops>/<backoffs>/<fails>,
+//               TX:<sent>/<errors>/<nobuf>/<timeouts>"  (latencies in us)
+//   "rtt[:<from>]"  "RTT:<id>=<avg>/<max>,..." send -> STATUS per node in ms,
+//                   ",+<next>" at the end when it didn't fit
+//   "h:cmd" / "h:i2c" / "h:rtt<id>"  "HIST:<name>:<n>:<b0>/<b1>/..."
+//                   bucket 0 counts 0-1, bucket i counts [2^i, 2^(i+1))
+//   "clr"      reset everything but the uptime
+#define PERF_HIST_BUCKETS 16
+
+typedef enum {
+  PERF_NTF_MSGS,     // Messages queued for notification
+  PERF_NTF_CHUNKS,   // Notifications sent
+  PERF_NTF_DROPS,    // Notify queue full / no connection
+  PERF_NTF_BACKOFFS, // Host out of mbufs
+  PERF_NTF_FAILS,    // Notify errors (connection dropped)
+  PERF_TX_SENT,      // Vendor messages handed to the mesh stack
+  PERF_TX_ERRORS,    // Send or send-complete errors
+  PERF_TX_NOBUF,     // ...of those, no advertising / segment buffer
+  PERF_TX_TIMEOUTS,  // Requests without a STATUS in time
+  PERF_COUNTER_COUNT
+} perf_counter_t;
+
+void perf_count(perf_counter_t c);
+
+// Latency samples
+void perf_record_cmd(uint32_t us);                // process_command()
+void perf_record_i2c(uint32_t us);                // INA260 sample read
+void perf_record_rtt(uint16_t dst, uint32_t us);  // mesh send -> STATUS
+
+// "perf" command (see above). Returns response length.
+int perf_command(const char *args, char *resp, size_t resp_size);
+
+#endif /* PERF_H */
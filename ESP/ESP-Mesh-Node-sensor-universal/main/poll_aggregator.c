@@ -0,0 +1,166 @@
+#include "poll_aggregator.h"
+#include "cmd_worker.h"
+#include "command.h"
+#include "gatt_service.h"
+#include "mesh_node.h"
+#include "node_tracker.h"
+
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/timers.h"
+#include <string.h>
+
+#define TAG "POLL_AGG"
+
+// Added to the slowest link timeout - group replies contend for airtime
+#define POLL_AGG_SLACK_MS 300
+
+// One notification's worth (gatt_notify_sensor_data copies at most this)
+#define POLL_BATCH_BUF_LEN SENSOR_DATA_MAX_LEN
+#define POLL_BATCH_MAX_FRAMES                                                  \
+  ((POLL_BATCH_BUF_LEN - POLL_BATCH_HDR_LEN) / TELEMETRY_FRAME_LEN)
+
+// Offer runs on the mesh task, begin on the NimBLE host, the deadline on the
+// timer daemon - all table access goes through agg_lock.
+static portMUX_TYPE agg_lock = portMUX_INITIALIZER_UNLOCKED;
+static TimerHandle_t agg_timer = NULL;
+
+static bool agg_active = false;
+static uint8_t agg_gen = 0;
+static node_mask_t agg_expected; // By node_id
+static node_mask_t agg_have;
+static uint8_t agg_frames[MAX_NODES][TELEMETRY_FRAME_LEN];
+
+// Close the active generation and send its frames to the Pi
+static void poll_agg_flush(const char *why) {
+  // Static: flushes are one poll period apart, and MAX_NODES frames would
+  // not fit the timer task's stack
+  static uint8_t frames[MAX_NODES][TELEMETRY_FRAME_LEN];
+  node_mask_t have;
+  int expected_count;
+  uint8_t gen;
+  int count = 0;
+
+  taskENTER_CRITICAL(&agg_lock);
+  if (!agg_active) {
+    taskEXIT_CRITICAL(&agg_lock);
+    return;
+  }
+  agg_active = false;
+  gen = agg_gen;
+  have = agg_have;
+  expected_count = 0;
+  for (int i = 0; i < MAX_NODES; i++) {
+    if (node_mask_test(&agg_expected, i))
+      expected_count++;
+    if (node_mask_test(&have, i))
+      memcpy(frames[count++], agg_frames[i], TELEMETRY_FRAME_LEN);
+  }
+  taskEXIT_CRITICAL(&agg_lock);
+
+  xTimerStop(agg_timer, 0);
+
+  ESP_LOGI(TAG, "Gen %d flush (%s): %d of %d frame(s)", gen, why, count,
+           expected_count);
+
+  // Always send at least one (possibly empty) LAST batch so the Pi can stop
+  // waiting for this generation
+  // Pack as many frames per notification as the connection's MTU allows
+  int max_frames =
+      (gatt_notify_payload_len() - POLL_BATCH_HDR_LEN) / TELEMETRY_FRAME_LEN;
+  if (max_frames > POLL_BATCH_MAX_FRAMES)
+    max_frames = POLL_BATCH_MAX_FRAMES;
+  int sent = 0;
+  do {
+    uint8_t batch[POLL_BATCH_BUF_LEN];
+    int n = count - sent;
+    if (n > max_frames)
+      n = max_frames;
+    batch[0] = POLL_BATCH_V1;
+    batch[1] = gen;
+    batch[2] = (uint8_t)n;
+    batch[3] = (sent + n >= count) ? POLL_BATCH_FLAG_LAST : 0;
+    memcpy(batch + POLL_BATCH_HDR_LEN, frames[sent], n * TELEMETRY_FRAME_LEN);
+    gatt_notify_sensor_data((const char *)batch,
+                            POLL_BATCH_HDR_LEN + n * TELEMETRY_FRAME_LEN);
+    sent += n;
+  } while (sent < count);
+}
+
+static void agg_timer_cb(TimerHandle_t xTimer) { poll_agg_flush("deadline"); }
+
+void poll_agg_begin(uint16_t group, int gen) {
+  node_mask_t members;
+  node_mask_t expected = {0};
+  int n_expected = 0;
+  int self = node_id_of(node_state.addr);
+  node_members(group, &members);
+
+  // Deadline tracks the slowest expected node's link timeout, capped at
+  // POLL_AGG_DEADLINE_MS (used as-is while any node is still unmeasured),
+  // plus the reply slot it waits for (see cmd_worker.h)
+  int32_t deadline_ms = 0;
+  for (int id = 0; id < MAX_NODES; id++) {
+    uint16_t addr = NODE_BASE_ADDR + id;
+    if (!node_mask_test(&members, id) ||
+        get_node_format(addr) == NODE_FMT_TEXT)
+      continue;
+    node_mask_set(&expected, id);
+    n_expected++;
+    if (id == self)
+      continue;
+
+    uint8_t ttl;
+    int32_t timeout_ms = POLL_AGG_DEADLINE_MS;
+    node_link_params(addr, &ttl, &timeout_ms);
+    timeout_ms += POLL_AGG_SLACK_MS;
+    if (timeout_ms > POLL_AGG_DEADLINE_MS)
+      timeout_ms = POLL_AGG_DEADLINE_MS;
+    timeout_ms += id * GROUP_REPLY_SLOT_MS;
+    if (timeout_ms > deadline_ms)
+      deadline_ms = timeout_ms;
+  }
+  if (deadline_ms == 0)
+    deadline_ms = POLL_AGG_SLACK_MS; // Only ourselves to wait for
+
+  if (agg_timer == NULL) {
+    agg_timer = xTimerCreate("poll_agg", pdMS_TO_TICKS(POLL_AGG_DEADLINE_MS),
+                             pdFALSE, NULL, agg_timer_cb);
+  }
+
+  taskENTER_CRITICAL(&agg_lock);
+  if (agg_active) {
+    ESP_LOGW(TAG, "Gen %d superseded before flush", agg_gen);
+  }
+  agg_active = true;
+  agg_gen = gen < 0 ? agg_gen + 1 : (uint8_t)gen;
+  agg_expected = expected;
+  memset(&agg_have, 0, sizeof(agg_have));
+  taskEXIT_CRITICAL(&agg_lock);
+
+  xTimerChangePeriod(agg_timer, pdMS_TO_TICKS(deadline_ms), 0);
+  ESP_LOGI(TAG, "Gen %d started, expecting %d node(s), deadline %ld ms",
+           agg_gen, n_expected, (long)deadline_ms);
+}
+
+bool poll_agg_offer(uint16_t src, const uint8_t *frame, uint16_t len) {
+  int id = node_id_of(src);
+  bool consumed = false;
+  bool complete = false;
+
+  if (id < 0 || !is_telemetry_frame(frame, len))
+    return false;
+
+  taskENTER_CRITICAL(&agg_lock);
+  if (agg_active && node_mask_test(&agg_expected, id)) {
+    memcpy(agg_frames[id], frame, TELEMETRY_FRAME_LEN);
+    node_mask_set(&agg_have, id);
+    consumed = true;
+    complete = node_mask_covers(&agg_have, &agg_expected);
+  }
+  taskEXIT_CRITICAL(&agg_lock);
+
+  if (complete)
+    poll_agg_flush("complete");
+  return consumed;
+}
@@ -0,0 +1,35 @@
+#ifndef POLL_AGGREGATOR_H
+#define POLL_AGGREGATOR_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// ============== Group-READ Aggregation ==============
+// ALL:READ / Z<n>:READ replies (binary telemetry frames) are collected per
+// poll generation and flushed as batch notifications once every expected node
+// has answered or the deadline passes (per node: link timeout, at most
+// POLL_AGG_DEADLINE_MS, plus its group reply slot; the latest node sets it).
+// Frames from nodes outside the polled group (e.g. published telemetry
+// during a zone poll) are not consumed.
+// Batch layout (one notify each, 2 frames at 20 bytes, all at a larger MTU):
+//   [POLL_BATCH_V1][gen][n_frames][flags] + n_frames * telemetry_frame_t
+// The last batch of a generation has POLL_BATCH_FLAG_LAST set (it may carry
+// zero frames). Text replies are not aggregated - they are forwarded as they
+// arrive, so they always reach the Pi before the batch.
+#define POLL_BATCH_V1 0xA2
+#define POLL_BATCH_HDR_LEN 4
+#define POLL_BATCH_FLAG_LAST 0x01
+#define POLL_AGG_DEADLINE_MS 2500
+
+// Start a new poll generation for a read sent to group (MESH_GROUP_ADDR or
+// a zone). Expected set = the group's members (node_members(), this node
+// included) that are not text-only. Any unflushed previous generation is
+// dropped. gen numbers the batches ("ALL:READ:<gen>" from the Pi, so it can
+// tell its own poll's LAST from a late one); < 0 takes the next local one.
+void poll_agg_begin(uint16_t group, int gen);
+
+// Offer a telemetry frame from src. Returns true if it was consumed by the
+// active generation (caller must not forward it), false otherwise.
+bool poll_agg_offer(uint16_t src, const uint8_t *frame, uint16_t len);
+
+#endif /* POLL_AGGREGATOR_H */
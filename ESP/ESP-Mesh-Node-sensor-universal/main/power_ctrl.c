@@ -0,0 +1,415 @@
+#include "power_ctrl.h"
+#include "command.h"
+#include "load_control.h"
+#include "mesh_node.h"
+#include "mesh_tx.h"
+#include "node_tracker.h"
+#include "nvs_store.h"
+#include "sensor.h"
+
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TAG "PWR_CTRL"
+
+#define DUTY_SYNC_TOLERANCE 2 // % - commanded vs reported before "out of sync"
+#define MW_PER_PCT_DEFAULT 50.0f
+
+typedef struct {
+  bool valid;
+  uint8_t duty;      // Last reported
+  uint8_t commanded; // Last sent by the controller (0 = none)
+  uint8_t target;    // Ceiling (0 = 100%)
+  uint32_t power_mw;
+  TickType_t seen;
+  TickType_t read_sent;
+} pctrl_node_t;
+
+typedef struct {
+  uint16_t addr;
+  uint8_t duty;
+} pctrl_cmd_t;
+
+static portMUX_TYPE pctrl_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static pctrl_config_t cfg = {.threshold_mw = 0,
+                             .priority = PCTRL_PRIORITY_NONE};
+static pctrl_node_t nodes[MAX_NODES];
+static bool force_evaluate = false;
+static TickType_t last_adjust = 0; // Control task only
+static uint32_t cfg_gen = 0;       // Bumped by every settings change
+
+// Control task's copy of the state, evaluated outside pctrl_lock
+static pctrl_node_t snap[MAX_NODES];
+
+static pctrl_node_t *node_for(uint16_t addr) {
+  int id = node_id_of(addr);
+  return id >= 0 ? &nodes[id] : NULL;
+}
+
+static bool responsive(const pctrl_node_t *n, TickType_t now) {
+  return n->valid && (now - n->seen) < pdMS_TO_TICKS(PCTRL_STALE_MS);
+}
+
+// Uses commanded duty over the (possibly lagging) reported one
+static float mw_per_pct(const pctrl_node_t *n, TickType_t now) {
+  uint8_t d = n->commanded ? n->commanded : n->duty;
+  if (d > 0 && n->power_mw > 0)
+    return (float)n->power_mw / d;
+
+  // Fallback: average over nodes that have data
+  float sum = 0;
+  int count = 0;
+  for (int i = 0; i < MAX_NODES; i++) {
+    const pctrl_node_t *o = &snap[i];
+    uint8_t od = o->commanded ? o->commanded : o->duty;
+    if (responsive(o, now) && od > 0 && o->power_mw > 0) {
+      sum += (float)o->power_mw / od;
+      count++;
+    }
+  }
+  return count ? sum / count : MW_PER_PCT_DEFAULT;
+}
+
+// New duty for a node's power share, or -1 if unchanged
+static int plan_nudge(const pctrl_node_t *n, float share_mw, TickType_t now) {
+  float ideal = share_mw / mw_per_pct(n, now);
+  int ceiling = n->target ? n->target : 100;
+  int new_duty = (int)(ideal + 0.5f);
+  if (new_duty < 0)
+    new_duty = 0;
+  if (new_duty > ceiling)
+    new_duty = ceiling;
+  int current = n->commanded ? n->commanded : n->duty;
+  return (new_duty == current) ? -1 : new_duty;
+}
+
+// One evaluation over snap[] with the settings in c (no lock held).
+// Updates snap[].commanded, fills cmds, returns count; total/budget are
+// reported for the caller's log.
+static int evaluate(TickType_t now, const pctrl_config_t *c, bool forced,
+                    pctrl_cmd_t *cmds, float *total_out, float *budget_out) {
+  if (!forced && (now - last_adjust) < pdMS_TO_TICKS(PCTRL_COOLDOWN_MS))
+    return 0;
+
+  float budget = (float)c->threshold_mw - PCTRL_HEADROOM_MW;
+  if (budget <= 0)
+    return 0;
+
+  int count = 0;
+  float total = 0;
+  bool all_at_ceiling = true, all_in_sync = true;
+  for (int i = 0; i < MAX_NODES; i++) {
+    pctrl_node_t *n = &snap[i];
+    if (!responsive(n, now))
+      continue;
+    count++;
+    total += n->power_mw;
+    if (!(n->target > 0 && n->commanded >= n->target))
+      all_at_ceiling = false;
+    if (n->commanded > 0 && abs(n->duty - n->commanded) > DUTY_SYNC_TOLERANCE)
+      all_in_sync = false;
+  }
+  if (count == 0)
+    return 0;
+  *total_out = total;
+  *budget_out = budget;
+
+  if (!forced) {
+    float diff = total > budget ? total - budget : budget - total;
+    if (diff < budget * PCTRL_DEADBAND_PCT / 100)
+      return 0;
+    if (all_at_ceiling && all_in_sync && total <= budget)
+      return 0;
+  } else {
+    // Threshold/priority change: trust the sensors over stale commands
+    for (int i = 0; i < MAX_NODES; i++) {
+      if (responsive(&snap[i], now) && snap[i].duty > 0)
+        snap[i].commanded = snap[i].duty;
+    }
+  }
+
+  // Shares: equal, or priority-weighted with surplus redistribution
+  float share = budget / count;
+  float pri_share = 0;
+  pctrl_node_t *pri = (c->priority < MAX_NODES) ? &snap[c->priority] : NULL;
+  if (pri && !responsive(pri, now))
+    pri = NULL;
+  if (pri) {
+    int others = count - 1;
+    float total_shares = PCTRL_PRIORITY_WEIGHT + others;
+    pri_share = budget * (PCTRL_PRIORITY_WEIGHT / total_shares);
+    float pri_max = (pri->target ? pri->target : 100) * mw_per_pct(pri, now);
+    if (pri_max < pri_share && others > 0)
+      pri_share = pri_max;
+    share = others > 0 ? (budget - pri_share) / others : 0;
+  }
+
+  int n_cmds = 0;
+  for (int i = 0; i < MAX_NODES; i++) {
+    pctrl_node_t *n = &snap[i];
+    if (!responsive(n, now))
+      continue;
+    int new_duty = plan_nudge(n, (n == pri) ? pri_share : share, now);
+    if (new_duty < 0)
+      continue;
+    n->commanded = (uint8_t)new_duty;
+    cmds[n_cmds].addr = NODE_BASE_ADDR + i;
+    cmds[n_cmds].duty = (uint8_t)new_duty;
+    n_cmds++;
+  }
+
+  return n_cmds;
+}
+
+// Two or more remote nodes share group duty vectors; a single one keeps
+// the tracked unicast (TID match, link sampling)
+static void send_duty_cmds(const pctrl_cmd_t *cmds, int count) {
+  vnd_duty_entry_t vec[VND_DUTY_VEC_MAX];
+  int n_vec = 0, n_remote = 0;
+  uint16_t last_addr = 0;
+  for (int i = 0; i < count; i++) {
+    if (cmds[i].addr != node_state.addr) {
+      n_remote++;
+      last_addr = cmds[i].addr;
+    }
+  }
+  for (int i = 0; i < count; i++) {
+    if (cmds[i].addr == node_state.addr) {
+      set_duty(cmds[i].duty);
+    } else if (n_remote == 1) {
+      char cmd[16];
+      int len = snprintf(cmd, sizeof(cmd), "duty:%d", cmds[i].duty);
+      send_vendor_command(last_addr, cmd, len);
+    } else {
+      vec[n_vec].node_id = cmds[i].addr - NODE_BASE_ADDR;
+      vec[n_vec].duty = cmds[i].duty;
+      if (++n_vec == VND_DUTY_VEC_MAX) {
+        send_duty_vector(vec, n_vec);
+        n_vec = 0;
+      }
+    }
+  }
+  if (n_vec > 0)
+    send_duty_vector(vec, n_vec);
+}
+
+static void pctrl_step(void) {
+  if (cfg.threshold_mw == 0)
+    return;
+
+  // Our own load: straight from the sampler ring
+  uint16_t vbus_raw;
+  int16_t current_raw;
+  if (ina260_read_raw(&vbus_raw, &current_raw) == ESP_OK) {
+    power_ctrl_on_reading(node_state.addr, get_current_duty(),
+                          ina260_power_mw(vbus_raw, current_raw));
+  }
+
+  TickType_t now = xTaskGetTickCount();
+  static pctrl_cmd_t cmds[MAX_NODES];
+  static uint16_t reads[MAX_NODES];
+  int n_reads = 0;
+
+  // Only copy under the lock; the float math runs after it
+  taskENTER_CRITICAL(&pctrl_lock);
+  memcpy(snap, nodes, sizeof(snap));
+  pctrl_config_t c = cfg;
+  uint32_t gen = cfg_gen;
+  bool forced = force_evaluate;
+  force_evaluate = false;
+  taskEXIT_CRITICAL(&pctrl_lock);
+
+  float total = 0, budget = 0;
+  int n_cmds = c.threshold_mw ? evaluate(now, &c, forced, cmds, &total, &budget)
+                              : 0;
+
+  taskENTER_CRITICAL(&pctrl_lock);
+  if (gen != cfg_gen) {
+    n_cmds = 0; // Settings changed meanwhile: plan again on the next step
+  } else {
+    for (int i = 0; i < MAX_NODES; i++)
+      nodes[i].commanded = snap[i].commanded;
+  }
+  // Keep readings fresh for the next evaluation
+  for (int i = 0; i < known_node_count; i++) {
+    pctrl_node_t *n = node_for(known_nodes[i]);
+    if (!n || known_nodes[i] == node_state.addr)
+      continue;
+    TickType_t age_limit = pdMS_TO_TICKS(PCTRL_READ_MAX_AGE_MS);
+    if ((!n->valid || now - n->seen > age_limit) &&
+        now - n->read_sent > age_limit) {
+      n->read_sent = now;
+      reads[n_reads++] = known_nodes[i];
+    }
+  }
+  taskEXIT_CRITICAL(&pctrl_lock);
+
+  if (n_cmds > 0) {
+    last_adjust = now;
+    ESP_LOGI(TAG, "%s: %.0f/%.0fmW, %d node(s) nudged",
+             total < budget ? "UP" : "DOWN", total, budget, n_cmds);
+  }
+  send_duty_cmds(cmds, n_cmds);
+  for (int i = 0; i < n_reads; i++) {
+    if (!mesh_tx_is_idle(reads[i]))
+      continue; // A duty reply is on its way anyway
+    const char *read_cmd = node_read_cmd(reads[i]);
+    send_vendor_command(reads[i], read_cmd, strlen(read_cmd));
+  }
+}
+
+static void pctrl_task(void *pvParameters) {
+  TickType_t wake = xTaskGetTickCount();
+  for (;;) {
+    vTaskDelayUntil(&wake, pdMS_TO_TICKS(PCTRL_PERIOD_MS));
+    pctrl_step();
+  }
+}
+
+void power_ctrl_on_reading(uint16_t addr, uint8_t duty, uint32_t power_mw) {
+  pctrl_node_t *n = node_for(addr);
+  if (!n)
+    return;
+  taskENTER_CRITICAL(&pctrl_lock);
+  n->valid = true;
+  n->duty = duty;
+  n->power_mw = power_mw;
+  n->seen = xTaskGetTickCount();
+  taskEXIT_CRITICAL(&pctrl_lock);
+}
+
+void power_ctrl_set_threshold(uint32_t threshold_mw) {
+  pctrl_cmd_t restore[MAX_NODES];
+  int n_restore = 0;
+
+  taskENTER_CRITICAL(&pctrl_lock);
+  bool first_enable = (cfg.threshold_mw == 0);
+  cfg.threshold_mw = threshold_mw;
+  force_evaluate = true;
+  cfg_gen++;
+  for (int i = 0; i < MAX_NODES; i++) {
+    pctrl_node_t *n = &nodes[i];
+    if (threshold_mw == 0) {
+      // Off: put every node we throttled back to its user setting
+      if (n->target > 0 && n->commanded != 0 && n->commanded != n->target) {
+        restore[n_restore].addr = NODE_BASE_ADDR + i;
+        restore[n_restore].duty = n->target;
+        n_restore++;
+      }
+      n->commanded = 0;
+    } else if (first_enable && n->valid && n->duty > 0 &&
+               !node_mask_test(&cfg.target_set_mask, i)) {
+      // Whatever the user set before enabling becomes the ceiling
+      n->target = n->duty;
+    }
+  }
+  pctrl_config_t saved = cfg;
+  taskEXIT_CRITICAL(&pctrl_lock);
+
+  save_pctrl_config(&saved);
+  send_duty_cmds(restore, n_restore);
+  if (threshold_mw) {
+    ESP_LOGI(TAG, "Threshold %lu mW (budget %ld mW)",
+             (unsigned long)threshold_mw,
+             (long)threshold_mw - PCTRL_HEADROOM_MW);
+  } else {
+    ESP_LOGI(TAG, "Controller off");
+  }
+}
+
+void power_ctrl_set_priority(uint8_t node_id) {
+  taskENTER_CRITICAL(&pctrl_lock);
+  cfg.priority = (node_id < MAX_NODES) ? node_id : PCTRL_PRIORITY_NONE;
+  force_evaluate = true;
+  cfg_gen++;
+  pctrl_config_t saved = cfg;
+  taskEXIT_CRITICAL(&pctrl_lock);
+  save_pctrl_config(&saved);
+}
+
+void power_ctrl_set_target(uint8_t node_id, uint8_t duty) {
+  if (node_id >= MAX_NODES)
+    return;
+  taskENTER_CRITICAL(&pctrl_lock);
+  nodes[node_id].target = duty > 100 ? 100 : duty;
+  nodes[node_id].commanded = duty; // Keep the mW/% estimate honest
+  cfg.targets[node_id] = nodes[node_id].target;
+  node_mask_set(&cfg.target_set_mask, node_id);
+  force_evaluate = true;
+  cfg_gen++;
+  pctrl_config_t saved = cfg;
+  taskEXIT_CRITICAL(&pctrl_lock);
+  save_pctrl_config(&saved);
+}
+
+bool power_ctrl_active(void) { return cfg.threshold_mw != 0; }
+
+pctrl_config_t power_ctrl_config(void) {
+  taskENTER_CRITICAL(&pctrl_lock);
+  pctrl_config_t c = cfg;
+  taskEXIT_CRITICAL(&pctrl_lock);
+  return c;
+}
+
+void power_ctrl_handover(void) {
+  taskENTER_CRITICAL(&pctrl_lock);
+  cfg.threshold_mw = 0;
+  for (int i = 0; i < MAX_NODES; i++)
+    nodes[i].commanded = 0;
+  cfg_gen++;
+  pctrl_config_t saved = cfg;
+  taskEXIT_CRITICAL(&pctrl_lock);
+
+  save_pctrl_config(&saved);
+  ESP_LOGI(TAG, "Controller handed over to another gateway");
+}
+
+int power_ctrl_status(char *buf, size_t size) {
+  TickType_t now = xTaskGetTickCount();
+  uint32_t total = 0;
+  int count = 0;
+
+  taskENTER_CRITICAL(&pctrl_lock);
+  for (int i = 0; i < MAX_NODES; i++) {
+    if (responsive(&nodes[i], now)) {
+      total += nodes[i].power_mw;
+      count++;
+    }
+  }
+  pctrl_config_t c = cfg;
+  taskEXIT_CRITICAL(&pctrl_lock);
+
+  if (c.threshold_mw == 0)
+    return snprintf(buf, size, "PM:OFF");
+  int len = snprintf(buf, size, "PM:ON,THR:%lu,TOTAL:%lu,N:%d",
+                     (unsigned long)c.threshold_mw, (unsigned long)total,
+                     count);
+  if (c.priority != PCTRL_PRIORITY_NONE && len < (int)size)
+    len += snprintf(buf + len, size - len, ",PRI:%d", c.priority);
+  return len;
+}
+
+void power_ctrl_init(void) {
+  pctrl_config_t saved;
+  if (restore_pctrl_config(&saved)) {
+    cfg = saved;
+    for (int i = 0; i < MAX_NODES; i++) {
+      if (node_mask_test(&cfg.target_set_mask, i))
+        nodes[i].target = cfg.targets[i];
+    }
+    if (cfg.threshold_mw) {
+      force_evaluate = true;
+      ESP_LOGI(TAG, "Restored: threshold %lu mW, priority %d",
+               (unsigned long)cfg.threshold_mw, cfg.priority);
+    }
+  }
+
+  if (xTaskCreate(pctrl_task, "pwr_ctrl", PCTRL_STACK_SIZE, NULL,
+                  PCTRL_PRIORITY, NULL) != pdPASS)
+    ESP_LOGE(TAG, "Task create failed");
+}
@@ -0,0 +1,61 @@
+#ifndef POWER_CTRL_H
+#define POWER_CTRL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "node_tracker.h"
+
+// ============== On-node Power Budget Controller ==============
+// Firmware port of the Pi PowerManager balancing loop. The GATT gateway node
+// that receives "ALL:PM:<mW>" becomes the controller: it takes readings from
+// vendor replies / published telemetry, and every PCTRL_PERIOD_MS nudges node
+// duties toward equal (or priority-weighted) shares of the budget with
+// direct "duty:" sends. The Pi only sets threshold, priority and targets;
+// the loop keeps running across GATT disconnects and is restored at boot.
+// It runs on its own task: the float math, logging and sends stay off the
+// timer daemon, and only the state copy happens under the lock.
+#define PCTRL_PERIOD_MS 250
+#define PCTRL_STACK_SIZE 4096
+#define PCTRL_PRIORITY 3 // Below the command worker
+#define PCTRL_COOLDOWN_MS 1000     // Between adjustments (Pi: 5 s)
+#define PCTRL_HEADROOM_MW 500      // budget = threshold - headroom
+#define PCTRL_PRIORITY_WEIGHT 2.0f // Priority node shares vs 1 per other node
+#define PCTRL_DEADBAND_PCT 5       // Skip when total is this close to budget
+#define PCTRL_READ_MAX_AGE_MS 750  // Re-read a node whose reading is older
+#define PCTRL_STALE_MS 5000        // Leave a silent node out of the budget
+#define PCTRL_PRIORITY_NONE 0xFF
+
+// Settings persisted in NVS (see nvs_store.h)
+typedef struct {
+  uint32_t threshold_mw; // 0 = off
+  uint8_t priority;      // Node id or PCTRL_PRIORITY_NONE
+  node_mask_t target_set_mask;
+  uint8_t targets[MAX_NODES];
+} pctrl_config_t;
+
+// Restore persisted settings and start the control task
+void power_ctrl_init(void);
+
+// threshold_mw 0 disables the controller
+void power_ctrl_set_threshold(uint32_t threshold_mw);
+void power_ctrl_set_priority(uint8_t node_id); // PCTRL_PRIORITY_NONE clears
+// Ceiling for a node's duty (the user's setting); 0 = 100%
+void power_ctrl_set_target(uint8_t node_id, uint8_t duty);
+bool power_ctrl_active(void);
+
+// Copy of the current settings (gateway sync, see gw_sync.h)
+pctrl_config_t power_ctrl_config(void);
+
+// Stop controlling without restoring duties: another gateway has taken the
+// loop over from its synced copy of our settings
+void power_ctrl_handover(void);
+
+// Feed a reading (from a vendor reply, publish or local sample)
+void power_ctrl_on_reading(uint16_t addr, uint8_t duty, uint32_t power_mw);
+
+// "PM:OFF", or "PM:ON,THR:<mW>,TOTAL:<mW>,N:<nodes>[,PRI:<id>]" (total and
+// count over responsive nodes). Returns length.
+int power_ctrl_status(char *buf, size_t size);
+
+#endif /* POWER_CTRL_H */
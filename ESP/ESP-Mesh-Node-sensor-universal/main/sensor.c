@@ -1,9 +1,18 @@
 #include "sensor.h"
-#include "driver/i2c.h"
+#include "nvs_store.h"
+#include "perf.h"
+#include "driver/gpio.h"
+#include "driver/i2c_master.h"
+#include "esp_idf_version.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include <math.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 static const char *TAG = "SENSOR";
 
@@ -12,18 +21,72 @@ static const char *TAG = "SENSOR";
 #define I2C_SDA_PIN GPIO_NUM_6 // Wire to INA260 SDA
 #define I2C_SCL_PIN GPIO_NUM_7 // Wire to INA260 SCL
 #define I2C_FREQ_HZ 400000
+#define I2C_TIMEOUT_MS 100
+#define I2C_PROBE_TIMEOUT_MS 20
 
 // INA260 valid address range: 0x40-0x4F (depends on A0/A1 wiring)
 #define INA260_ADDR_MIN 0x40
 #define INA260_ADDR_MAX 0x4F
 
-static uint8_t ina260_addr = 0; // Auto-detected at runtime
+static i2c_master_bus_handle_t i2c_bus = NULL;
+static i2c_master_dev_handle_t ina260_dev = NULL; // Persistent, created once
+static uint8_t ina260_addr = 0; // Cached in NVS, else auto-detected
 
 // INA260 registers
 #define INA260_REG_CONFIG 0x00
 #define INA260_REG_CURRENT 0x01
 #define INA260_REG_VOLTAGE 0x02
-#define INA260_CONFIG 0x6727 // 1024-sample averaging
+#define INA260_REG_MASK_ENABLE 0x06
+#define INA260_MASK_CNVR 0x0400 // ALERT on conversion ready (read clears)
+
+// Config register fields (bits 14:12 read back as 110)
+#define INA260_CFG_FIXED 0x6000
+#define INA260_CFG_AVG(c) (((c) & 0x7) << 9)
+#define INA260_CFG_VBUSCT(c) (((c) & 0x7) << 6)
+#define INA260_CFG_ISHCT(c) (((c) & 0x7) << 3)
+#define INA260_CFG_MODE_MASK 0x0007
+#define INA260_MODE_TRIGGERED 0x3 // V + I, one shot per config write
+#define INA260_MODE_CONTINUOUS 0x7
+
+#define INA260_CONFIG_DEFAULT                                                  \
+  (INA260_CFG_FIXED | INA260_CFG_AVG(3) | INA260_CFG_VBUSCT(4) |              \
+   INA260_CFG_ISHCT(4) | INA260_MODE_CONTINUOUS) // 0x6727, 64 avg
+
+static const uint16_t avg_counts[8] = {1, 4, 16, 64, 128, 256, 512, 1024};
+static const uint16_t conv_times_us[8] = {140, 204, 332, 588,
+                                          1100, 2116, 4156, 8244};
+
+static const struct {
+  const char *name;
+  uint16_t config;
+} profiles[] = {
+    [SENSOR_PROFILE_FAST] = {"FAST", INA260_CFG_FIXED | INA260_CFG_AVG(1) |
+                                         INA260_CFG_VBUSCT(4) |
+                                         INA260_CFG_ISHCT(4) |
+                                         INA260_MODE_CONTINUOUS},
+    [SENSOR_PROFILE_BALANCED] = {"BALANCED", INA260_CONFIG_DEFAULT},
+    [SENSOR_PROFILE_ACCURATE] = {"ACCURATE", INA260_CFG_FIXED |
+                                                 INA260_CFG_AVG(5) |
+                                                 INA260_CFG_VBUSCT(4) |
+                                                 INA260_CFG_ISHCT(4) |
+                                                 INA260_MODE_TRIGGERED},
+};
+
+static volatile uint16_t ina260_config = INA260_CONFIG_DEFAULT;
+
+// ============== Sampler ==============
+#define INA260_ALERT_PIN GPIO_NUM_4 // Open-drain ALERT, active low
+#define SAMPLER_STACK_SIZE 3072
+#define SAMPLER_PRIORITY 6 // Above console, below BT host
+
+static TaskHandle_t sampler_task = NULL;
+static sensor_sample_cb_t sample_cbs[SENSOR_SAMPLE_CB_MAX];
+static int n_sample_cbs = 0;
+
+// Single producer (sampler_task), any number of readers. sample_count is
+// bumped after the slot is written, so readers only see complete entries.
+static ina260_sample_t sample_ring[INA260_SAMPLE_RING_LEN];
+static atomic_uint sample_count = 0;
 
 static bool ina260_ok = false; // Set true if INA260 found on I2C
 
@@ -35,13 +98,7 @@ void i2c_scan(void) {
   ESP_LOGI(TAG, "I2C bus scan:");
   int found = 0;
   for (uint8_t addr = 0x08; addr < 0x78; addr++) {
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-    i2c_master_start(cmd);
-    i2c_master_write_byte(cmd, (addr << 1) | I2C_MASTER_WRITE, true);
-    i2c_master_stop(cmd);
-    esp_err_t ret = i2c_master_cmd_begin(I2C_PORT, cmd, pdMS_TO_TICKS(50));
-    i2c_cmd_link_delete(cmd);
-    if (ret == ESP_OK) {
+    if (i2c_master_probe(i2c_bus, addr, I2C_PROBE_TIMEOUT_MS) == ESP_OK) {
       ESP_LOGI(TAG, "  Found device at 0x%02x", addr);
       found++;
     }
@@ -53,57 +110,70 @@ void i2c_scan(void) {
   }
 }
 
+static esp_err_t ina260_write_config(uint16_t config) {
+  uint8_t config_data[3] = {INA260_REG_CONFIG, (config >> 8) & 0xFF,
+                            config & 0xFF};
+  return i2c_master_transmit(ina260_dev, config_data, sizeof(config_data),
+                             I2C_TIMEOUT_MS);
+}
+
+// Probe the NVS-cached address first; scan 0x40-0x4F only if it's gone
+static uint8_t ina260_detect(void) {
+  uint8_t cached = restore_ina260_addr();
+  if (cached >= INA260_ADDR_MIN && cached <= INA260_ADDR_MAX &&
+      i2c_master_probe(i2c_bus, cached, I2C_PROBE_TIMEOUT_MS) == ESP_OK) {
+    ESP_LOGI(TAG, "INA260 at cached address 0x%02x", cached);
+    return cached;
+  }
+
+  for (uint8_t addr = INA260_ADDR_MIN; addr <= INA260_ADDR_MAX; addr++) {
+    if (i2c_master_probe(i2c_bus, addr, I2C_PROBE_TIMEOUT_MS) == ESP_OK) {
+      ESP_LOGI(TAG, "INA260 auto-detected at 0x%02x", addr);
+      save_ina260_addr(addr);
+      return addr;
+    }
+  }
+
+  // Nothing in range - full scan to help diagnose wiring
+  i2c_scan();
+  return 0;
+}
+
 esp_err_t sensor_init(void) {
-  // Initialize I2C master
-  i2c_config_t conf = {
-      .mode = I2C_MODE_MASTER,
+  // Initialize I2C master bus
+  i2c_master_bus_config_t bus_conf = {
+      .i2c_port = I2C_PORT,
       .sda_io_num = I2C_SDA_PIN,
       .scl_io_num = I2C_SCL_PIN,
-      .sda_pullup_en = GPIO_PULLUP_ENABLE,
-      .scl_pullup_en = GPIO_PULLUP_ENABLE,
-      .master.clk_speed = I2C_FREQ_HZ,
+      .clk_source = I2C_CLK_SRC_DEFAULT,
+      .glitch_ignore_cnt = 7,
+      .flags.enable_internal_pullup = true,
   };
-  ESP_ERROR_CHECK(i2c_param_config(I2C_PORT, &conf));
-  ESP_ERROR_CHECK(i2c_driver_install(I2C_PORT, conf.mode, 0, 0, 0));
+  ESP_ERROR_CHECK(i2c_new_master_bus(&bus_conf, &i2c_bus));
 
   ESP_LOGI(TAG, "I2C initialized: SDA=GPIO%d, SCL=GPIO%d, %d Hz", I2C_SDA_PIN,
            I2C_SCL_PIN, I2C_FREQ_HZ);
 
-  // Scan bus (diagnostic log)
-  i2c_scan();
-
-  // Auto-detect INA260 in the valid address range (0x40-0x4F)
-  ina260_addr = 0;
-  for (uint8_t addr = INA260_ADDR_MIN; addr <= INA260_ADDR_MAX; addr++) {
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-    i2c_master_start(cmd);
-    i2c_master_write_byte(cmd, (addr << 1) | I2C_MASTER_WRITE, true);
-    i2c_master_stop(cmd);
-    esp_err_t ret = i2c_master_cmd_begin(I2C_PORT, cmd, pdMS_TO_TICKS(100));
-    i2c_cmd_link_delete(cmd);
-    if (ret == ESP_OK) {
-      ina260_addr = addr;
-      ESP_LOGI(TAG, "INA260 auto-detected at 0x%02x", ina260_addr);
-      break;
-    }
-  }
+  ina260_addr = ina260_detect();
 
   if (ina260_addr != 0) {
+    i2c_device_config_t dev_conf = {
+        .dev_addr_length = I2C_ADDR_BIT_LEN_7,
+        .device_address = ina260_addr,
+        .scl_speed_hz = I2C_FREQ_HZ,
+    };
+    ESP_ERROR_CHECK(i2c_master_bus_add_device(i2c_bus, &dev_conf, &ina260_dev));
     ina260_ok = true;
 
-    // Configure: 1024-sample averaging (same as Pico code)
-    uint8_t config_data[3] = {INA260_REG_CONFIG, (INA260_CONFIG >> 8) & 0xFF,
-                              INA260_CONFIG & 0xFF};
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-    i2c_master_start(cmd);
-    i2c_master_write_byte(cmd, (ina260_addr << 1) | I2C_MASTER_WRITE, true);
-    i2c_master_write(cmd, config_data, sizeof(config_data), true);
-    i2c_master_stop(cmd);
-    i2c_master_cmd_begin(I2C_PORT, cmd, pdMS_TO_TICKS(100));
-    i2c_cmd_link_delete(cmd);
+    // Configure from the persisted profile (default: 64-sample averaging)
+    uint16_t saved = restore_sensor_config();
+    if (saved != 0)
+      ina260_config = saved;
+    ina260_write_config(ina260_config);
 
     vTaskDelay(pdMS_TO_TICKS(200)); // Let config settle
-    ESP_LOGI(TAG, "INA260 configured (1024-sample averaging)");
+    ESP_LOGI(TAG, "INA260 configured (0x%04x, %lu ms per reading)",
+             ina260_config, (unsigned long)sensor_conversion_ms());
   } else {
     ESP_LOGE(TAG, "INA260 NOT FOUND in range 0x%02x-0x%02x! Check wiring.",
              INA260_ADDR_MIN, INA260_ADDR_MAX);
@@ -113,56 +183,347 @@ esp_err_t sensor_init(void) {
   return ESP_OK;
 }
 
+// Read one 16-bit INA260 register (big-endian on the wire)
+static esp_err_t ina260_read_reg(uint8_t reg, uint16_t *out) {
+  uint8_t data[2] = {0};
+
+  esp_err_t ret = i2c_master_transmit_receive(ina260_dev, &reg, 1, data, 2,
+                                              I2C_TIMEOUT_MS);
+  if (ret == ESP_OK)
+    *out = (data[0] << 8) | data[1];
+  return ret;
+}
+
 float ina260_read_voltage(void) {
   if (!ina260_ok)
     return 0.0f;
 
-  uint8_t reg = INA260_REG_VOLTAGE;
-  uint8_t data[2] = {0};
-
-  i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-  i2c_master_start(cmd);
-  i2c_master_write_byte(cmd, (ina260_addr << 1) | I2C_MASTER_WRITE, true);
-  i2c_master_write_byte(cmd, reg, true);
-  i2c_master_start(cmd); // Repeated start
-  i2c_master_write_byte(cmd, (ina260_addr << 1) | I2C_MASTER_READ, true);
-  i2c_master_read(cmd, data, 2, I2C_MASTER_LAST_NACK);
-  i2c_master_stop(cmd);
-  esp_err_t ret = i2c_master_cmd_begin(I2C_PORT, cmd, pdMS_TO_TICKS(100));
-  i2c_cmd_link_delete(cmd);
+  ina260_sample_t sample;
+  if (sampler_task != NULL)
+    return ina260_latest(&sample) ? sample.vbus_raw * INA260_VBUS_LSB_MV / 1000.0f
+                                  : 0.0f;
 
+  uint16_t raw = 0;
+  esp_err_t ret = ina260_read_reg(INA260_REG_VOLTAGE, &raw);
   if (ret != ESP_OK) {
     ESP_LOGW(TAG, "Voltage read failed: %d", ret);
     return 0.0f;
   }
 
-  uint16_t raw = (data[0] << 8) | data[1];
-  return raw * 1.25f / 1000.0f; // LSB = 1.25mV
+  return raw * INA260_VBUS_LSB_MV / 1000.0f;
 }
 
 float ina260_read_current(void) {
   if (!ina260_ok)
     return 0.0f;
 
-  uint8_t reg = INA260_REG_CURRENT;
-  uint8_t data[2] = {0};
-
-  i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-  i2c_master_start(cmd);
-  i2c_master_write_byte(cmd, (ina260_addr << 1) | I2C_MASTER_WRITE, true);
-  i2c_master_write_byte(cmd, reg, true);
-  i2c_master_start(cmd);
-  i2c_master_write_byte(cmd, (ina260_addr << 1) | I2C_MASTER_READ, true);
-  i2c_master_read(cmd, data, 2, I2C_MASTER_LAST_NACK);
-  i2c_master_stop(cmd);
-  esp_err_t ret = i2c_master_cmd_begin(I2C_PORT, cmd, pdMS_TO_TICKS(100));
-  i2c_cmd_link_delete(cmd);
+  ina260_sample_t sample;
+  if (sampler_task != NULL)
+    return ina260_latest(&sample) ? fabsf(sample.current_raw * INA260_CURRENT_LSB_MA)
+                                  : 0.0f;
 
+  uint16_t raw = 0;
+  esp_err_t ret = ina260_read_reg(INA260_REG_CURRENT, &raw);
   if (ret != ESP_OK) {
     ESP_LOGW(TAG, "Current read failed: %d", ret);
     return 0.0f;
   }
 
-  int16_t raw = (int16_t)((data[0] << 8) | data[1]);
-  return fabsf(raw * 1.25f); // LSB = 1.25mA, abs for polarity
+  return fabsf((int16_t)raw * INA260_CURRENT_LSB_MA); // abs for polarity
+}
+
+esp_err_t ina260_read_raw(uint16_t *vbus_raw, int16_t *current_raw) {
+  *vbus_raw = 0;
+  *current_raw = 0;
+  if (!ina260_ok)
+    return ESP_ERR_INVALID_STATE;
+
+  ina260_sample_t sample;
+  if (sampler_task != NULL) {
+    if (!ina260_latest(&sample))
+      return ESP_ERR_NOT_FINISHED;
+    *vbus_raw = sample.vbus_raw;
+    *current_raw = sample.current_raw;
+    return ESP_OK;
+  }
+
+  uint16_t cur = 0;
+  esp_err_t ret = ina260_read_reg(INA260_REG_VOLTAGE, vbus_raw);
+  if (ret == ESP_OK)
+    ret = ina260_read_reg(INA260_REG_CURRENT, &cur);
+  if (ret != ESP_OK) {
+    ESP_LOGW(TAG, "Raw read failed: %d", ret);
+    *vbus_raw = 0;
+    return ret;
+  }
+
+  *current_raw = (int16_t)cur;
+  return ESP_OK;
+}
+
+// ============== Sampler Task ==============
+static void IRAM_ATTR ina260_alert_isr(void *arg) {
+  BaseType_t woken = pdFALSE;
+  vTaskNotifyGiveFromISR(sampler_task, &woken);
+  portYIELD_FROM_ISR(woken);
+}
+
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 4, 0)
+// Mask/Enable (clears the ALERT latch), voltage, current as one transaction:
+// START addr+W reg START addr+R data ... STOP. The job list is built once;
+// only the receive buffers change between samples.
+#define BURST_REGS 3
+static uint8_t burst_data[BURST_REGS][2];
+static uint8_t burst_addr_w, burst_addr_r;
+static uint8_t burst_regs[BURST_REGS] = {INA260_REG_MASK_ENABLE,
+                                         INA260_REG_VOLTAGE, INA260_REG_CURRENT};
+static i2c_operation_job_t burst_ops[BURST_REGS * 6 + 1];
+static size_t burst_op_count = 0;
+
+static void ina260_burst_prepare(void) {
+  size_t n = 0;
+  burst_addr_w = (ina260_addr << 1) | 0;
+  burst_addr_r = (ina260_addr << 1) | 1;
+  for (int i = 0; i < BURST_REGS; i++) {
+    burst_ops[n++] = (i2c_operation_job_t){.command = I2C_MASTER_CMD_START};
+    burst_ops[n++] = (i2c_operation_job_t){
+        .command = I2C_MASTER_CMD_WRITE,
+        .write = {.ack_check = true, .data = &burst_addr_w, .total_bytes = 1}};
+    burst_ops[n++] = (i2c_operation_job_t){
+        .command = I2C_MASTER_CMD_WRITE,
+        .write = {.ack_check = true, .data = &burst_regs[i], .total_bytes = 1}};
+    burst_ops[n++] = (i2c_operation_job_t){.command = I2C_MASTER_CMD_START};
+    burst_ops[n++] = (i2c_operation_job_t){
+        .command = I2C_MASTER_CMD_WRITE,
+        .write = {.ack_check = true, .data = &burst_addr_r, .total_bytes = 1}};
+    // MSB acked, LSB nacked to end the read
+    burst_ops[n++] = (i2c_operation_job_t){
+        .command = I2C_MASTER_CMD_READ,
+        .read = {.ack_value = I2C_ACK_VAL, .data = &burst_data[i][0],
+                 .total_bytes = 1}};
+    burst_ops[n++] = (i2c_operation_job_t){
+        .command = I2C_MASTER_CMD_READ,
+        .read = {.ack_value = I2C_NACK_VAL, .data = &burst_data[i][1],
+                 .total_bytes = 1}};
+  }
+  burst_ops[n++] = (i2c_operation_job_t){.command = I2C_MASTER_CMD_STOP};
+  burst_op_count = n;
+}
+
+static esp_err_t ina260_read_burst(uint16_t *vbus_raw, uint16_t *cur_raw) {
+  esp_err_t ret = i2c_master_execute_defined_operations(
+      ina260_dev, burst_ops, burst_op_count, I2C_TIMEOUT_MS);
+  if (ret == ESP_OK) {
+    *vbus_raw = (burst_data[1][0] << 8) | burst_data[1][1];
+    *cur_raw = (burst_data[2][0] << 8) | burst_data[2][1];
+  }
+  return ret;
+}
+#else
+// No custom-sequence API before IDF 5.4: back-to-back register reads
+static void ina260_burst_prepare(void) {}
+
+static esp_err_t ina260_read_burst(uint16_t *vbus_raw, uint16_t *cur_raw) {
+  uint16_t mask;
+  esp_err_t ret = ina260_read_reg(INA260_REG_MASK_ENABLE, &mask);
+  if (ret == ESP_OK)
+    ret = ina260_read_reg(INA260_REG_VOLTAGE, vbus_raw);
+  if (ret == ESP_OK)
+    ret = ina260_read_reg(INA260_REG_CURRENT, cur_raw);
+  return ret;
+}
+#endif
+
+static void sampler_task_fn(void *pvParameters) {
+  for (;;) {
+    uint16_t config = ina260_config;
+    bool triggered = (config & INA260_CFG_MODE_MASK) == INA260_MODE_TRIGGERED;
+    uint32_t conv_ms = sensor_conversion_ms();
+    TickType_t start = xTaskGetTickCount();
+
+    // Triggered mode: writing the config register starts one conversion
+    if (triggered)
+      ina260_write_config(config);
+
+    // Woken by ALERT; the timeout keeps sampling if the pin isn't wired
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(conv_ms + INA260_SAMPLE_SLACK_MS));
+
+    uint16_t vbus = 0, cur = 0;
+    int64_t read_start = esp_timer_get_time();
+    esp_err_t ret = ina260_read_burst(&vbus, &cur);
+    perf_record_i2c((uint32_t)(esp_timer_get_time() - read_start));
+    if (ret != ESP_OK) {
+      ESP_LOGW(TAG, "Sample read failed: %d", ret);
+      continue;
+    }
+
+    unsigned n = atomic_load_explicit(&sample_count, memory_order_relaxed);
+    ina260_sample_t *slot = &sample_ring[n & (INA260_SAMPLE_RING_LEN - 1)];
+    slot->vbus_raw = vbus;
+    slot->current_raw = (int16_t)cur;
+    slot->tick = xTaskGetTickCount();
+    atomic_store_explicit(&sample_count, n + 1, memory_order_release);
+    for (int i = 0; i < n_sample_cbs; i++)
+      sample_cbs[i](slot);
+
+    // Pace fast profiles, and space out one-shot conversions
+    uint32_t period_ms = triggered ? INA260_TRIGGER_PERIOD_MS
+                                   : INA260_SAMPLE_MIN_MS;
+    TickType_t elapsed = xTaskGetTickCount() - start;
+    if (elapsed < pdMS_TO_TICKS(period_ms))
+      vTaskDelay(pdMS_TO_TICKS(period_ms) - elapsed);
+  }
+}
+
+esp_err_t sensor_sampler_start(void) {
+  if (!ina260_ok || sampler_task != NULL)
+    return ESP_OK;
+
+  ina260_burst_prepare();
+  if (xTaskCreate(sampler_task_fn, "ina260", SAMPLER_STACK_SIZE, NULL,
+                  SAMPLER_PRIORITY, &sampler_task) != pdPASS) {
+    ESP_LOGE(TAG, "Sampler task create failed");
+    return ESP_ERR_NO_MEM;
+  }
+
+  // Conversion-ready on ALERT; without the pin we just sample on the timeout
+  uint8_t mask_data[3] = {INA260_REG_MASK_ENABLE, (INA260_MASK_CNVR >> 8) & 0xFF,
+                          INA260_MASK_CNVR & 0xFF};
+  esp_err_t ret = i2c_master_transmit(ina260_dev, mask_data, sizeof(mask_data),
+                                      I2C_TIMEOUT_MS);
+
+  gpio_config_t io = {
+      .pin_bit_mask = 1ULL << INA260_ALERT_PIN,
+      .mode = GPIO_MODE_INPUT,
+      .pull_up_en = GPIO_PULLUP_ENABLE,
+      .intr_type = GPIO_INTR_NEGEDGE,
+  };
+  if (ret == ESP_OK)
+    ret = gpio_config(&io);
+  if (ret == ESP_OK) {
+    ret = gpio_install_isr_service(0);
+    if (ret == ESP_ERR_INVALID_STATE)
+      ret = ESP_OK; // Already installed by another driver
+  }
+  if (ret == ESP_OK)
+    ret = gpio_isr_handler_add(INA260_ALERT_PIN, ina260_alert_isr, NULL);
+
+  if (ret != ESP_OK) {
+    ESP_LOGW(TAG, "ALERT setup failed (%d), sampling on conversion time",
+             ret);
+  } else {
+    ESP_LOGI(TAG, "Sampler running (ALERT on GPIO%d)", INA260_ALERT_PIN);
+  }
+  return ESP_OK;
+}
+
+esp_err_t sensor_add_sample_cb(sensor_sample_cb_t cb) {
+  if (n_sample_cbs >= SENSOR_SAMPLE_CB_MAX)
+    return ESP_ERR_NO_MEM;
+  sample_cbs[n_sample_cbs++] = cb;
+  return ESP_OK;
+}
+
+// 1.25 mV * 1.25 mA = 1.5625 uW per count^2
+uint32_t ina260_power_mw(uint16_t vbus_raw, int16_t current_raw) {
+  uint32_t i_raw = (current_raw < 0) ? -current_raw : current_raw;
+  return (uint32_t)(((uint64_t)vbus_raw * i_raw * 25) / 16000);
+}
+
+bool ina260_latest(ina260_sample_t *out) {
+  for (;;) {
+    unsigned n = atomic_load_explicit(&sample_count, memory_order_acquire);
+    if (n == 0)
+      return false;
+    *out = sample_ring[(n - 1) & (INA260_SAMPLE_RING_LEN - 1)];
+    // A lapping producer could have rewritten the slot mid-copy
+    unsigned now = atomic_load_explicit(&sample_count, memory_order_acquire);
+    if (now - n < INA260_SAMPLE_RING_LEN - 1)
+      return true;
+  }
+}
+
+// ============== Sensor Profiles ==============
+uint16_t sensor_get_config(void) { return ina260_config; }
+
+uint32_t sensor_conversion_ms(void) {
+  uint16_t config = ina260_config;
+  uint32_t avg = avg_counts[(config >> 9) & 0x7];
+  uint32_t ct_us = conv_times_us[(config >> 6) & 0x7] +
+                   conv_times_us[(config >> 3) & 0x7];
+  return (avg * ct_us + 999) / 1000;
+}
+
+esp_err_t sensor_set_config(uint16_t config) {
+  if (!ina260_ok)
+    return ESP_ERR_INVALID_STATE;
+
+  config = (config & 0x0FFF) | INA260_CFG_FIXED;
+  if (config == ina260_config)
+    return ESP_OK; // The gateway re-selects profiles often; spare the flash
+  esp_err_t ret = ina260_write_config(config);
+  if (ret != ESP_OK) {
+    ESP_LOGW(TAG, "Config write failed: %d", ret);
+    return ret;
+  }
+  ina260_config = config;
+  save_sensor_config(config);
+  if (sampler_task != NULL)
+    xTaskNotifyGive(sampler_task); // Pick up the new timing now
+  ESP_LOGI(TAG, "Config 0x%04x (%lu ms per reading)", config,
+           (unsigned long)sensor_conversion_ms());
+  return ESP_OK;
+}
+
+static int code_for(const uint16_t *table, long value) {
+  for (int i = 0; i < 8; i++) {
+    if (table[i] == value)
+      return i;
+  }
+  return -1;
+}
+
+int sensor_profile_command(const char *args, char *resp, size_t resp_size) {
+  if (args[0] != '\0') {
+    int profile = -1;
+    for (int i = 0; i < SENSOR_PROFILE_CUSTOM; i++) {
+      if (strcasecmp(args, profiles[i].name) == 0)
+        profile = i;
+    }
+
+    uint16_t config;
+    if (profile >= 0) {
+      config = profiles[profile].config;
+    } else {
+      // Custom: "<avg>:<vbus_us>:<ish_us>[:t]"
+      char *p;
+      int avg = code_for(avg_counts, strtol(args, &p, 10));
+      int vct = (*p == ':') ? code_for(conv_times_us, strtol(p + 1, &p, 10)) : -1;
+      int ict = (*p == ':') ? code_for(conv_times_us, strtol(p + 1, &p, 10)) : -1;
+      bool trig = (strcmp(p, ":t") == 0);
+      if (avg < 0 || vct < 0 || ict < 0 || (*p != '\0' && !trig))
+        return snprintf(resp, resp_size, "ERR:SP:%s", args);
+      config = INA260_CFG_FIXED | INA260_CFG_AVG(avg) | INA260_CFG_VBUSCT(vct) |
+               INA260_CFG_ISHCT(ict) |
+               (trig ? INA260_MODE_TRIGGERED : INA260_MODE_CONTINUOUS);
+    }
+
+    if (sensor_set_config(config) != ESP_OK)
+      return snprintf(resp, resp_size, "ERR:SP:I2C");
+  }
+
+  uint16_t config = ina260_config;
+  const char *name = "CUSTOM";
+  for (int i = 0; i < SENSOR_PROFILE_CUSTOM; i++) {
+    if (profiles[i].config == config)
+      name = profiles[i].name;
+  }
+  return snprintf(resp, resp_size, "SP:%s,AVG:%u,CT:%u/%uus,%s,T:%lums", name,
+                  avg_counts[(config >> 9) & 0x7],
+                  conv_times_us[(config >> 6) & 0x7],
+                  conv_times_us[(config >> 3) & 0x7],
+                  ((config & INA260_CFG_MODE_MASK) == INA260_MODE_TRIGGERED)
+                      ? "TRIG"
+                      : "CONT",
+                  (unsigned long)sensor_conversion_ms());
 }
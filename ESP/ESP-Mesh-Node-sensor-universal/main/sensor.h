@@ -3,17 +3,83 @@
 
 #include "esp_err.h"
 #include <stdbool.h>
+#include <stdint.h>
 
 // Initialize I2C bus and configure INA260 sensor.
 // Returns ESP_OK on success. Sets internal ina260_ok flag.
 esp_err_t sensor_init(void);
 
+// INA260 register scaling (fixed by the part, see datasheet)
+#define INA260_VBUS_LSB_MV 1.25f
+#define INA260_CURRENT_LSB_MA 1.25f
+
+// ============== Background Sampler ==============
+// A sampler task reads Mask/Enable, bus voltage and current in one I2C
+// transaction each time the INA260 ALERT pin signals conversion-ready (or
+// after the profile's conversion time if the pin isn't wired), and pushes
+// the result into a single-producer ring. The read functions below return
+// the latest ring entry, so a sensor read costs no I2C time in the caller
+// (typically the BLE mesh task).
+#define INA260_SAMPLE_RING_LEN 8      // Power of two
+#define INA260_SAMPLE_SLACK_MS 10     // Fallback wait past the conversion time
+#define INA260_SAMPLE_MIN_MS 20       // Sampling floor for very fast profiles
+#define INA260_TRIGGER_PERIOD_MS 1000 // Triggered mode: one conversion per period
+                                      // (longer if the conversion is)
+
+typedef struct {
+  uint16_t vbus_raw;
+  int16_t current_raw;
+  uint32_t tick; // xTaskGetTickCount() at sample time
+} ina260_sample_t;
+
+// Called from the sampler task after every new sample (keep it short).
+// Up to SENSOR_SAMPLE_CB_MAX callbacks, added once at init.
+#define SENSOR_SAMPLE_CB_MAX 2
+typedef void (*sensor_sample_cb_t)(const ina260_sample_t *sample);
+esp_err_t sensor_add_sample_cb(sensor_sample_cb_t cb);
+
+// P = V * I in mW from raw registers (abs current, like the text reading)
+uint32_t ina260_power_mw(uint16_t vbus_raw, int16_t current_raw);
+
+// Start the sampler task. Call after sensor_init(); no-op without INA260.
+esp_err_t sensor_sampler_start(void);
+
+// Copy the newest sample. Returns false if none has been taken yet.
+bool ina260_latest(ina260_sample_t *out);
+
 // Read INA260 bus voltage in volts. Returns 0.0 if sensor not found.
 float ina260_read_voltage(void);
 
 // Read INA260 current in milliamps. Returns 0.0 if sensor not found.
 float ina260_read_current(void);
 
+// Read raw bus voltage and (signed) current registers for the binary
+// telemetry frame. Both are zeroed on failure.
+esp_err_t ina260_read_raw(uint16_t *vbus_raw, int16_t *current_raw);
+
+// ============== Sensor Profiles ==============
+// INA260 config register: averaging count, VBUS / shunt conversion times and
+// continuous vs triggered mode. Selected at runtime with the "sp" command and
+// persisted in NVS. Reading latency is roughly avg * (vbus_ct + ish_ct).
+typedef enum {
+  SENSOR_PROFILE_FAST = 0, // 4 avg, 1.1 ms + 1.1 ms   (~9 ms)  - balancing
+  SENSOR_PROFILE_BALANCED, // 64 avg, 1.1 ms + 1.1 ms  (~141 ms) - default
+  SENSOR_PROFILE_ACCURATE, // 256 avg, 1.1 ms + 1.1 ms (~564 ms), 1 Hz - idle
+  SENSOR_PROFILE_CUSTOM,
+} sensor_profile_t;
+
+// Write and persist a raw config register value
+esp_err_t sensor_set_config(uint16_t config);
+uint16_t sensor_get_config(void);
+
+// Reading latency of the active config in ms
+uint32_t sensor_conversion_ms(void);
+
+// "sp" command: "" reports, "fast" / "balanced" / "accurate" selects a
+// profile, "<avg>:<vbus_us>:<ish_us>[:t]" sets a custom one (t = triggered).
+// Returns response length.
+int sensor_profile_command(const char *args, char *resp, size_t resp_size);
+
 // Scan I2C bus and log all found devices. Diagnostic only.
 void i2c_scan(void);
 
@@ -0,0 +1,145 @@
+#include "sensor_stats.h"
+#include "load_control.h"
+#include "mesh_node.h"
+#include "node_tracker.h"
+#include "sensor.h"
+
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TAG "STATS"
+
+// One bucket per second; one extra for the second being filled
+#define STATS_BUCKETS (STATS_MAX_WINDOW_S + 1)
+
+typedef struct {
+  uint32_t sec; // Uptime second this bucket holds (valid when n > 0)
+  uint16_t n;
+  uint8_t duty_min;
+  uint8_t duty_max;
+  uint32_t p_min_mw;
+  uint32_t p_max_mw;
+  uint64_t p_sum_mw;
+  uint32_t vbus_sum;
+  uint64_t i2_sum;      // current_raw^2
+  uint64_t energy_mwms; // mW * ms
+} stats_bucket_t;
+
+static stats_bucket_t buckets[STATS_BUCKETS];
+static bool have_prev = false;
+static uint32_t prev_ms = 0;
+static portMUX_TYPE stats_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// Sampler task: O(1) per sample
+static void stats_on_sample(const ina260_sample_t *sample) {
+  uint32_t now_ms = pdTICKS_TO_MS(sample->tick);
+  uint32_t sec = now_ms / STATS_BUCKET_MS;
+  uint32_t p_mw = ina260_power_mw(sample->vbus_raw, sample->current_raw);
+  uint8_t duty = (uint8_t)get_current_duty();
+  uint32_t dt_ms = have_prev ? now_ms - prev_ms : 0;
+  if (dt_ms > STATS_MAX_GAP_MS)
+    dt_ms = STATS_MAX_GAP_MS;
+  have_prev = true;
+  prev_ms = now_ms;
+
+  taskENTER_CRITICAL(&stats_lock);
+  stats_bucket_t *b = &buckets[sec % STATS_BUCKETS];
+  if (b->n == 0 || b->sec != sec) {
+    memset(b, 0, sizeof(*b));
+    b->sec = sec;
+    b->p_min_mw = UINT32_MAX;
+    b->duty_min = b->duty_max = duty;
+  }
+  b->n++;
+  if (p_mw < b->p_min_mw)
+    b->p_min_mw = p_mw;
+  if (p_mw > b->p_max_mw)
+    b->p_max_mw = p_mw;
+  if (duty < b->duty_min)
+    b->duty_min = duty;
+  if (duty > b->duty_max)
+    b->duty_max = duty;
+  b->p_sum_mw += p_mw;
+  b->vbus_sum += sample->vbus_raw;
+  b->i2_sum += (int32_t)sample->current_raw * sample->current_raw;
+  b->energy_mwms += (uint64_t)p_mw * dt_ms;
+  taskEXIT_CRITICAL(&stats_lock);
+}
+
+void sensor_stats_init(void) {
+  if (sensor_add_sample_cb(stats_on_sample) != ESP_OK)
+    ESP_LOGE(TAG, "No free sampler callback slot");
+}
+
+int sensor_stats_command(const char *args, uint8_t *buf, size_t buf_size) {
+  long window = STATS_DEFAULT_WINDOW_S;
+  if (args[0] != '\0') {
+    char *endptr;
+    window = strtol(args, &endptr, 10);
+    if (endptr == args || *endptr != '\0')
+      return 0;
+  }
+  if (window < 1 || window > STATS_MAX_WINDOW_S ||
+      buf_size < sizeof(stats_frame_t))
+    return 0;
+
+  int node_id = node_id_of(node_state.addr);
+  stats_frame_t frame = {
+      .version = STATS_FRAME_V1,
+      .node_id = node_id < 0 ? 0 : node_id,
+      .duty = (uint8_t)get_current_duty(),
+      .p_min_mw = UINT32_MAX,
+  };
+  uint32_t n = 0, vbus_sum = 0;
+  uint64_t p_sum = 0, i2_sum = 0, energy = 0;
+  uint8_t duty_min = frame.duty, duty_max = frame.duty;
+  uint32_t cur_sec = pdTICKS_TO_MS(xTaskGetTickCount()) / STATS_BUCKET_MS;
+
+  taskENTER_CRITICAL(&stats_lock);
+  for (uint32_t k = 1; k <= (uint32_t)window; k++) {
+    uint32_t sec = cur_sec - k;
+    const stats_bucket_t *b = &buckets[sec % STATS_BUCKETS];
+    if (b->n == 0 || b->sec != sec)
+      continue;
+    frame.window_s++;
+    n += b->n;
+    if (b->p_min_mw < frame.p_min_mw)
+      frame.p_min_mw = b->p_min_mw;
+    if (b->p_max_mw > frame.p_max_mw)
+      frame.p_max_mw = b->p_max_mw;
+    if (b->duty_min < duty_min)
+      duty_min = b->duty_min;
+    if (b->duty_max > duty_max)
+      duty_max = b->duty_max;
+    p_sum += b->p_sum_mw;
+    vbus_sum += b->vbus_sum;
+    i2_sum += b->i2_sum;
+    energy += b->energy_mwms;
+  }
+  taskEXIT_CRITICAL(&stats_lock);
+
+  if (frame.window_s < window)
+    frame.flags |= STATS_FLAG_PARTIAL;
+  if (duty_min != duty_max)
+    frame.flags |= STATS_FLAG_DUTY_CHANGED;
+  if (n) {
+    frame.samples = n > UINT16_MAX ? UINT16_MAX : n;
+    frame.p_mean_mw = p_sum / n;
+    frame.vbus_mean_raw = vbus_sum / n;
+    frame.i_rms_raw = (uint16_t)sqrtf((float)i2_sum / n);
+  } else {
+    frame.p_min_mw = 0;
+  }
+  frame.energy_uwh = energy / 3600; // 1 uWh = 3600 mW*ms
+
+  memcpy(buf, &frame, sizeof(frame));
+  return sizeof(frame);
+}
+
+bool is_stats_frame(const uint8_t *data, uint16_t len) {
+  return len == STATS_FRAME_LEN && data[0] == STATS_FRAME_V1;
+}
@@ -0,0 +1,58 @@
+#ifndef SENSOR_STATS_H
+#define SENSOR_STATS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// ============== Rolling Sensor Statistics ==============
+// Every sampler sample is folded into a one-second bucket (count, min / max /
+// sum of power, sum of bus voltage and current^2, energy = P * time since the
+// previous sample). A window summary combines the last N complete buckets,
+// so the Pi can fetch averages and energy over 1..STATS_MAX_WINDOW_S seconds
+// with one small reply instead of polling at the sample rate:
+//   [STATS_FRAME_V1][node_id][tid][window_s][samples u16][duty][flags]
+//   [p_min_mw u32][p_max_mw u32][p_mean_mw u32][vbus_mean_raw u16]
+//   [i_rms_raw u16][energy_uwh u32]
+// The newest (current) second is not included, so a window lags by < 1 s.
+#define STATS_FRAME_V1 0xA4
+#define STATS_FRAME_LEN 28
+#define STATS_BUCKET_MS 1000
+#define STATS_MAX_WINDOW_S 60
+#define STATS_DEFAULT_WINDOW_S 10
+#define STATS_MAX_GAP_MS 2000 // Energy span credited to one sample, at most
+
+#define STATS_FLAG_PARTIAL 0x01      // Fewer seconds of data than asked for
+#define STATS_FLAG_DUTY_CHANGED 0x02 // Duty moved during the window
+
+typedef struct {
+  uint8_t version;  // STATS_FRAME_V1
+  uint8_t node_id;  // unicast - NODE_BASE_ADDR
+  uint8_t tid;      // request TID (see mesh_tx.h), 0 if none
+  uint8_t window_s; // seconds with data (<= requested)
+  uint16_t samples;
+  uint8_t duty; // current PWM duty
+  uint8_t flags;
+  uint32_t p_min_mw;
+  uint32_t p_max_mw;
+  uint32_t p_mean_mw;
+  uint16_t vbus_mean_raw; // INA260 registers, as in telemetry_frame_t
+  uint16_t i_rms_raw;
+  uint32_t energy_uwh;
+} __attribute__((packed)) stats_frame_t;
+
+_Static_assert(sizeof(stats_frame_t) == STATS_FRAME_LEN,
+               "stats frame must stay 28 bytes");
+
+// Hook the sampler. Call after sensor_init().
+void sensor_stats_init(void);
+
+// "stats" command: "" = STATS_DEFAULT_WINDOW_S, "<seconds>" otherwise.
+// Fills buf with a stats_frame_t; returns STATS_FRAME_LEN (0 if buf is too
+// small or the window is out of range).
+int sensor_stats_command(const char *args, uint8_t *buf, size_t buf_size);
+
+// True if data looks like a stats frame (version + length match)
+bool is_stats_frame(const uint8_t *data, uint16_t len);
+
+#endif /* SENSOR_STATS_H */
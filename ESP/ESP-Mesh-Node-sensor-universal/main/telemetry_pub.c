@@ -0,0 +1,89 @@
+#include "telemetry_pub.h"
+#include "command.h"
+#include "sensor.h"
+#include "mesh_node.h"
+#include "gatt_service.h"
+
+#include "esp_log.h"
+#include "host/ble_hs.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TAG "TELEM_PUB"
+
+static bool pub_enabled = true;
+static uint16_t pub_delta_mw = TELEMETRY_PUB_DELTA_MW_DEFAULT;
+static uint8_t pub_heartbeat = TELEMETRY_PUB_HEARTBEAT_DEFAULT;
+
+// Last published reading, for delta suppression
+static bool have_last = false;
+static uint8_t last_duty = 0;
+static uint32_t last_power_mw = 0;
+static uint8_t periods_since_pub = 0;
+
+void telemetry_pub_update(esp_ble_mesh_model_t *model) {
+  struct net_buf_simple *msg = model->pub->msg;
+  telemetry_frame_t frame;
+
+  net_buf_simple_reset(msg); // Empty = skip this period
+  if (!pub_enabled || model->pub->publish_addr == ESP_BLE_MESH_ADDR_UNASSIGNED)
+    return;
+
+  format_sensor_frame((uint8_t *)&frame, sizeof(frame));
+  uint32_t power_mw = ina260_power_mw(frame.vbus_raw, frame.current_raw);
+  uint32_t change = (power_mw > last_power_mw) ? power_mw - last_power_mw
+                                               : last_power_mw - power_mw;
+
+  periods_since_pub++;
+  bool publish = !have_last || frame.duty != last_duty ||
+                 change > pub_delta_mw || periods_since_pub >= pub_heartbeat;
+  if (!publish)
+    return;
+
+  // Vendor opcode is 3 bytes: first octet, then company ID little-endian
+  net_buf_simple_add_u8(msg, (VND_OP_STATUS >> 16) & 0xFF);
+  net_buf_simple_add_le16(msg, VND_OP_STATUS & 0xFFFF);
+  net_buf_simple_add_mem(msg, &frame, sizeof(frame));
+
+  // Gateway: our own publication doesn't come back to us, tell the Pi here
+  if (gatt_conn_handle != BLE_HS_CONN_HANDLE_NONE) {
+    telemetry_frame_t pub = frame;
+    pub.version = TELEMETRY_FRAME_PUB;
+    gatt_notify_sensor_data((const char *)&pub, sizeof(pub));
+  }
+
+  ESP_LOGD(TAG, "Publish: duty=%d%%, P=%lumW (change %lu, %d periods)",
+           frame.duty, (unsigned long)power_mw, (unsigned long)change,
+           periods_since_pub);
+  have_last = true;
+  last_duty = frame.duty;
+  last_power_mw = power_mw;
+  periods_since_pub = 0;
+}
+
+int telemetry_pub_command(const char *args, char *resp, size_t resp_size) {
+  if (strcmp(args, "off") == 0) {
+    pub_enabled = false;
+  } else if (strcmp(args, "on") == 0) {
+    pub_enabled = true;
+    have_last = false; // Publish on the next period
+  } else if (args[0] != '\0') {
+    char *endptr;
+    long delta = strtol(args, &endptr, 10);
+    if (endptr == args || delta < 0 || delta > UINT16_MAX)
+      return snprintf(resp, resp_size, "ERR:PUB:%s", args);
+    pub_delta_mw = (uint16_t)delta;
+    if (*endptr == ':') {
+      long hb = atol(endptr + 1);
+      if (hb < 1 || hb > UINT8_MAX)
+        return snprintf(resp, resp_size, "ERR:PUB:%s", args);
+      pub_heartbeat = (uint8_t)hb;
+    }
+    ESP_LOGI(TAG, "Delta %u mW, heartbeat %u periods", pub_delta_mw,
+             pub_heartbeat);
+  }
+
+  return snprintf(resp, resp_size, "PUB:%s,DELTA:%umW,HB:%u",
+                  pub_enabled ? "ON" : "OFF", pub_delta_mw, pub_heartbeat);
+}
@@ -0,0 +1,25 @@
+#ifndef TELEMETRY_PUB_H
+#define TELEMETRY_PUB_H
+
+#include <stddef.h>
+#include "esp_ble_mesh_defs.h"
+
+// ============== Periodic Telemetry Publication ==============
+// The provisioner points the vendor server's publication at
+// MESH_TELEMETRY_ADDR with a fixed period. Every period the stack raises
+// PUBLISH_UPDATE_EVT; we sample a fresh telemetry frame and either load it
+// for the next publish or suppress it when nothing has changed:
+//   - duty changed, or power moved by more than delta_mw -> publish
+//   - otherwise publish at least every heartbeat periods (liveness)
+// A suppressed period leaves the publish buffer empty, which the stack skips.
+#define TELEMETRY_PUB_DELTA_MW_DEFAULT 50
+#define TELEMETRY_PUB_HEARTBEAT_DEFAULT 5 // periods
+
+// Handle PUBLISH_UPDATE_EVT for the vendor server model
+void telemetry_pub_update(esp_ble_mesh_model_t *model);
+
+// "pub" command: "" reports settings, "<delta_mw>:<heartbeat>" sets them,
+// "off" / "on" disables / re-enables publishing. Returns response length.
+int telemetry_pub_command(const char *args, char *resp, size_t resp_size);
+
+#endif /* TELEMETRY_PUB_H */
@@ -12,6 +12,7 @@
 #include "ble_mesh_example_init.h"
 
 #include "mesh_config.h"
+#include "prov_console.h"
 #include "provisioning.h"
 
 #define TAG "MAIN"
@@ -46,5 +47,8 @@ void app_main(void) {
     return;
   }
 
+  // Zone assignment console - the provisioner keeps running without it
+  prov_console_init();
+
   ESP_LOGI(TAG, "Provisioner running - waiting for mesh nodes...");
 }
@@ -8,9 +8,6 @@
 
 uint8_t dev_uuid[16];
 
-// Prevent duplicate provisioning attempts
-bool provisioning_in_progress = false;
-
 // Track when local keys are ready for use
 bool netkey_ready = false;
 bool appkey_ready = false;
@@ -21,6 +18,7 @@ struct esp_ble_mesh_key prov_key;
 // Client models
 esp_ble_mesh_client_t config_client;
 esp_ble_mesh_client_t onoff_client;
+esp_ble_mesh_client_t vnd_client; // Node list pushes (node_list.c)
 
 // Configuration server
 static esp_ble_mesh_cfg_srv_t config_server = {
@@ -48,8 +46,19 @@ esp_ble_mesh_model_t root_models[] = {
     ESP_BLE_MESH_MODEL_GEN_ONOFF_CLI(NULL, &onoff_client),
 };
 
+// Vendor client: sends node lists, takes the gateways' requests for them
+static esp_ble_mesh_model_op_t vnd_cli_op[] = {
+    ESP_BLE_MESH_MODEL_OP(VND_OP_NODE_LIST_GET, 1),
+    ESP_BLE_MESH_MODEL_OP_END,
+};
+
+esp_ble_mesh_model_t vnd_models[] = {
+    ESP_BLE_MESH_VENDOR_MODEL(CID_ESP, VND_MODEL_ID_CLIENT, vnd_cli_op, NULL,
+                              &vnd_client),
+};
+
 esp_ble_mesh_elem_t elements[] = {
-    ESP_BLE_MESH_ELEMENT(0, root_models, ESP_BLE_MESH_MODEL_NONE),
+    ESP_BLE_MESH_ELEMENT(0, root_models, vnd_models),
 };
 
 esp_ble_mesh_comp_t composition = {
@@ -62,7 +71,7 @@ esp_ble_mesh_comp_t composition = {
 esp_ble_mesh_prov_t provision = {
     .prov_uuid = dev_uuid,
     .prov_unicast_addr = PROV_OWN_ADDR,
-    .prov_start_address = 0x0005, // First node gets address 0x0005
+    .prov_start_address = NODE_BASE_ADDR, // Slot 0 (addresses are ours)
     .prov_attention = 0x00,
     .prov_algorithm = 0x00,
     .prov_pub_key_oob = 0x00,
@@ -24,7 +24,27 @@
 #define VND_MODEL_ID_CLIENT 0x0000
 #define VND_MODEL_ID_SERVER 0x0001
 
+// Vendor opcodes the provisioner uses: node list push and the gateways'
+// request for it (node_list.h)
+#define VND_OP_NODE_LIST ESP_BLE_MESH_MODEL_OP_3(0x06, CID_ESP)
+#define VND_OP_NODE_LIST_GET ESP_BLE_MESH_MODEL_OP_3(0x07, CID_ESP)
+
 #define MESH_GROUP_ADDR 0xC000 // Group address for ALL commands
+#define MESH_TELEMETRY_ADDR 0xC001 // Vendor servers publish readings here
+
+// Zone groups ("Z<n>:" commands on the gateway), one per bus segment. A
+// node's vendor server can join MESH_ZONES_PER_NODE of them on top of
+// MESH_GROUP_ADDR (CONFIG_BLE_MESH_MODEL_GROUP_COUNT on the nodes).
+#define MESH_ZONE_BASE_ADDR 0xC100
+#define MESH_MAX_ZONES 8
+#define MESH_ZONES_PER_NODE 3
+#define MESH_ZONE_ADDR(z) (MESH_ZONE_BASE_ADDR + (z))
+
+// Telemetry publication: period byte = steps (bits 0-5) | resolution (bits
+// 6-7, 0 = 100 ms). 20 steps x 100 ms = 2 s. Nodes suppress unchanged
+// readings themselves, so this is the sampling cadence, not the air rate.
+#define TELEMETRY_PUB_PERIOD ((0 << 6) | 20)
+#define TELEMETRY_PUB_TTL 7
 
 #define PROV_OWN_ADDR 0x0001 // Provisioner's own address
 
@@ -46,9 +66,6 @@
 
 extern uint8_t dev_uuid[16];
 
-// Prevent duplicate provisioning attempts
-extern bool provisioning_in_progress;
-
 // Track when local keys are ready for use
 extern bool netkey_ready;
 extern bool appkey_ready;
@@ -63,9 +80,11 @@ extern struct esp_ble_mesh_key {
 // Client models
 extern esp_ble_mesh_client_t config_client;
 extern esp_ble_mesh_client_t onoff_client;
+extern esp_ble_mesh_client_t vnd_client;
 
 // Models
 extern esp_ble_mesh_model_t root_models[];
+extern esp_ble_mesh_model_t vnd_models[];
 
 // Elements and composition
 extern esp_ble_mesh_elem_t elements[];
@@ -3,9 +3,202 @@
 #include "esp_log.h"
 
 #include "model_binding.h"
+#include "node_list.h"
 
 #define TAG "MODEL_BIND"
 
+static const char *const cfg_state_names[] = {
+    "IDLE", "QUEUED", "COMP", "APPKEY", "BIND", "PROBE", "DONE", "FAILED",
+};
+
+static bool cfg_active(const mesh_node_info_t *node) {
+  return node->cfg_state >= NODE_CFG_COMP && node->cfg_state <= NODE_CFG_PROBE;
+}
+
+static int cfg_in_flight(void) {
+  int n = 0;
+  for (int i = 0; i < MAX_NODES; i++) {
+    if (nodes[i].unicast && cfg_active(&nodes[i]))
+      n++;
+  }
+  return n;
+}
+
+// Request composition data - Config messages use NetKey (not AppKey)
+static esp_err_t send_comp_data_get(mesh_node_info_t *node) {
+  esp_ble_mesh_client_common_param_t common = {0};
+  esp_ble_mesh_cfg_client_get_state_t get = {0};
+
+  ESP_LOGI(TAG, "Sending COMP_DATA_GET to 0x%04x using net_idx 0x%04x",
+           node->unicast, prov_key.net_idx);
+  set_config_common(&common, node->unicast, &root_models[1],
+                    ESP_BLE_MESH_MODEL_OP_COMPOSITION_DATA_GET);
+  get.comp_data_get.page = COMP_DATA_PAGE_0;
+
+  return esp_ble_mesh_config_client_get_state(&common, &get);
+}
+
+static esp_err_t send_app_key_add(mesh_node_info_t *node) {
+  esp_ble_mesh_client_common_param_t common = {0};
+  esp_ble_mesh_cfg_client_set_state_t set = {0};
+
+  ESP_LOGI(TAG, "Adding AppKey to node 0x%04x", node->unicast);
+  set_config_common(&common, node->unicast, &root_models[1],
+                    ESP_BLE_MESH_MODEL_OP_APP_KEY_ADD);
+  set.app_key_add.net_idx = prov_key.net_idx;
+  set.app_key_add.app_idx = prov_key.app_idx;
+  memcpy(set.app_key_add.app_key, prov_key.app_key, 16);
+
+  return esp_ble_mesh_config_client_set_state(&common, &set);
+}
+
+// Warm restart probe: one Vendor Model App Get tells us whether the node
+// still holds our AppKey binding (it keeps its config across our reboots)
+static esp_err_t send_vnd_app_get(mesh_node_info_t *node) {
+  esp_ble_mesh_client_common_param_t common = {0};
+  esp_ble_mesh_cfg_client_get_state_t get = {0};
+
+  ESP_LOGI(TAG, "Probing node 0x%04x", node->unicast);
+  set_config_common(&common, node->unicast, &root_models[1],
+                    ESP_BLE_MESH_MODEL_OP_VENDOR_MODEL_APP_GET);
+  get.vnd_model_app_get.element_addr = node->unicast;
+  get.vnd_model_app_get.company_id = CID_ESP;
+  get.vnd_model_app_get.model_id =
+      node->has_vnd_srv ? VND_MODEL_ID_SERVER : VND_MODEL_ID_CLIENT;
+
+  return esp_ble_mesh_config_client_get_state(&common, &get);
+}
+
+// App key indexes are packed two per 3 octets, 12 bits each, with a
+// trailing 2-octet entry for an odd count
+static bool app_idx_list_has(const struct net_buf_simple *buf,
+                             uint16_t app_idx) {
+  const uint8_t *p = buf ? buf->data : NULL;
+  uint16_t len = buf ? buf->len : 0;
+
+  for (; len >= 3; p += 3, len -= 3) {
+    if ((p[0] | ((p[1] & 0x0f) << 8)) == app_idx ||
+        ((p[1] >> 4) | (p[2] << 4)) == app_idx)
+      return true;
+  }
+  return len == 2 && (p[0] | ((p[1] & 0x0f) << 8)) == app_idx;
+}
+
+static void cfg_send_step(mesh_node_info_t *node) {
+  esp_err_t err;
+
+  switch (node->cfg_state) {
+  case NODE_CFG_COMP:
+    err = send_comp_data_get(node);
+    break;
+  case NODE_CFG_APPKEY:
+    err = send_app_key_add(node);
+    break;
+  case NODE_CFG_PROBE:
+    err = send_vnd_app_get(node);
+    break;
+  case NODE_CFG_BIND:
+    bind_next_model(node); // Retries itself on send failure
+    return;
+  default:
+    return;
+  }
+
+  if (err) {
+    ESP_LOGE(TAG, "Node 0x%04x: %s send failed: %d", node->unicast,
+             cfg_state_names[node->cfg_state], err);
+    cfg_pipeline_retry(node);
+  }
+}
+
+// Node left the pipeline - save it and hand its slot to the next queued node
+static void cfg_pipeline_finish(mesh_node_info_t *node, node_cfg_state_t state) {
+  node->cfg_state = state;
+  node_registry_save();
+
+  for (int i = 0; i < MAX_NODES && cfg_in_flight() < CFG_MAX_IN_FLIGHT; i++) {
+    if (nodes[i].unicast && nodes[i].cfg_state == NODE_CFG_QUEUED) {
+      ESP_LOGI(TAG, "Node 0x%04x: dequeued", nodes[i].unicast);
+      cfg_pipeline_advance(&nodes[i], nodes[i].cfg_next);
+    }
+  }
+}
+
+void cfg_pipeline_start(mesh_node_info_t *node, node_cfg_state_t first) {
+  if (cfg_active(node)) {
+    // Re-provisioned mid-configuration: restart from the new first step
+    cfg_pipeline_advance(node, first);
+    return;
+  }
+  if (cfg_in_flight() >= CFG_MAX_IN_FLIGHT) {
+    node->cfg_state = NODE_CFG_QUEUED;
+    node->cfg_next = first;
+    ESP_LOGI(TAG, "Node 0x%04x: queued for configuration (%d in flight)",
+             node->unicast, CFG_MAX_IN_FLIGHT);
+    return;
+  }
+  cfg_pipeline_advance(node, first);
+}
+
+void cfg_pipeline_advance(mesh_node_info_t *node, node_cfg_state_t next) {
+  node->cfg_state = next;
+  node->cfg_retries = 0;
+  cfg_send_step(node);
+}
+
+void cfg_pipeline_retry(mesh_node_info_t *node) {
+  if (!cfg_active(node))
+    return;
+
+  if (++node->cfg_retries > CFG_MAX_RETRIES) {
+    ESP_LOGE(TAG, "Node 0x%04x: %s failed after %d retries, giving up",
+             node->unicast, cfg_state_names[node->cfg_state], CFG_MAX_RETRIES);
+    cfg_pipeline_finish(node, NODE_CFG_FAILED);
+    return;
+  }
+  ESP_LOGW(TAG, "Node 0x%04x: retrying %s (%d/%d)", node->unicast,
+           cfg_state_names[node->cfg_state], node->cfg_retries,
+           CFG_MAX_RETRIES);
+  cfg_send_step(node);
+}
+
+void cfg_pipeline_probe_status(mesh_node_info_t *node, uint8_t status,
+                               const struct net_buf_simple *app_idx) {
+  if (node->cfg_state != NODE_CFG_PROBE)
+    return;
+
+  if (status == 0 && app_idx_list_has(app_idx, prov_key.app_idx)) {
+    ESP_LOGI(TAG, "Node 0x%04x: configuration intact", node->unicast);
+    cfg_pipeline_advance(node, NODE_CFG_BIND);
+    return;
+  }
+
+  ESP_LOGW(TAG, "Node 0x%04x: lost configuration (status 0x%02x), "
+           "re-binding", node->unicast, status);
+  node->srv_bound = node->cli_bound = false;
+  node->vnd_srv_bound = node->vnd_cli_bound = false;
+  node->vnd_srv_subscribed = node->vnd_cli_subscribed = false;
+  node->vnd_srv_pub_set = false;
+  node->zones_subscribed = 0;
+  cfg_pipeline_advance(node, NODE_CFG_APPKEY);
+}
+
+void cfg_pipeline_probe_all(void) {
+  for (int i = 0; i < MAX_NODES; i++) {
+    if (!nodes[i].unicast || nodes[i].cfg_state != NODE_CFG_IDLE)
+      continue;
+    // No composition recorded - the node never got past COMP last time
+    if (!nodes[i].has_vnd_srv && !nodes[i].has_vnd_cli &&
+        !nodes[i].has_onoff_srv && !nodes[i].has_onoff_cli) {
+      cfg_pipeline_start(&nodes[i], NODE_CFG_COMP);
+    } else if (!nodes[i].has_vnd_srv && !nodes[i].has_vnd_cli) {
+      cfg_pipeline_start(&nodes[i], NODE_CFG_APPKEY); // Nothing to probe
+    } else {
+      cfg_pipeline_start(&nodes[i], NODE_CFG_PROBE);
+    }
+  }
+}
+
 // Helper to bind a model to AppKey
 esp_err_t bind_model(mesh_node_info_t *node, uint16_t model_id) {
   esp_ble_mesh_client_common_param_t common = {0};
@@ -58,13 +251,15 @@ esp_err_t bind_vendor_model(mesh_node_info_t *node, uint16_t model_id) {
   return esp_ble_mesh_config_client_set_state(&common, &set);
 }
 
-// Subscribe a node's vendor server model to the group address
-esp_err_t subscribe_vendor_model_to_group(mesh_node_info_t *node) {
+// Subscribe a node's vendor server model to a group address (MESH_GROUP_ADDR
+// or one of its zones)
+esp_err_t subscribe_vendor_model_to_group(mesh_node_info_t *node,
+                                          uint16_t group_addr) {
   esp_ble_mesh_client_common_param_t common = {0};
   esp_ble_mesh_cfg_client_set_state_t set = {0};
 
   ESP_LOGI(TAG, "Subscribing Vnd Server on 0x%04x to group 0x%04x",
-           node->unicast, MESH_GROUP_ADDR);
+           node->unicast, group_addr);
 
   common.opcode = ESP_BLE_MESH_MODEL_OP_MODEL_SUB_ADD;
   common.model = &root_models[1]; // CFG_CLI
@@ -76,16 +271,144 @@ esp_err_t subscribe_vendor_model_to_group(mesh_node_info_t *node) {
   common.msg_role = ROLE_PROVISIONER;
 
   set.model_sub_add.element_addr = node->unicast;
-  set.model_sub_add.sub_addr = MESH_GROUP_ADDR;
+  set.model_sub_add.sub_addr = group_addr;
   set.model_sub_add.model_id = VND_MODEL_ID_SERVER;
   set.model_sub_add.company_id = CID_ESP;
 
   return esp_ble_mesh_config_client_set_state(&common, &set);
 }
 
+// Drop a node's vendor server model from a group (zone reassignment)
+esp_err_t unsubscribe_vendor_model_from_group(mesh_node_info_t *node,
+                                              uint16_t group_addr) {
+  esp_ble_mesh_client_common_param_t common = {0};
+  esp_ble_mesh_cfg_client_set_state_t set = {0};
+
+  ESP_LOGI(TAG, "Unsubscribing Vnd Server on 0x%04x from group 0x%04x",
+           node->unicast, group_addr);
+
+  common.opcode = ESP_BLE_MESH_MODEL_OP_MODEL_SUB_DELETE;
+  common.model = &root_models[1]; // CFG_CLI
+  common.ctx.net_idx = prov_key.net_idx;
+  common.ctx.app_idx = prov_key.app_idx;
+  common.ctx.addr = node->unicast;
+  common.ctx.send_ttl = MSG_SEND_TTL;
+  common.msg_timeout = MSG_TIMEOUT;
+  common.msg_role = ROLE_PROVISIONER;
+
+  set.model_sub_delete.element_addr = node->unicast;
+  set.model_sub_delete.sub_addr = group_addr;
+  set.model_sub_delete.model_id = VND_MODEL_ID_SERVER;
+  set.model_sub_delete.company_id = CID_ESP;
+
+  return esp_ble_mesh_config_client_set_state(&common, &set);
+}
+
+// Subscribe a node's vendor client model to the telemetry group, so gateway
+// nodes receive the other nodes' published readings
+esp_err_t subscribe_vendor_client_to_telemetry(mesh_node_info_t *node) {
+  esp_ble_mesh_client_common_param_t common = {0};
+  esp_ble_mesh_cfg_client_set_state_t set = {0};
+
+  ESP_LOGI(TAG, "Subscribing Vnd Client on 0x%04x to telemetry 0x%04x",
+           node->unicast, MESH_TELEMETRY_ADDR);
+
+  common.opcode = ESP_BLE_MESH_MODEL_OP_MODEL_SUB_ADD;
+  common.model = &root_models[1]; // CFG_CLI
+  common.ctx.net_idx = prov_key.net_idx;
+  common.ctx.app_idx = prov_key.app_idx;
+  common.ctx.addr = node->unicast;
+  common.ctx.send_ttl = MSG_SEND_TTL;
+  common.msg_timeout = MSG_TIMEOUT;
+  common.msg_role = ROLE_PROVISIONER;
+
+  set.model_sub_add.element_addr = node->unicast;
+  set.model_sub_add.sub_addr = MESH_TELEMETRY_ADDR;
+  set.model_sub_add.model_id = VND_MODEL_ID_CLIENT;
+  set.model_sub_add.company_id = CID_ESP;
+
+  return esp_ble_mesh_config_client_set_state(&common, &set);
+}
+
+// Point a node's vendor server publication at the telemetry group
+esp_err_t set_vendor_server_publication(mesh_node_info_t *node) {
+  esp_ble_mesh_client_common_param_t common = {0};
+  esp_ble_mesh_cfg_client_set_state_t set = {0};
+
+  ESP_LOGI(TAG, "Setting Vnd Server publication on 0x%04x -> 0x%04x",
+           node->unicast, MESH_TELEMETRY_ADDR);
+
+  common.opcode = ESP_BLE_MESH_MODEL_OP_MODEL_PUB_SET;
+  common.model = &root_models[1]; // CFG_CLI
+  common.ctx.net_idx = prov_key.net_idx;
+  common.ctx.app_idx = prov_key.app_idx;
+  common.ctx.addr = node->unicast;
+  common.ctx.send_ttl = MSG_SEND_TTL;
+  common.msg_timeout = MSG_TIMEOUT;
+  common.msg_role = ROLE_PROVISIONER;
+
+  set.model_pub_set.element_addr = node->unicast;
+  set.model_pub_set.publish_addr = MESH_TELEMETRY_ADDR;
+  set.model_pub_set.publish_app_idx = prov_key.app_idx;
+  set.model_pub_set.cred_flag = false;
+  set.model_pub_set.publish_ttl = TELEMETRY_PUB_TTL;
+  set.model_pub_set.publish_period = TELEMETRY_PUB_PERIOD;
+  set.model_pub_set.publish_retransmit = 0; // Next period is the retry
+  set.model_pub_set.model_id = VND_MODEL_ID_SERVER;
+  set.model_pub_set.company_id = CID_ESP;
+
+  return esp_ble_mesh_config_client_set_state(&common, &set);
+}
+
+int cfg_zone_pending(const mesh_node_info_t *node) {
+  uint8_t diff = node->zones ^ node->zones_subscribed;
+  return diff ? __builtin_ctz(diff) : -1;
+}
+
+void cfg_zone_sub_status(mesh_node_info_t *node, bool add, uint16_t group_addr,
+                         uint8_t status) {
+  int zone = group_addr - MESH_ZONE_BASE_ADDR;
+  if (zone < 0 || zone >= MESH_MAX_ZONES)
+    return;
+  uint8_t bit = 1 << zone;
+
+  if (status == 0) {
+    ESP_LOGI(TAG, "Node 0x%04x %s zone %d", node->unicast,
+             add ? "joined" : "left", zone);
+  } else if (add) {
+    // Typically Insufficient Resources: the node's subscription list is full
+    ESP_LOGW(TAG, "Node 0x%04x rejected zone %d (status 0x%02x), dropping it",
+             node->unicast, zone, status);
+    node->zones &= ~bit;
+    add = false;
+  }
+  if (add)
+    node->zones_subscribed |= bit;
+  else
+    node->zones_subscribed &= ~bit;
+  bind_next_model(node);
+}
+
+void cfg_pipeline_set_zones(mesh_node_info_t *node, uint8_t zones) {
+  node->zones = zones;
+  switch (node->cfg_state) {
+  case NODE_CFG_DONE:
+    cfg_pipeline_start(node, NODE_CFG_BIND); // Only the zone steps are left
+    break;
+  case NODE_CFG_FAILED:
+    cfg_pipeline_start(node, NODE_CFG_PROBE);
+    break;
+  default:
+    // Queued, mid-configuration or awaiting the boot probe: the BIND chain
+    // picks the new zones up, and the registry is saved when it finishes
+    break;
+  }
+}
+
 // Bind the next unbound model in priority order, or log FULLY CONFIGURED
 void bind_next_model(mesh_node_info_t *node) {
   esp_err_t err;
+  int zone;
 
   if (node->has_onoff_srv && !node->srv_bound) {
     err = bind_model(node, ESP_BLE_MESH_MODEL_ID_GEN_ONOFF_SRV);
@@ -104,12 +427,33 @@ void bind_next_model(mesh_node_info_t *node) {
     if (err)
       ESP_LOGE(TAG, "Bind Vendor Client failed: %d", err);
   } else if (node->has_vnd_srv && !node->vnd_srv_subscribed) {
-    err = subscribe_vendor_model_to_group(node);
+    err = subscribe_vendor_model_to_group(node, MESH_GROUP_ADDR);
     if (err)
       ESP_LOGE(TAG, "Subscribe Vnd Server to group failed: %d", err);
+  } else if (node->has_vnd_cli && !node->vnd_cli_subscribed) {
+    err = subscribe_vendor_client_to_telemetry(node);
+    if (err)
+      ESP_LOGE(TAG, "Subscribe Vnd Client to telemetry failed: %d", err);
+  } else if (node->has_vnd_srv && !node->vnd_srv_pub_set) {
+    err = set_vendor_server_publication(node);
+    if (err)
+      ESP_LOGE(TAG, "Set Vnd Server publication failed: %d", err);
+  } else if (node->has_vnd_srv && (zone = cfg_zone_pending(node)) >= 0) {
+    if (node->zones & (1 << zone))
+      err = subscribe_vendor_model_to_group(node, MESH_ZONE_ADDR(zone));
+    else
+      err = unsubscribe_vendor_model_from_group(node, MESH_ZONE_ADDR(zone));
+    if (err)
+      ESP_LOGE(TAG, "Zone %d subscription change failed: %d", zone, err);
   } else {
     ESP_LOGI(TAG, "========== NODE 0x%04x FULLY CONFIGURED ==========",
              node->unicast);
     ESP_LOGI(TAG, "Provisioned nodes: %d", node_count);
+    cfg_pipeline_finish(node, NODE_CFG_DONE);
+    node_list_node_ready(node);
+    return;
   }
+
+  if (err)
+    cfg_pipeline_retry(node);
 }
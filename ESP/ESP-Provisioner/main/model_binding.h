@@ -10,8 +10,53 @@ esp_err_t bind_model(mesh_node_info_t *node, uint16_t model_id);
 
 esp_err_t bind_vendor_model(mesh_node_info_t *node, uint16_t model_id);
 
-esp_err_t subscribe_vendor_model_to_group(mesh_node_info_t *node);
+esp_err_t subscribe_vendor_model_to_group(mesh_node_info_t *node,
+                                          uint16_t group_addr);
+
+esp_err_t unsubscribe_vendor_model_from_group(mesh_node_info_t *node,
+                                              uint16_t group_addr);
+
+esp_err_t subscribe_vendor_client_to_telemetry(mesh_node_info_t *node);
+
+esp_err_t set_vendor_server_publication(mesh_node_info_t *node);
 
 void bind_next_model(mesh_node_info_t *node);
 
+// Configuration pipeline: up to CFG_MAX_IN_FLIGHT nodes are configured at
+// once, each running its own COMP -> APPKEY -> BIND chain (or PROBE after a
+// warm restart). Further nodes wait in NODE_CFG_QUEUED.
+#define CFG_MAX_IN_FLIGHT 3
+#define CFG_MAX_RETRIES 3
+
+// Start configuring node at step first (NODE_CFG_COMP for a freshly
+// provisioned node, NODE_CFG_PROBE for one restored from NVS)
+void cfg_pipeline_start(mesh_node_info_t *node, node_cfg_state_t first);
+
+// Current step succeeded, move on to next
+void cfg_pipeline_advance(mesh_node_info_t *node, node_cfg_state_t next);
+
+// Current step failed or timed out: resend it, or give up on the node
+void cfg_pipeline_retry(mesh_node_info_t *node);
+
+// Vendor Model App List for a PROBE: config intact -> resume BIND (which
+// finishes at once if every flag is set), otherwise redo AppKey + binds
+void cfg_pipeline_probe_status(mesh_node_info_t *node, uint8_t status,
+                               const struct net_buf_simple *app_idx);
+
+// Probe every node restored by node_registry_load()
+void cfg_pipeline_probe_all(void);
+
+// Zones: the BIND chain ends by subscribing the Vendor Server to each
+// assigned zone group and unsubscribing it from zones it no longer has.
+// Assign a new zone bitmap and run the chain if the node is idle.
+void cfg_pipeline_set_zones(mesh_node_info_t *node, uint8_t zones);
+
+// Zone whose subscription differs from the assignment (next to change), or -1
+int cfg_zone_pending(const mesh_node_info_t *node);
+
+// Model Subscription Add / Delete result for a zone group (status 0 = ok).
+// A rejected zone is dropped from the assignment; the chain continues.
+void cfg_zone_sub_status(mesh_node_info_t *node, bool add, uint16_t group_addr,
+                         uint8_t status);
+
 #endif /* MODEL_BINDING_H */
@@ -0,0 +1,147 @@
+/* Node list: push the registry to gateway-capable nodes, so gateways know
+ * the mesh without probing for it */
+
+#include "esp_log.h"
+
+#include "node_list.h"
+
+#define TAG "NODE_LIST"
+
+#define NODE_LIST_PER_MSG                                                      \
+  ((NODE_LIST_MAX_PAYLOAD - sizeof(node_list_hdr_t)) /                        \
+   sizeof(node_list_entry_t))
+
+// What gateways were last told about each slot
+static bool announced[MAX_NODES];
+static uint8_t announced_zones[MAX_NODES];
+
+static void fill_entry(node_list_entry_t *e, const mesh_node_info_t *n) {
+  e->unicast = n->unicast;
+  e->elem_num = n->elem_num;
+  e->models = (n->has_vnd_srv ? NODE_LIST_MODEL_SRV : 0) |
+              (n->has_vnd_cli ? NODE_LIST_MODEL_CLI : 0);
+  e->zones = n->zones_subscribed;
+}
+
+static esp_err_t send_list(uint16_t dst, const uint8_t *buf, uint16_t len) {
+  esp_ble_mesh_msg_ctx_t ctx = {0};
+  ctx.net_idx = prov_key.net_idx;
+  ctx.app_idx = prov_key.app_idx;
+  ctx.addr = dst;
+  ctx.send_ttl = MSG_SEND_TTL;
+
+  esp_err_t err = esp_ble_mesh_client_model_send_msg(
+      vnd_client.model, &ctx, VND_OP_NODE_LIST, len, (uint8_t *)buf,
+      MSG_TIMEOUT, false, ROLE_PROVISIONER);
+  if (err != ESP_OK)
+    ESP_LOGE(TAG, "Node list to 0x%04x failed: %d", dst, err);
+  return err;
+}
+
+void node_list_init(void) {
+  for (int i = 0; i < MAX_NODES; i++) {
+    announced[i] = nodes[i].unicast != 0;
+    announced_zones[i] = nodes[i].zones_subscribed;
+  }
+}
+
+// Full list to node's vendor client
+static esp_err_t node_list_push(mesh_node_info_t *node) {
+  uint8_t buf[NODE_LIST_MAX_PAYLOAD];
+  node_list_hdr_t hdr = {.version = NODE_LIST_V2,
+                         .flags = NODE_LIST_FLAG_FULL | NODE_LIST_FLAG_FIRST};
+  for (int i = 0; i < MAX_NODES; i++) {
+    if (nodes[i].unicast && announced[i])
+      hdr.total++;
+  }
+
+  // One message per NODE_LIST_PER_MSG entries (at least one message)
+  int i = 0;
+  do {
+    uint16_t len = sizeof(hdr);
+    hdr.count = 0;
+    for (; i < MAX_NODES && hdr.count < NODE_LIST_PER_MSG; i++) {
+      if (!nodes[i].unicast || !announced[i])
+        continue;
+      node_list_entry_t e;
+      fill_entry(&e, &nodes[i]);
+      memcpy(buf + len, &e, sizeof(e));
+      len += sizeof(e);
+      hdr.count++;
+    }
+    // Skip past free slots so the last message is the one flagged LAST
+    while (i < MAX_NODES && !(nodes[i].unicast && announced[i]))
+      i++;
+    if (i >= MAX_NODES)
+      hdr.flags |= NODE_LIST_FLAG_LAST;
+    memcpy(buf, &hdr, sizeof(hdr));
+    esp_err_t err = send_list(node->unicast, buf, len);
+    if (err != ESP_OK)
+      return err; // The gateway asks again (NODE_LIST_GET)
+    hdr.seq++;
+    hdr.flags = NODE_LIST_FLAG_FULL;
+  } while (i < MAX_NODES);
+
+  ESP_LOGI(TAG, "Node 0x%04x: sent node list (%d nodes)", node->unicast,
+           hdr.total);
+  return ESP_OK;
+}
+
+void node_list_node_ready(mesh_node_info_t *node) {
+  int slot = node->unicast - NODE_BASE_ADDR;
+  bool changed =
+      !announced[slot] || announced_zones[slot] != node->zones_subscribed;
+  announced[slot] = true;
+  announced_zones[slot] = node->zones_subscribed;
+
+  if (node->has_vnd_cli)
+    node_list_push(node);
+  if (!changed)
+    return;
+
+  // Everyone else hears about it in one message
+  uint8_t buf[sizeof(node_list_hdr_t) + sizeof(node_list_entry_t)];
+  node_list_hdr_t hdr = {.version = NODE_LIST_V2, .flags = 0, .count = 1};
+  node_list_entry_t e;
+  fill_entry(&e, node);
+  memcpy(buf, &hdr, sizeof(hdr));
+  memcpy(buf + sizeof(hdr), &e, sizeof(e));
+  if (send_list(MESH_TELEMETRY_ADDR, buf, sizeof(buf)) == ESP_OK)
+    ESP_LOGI(TAG, "Node 0x%04x: announced to gateways", node->unicast);
+}
+
+void node_list_model_cb(esp_ble_mesh_model_cb_event_t event,
+                        esp_ble_mesh_model_cb_param_t *param) {
+  esp_ble_mesh_msg_ctx_t *ctx = NULL;
+  uint32_t opcode = 0;
+
+  switch (event) {
+  case ESP_BLE_MESH_MODEL_OPERATION_EVT:
+    ctx = param->model_operation.ctx;
+    opcode = param->model_operation.opcode;
+    break;
+  case ESP_BLE_MESH_CLIENT_MODEL_RECV_PUBLISH_MSG_EVT:
+    ctx = param->client_recv_publish_msg.ctx;
+    opcode = param->client_recv_publish_msg.opcode;
+    break;
+  case ESP_BLE_MESH_MODEL_SEND_COMP_EVT:
+    if (param->model_send_comp.err_code)
+      ESP_LOGW(TAG, "Node list send to 0x%04x failed: %d",
+               param->model_send_comp.ctx->addr,
+               param->model_send_comp.err_code);
+    return;
+  default:
+    return;
+  }
+
+  if (opcode != VND_OP_NODE_LIST_GET)
+    return;
+  // Only configured nodes get the list (it is pushed again on DONE anyway)
+  mesh_node_info_t *node = get_node_info(ctx->addr);
+  if (!node || node->cfg_state != NODE_CFG_DONE) {
+    ESP_LOGW(TAG, "Node list request from 0x%04x ignored", ctx->addr);
+    return;
+  }
+  ESP_LOGI(TAG, "Node 0x%04x: asked for the node list", ctx->addr);
+  node_list_push(node);
+}
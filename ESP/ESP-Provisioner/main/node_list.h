@@ -0,0 +1,54 @@
+/* Node list: push the registry to gateway-capable nodes */
+
+#ifndef NODE_LIST_H
+#define NODE_LIST_H
+
+#include "mesh_config.h"
+#include "node_registry.h"
+
+// VND_OP_NODE_LIST payload (same as the mesh node's node_list.h):
+// [NODE_LIST_V2][flags][count][seq][total] + count * node_list_entry_t, at
+// most NODE_LIST_MAX_PAYLOAD bytes per message. A full list goes to one
+// node's vendor client: every message FULL with its index in seq and the
+// list's entry count in total, FIRST on the first and LAST on the last, so
+// the node can tell a lost message. A delta (no flags, seq/total 0) goes to
+// MESH_TELEMETRY_ADDR, where every vendor client listens.
+#define NODE_LIST_V2 0x4D
+#define NODE_LIST_MAX_PAYLOAD 64
+
+#define NODE_LIST_FLAG_FIRST 0x01
+#define NODE_LIST_FLAG_LAST 0x02
+#define NODE_LIST_FLAG_FULL 0x04
+
+#define NODE_LIST_MODEL_SRV 0x01
+#define NODE_LIST_MODEL_CLI 0x02
+
+typedef struct {
+  uint8_t version;
+  uint8_t flags;
+  uint8_t count;
+  uint8_t seq;   // Message index within a full list
+  uint8_t total; // Entries in the whole full list
+} __attribute__((packed)) node_list_hdr_t;
+
+typedef struct {
+  uint16_t unicast;
+  uint8_t elem_num;
+  uint8_t models; // NODE_LIST_MODEL_*
+  uint8_t zones;  // Zone groups the vendor server is subscribed to
+} __attribute__((packed)) node_list_entry_t;
+
+// Take the nodes restored by node_registry_load() as already announced:
+// they reach every gateway in its full list, no deltas needed
+void node_list_init(void);
+
+// Node finished configuration: send it the full list if it is
+// gateway-capable (vendor client), and a delta to the others if it is new
+// or its zones changed since it was last announced
+void node_list_node_ready(mesh_node_info_t *node);
+
+// Vendor client events: NODE_LIST_GET requests, send failures
+void node_list_model_cb(esp_ble_mesh_model_cb_event_t event,
+                        esp_ble_mesh_model_cb_param_t *param);
+
+#endif /* NODE_LIST_H */
@@ -1,39 +1,134 @@
 /* Node registry: track provisioned nodes */
 
+#include "esp_ble_mesh_networking_api.h"
 #include "esp_log.h"
+#include "nvs.h"
 
 #include "node_registry.h"
 
 #define TAG "NODE_REG"
 
+#define REG_NVS_NAMESPACE "prov_reg"
+#define REG_NVS_KEY "nodes"
+#define REG_VERSION 2
+#define REG_V1_RECORD_LEN 22 // v1: no zone bytes
+
+// Persisted flag bits (mesh_node_info_t bools)
+#define NODE_F_ONOFF_SRV (1 << 0)
+#define NODE_F_ONOFF_CLI (1 << 1)
+#define NODE_F_VND_SRV (1 << 2)
+#define NODE_F_VND_CLI (1 << 3)
+#define NODE_F_SRV_BOUND (1 << 4)
+#define NODE_F_CLI_BOUND (1 << 5)
+#define NODE_F_VND_SRV_BOUND (1 << 6)
+#define NODE_F_VND_CLI_BOUND (1 << 7)
+#define NODE_F_VND_SRV_SUB (1 << 8)
+#define NODE_F_VND_CLI_SUB (1 << 9)
+#define NODE_F_VND_SRV_PUB (1 << 10)
+
+// Compact on-flash record, 24 bytes per node. Fields are only ever appended,
+// so an older record is a prefix of this one.
+typedef struct {
+  uint8_t uuid[16];
+  uint16_t unicast;
+  uint8_t elem_num;
+  uint8_t node_idx;
+  uint16_t flags;
+  uint8_t zones;
+  uint8_t zones_subscribed;
+} __attribute__((packed)) node_record_t;
+
+typedef struct {
+  uint8_t version;
+  uint8_t count;
+  node_record_t rec[MAX_NODES];
+} __attribute__((packed)) node_db_t;
+
 mesh_node_info_t nodes[MAX_NODES] = {0};
 int node_count = 0;
 
+static uint16_t pack_flags(const mesh_node_info_t *n) {
+  return (n->has_onoff_srv ? NODE_F_ONOFF_SRV : 0) |
+         (n->has_onoff_cli ? NODE_F_ONOFF_CLI : 0) |
+         (n->has_vnd_srv ? NODE_F_VND_SRV : 0) |
+         (n->has_vnd_cli ? NODE_F_VND_CLI : 0) |
+         (n->srv_bound ? NODE_F_SRV_BOUND : 0) |
+         (n->cli_bound ? NODE_F_CLI_BOUND : 0) |
+         (n->vnd_srv_bound ? NODE_F_VND_SRV_BOUND : 0) |
+         (n->vnd_cli_bound ? NODE_F_VND_CLI_BOUND : 0) |
+         (n->vnd_srv_subscribed ? NODE_F_VND_SRV_SUB : 0) |
+         (n->vnd_cli_subscribed ? NODE_F_VND_CLI_SUB : 0) |
+         (n->vnd_srv_pub_set ? NODE_F_VND_SRV_PUB : 0);
+}
+
+static void unpack_flags(mesh_node_info_t *n, uint16_t f) {
+  n->has_onoff_srv = f & NODE_F_ONOFF_SRV;
+  n->has_onoff_cli = f & NODE_F_ONOFF_CLI;
+  n->has_vnd_srv = f & NODE_F_VND_SRV;
+  n->has_vnd_cli = f & NODE_F_VND_CLI;
+  n->srv_bound = f & NODE_F_SRV_BOUND;
+  n->cli_bound = f & NODE_F_CLI_BOUND;
+  n->vnd_srv_bound = f & NODE_F_VND_SRV_BOUND;
+  n->vnd_cli_bound = f & NODE_F_VND_CLI_BOUND;
+  n->vnd_srv_subscribed = f & NODE_F_VND_SRV_SUB;
+  n->vnd_cli_subscribed = f & NODE_F_VND_CLI_SUB;
+  n->vnd_srv_pub_set = f & NODE_F_VND_SRV_PUB;
+}
+
+#if defined(CONFIG_BLE_MESH_MAX_PROV_NODES) &&                                \
+    CONFIG_BLE_MESH_MAX_PROV_NODES < MAX_NODES
+#error "CONFIG_BLE_MESH_MAX_PROV_NODES must be at least CONFIG_MESH_MAX_NODES"
+#endif
+
+static int node_slot(uint16_t unicast) {
+  return (unicast >= NODE_BASE_ADDR && unicast < NODE_BASE_ADDR + MAX_NODES)
+             ? unicast - NODE_BASE_ADDR
+             : -1;
+}
+
+static mesh_node_info_t *find_by_uuid(const uint8_t uuid[16]) {
+  for (int i = 0; i < MAX_NODES; i++) {
+    if (nodes[i].unicast && !memcmp(nodes[i].uuid, uuid, 16))
+      return &nodes[i];
+  }
+  return NULL;
+}
+
 // Store node info
 esp_err_t store_node_info(const uint8_t uuid[16], uint16_t unicast,
                           uint8_t elem_num, int node_idx) {
-  if (node_count >= MAX_NODES) {
-    ESP_LOGE(TAG, "Max nodes reached");
+  int slot = node_slot(unicast);
+  if (slot < 0) {
+    ESP_LOGE(TAG, "Address 0x%04x outside node range", unicast);
     return ESP_FAIL;
   }
 
-  // Check if already exists
-  for (int i = 0; i < node_count; i++) {
-    if (!memcmp(nodes[i].uuid, uuid, 16)) {
-      nodes[i].unicast = unicast;
-      nodes[i].elem_num = elem_num;
-      ESP_LOGW(TAG, "Node re-provisioned at 0x%04x", unicast);
-      return ESP_OK;
-    }
+  // Same device at a new address: free its old slot
+  mesh_node_info_t *old = find_by_uuid(uuid);
+  uint8_t zones = old ? old->zones : 0; // A known device keeps its zones
+  if (old && old != &nodes[slot]) {
+    ESP_LOGW(TAG, "Node moved 0x%04x -> 0x%04x", old->unicast, unicast);
+    memset(old, 0, sizeof(*old));
+    node_count--;
   }
 
-  // Add new node
-  memcpy(nodes[node_count].uuid, uuid, 16);
-  nodes[node_count].unicast = unicast;
-  nodes[node_count].elem_num = elem_num;
-  snprintf(nodes[node_count].name, sizeof(nodes[node_count].name), "NODE-%d",
-           node_idx);
-  node_count++;
+  mesh_node_info_t *n = &nodes[slot];
+  if (n->unicast && memcmp(n->uuid, uuid, 16)) {
+    ESP_LOGW(TAG, "Address 0x%04x reused by a new device", unicast);
+  } else if (n->unicast) {
+    ESP_LOGW(TAG, "Node re-provisioned at 0x%04x", unicast);
+  } else {
+    node_count++;
+  }
+
+  // A (re-)provisioned node starts with no AppKey or bindings
+  memset(n, 0, sizeof(*n));
+  n->zones = zones;
+  memcpy(n->uuid, uuid, 16);
+  n->unicast = unicast;
+  n->elem_num = elem_num;
+  n->node_idx = node_idx;
+  snprintf(n->name, sizeof(n->name), "NODE-%d", node_idx);
 
   ESP_LOGI(TAG, "Stored node %d: addr=0x%04x, elements=%d", node_count, unicast,
            elem_num);
@@ -42,11 +137,122 @@ esp_err_t store_node_info(const uint8_t uuid[16], uint16_t unicast,
 }
 
 mesh_node_info_t *get_node_info(uint16_t unicast) {
-  for (int i = 0; i < node_count; i++) {
-    if (nodes[i].unicast <= unicast &&
-        nodes[i].unicast + nodes[i].elem_num > unicast) {
-      return &nodes[i];
+  int slot = node_slot(unicast);
+  if (slot < 0 || !nodes[slot].unicast)
+    return NULL;
+  return &nodes[slot];
+}
+
+uint16_t node_registry_alloc_addr(const uint8_t uuid[16],
+                                  const uint16_t *reserved, int n_reserved) {
+  mesh_node_info_t *known = find_by_uuid(uuid);
+  if (known)
+    return known->unicast;
+
+  for (int slot = 0; slot < MAX_NODES; slot++) {
+    uint16_t addr = NODE_BASE_ADDR + slot;
+    bool taken = nodes[slot].unicast != 0 ||
+                 esp_ble_mesh_provisioner_get_node_with_addr(addr) != NULL;
+    for (int i = 0; i < n_reserved && !taken; i++)
+      taken = (reserved[i] == addr);
+    if (!taken)
+      return addr;
+  }
+  return 0;
+}
+
+esp_err_t node_registry_load(void) {
+  static node_db_t db;
+  size_t len = sizeof(db);
+  nvs_handle_t handle;
+  esp_err_t err;
+
+  err = nvs_open(REG_NVS_NAMESPACE, NVS_READONLY, &handle);
+  if (err != ESP_OK) {
+    ESP_LOGI(TAG, "No saved node registry");
+    return err;
+  }
+  err = nvs_get_blob(handle, REG_NVS_KEY, &db, &len);
+  nvs_close(handle);
+  if (err != ESP_OK) {
+    ESP_LOGI(TAG, "No saved node registry");
+    return err;
+  }
+  size_t rec_len =
+      (db.version == 1) ? REG_V1_RECORD_LEN : sizeof(node_record_t);
+  if (len < 2 || (db.version != 1 && db.version != REG_VERSION) ||
+      db.count > MAX_NODES || len != 2 + db.count * rec_len) {
+    ESP_LOGW(TAG, "Saved node registry invalid (len=%d), ignoring", (int)len);
+    return ESP_ERR_INVALID_SIZE;
+  }
+
+  memset(nodes, 0, sizeof(nodes));
+  node_count = 0;
+  for (int i = 0; i < db.count; i++) {
+    node_record_t r = {0}; // Fields missing from older records stay 0
+    memcpy(&r, (const uint8_t *)db.rec + i * rec_len, rec_len);
+    const node_record_t *rec = &r;
+    int slot = node_slot(rec->unicast);
+    if (slot < 0 || nodes[slot].unicast)
+      continue; // Saved with a smaller CONFIG_MESH_MAX_NODES, or duplicate
+    mesh_node_info_t *n = &nodes[slot];
+
+    // The stack's own settings are the source of truth for what is
+    // provisioned; skip nodes it has forgotten (e.g. after a node reset)
+    if (!esp_ble_mesh_provisioner_get_node_with_addr(rec->unicast)) {
+      ESP_LOGW(TAG, "Dropping saved node 0x%04x (unknown to mesh stack)",
+               rec->unicast);
+      continue;
     }
+    memcpy(n->uuid, rec->uuid, 16);
+    n->unicast = rec->unicast;
+    n->elem_num = rec->elem_num;
+    n->node_idx = rec->node_idx;
+    unpack_flags(n, rec->flags);
+    n->zones = rec->zones;
+    n->zones_subscribed = rec->zones_subscribed;
+    n->cfg_state = NODE_CFG_IDLE;
+    snprintf(n->name, sizeof(n->name), "NODE-%d", rec->node_idx);
+    node_count++;
   }
-  return NULL;
+
+  ESP_LOGI(TAG, "Restored %d node(s) from NVS", node_count);
+  return ESP_OK;
+}
+
+esp_err_t node_registry_save(void) {
+  static node_db_t db;
+  nvs_handle_t handle;
+  esp_err_t err;
+
+  db.version = REG_VERSION;
+  db.count = 0;
+  for (int i = 0; i < MAX_NODES; i++) {
+    if (!nodes[i].unicast)
+      continue;
+    node_record_t *rec = &db.rec[db.count++];
+    memcpy(rec->uuid, nodes[i].uuid, 16);
+    rec->unicast = nodes[i].unicast;
+    rec->elem_num = nodes[i].elem_num;
+    rec->node_idx = nodes[i].node_idx;
+    rec->flags = pack_flags(&nodes[i]);
+    rec->zones = nodes[i].zones;
+    rec->zones_subscribed = nodes[i].zones_subscribed;
+  }
+
+  err = nvs_open(REG_NVS_NAMESPACE, NVS_READWRITE, &handle);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "NVS open failed: %d", err);
+    return err;
+  }
+  err = nvs_set_blob(handle, REG_NVS_KEY, &db,
+                     2 + db.count * sizeof(node_record_t));
+  if (err == ESP_OK) {
+    err = nvs_commit(handle);
+  }
+  nvs_close(handle);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Save node registry failed: %d", err);
+  }
+  return err;
 }
@@ -8,6 +8,19 @@
 #include <string.h>
 
 #include "esp_err.h"
+#include "sdkconfig.h"
+
+// Per-node configuration pipeline step (see model_binding.c)
+typedef enum {
+  NODE_CFG_IDLE,   // Restored from NVS, not probed yet
+  NODE_CFG_QUEUED, // Waiting for a configuration slot
+  NODE_CFG_COMP,   // Composition Data Get outstanding
+  NODE_CFG_APPKEY, // AppKey Add outstanding
+  NODE_CFG_BIND,   // bind_next_model() chain (binds, subs, publication)
+  NODE_CFG_PROBE,  // Warm restart: Vendor Model App Get outstanding
+  NODE_CFG_DONE,
+  NODE_CFG_FAILED, // Out of retries - probed again on next boot
+} node_cfg_state_t;
 
 // Track provisioned nodes
 typedef struct {
@@ -25,15 +38,41 @@ typedef struct {
   bool vnd_srv_bound;
   bool vnd_cli_bound;
   bool vnd_srv_subscribed; // Vendor Server subscribed to group 0xC000
+  bool vnd_cli_subscribed; // Vendor Client subscribed to telemetry 0xC001
+  bool vnd_srv_pub_set;    // Vendor Server publishing to telemetry 0xC001
+  uint8_t zones;           // Assigned zones, bit z = MESH_ZONE_ADDR(z)
+  uint8_t zones_subscribed; // Zones the Vendor Server is subscribed to
+  uint8_t node_idx;
+  uint8_t cfg_state;       // node_cfg_state_t
+  uint8_t cfg_next;        // Step to start with once a slot frees up
+  uint8_t cfg_retries;     // Retries of the current step
 } mesh_node_info_t;
 
-#define MAX_NODES 10
+// Nodes get dense unicast addresses NODE_BASE_ADDR + slot (the mesh nodes
+// derive their node id the same way), and nodes[] is indexed by slot, so a
+// unicast lookup is a direct index. Free slots have unicast == 0.
+#define MAX_NODES CONFIG_MESH_MAX_NODES
+#define NODE_BASE_ADDR 0x0005
 extern mesh_node_info_t nodes[MAX_NODES];
-extern int node_count;
+extern int node_count; // Used slots
 
 esp_err_t store_node_info(const uint8_t uuid[16], uint16_t unicast,
                           uint8_t elem_num, int node_idx);
 
 mesh_node_info_t *get_node_info(uint16_t unicast);
 
+// Address to provision uuid with: its old address if we know the device
+// (reflashed / reset node), else the lowest free slot not in reserved[]
+// (links still in progress). Returns 0 when the table is full.
+uint16_t node_registry_alloc_addr(const uint8_t uuid[16],
+                                  const uint16_t *reserved, int n_reserved);
+
+// Load the registry saved by node_registry_save(). Records whose unicast
+// address the mesh stack no longer knows are dropped. Call once the
+// provisioner is enabled so the stack has restored its own node table.
+esp_err_t node_registry_load(void);
+
+// Persist all nodes (identity + bind/subscription flags + zones) to NVS
+esp_err_t node_registry_save(void);
+
 #endif /* NODE_REGISTRY_H */
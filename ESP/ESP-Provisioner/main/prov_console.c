@@ -0,0 +1,130 @@
+/* Provisioner console: zone assignment and node listing */
+
+#include <stdlib.h>
+#include <strings.h>
+
+#include "esp_console.h"
+#include "esp_log.h"
+
+#include "model_binding.h"
+#include "prov_console.h"
+
+#define TAG "CONSOLE"
+
+static const char *const cfg_state_names[] = {
+    "IDLE", "QUEUED", "COMP", "APPKEY", "BIND", "PROBE", "DONE", "FAILED",
+};
+
+static void format_zones(uint8_t zones, char *buf, size_t size) {
+  int len = 0;
+  buf[0] = '\0';
+  for (int z = 0; z < MESH_MAX_ZONES && len < (int)size; z++) {
+    if (zones & (1 << z))
+      len += snprintf(buf + len, size - len, len ? ",%d" : "%d", z);
+  }
+  if (!len)
+    snprintf(buf, size, "-");
+}
+
+// "0,2" -> bitmap; "none" -> 0. Returns -1 on a bad list.
+static int parse_zones(const char *s) {
+  int zones = 0;
+  if (strcasecmp(s, "none") == 0)
+    return 0;
+  while (*s) {
+    char *end;
+    long z = strtol(s, &end, 10);
+    if (end == s || z < 0 || z >= MESH_MAX_ZONES)
+      return -1;
+    zones |= 1 << z;
+    s = end;
+    if (*s == ',')
+      s++;
+    else if (*s)
+      return -1;
+  }
+  return zones;
+}
+
+static int cmd_nodes(int argc, char **argv) {
+  printf("%d node(s)\n", node_count);
+  for (int i = 0; i < MAX_NODES; i++) {
+    char zones[MESH_MAX_ZONES * 2 + 1], pending[MESH_MAX_ZONES * 2 + 1];
+    if (!nodes[i].unicast)
+      continue;
+    uint8_t changing = nodes[i].zones ^ nodes[i].zones_subscribed;
+    format_zones(nodes[i].zones, zones, sizeof(zones));
+    format_zones(changing, pending, sizeof(pending));
+    printf("  id %-3d 0x%04x %-6s zones %s%s%s%s\n", i, nodes[i].unicast,
+           cfg_state_names[nodes[i].cfg_state], zones,
+           changing ? " (changing " : "", changing ? pending : "",
+           changing ? ")" : "");
+  }
+  return 0;
+}
+
+// Runs on the console task; the config client is thread safe and the
+// node's fields are single-byte writes picked up by the BIND chain
+static int cmd_zone(int argc, char **argv) {
+  if (argc != 3) {
+    printf("usage: zone <node_id> <z,..|none>\n");
+    return 1;
+  }
+  int id = atoi(argv[1]);
+  mesh_node_info_t *node = get_node_info(NODE_BASE_ADDR + id);
+  if (id < 0 || !node) {
+    printf("no node with id %d\n", id);
+    return 1;
+  }
+  if (!node->has_vnd_srv) {
+    printf("node %d has no vendor server\n", id);
+    return 1;
+  }
+  int zones = parse_zones(argv[2]);
+  if (zones < 0 || __builtin_popcount(zones) > MESH_ZONES_PER_NODE) {
+    printf("zones: comma list of 0..%d, at most %d, or none\n",
+           MESH_MAX_ZONES - 1, MESH_ZONES_PER_NODE);
+    return 1;
+  }
+
+  ESP_LOGI(TAG, "Node 0x%04x: zones 0x%02x -> 0x%02x", node->unicast,
+           node->zones, zones);
+  cfg_pipeline_set_zones(node, zones);
+  return 0;
+}
+
+esp_err_t prov_console_init(void) {
+  esp_console_repl_t *repl = NULL;
+  esp_console_repl_config_t repl_config = ESP_CONSOLE_REPL_CONFIG_DEFAULT();
+  esp_err_t err;
+
+  repl_config.prompt = "prov>";
+#if defined(CONFIG_ESP_CONSOLE_USB_SERIAL_JTAG)
+  esp_console_dev_usb_serial_jtag_config_t hw_config =
+      ESP_CONSOLE_DEV_USB_SERIAL_JTAG_CONFIG_DEFAULT();
+  err = esp_console_new_repl_usb_serial_jtag(&hw_config, &repl_config, &repl);
+#else
+  esp_console_dev_uart_config_t hw_config =
+      ESP_CONSOLE_DEV_UART_CONFIG_DEFAULT();
+  err = esp_console_new_repl_uart(&hw_config, &repl_config, &repl);
+#endif
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Console init failed: %d", err);
+    return err;
+  }
+
+  const esp_console_cmd_t cmds[] = {
+      {.command = "nodes",
+       .help = "List provisioned nodes, config state and zones",
+       .func = cmd_nodes},
+      {.command = "zone",
+       .help = "Assign a node's zone groups (0xC100 + zone)",
+       .hint = "<node_id> <z,..|none>",
+       .func = cmd_zone},
+  };
+  for (int i = 0; i < sizeof(cmds) / sizeof(cmds[0]); i++)
+    esp_console_cmd_register(&cmds[i]);
+  esp_console_register_help_command();
+
+  return esp_console_start_repl(repl);
+}
@@ -0,0 +1,13 @@
+/* Provisioner console: zone assignment and node listing */
+
+#ifndef PROV_CONSOLE_H
+#define PROV_CONSOLE_H
+
+#include "esp_err.h"
+
+// Serial console commands:
+//   nodes                     list nodes, config state and zones
+//   zone <node_id> <z,..|none> assign a node's zones (persisted)
+esp_err_t prov_console_init(void);
+
+#endif /* PROV_CONSOLE_H */
@@ -3,17 +3,149 @@
 #include <inttypes.h>
 
 #include "esp_log.h"
+#include "esp_timer.h"
 
+#include "node_list.h"
 #include "provisioning.h"
 
 #define TAG "PROV"
 
+// Provisioning links run one at a time: LINK_CLOSE only reports the bearer
+// and reason, not the device, so with two links open a failed one can't be
+// told apart from the other and the wrong reservation would be freed.
+// Devices seen while the link is busy wait in pending_devs; configuration
+// (model_binding.c) still runs in parallel once a device is provisioned.
+#define PROV_MAX_LINKS 1
+#define PROV_PENDING_MAX 8
+// A link that never reported close (e.g. the open timed out silently)
+#define PROV_LINK_STALE_US (60 * 1000 * 1000LL)
+
+typedef struct {
+  bool used;
+  bool completed; // PROV_COMPLETE seen, waiting for its link close
+  int64_t started_us;
+  uint8_t uuid[16];
+  uint16_t unicast; // Reserved for this device
+} prov_link_t;
+
+static prov_link_t prov_links[PROV_MAX_LINKS];
+static esp_ble_mesh_unprov_dev_add_t pending_devs[PROV_PENDING_MAX];
+static int pending_count = 0;
+
+static bool uuid_known(const uint8_t uuid[16]) {
+  for (int i = 0; i < PROV_MAX_LINKS; i++) {
+    if (prov_links[i].used && !memcmp(prov_links[i].uuid, uuid, 16))
+      return true;
+  }
+  for (int i = 0; i < pending_count; i++) {
+    if (!memcmp(pending_devs[i].uuid, uuid, 16))
+      return true;
+  }
+  return false;
+}
+
+static prov_link_t *free_link_slot(void) {
+  int64_t now = esp_timer_get_time();
+
+  for (int i = 0; i < PROV_MAX_LINKS; i++) {
+    if (prov_links[i].used &&
+        now - prov_links[i].started_us > PROV_LINK_STALE_US) {
+      ESP_LOGW(TAG, "Reclaiming stale provisioning link for %s",
+               bt_hex(prov_links[i].uuid, 16));
+      prov_links[i].used = false;
+    }
+    if (!prov_links[i].used)
+      return &prov_links[i];
+  }
+  return NULL;
+}
+
+// We pick the unicast address ourselves so node ids stay dense
+// (NODE_BASE_ADDR + slot) and a reflashed node gets its old id back
+static esp_err_t prov_start_device(prov_link_t *link,
+                                   esp_ble_mesh_unprov_dev_add_t *dev) {
+  uint16_t reserved[PROV_MAX_LINKS];
+  int n_reserved = 0;
+  esp_err_t err;
+
+  // A known device advertising again lost its provisioning; let the stack
+  // forget it so the address can be handed out again
+  if (esp_ble_mesh_provisioner_get_node_with_uuid(dev->uuid)) {
+    err = esp_ble_mesh_provisioner_delete_node_with_uuid(dev->uuid);
+    if (err) {
+      ESP_LOGW(TAG, "Delete stale node failed: %d", err);
+    }
+  }
+
+  for (int i = 0; i < PROV_MAX_LINKS; i++) {
+    if (prov_links[i].used)
+      reserved[n_reserved++] = prov_links[i].unicast;
+  }
+  uint16_t unicast = node_registry_alloc_addr(dev->uuid, reserved, n_reserved);
+  if (unicast == 0) {
+    ESP_LOGW(TAG, "Node table full (%d), not provisioning %s", MAX_NODES,
+             bt_hex(dev->uuid, 16));
+    return ESP_ERR_NO_MEM;
+  }
+
+  link->used = true;
+  link->completed = false;
+  link->started_us = esp_timer_get_time();
+  link->unicast = unicast;
+  memcpy(link->uuid, dev->uuid, 16);
+
+  err = esp_ble_mesh_provisioner_prov_device_with_addr(
+      dev->uuid, dev->addr, dev->addr_type, dev->bearer, dev->oob_info,
+      unicast);
+  if (err) {
+    ESP_LOGE(TAG, "Provision device failed: %d", err);
+    link->used = false;
+  } else {
+    ESP_LOGI(TAG, "Started provisioning device %s at 0x%04x",
+             bt_hex(dev->uuid, 16), unicast);
+  }
+  return err;
+}
+
+// Start queued devices while links are free
+static void prov_start_pending(void) {
+  prov_link_t *link;
+
+  while (pending_count > 0 && (link = free_link_slot()) != NULL) {
+    esp_ble_mesh_unprov_dev_add_t dev = pending_devs[0];
+    pending_count--;
+    memmove(&pending_devs[0], &pending_devs[1],
+            pending_count * sizeof(pending_devs[0]));
+    prov_start_device(link, &dev);
+  }
+}
+
+// Local keys are up (added now or restored from NVS): bring back the node
+// registry and probe the nodes it lists
+static void provisioner_keys_ready(void) {
+  static bool restored = false;
+
+  appkey_ready = true;
+  if (restored)
+    return;
+  restored = true;
+
+  // The Vendor Client node lists go out on. Also on restore: an AppKey
+  // saved by an older build was never bound to it.
+  esp_err_t err = esp_ble_mesh_provisioner_bind_app_key_to_local_model(
+      PROV_OWN_ADDR, prov_key.app_idx, VND_MODEL_ID_CLIENT, CID_ESP);
+  if (err != ESP_OK)
+    ESP_LOGE(TAG, "Bind local vendor model AppKey failed: %d", err);
+  if (node_registry_load() == ESP_OK) {
+    node_list_init();
+    cfg_pipeline_probe_all();
+  }
+}
+
 // Called when provisioning completes
 esp_err_t prov_complete(int node_idx, const esp_ble_mesh_octet16_t uuid,
                         uint16_t unicast, uint8_t elem_num,
                         uint16_t net_idx) {
-  esp_ble_mesh_client_common_param_t common = {0};
-  esp_ble_mesh_cfg_client_get_state_t get_state = {0};
   mesh_node_info_t *node = NULL;
   char name[16] = {0};
   int err;
@@ -26,6 +158,11 @@ esp_err_t prov_complete(int node_idx, const esp_ble_mesh_octet16_t uuid,
   ESP_LOGI(TAG, "Device UUID: %s", bt_hex(uuid, 16));
   ESP_LOGI(TAG, "============================================");
 
+  for (int i = 0; i < PROV_MAX_LINKS; i++) {
+    if (prov_links[i].used && !memcmp(prov_links[i].uuid, uuid, 16))
+      prov_links[i].completed = true;
+  }
+
   // Set node name
   snprintf(name, sizeof(name), "NODE-%d", node_idx);
   err = esp_ble_mesh_provisioner_set_node_name(node_idx, name);
@@ -45,21 +182,10 @@ esp_err_t prov_complete(int node_idx, const esp_ble_mesh_octet16_t uuid,
     ESP_LOGE(TAG, "Get node info failed");
     return ESP_FAIL;
   }
+  node_registry_save();
 
-  // Request composition data - Config messages use NetKey (not AppKey)
-  // Use &root_models[1] directly (CFG_CLI model) to ensure valid model pointer
-  ESP_LOGI(TAG, "Sending COMP_DATA_GET to 0x%04x using net_idx 0x%04x", unicast,
-           prov_key.net_idx);
-  set_config_common(&common, unicast, &root_models[1],
-                    ESP_BLE_MESH_MODEL_OP_COMPOSITION_DATA_GET);
-  get_state.comp_data_get.page = COMP_DATA_PAGE_0;
-
-  err = esp_ble_mesh_config_client_get_state(&common, &get_state);
-  if (err) {
-    ESP_LOGE(TAG, "Get composition data failed: %d", err);
-    return ESP_FAIL;
-  }
-
+  // Composition -> AppKey -> binds, alongside any other nodes in flight
+  cfg_pipeline_start(node, NODE_CFG_COMP);
   return ESP_OK;
 }
 
@@ -71,6 +197,19 @@ static void prov_link_open(esp_ble_mesh_prov_bearer_t bearer) {
 static void prov_link_close(esp_ble_mesh_prov_bearer_t bearer, uint8_t reason) {
   ESP_LOGI(TAG, "Provisioning link closed (%s), reason: 0x%02x",
            bearer == ESP_BLE_MESH_PROV_ADV ? "PB-ADV" : "PB-GATT", reason);
+
+  // The event doesn't say which device it was: with one link at a time
+  // (PROV_MAX_LINKS) it is the one in use
+  for (int i = 0; i < PROV_MAX_LINKS; i++) {
+    if (!prov_links[i].used)
+      continue;
+    if (!prov_links[i].completed)
+      ESP_LOGW(TAG, "Provisioning %s at 0x%04x failed, address released",
+               bt_hex(prov_links[i].uuid, 16), prov_links[i].unicast);
+    prov_links[i].used = false;
+  }
+
+  prov_start_pending();
 }
 
 // Handle unprovisioned device advertisements
@@ -79,10 +218,10 @@ static void recv_unprov_adv_pkt(uint8_t dev_uuid[16], uint8_t addr[BD_ADDR_LEN],
                                 uint16_t oob_info, uint8_t adv_type,
                                 esp_ble_mesh_prov_bearer_t bearer) {
   esp_ble_mesh_unprov_dev_add_t add_dev = {0};
-  int err;
+  prov_link_t *link;
 
-  // Only start provisioning if not already in progress
-  if (provisioning_in_progress) {
+  // Already being provisioned or waiting for a link
+  if (uuid_known(dev_uuid)) {
     return; // Skip duplicate advertisements
   }
 
@@ -100,23 +239,21 @@ static void recv_unprov_adv_pkt(uint8_t dev_uuid[16], uint8_t addr[BD_ADDR_LEN],
            (bearer & ESP_BLE_MESH_PROV_ADV) ? "PB-ADV" : "PB-GATT");
   ESP_LOGI(TAG, "================================================");
 
-  // Add device and start provisioning immediately
   memcpy(add_dev.addr, addr, BD_ADDR_LEN);
   add_dev.addr_type = addr_type;
   memcpy(add_dev.uuid, dev_uuid, 16);
   add_dev.oob_info = oob_info;
   add_dev.bearer = bearer;
 
-  provisioning_in_progress = true; // Set flag before starting
-  err = esp_ble_mesh_provisioner_add_unprov_dev(
-      &add_dev, ADD_DEV_RM_AFTER_PROV_FLAG | ADD_DEV_START_PROV_NOW_FLAG |
-                    ADD_DEV_FLUSHABLE_DEV_FLAG);
-
-  if (err) {
-    ESP_LOGE(TAG, "Add unprovisioned device failed: %d", err);
-    provisioning_in_progress = false; // Reset on failure
+  link = free_link_slot();
+  if (link) {
+    prov_start_device(link, &add_dev);
+  } else if (pending_count < PROV_PENDING_MAX) {
+    pending_devs[pending_count++] = add_dev;
+    ESP_LOGI(TAG, "All links busy, device queued (%d pending)", pending_count);
   } else {
-    ESP_LOGI(TAG, "Started provisioning device...");
+    // It keeps advertising - picked up again once the queue drains
+    ESP_LOGW(TAG, "Pending device queue full, ignoring for now");
   }
 }
 
@@ -135,7 +272,7 @@ void provisioning_cb(esp_ble_mesh_prov_cb_event_t event,
           prov_key.app_key, prov_key.net_idx, prov_key.app_idx);
       if (err == ESP_ERR_INVALID_STATE) {
         ESP_LOGW(TAG, "AppKey already exists (restored from NVS)");
-        appkey_ready = true;
+        provisioner_keys_ready();
       } else if (err != ESP_OK) {
         ESP_LOGE(TAG, "Add local AppKey failed: %d", err);
       } else {
@@ -165,7 +302,6 @@ void provisioning_cb(esp_ble_mesh_prov_cb_event_t event,
   case ESP_BLE_MESH_PROVISIONER_PROV_LINK_CLOSE_EVT:
     prov_link_close(param->provisioner_prov_link_close.bearer,
                     param->provisioner_prov_link_close.reason);
-    provisioning_in_progress = false; // Reset flag when link closes
     break;
 
   case ESP_BLE_MESH_PROVISIONER_PROV_COMPLETE_EVT:
@@ -201,7 +337,6 @@ void provisioning_cb(esp_ble_mesh_prov_cb_event_t event,
              param->provisioner_add_app_key_comp.err_code);
     if (param->provisioner_add_app_key_comp.err_code == ESP_OK) {
       prov_key.app_idx = param->provisioner_add_app_key_comp.app_idx;
-      appkey_ready = true; // AppKey is now ready for use
       ESP_LOGI(TAG, "AppKey ready (idx 0x%04x)", prov_key.app_idx);
 
       // Bind AppKey to our local OnOff Client model
@@ -211,6 +346,7 @@ void provisioning_cb(esp_ble_mesh_prov_cb_event_t event,
       if (err != ESP_OK) {
         ESP_LOGE(TAG, "Bind local model AppKey failed: %d", err);
       }
+      provisioner_keys_ready(); // AppKey is now ready for use
     }
     break;
 
@@ -246,11 +382,9 @@ void provisioning_cb(esp_ble_mesh_prov_cb_event_t event,
 // Config client callbacks - handles AppKey distribution
 void config_client_cb(esp_ble_mesh_cfg_client_cb_event_t event,
                       esp_ble_mesh_cfg_client_cb_param_t *param) {
-  esp_ble_mesh_client_common_param_t common = {0};
   mesh_node_info_t *node = NULL;
   uint32_t opcode = param->params->opcode;
   uint16_t addr = param->params->ctx.addr;
-  int err;
 
   ESP_LOGI(TAG,
            "Config client event: 0x%02x, opcode: 0x%04" PRIx32 ", addr: 0x%04x",
@@ -264,12 +398,30 @@ void config_client_cb(esp_ble_mesh_cfg_client_cb_event_t event,
     // For Model App Bind, a status error means model doesn't exist on the node.
     // Skip to the next model in the bind chain instead of giving up.
     if (opcode == ESP_BLE_MESH_MODEL_OP_MODEL_APP_BIND ||
-        opcode == ESP_BLE_MESH_MODEL_OP_MODEL_SUB_ADD) {
+        opcode == ESP_BLE_MESH_MODEL_OP_MODEL_SUB_ADD ||
+        opcode == ESP_BLE_MESH_MODEL_OP_MODEL_SUB_DELETE ||
+        opcode == ESP_BLE_MESH_MODEL_OP_MODEL_PUB_SET) {
       node = get_node_info(addr);
-      if (node) {
+      // Zone changes run last, once the publication step is marked done
+      int zone = node ? cfg_zone_pending(node) : -1;
+      if (node && zone >= 0 && node->vnd_srv_pub_set &&
+          opcode != ESP_BLE_MESH_MODEL_OP_MODEL_PUB_SET) {
+        cfg_zone_sub_status(node, opcode == ESP_BLE_MESH_MODEL_OP_MODEL_SUB_ADD,
+                            MESH_ZONE_ADDR(zone), 0xFF /* no status */);
+      } else if (node) {
         ESP_LOGW(TAG, "Config op failed, trying next step...");
+        // Telemetry steps are optional (polling still works) - mark them
+        // done so the chain moves on instead of retrying forever
+        if (opcode == ESP_BLE_MESH_MODEL_OP_MODEL_PUB_SET) {
+          node->vnd_srv_pub_set = true;
+        } else if (opcode == ESP_BLE_MESH_MODEL_OP_MODEL_SUB_ADD &&
+                   node->vnd_srv_subscribed) {
+          node->vnd_cli_subscribed = true;
+        }
         bind_next_model(node);
       }
+    } else if ((node = get_node_info(addr)) != NULL) {
+      cfg_pipeline_retry(node); // COMP / AppKey / probe
     }
     return;
   }
@@ -282,7 +434,8 @@ void config_client_cb(esp_ble_mesh_cfg_client_cb_event_t event,
 
   switch (event) {
   case ESP_BLE_MESH_CFG_CLIENT_GET_STATE_EVT:
-    if (opcode == ESP_BLE_MESH_MODEL_OP_COMPOSITION_DATA_GET) {
+    if (opcode == ESP_BLE_MESH_MODEL_OP_COMPOSITION_DATA_GET &&
+        node->cfg_state == NODE_CFG_COMP) {
       ESP_LOGI(TAG, "Got composition data from 0x%04x", addr);
 
       // Parse composition data to detect which models node has
@@ -290,25 +443,21 @@ void config_client_cb(esp_ble_mesh_cfg_client_cb_event_t event,
           node, param->status_cb.comp_data_status.composition_data);
 
       // Now add AppKey to the node
-      esp_ble_mesh_cfg_client_set_state_t set = {0};
-      set_config_common(&common, addr, &root_models[1],
-                        ESP_BLE_MESH_MODEL_OP_APP_KEY_ADD);
-      set.app_key_add.net_idx = prov_key.net_idx;
-      set.app_key_add.app_idx = prov_key.app_idx;
-      memcpy(set.app_key_add.app_key, prov_key.app_key, 16);
-
-      err = esp_ble_mesh_config_client_set_state(&common, &set);
-      if (err) {
-        ESP_LOGE(TAG, "AppKey Add failed: %d", err);
-      }
+      cfg_pipeline_advance(node, NODE_CFG_APPKEY);
+    } else if (opcode == ESP_BLE_MESH_MODEL_OP_VENDOR_MODEL_APP_GET) {
+      cfg_pipeline_probe_status(node,
+                                param->status_cb.vnd_model_app_list.status,
+                                param->status_cb.vnd_model_app_list.app_idx);
     }
     break;
 
   case ESP_BLE_MESH_CFG_CLIENT_SET_STATE_EVT:
     if (opcode == ESP_BLE_MESH_MODEL_OP_APP_KEY_ADD) {
+      if (node->cfg_state != NODE_CFG_APPKEY)
+        break;
       ESP_LOGI(TAG, "AppKey added to node 0x%04x", addr);
       // Start binding models in priority order
-      bind_next_model(node);
+      cfg_pipeline_advance(node, NODE_CFG_BIND);
     } else if (opcode == ESP_BLE_MESH_MODEL_OP_MODEL_APP_BIND) {
       // Determine which model was just bound from the status
       uint16_t model_id = param->status_cb.model_app_status.model_id;
@@ -336,17 +485,34 @@ void config_client_cb(esp_ble_mesh_cfg_client_cb_event_t event,
 
       // Chain to next unbound model
       bind_next_model(node);
+    } else if ((opcode == ESP_BLE_MESH_MODEL_OP_MODEL_SUB_ADD ||
+                opcode == ESP_BLE_MESH_MODEL_OP_MODEL_SUB_DELETE) &&
+               param->status_cb.model_sub_status.sub_addr >=
+                   MESH_ZONE_BASE_ADDR) {
+      cfg_zone_sub_status(node, opcode == ESP_BLE_MESH_MODEL_OP_MODEL_SUB_ADD,
+                          param->status_cb.model_sub_status.sub_addr,
+                          param->status_cb.model_sub_status.status);
     } else if (opcode == ESP_BLE_MESH_MODEL_OP_MODEL_SUB_ADD) {
-      ESP_LOGI(TAG, "Group subscription added on 0x%04x", addr);
+      ESP_LOGI(TAG, "Group subscription 0x%04x added on 0x%04x",
+               param->status_cb.model_sub_status.sub_addr, addr);
       if (node) {
-        node->vnd_srv_subscribed = true;
-        bind_next_model(node); // Chains to "FULLY CONFIGURED"
+        if (param->status_cb.model_sub_status.model_id == VND_MODEL_ID_CLIENT) {
+          node->vnd_cli_subscribed = true;
+        } else {
+          node->vnd_srv_subscribed = true;
+        }
+        bind_next_model(node);
       }
+    } else if (opcode == ESP_BLE_MESH_MODEL_OP_MODEL_PUB_SET) {
+      ESP_LOGI(TAG, "Telemetry publication set on 0x%04x", addr);
+      node->vnd_srv_pub_set = true;
+      bind_next_model(node); // Chains to "FULLY CONFIGURED"
     }
     break;
 
   case ESP_BLE_MESH_CFG_CLIENT_TIMEOUT_EVT:
     ESP_LOGW(TAG, "Config client timeout for opcode 0x%04" PRIx32, opcode);
+    cfg_pipeline_retry(node); // Resends the node's current step
     break;
 
   default:
@@ -392,6 +558,7 @@ esp_err_t ble_mesh_init(void) {
   esp_ble_mesh_register_prov_callback(provisioning_cb);
   esp_ble_mesh_register_config_client_callback(config_client_cb);
   esp_ble_mesh_register_generic_client_callback(generic_client_cb);
+  esp_ble_mesh_register_custom_model_callback(node_list_model_cb);
 
   // Initialize mesh stack
   err = esp_ble_mesh_init(&provision, &composition);
@@ -404,6 +571,13 @@ esp_err_t ble_mesh_init(void) {
   // These may not be auto-filled by the macros
   config_client.model = &root_models[1]; // CFG_CLI model
   onoff_client.model = &root_models[2];  // GEN_ONOFF_CLI model
+  vnd_client.model = &vnd_models[0];
+
+  err = esp_ble_mesh_client_model_init(&vnd_models[0]);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Vendor client init failed: %d", err);
+    return err;
+  }
 
   // Set UUID match filter - only provision devices starting with 0xdd 0xdd
   err = esp_ble_mesh_provisioner_set_dev_uuid_match(match, sizeof(match), 0x0,
@@ -152,6 +152,8 @@ function handleMessage(msg) {
     } else if (msg.type === 'event') {
         if (msg.event === 'pm_update') {
             updatePowerManager(msg.data);
+        } else if (msg.event === 'perf_update') {
+            nodes.updateNode(msg.data.node_id, { perf: msg.data.perf });
         } else if (msg.event === 'poll_update') {
             updatePollStatus(msg.data);
         } else if (['connected', 'disconnected', 'reconnecting'].includes(msg.event)) {
@@ -61,6 +61,7 @@ function renderCard(id, data) {
                         <div class="popover-item" onclick="promptDuty('${id}')">Set Duty %</div>
                         <div class="popover-item" onclick="sendRead('${id}')">Read Sensor</div>
                         <div class="popover-item" onclick="sendStop('${id}')">Stop Load</div>
+                        <div class="popover-item" onclick="sendPerf('${id}')">Node Health</div>
                     </div>
                 </div>
             </div>
@@ -89,6 +90,10 @@ function renderCard(id, data) {
             <div class="power-bar-bg">
                 <div id="bar-${id}" class="power-bar-fill"></div>
             </div>
+            <div class="metric" style="margin-top: 0.5rem;">
+                <span class="metric-label">Health (heap / cmd / tx err / ntf drop)</span>
+                <span id="perf-${id}" style="font-size: 0.8rem; color: var(--text-secondary)">—</span>
+            </div>
         `;
         container.appendChild(card);
 
@@ -132,6 +137,15 @@ function renderCard(id, data) {
         flashElement(currEl);
     }
 
+    // Firmware health counters (PERF), refreshed by the web poll
+    const p = data.perf;
+    if (p && p.heap_free !== undefined) {
+        document.getElementById(`perf-${id}`).textContent =
+            `${(p.heap_free / 1024).toFixed(0)}k (min ${(p.heap_min / 1024).toFixed(0)}k) / ` +
+            `${p.cmd_avg_us}µs (max ${p.cmd_max_us}) / ` +
+            `${p.tx_errors} (${p.tx_nobuf} nobuf) / ${p.ntf_drops}`;
+    }
+
     // Power bar
     const maxScale = 500;
     let pct = Math.min(((data.power || 0) / maxScale) * 100, 100);
@@ -165,6 +179,11 @@ window.sendRead = (id) => {
     sendCmdFunc(`node ${id} read`);
 };
 
+window.sendPerf = (id) => {
+    document.getElementById(`popover-${id}`).classList.remove('active');
+    sendCmdFunc(`node ${id} perf`);
+};
+
 window.sendStop = (id) => {
     document.getElementById(`popover-${id}`).classList.remove('active');
     sendCmdFunc(`node ${id} stop`);
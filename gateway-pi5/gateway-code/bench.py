@@ -0,0 +1,409 @@
+#!/usr/bin/env python3
+"""
+Mesh performance benchmark for DC Monitor firmware builds
+
+Runs fixed scenarios through the GATT gateway and writes the results to JSON
+so two firmware builds can be compared. Needs firmware built with
+CONFIG_MESH_BENCHMARK (ESP/ESP-Mesh-Node-sensor-universal, bench.h) for the
+ping and notify scenarios; the others work with any firmware.
+
+Usage:
+    python bench.py --label before                  # all scenarios -> bench-before.json
+    python bench.py --label after --count 200
+    python bench.py --only rtt,notify --nodes 1,2
+    python bench.py --compare bench-before.json bench-after.json
+
+Scenarios:
+    rtt      N:PING to every node, RTT by hop count (firmware and Pi clocks)
+    group    ALL:READ until the last node's reading arrives
+    duty     N:DUTY back to back on one node: achieved rate and latency
+    notify   ALL:BENCH notify burst: GATT throughput and loss
+
+Replaces the ad-hoc legacy/old-tests/test-*.py copies of the gateway for
+performance work: it drives DCMonitorGateway itself, so it measures the
+same command and notification paths the TUI and web dashboard use.
+"""
+
+import argparse
+import asyncio
+import json
+import statistics
+import sys
+import time
+from datetime import datetime
+
+from constants import PONG_RE, BENCH_DONE_RE
+from dc_gateway import DCMonitorGateway
+
+
+def summarize(values):
+    """min / median / p95 / max / mean of a list of numbers (None if empty)."""
+    if not values:
+        return None
+    ordered = sorted(values)
+    p95 = ordered[min(len(ordered) - 1, int(round(0.95 * (len(ordered) - 1))))]
+    return {
+        "n": len(ordered),
+        "min": ordered[0],
+        "median": statistics.median(ordered),
+        "p95": p95,
+        "max": ordered[-1],
+        "mean": round(statistics.fmean(ordered), 3),
+    }
+
+
+class Bench:
+    """Scenario runner on top of a connected DCMonitorGateway."""
+
+    def __init__(self, gateway: DCMonitorGateway, log=print):
+        self.gw = gateway
+        self.say = log
+        self._loop = asyncio.get_running_loop()
+        self._events: asyncio.Queue = asyncio.Queue()
+        gateway._bench_sink = self._sink
+
+    def _sink(self, kind, value):
+        # Called on bleak's callback thread; stamp on arrival
+        self._loop.call_soon_threadsafe(
+            self._events.put_nowait, (time.monotonic(), kind, value))
+
+    def _drain(self):
+        while not self._events.empty():
+            self._events.get_nowait()
+
+    async def _expect(self, match, timeout):
+        """Wait for the first event match(kind, value) accepts.
+
+        Returns (arrival time, match result), or None on timeout.
+        """
+        deadline = time.monotonic() + timeout
+        while True:
+            left = deadline - time.monotonic()
+            if left <= 0:
+                return None
+            try:
+                t, kind, value = await asyncio.wait_for(self._events.get(), left)
+            except asyncio.TimeoutError:
+                return None
+            result = match(kind, value)
+            if result is not None:
+                return t, result
+
+    async def _send(self, cmd: str) -> float:
+        self._drain()
+        t0 = time.monotonic()
+        if not await self.gw.send_command(cmd, _silent=True):
+            raise RuntimeError(f"write failed: {cmd}")
+        return t0
+
+    # ---- Node discovery ----
+    async def discover(self, timeout=6.0) -> list:
+        """Node ids that answer a group READ."""
+        await self._send("ALL:READ")
+        seen = set()
+        deadline = time.monotonic() + timeout
+        while time.monotonic() < deadline:
+            ev = await self._expect(
+                lambda k, v: v[0] if k == "reading" else
+                ("done" if k == "poll_done" else None),
+                deadline - time.monotonic())
+            if ev is None or ev[1] == "done":
+                break
+            seen.add(ev[1])
+        return sorted(seen, key=int)
+
+    # ---- Scenarios ----
+    async def rtt(self, nodes, count, lengths, timeout):
+        """Unicast ping RTT per node and payload length, grouped by hops."""
+        def pong_or_error(kind, value):
+            if kind != "text":
+                return None
+            if value.startswith(("ERROR:MESH_TIMEOUT", "ERROR:MESH_SEND_FAIL")):
+                return "lost"
+            if value.startswith("ERROR:"):
+                return value
+            m = PONG_RE.match(value)
+            return m if m else None
+
+        per_node, by_hops, skipped = {}, {}, []
+        for node in nodes:
+            for length in lengths:
+                fw_us, pi_ms, srv_us, hops, lost = [], [], [], [], 0
+                for _ in range(count):
+                    t0 = await self._send(f"{node}:PING:{length}")
+                    ev = await self._expect(pong_or_error, timeout)
+                    if ev is None or ev[1] == "lost":
+                        lost += 1
+                        continue
+                    t, m = ev
+                    if isinstance(m, str):
+                        if m.startswith(("ERROR:NO_BENCH", "ERROR:UNKNOWN_CMD")):
+                            raise RuntimeError("gateway firmware has no benchmark mode")
+                        # Our own gateway node (PING_TARGET) or not ready
+                        skipped.append({"node": node, "error": m})
+                        break
+                    fw_us.append(int(m.group(3)))
+                    srv_us.append(int(m.group(4)))
+                    hops.append(int(m.group(5)))
+                    pi_ms.append(round((t - t0) * 1000, 2))
+                else:
+                    key = f"{node}/{length}"
+                    hop = max(set(hops), key=hops.count) if hops else None
+                    per_node[key] = {
+                        "node": node, "len": length, "hops": hop,
+                        "sent": count, "lost": lost,
+                        "loss": round(lost / count, 4),
+                        "rtt_us": summarize(fw_us),
+                        "srv_us": summarize(srv_us),
+                        "pi_rtt_ms": summarize(pi_ms),
+                    }
+                    if hop is not None:
+                        by_hops.setdefault(f"{hop}/{length}", []).extend(fw_us)
+                    self.say(f"  rtt node {node} len {length}: "
+                             f"{per_node[key]['rtt_us']} lost {lost}")
+                    continue
+                break  # Skipped node: no point trying other lengths
+        return {
+            "nodes": per_node,
+            "by_hops": {k: summarize(v) for k, v in sorted(by_hops.items())},
+            "skipped": skipped,
+        }
+
+    async def group_read(self, rounds, expected, timeout):
+        """ALL:READ to every expected node's reading (or poll batch end)."""
+        times_ms, partial = [], 0
+        for _ in range(rounds):
+            t0 = await self._send("ALL:READ")
+            seen, done = set(), None
+            while True:
+                ev = await self._expect(
+                    lambda k, v: ("reading", v[0]) if k == "reading" else
+                    (("done", None) if k == "poll_done" else None),
+                    timeout - (time.monotonic() - t0))
+                if ev is None:
+                    break
+                t, (what, node) = ev
+                if what == "reading":
+                    seen.add(node)
+                    if set(expected) <= seen:
+                        done = t
+                        break
+                else:
+                    done = t
+                    break
+            if done is None or not set(expected) <= seen:
+                partial += 1
+            if done is not None:
+                times_ms.append(round((done - t0) * 1000, 2))
+            await asyncio.sleep(0.2)
+        result = {"rounds": rounds, "nodes": len(expected), "incomplete": partial,
+                  "completion_ms": summarize(times_ms)}
+        self.say(f"  group read: {result['completion_ms']} incomplete {partial}")
+        return result
+
+    async def duty_rate(self, node, duration, timeout):
+        """Back-to-back duty commands to one node, each waiting for its reading."""
+        latencies_ms, lost, duty = [], 0, 30
+        start = time.monotonic()
+        while time.monotonic() - start < duration:
+            duty = 60 if duty == 30 else 30
+            target = duty
+            t0 = await self._send(f"{node}:DUTY:{duty}")
+            ev = await self._expect(
+                lambda k, v: True if k == "reading" and v[0] == node and v[1] == target
+                else None, timeout)
+            if ev is None:
+                lost += 1
+            else:
+                latencies_ms.append(round((ev[0] - t0) * 1000, 2))
+        elapsed = time.monotonic() - start
+        await self._send(f"{node}:DUTY:0")
+        result = {"node": node, "duration_s": round(elapsed, 2),
+                  "completed": len(latencies_ms), "lost": lost,
+                  "rate_hz": round(len(latencies_ms) / elapsed, 2) if elapsed else 0,
+                  "latency_ms": summarize(latencies_ms)}
+        self.say(f"  duty node {node}: {result['rate_hz']}/s {result['latency_ms']}")
+        return result
+
+    async def notify(self, count, lengths, timeout):
+        """GATT notify burst throughput (gateway -> Pi)."""
+        def burst_event(kind, value):
+            if kind != "text":
+                return None
+            if value.startswith(("BN:", "BENCH:DONE", "ERROR:")):
+                return value
+            return None
+
+        results = {}
+        for length in lengths:
+            t0 = await self._send(f"ALL:BENCH:{count}:{length}")
+            got, seqs, first, last, done = 0, set(), None, None, None
+            while True:
+                ev = await self._expect(burst_event, timeout)
+                if ev is None:
+                    break
+                t, text = ev
+                if text.startswith("ERROR:"):
+                    raise RuntimeError(f"notify burst rejected: {text}")
+                if text.startswith("BENCH:DONE"):
+                    done = BENCH_DONE_RE.match(text)
+                    break
+                got += 1
+                seqs.add(text.split(":", 2)[1])
+                first = first or t
+                last = t
+            span = (last - first) if first and last and last > first else 0
+            fw_sent = int(done.group(1)) if done else None
+            fw_us = int(done.group(2)) if done else None
+            results[str(length)] = {
+                "requested": count, "received": got, "unique": len(seqs),
+                "fw_sent": fw_sent,
+                "fw_retries": int(done.group(3)) if done else None,
+                "loss": round(1 - len(seqs) / fw_sent, 4) if fw_sent else None,
+                "first_ms": round((first - t0) * 1000, 2) if first else None,
+                "pi_msgs_per_s": round(got / span, 1) if span else None,
+                "pi_bytes_per_s": round(got * length / span, 1) if span else None,
+                "fw_msgs_per_s": round(fw_sent / (fw_us / 1e6), 1)
+                if fw_sent and fw_us else None,
+            }
+            self.say(f"  notify len {length}: {results[str(length)]}")
+            await asyncio.sleep(1.0)
+        return results
+
+
+def _flatten(obj, prefix=""):
+    """{"a": {"b": 1}} -> {"a.b": 1}, numbers only."""
+    out = {}
+    if isinstance(obj, dict):
+        for k, v in obj.items():
+            out.update(_flatten(v, f"{prefix}{k}."))
+    elif isinstance(obj, (int, float)) and not isinstance(obj, bool):
+        out[prefix[:-1]] = obj
+    return out
+
+
+def compare(path_a: str, path_b: str) -> None:
+    """Print every shared metric of two result files side by side."""
+    with open(path_a) as f:
+        a = json.load(f)
+    with open(path_b) as f:
+        b = json.load(f)
+    fa, fb = _flatten(a["scenarios"]), _flatten(b["scenarios"])
+    name_a, name_b = a.get("label", path_a), b.get("label", path_b)
+    width = max((len(k) for k in fa), default=10)
+    print(f"{'metric':<{width}}  {name_a:>12}  {name_b:>12}  {'change':>8}")
+    for key in sorted(set(fa) & set(fb)):
+        va, vb = fa[key], fb[key]
+        change = f"{(vb - va) / va * 100:+.1f}%" if va else ""
+        print(f"{key:<{width}}  {va:>12}  {vb:>12}  {change:>8}")
+    only = sorted(set(fa) ^ set(fb))
+    if only:
+        print(f"\n{len(only)} metric(s) only in one file (scenario skipped?)")
+
+
+async def run(args) -> int:
+    gateway = DCMonitorGateway()
+    gateway._standby_enabled = False  # A second link would share the radio
+    # Keep gateway chatter out of the report
+    gateway.log = lambda text, *a, **k: print(f"  {text}") if args.verbose else None
+
+    devices = await gateway.scan_for_nodes(timeout=args.timeout,
+                                           target_address=args.address)
+    if args.address:
+        devices = [d for d in devices if d.address.upper() == args.address.upper()]
+    for dev in devices:
+        if await gateway.connect_to_node(dev):
+            break
+    else:
+        print("No gateway connected")
+        return 1
+    print(f"Connected to {gateway.connected_device.name or gateway.connected_device.address}")
+
+    bench = Bench(gateway)
+    scenarios = [s.strip() for s in args.only.split(",")] if args.only else \
+        ["rtt", "group", "duty", "notify"]
+    results = {}
+    nodes = []
+    try:
+        await asyncio.sleep(1.0)  # Let MESH_READY / LINK chatter settle
+        if args.nodes:
+            nodes = [n.strip() for n in args.nodes.split(",")]
+        else:
+            nodes = await bench.discover()
+        print(f"Nodes: {', '.join(nodes) or '(none)'}")
+
+        for name in scenarios:
+            print(f"[{name}]")
+            try:
+                if name == "rtt":
+                    results[name] = await bench.rtt(nodes, args.count, args.lengths,
+                                                    args.reply_timeout)
+                elif name == "group":
+                    results[name] = await bench.group_read(args.rounds, nodes,
+                                                           args.reply_timeout)
+                elif name == "duty":
+                    if not nodes:
+                        raise RuntimeError("no nodes")
+                    node = args.duty_node or nodes[-1]
+                    results[name] = await bench.duty_rate(node, args.duration,
+                                                          args.reply_timeout)
+                elif name == "notify":
+                    results[name] = await bench.notify(args.bursts, args.notify_lengths,
+                                                       args.reply_timeout)
+                else:
+                    print(f"  unknown scenario '{name}'")
+            except RuntimeError as e:
+                print(f"  skipped: {e}")
+                results[name] = {"error": str(e)}
+    finally:
+        gateway._bench_sink = None
+        await gateway.disconnect()
+
+    out = {
+        "label": args.label,
+        "timestamp": datetime.now().isoformat(timespec="seconds"),
+        "gateway": gateway._last_connected_address,
+        "nodes": nodes,
+        "args": {k: v for k, v in vars(args).items() if k not in ("compare",)},
+        "scenarios": results,
+    }
+    path = args.output or f"bench-{args.label}.json"
+    with open(path, "w") as f:
+        json.dump(out, f, indent=2)
+    print(f"Results written to {path}")
+    return 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description="DC Monitor mesh benchmark")
+    parser.add_argument("--label", default=datetime.now().strftime("%Y%m%d-%H%M%S"),
+                        help="Name of this run (firmware build), used in the file name")
+    parser.add_argument("--output", help="Result file (default bench-<label>.json)")
+    parser.add_argument("--compare", nargs=2, metavar=("A", "B"),
+                        help="Compare two result files and exit")
+    parser.add_argument("--address", help="Gateway MAC address")
+    parser.add_argument("--timeout", type=float, default=10.0, help="Scan timeout")
+    parser.add_argument("--only", help="Comma-separated scenarios (rtt,group,duty,notify)")
+    parser.add_argument("--nodes", help="Comma-separated node ids (default: discover)")
+    parser.add_argument("--count", type=int, default=50, help="Pings per node and length")
+    parser.add_argument("--lengths", type=lambda s: [int(x) for x in s.split(",")],
+                        default=[8, 32, 64], help="Ping payload sizes (bytes)")
+    parser.add_argument("--rounds", type=int, default=20, help="Group read rounds")
+    parser.add_argument("--duration", type=float, default=20.0, help="Duty scenario (s)")
+    parser.add_argument("--duty-node", help="Node for the duty scenario (default: last)")
+    parser.add_argument("--bursts", type=int, default=500, help="Notifications per burst")
+    parser.add_argument("--notify-lengths", type=lambda s: [int(x) for x in s.split(",")],
+                        default=[20, 64, 120], help="Notify message sizes (bytes)")
+    parser.add_argument("--reply-timeout", type=float, default=5.0,
+                        help="Per-reply timeout (s)")
+    parser.add_argument("--verbose", action="store_true", help="Show gateway log")
+    args = parser.parse_args()
+
+    if args.compare:
+        compare(*args.compare)
+        return 0
+    return asyncio.run(run(args))
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -1,6 +1,7 @@
 """Shared constants for the DC Monitor Gateway."""
 
 import re
+import struct
 
 # Custom UUIDs matching ESP32-C6 ble_service.h
 DC_MONITOR_SERVICE_UUID = "0000dc01-0000-1000-8000-00805f9b34fb"
@@ -16,3 +17,80 @@ DEVICE_NAME_PREFIXES = ["Mesh-Gateway", "DC-Monitor", "ESP-BLE-MESH"]
 # Sensor data parsing regex (case-insensitive for mA/mW/MA/MW)
 SENSOR_RE = re.compile(r'D:(\d+)%,V:([\d.]+)V,I:([\d.]+)mA,P:([\d.]+)mW', re.IGNORECASE)
 NODE_ID_RE = re.compile(r'NODE(\d+)', re.IGNORECASE)
+
+# Per-node link estimate from the gateway firmware (node_tracker.h)
+LINK_RE = re.compile(r'LINK:NODE(\d+):RTT:(\d+):VAR:(\d+):HOPS:(\d+):TO:(\d+)')
+
+# Gateway's node list (firmware node_list.h, "ALL:NODES"):
+# NODES:<PROV|SCAN>:<self id>:<known>:<hex node mask>
+NODES_RE = re.compile(r'NODES:(PROV|SCAN):(-?\d+):(\d+):([0-9a-fA-F]+)')
+
+# Node health counters (firmware perf.h, "N:PERF"); latencies in us
+PERF_RE = re.compile(r'PERF:UP:(\d+),HEAP:(\d+)/(\d+),CMD:(\d+)/(\d+),I2C:(\d+)/(\d+),'
+                     r'NTF:(\d+)/(\d+)/(\d+)/(\d+)/(\d+),TX:(\d+)/(\d+)/(\d+)/(\d+)')
+PERF_FIELDS = ("uptime_s", "heap_free", "heap_min", "cmd_avg_us", "cmd_max_us",
+               "i2c_avg_us", "i2c_max_us", "ntf_msgs", "ntf_chunks", "ntf_drops",
+               "ntf_backoffs", "ntf_fails", "tx_sent", "tx_errors", "tx_nobuf",
+               "tx_timeouts")
+# "N:PERF:rtt" reply entries: <dst node>=<avg ms>/<max ms>
+PERF_RTT_RE = re.compile(r'(\d+)=(\d+)/(\d+)')
+
+# Benchmark mode (firmware bench.h, bench.py); times in us
+PONG_RE = re.compile(r'PONG:NODE(\d+):SEQ:(\d+):RTT:(\d+):SRV:(\d+):HOPS:(\d+):LEN:(\d+)')
+BENCH_DONE_RE = re.compile(r'BENCH:DONE:(\d+):(\d+):(\d+)')
+
+# Binary telemetry frame v1 (firmware command "rb", see command.h)
+# <version, node_id, seq, duty, vbus_raw (u16), current_raw (i16)>, little-endian
+TELEMETRY_FRAME_V1 = 0xA1
+TELEMETRY_FRAME_PUB = 0xA6  # Same frame, published on 0xC001 (not a poll reply)
+TELEMETRY_FRAME = struct.Struct('<BBBBHh')
+INA260_VBUS_LSB_MV = 1.25
+INA260_CURRENT_LSB_MA = 1.25
+
+# Group-READ batch (firmware poll_aggregator.h): header + frames (2 per batch
+# over the mesh proxy, all nodes in one batch on a larger MTU)
+# <version, generation, n_frames, flags>
+POLL_BATCH_V1 = 0xA2
+POLL_BATCH_HDR = struct.Struct('<BBBB')
+POLL_BATCH_FLAG_LAST = 0x01
+
+# Telemetry history frame (firmware history.h, "N:HISTORY[:since[:max_age]]")
+# <version, node_id, tid, n, flags, boot_id, first_seq (u16)> + n samples of
+# <age (0.1 s, u16), duty, vbus_raw (u16), current_raw (i16)>
+HISTORY_FRAME_V1 = 0xA3
+HISTORY_HDR = struct.Struct('<BBBBBBH')
+HISTORY_SAMPLE = struct.Struct('<HBHh')
+HISTORY_FLAG_MORE = 0x01
+HISTORY_FLAG_GAP = 0x02
+
+# Rolling window summary (firmware sensor_stats.h, "N:STATS[:<seconds>]")
+# <version, node_id, tid, window_s, samples (u16), duty, flags,
+#  p_min_mw, p_max_mw, p_mean_mw (u32), vbus_mean_raw, i_rms_raw (u16),
+#  energy_uwh (u32)>
+STATS_FRAME_V1 = 0xA4
+STATS_FRAME = struct.Struct('<BBBBHBBIIIHHI')
+STATS_FLAG_PARTIAL = 0x01
+STATS_FLAG_DUTY_CHANGED = 0x02
+
+# Length-prefixed notify framing (firmware gatt_service.h): messages longer
+# than one notification start with <mark, total_len (u16)>, then raw bytes
+# follow in later notifications until total_len have arrived
+GATT_FRAME_MARK = 0xA0
+GATT_FRAME_HDR = struct.Struct('<BH')
+
+# Binary command batch on the COMMAND characteristic (firmware
+# command_parser.h): <version, n_entries> + n * <opcode, target, value>,
+# target is a node bitmap (bit i = node 16 * window + i, window = opcode
+# high nibble) or GATT_BCMD_TARGET_ALL
+GATT_BCMD_V1 = 0xB0
+GATT_BCMD_HDR = struct.Struct('<BB')
+GATT_BCMD_ENTRY = struct.Struct('<BHH')
+GATT_BCMD_TARGET_ALL = 0xFFFF
+GATT_BCMD_MAX_ENTRIES = 12  # COMMAND_MAX_LEN (64) - header, 5 bytes each
+GATT_BCMD_WINDOW_SHIFT = 4
+GATT_BCMD_WINDOW_NODES = 16
+GATT_BCMD_OP_DUTY = 0x01
+GATT_BCMD_OP_STOP = 0x02
+GATT_BCMD_OP_RAMP = 0x03
+GATT_BCMD_OP_READ = 0x04
+GATT_BCMD_OP_LIMIT = 0x05
@@ -62,6 +62,22 @@ def insert_reading(node_id: str, duty: int, voltage: float,
     conn.close()
 
 
+def insert_readings(rows):
+    """Insert backfilled readings in one transaction.
+
+    rows: (timestamp, node_id, duty, voltage, current_ma, power_mw) tuples.
+    """
+    conn = get_connection()
+    conn.executemany(
+        "INSERT INTO sensor_readings "
+        "(timestamp, node_id, duty, voltage, current_ma, power_mw) "
+        "VALUES (?, ?, ?, ?, ?, ?)",
+        rows
+    )
+    conn.commit()
+    conn.close()
+
+
 def get_history(node_id: str = None, minutes: int = 30,
                 limit: int = 500) -> list[dict]:
     """Get historical readings, optionally filtered by node and time window."""
@@ -20,6 +20,37 @@ from constants import (
     DEVICE_NAME_PREFIXES,
     SENSOR_RE,
     NODE_ID_RE,
+    LINK_RE,
+    NODES_RE,
+    PERF_RE,
+    PERF_FIELDS,
+    PERF_RTT_RE,
+    TELEMETRY_FRAME_V1,
+    TELEMETRY_FRAME_PUB,
+    TELEMETRY_FRAME,
+    INA260_VBUS_LSB_MV,
+    INA260_CURRENT_LSB_MA,
+    POLL_BATCH_V1,
+    POLL_BATCH_HDR,
+    POLL_BATCH_FLAG_LAST,
+    HISTORY_FRAME_V1,
+    HISTORY_HDR,
+    HISTORY_SAMPLE,
+    HISTORY_FLAG_MORE,
+    HISTORY_FLAG_GAP,
+    STATS_FRAME_V1,
+    STATS_FRAME,
+    STATS_FLAG_PARTIAL,
+    STATS_FLAG_DUTY_CHANGED,
+    GATT_FRAME_MARK,
+    GATT_FRAME_HDR,
+    GATT_BCMD_V1,
+    GATT_BCMD_HDR,
+    GATT_BCMD_ENTRY,
+    GATT_BCMD_MAX_ENTRIES,
+    GATT_BCMD_WINDOW_SHIFT,
+    GATT_BCMD_WINDOW_NODES,
+    GATT_BCMD_OP_DUTY,
 )
 from power_manager import PowerManager
 
@@ -39,19 +70,47 @@ class DCMonitorGateway:
         self.running = True
         self.target_node = "0"
         self._chunk_buf = ""  # Buffer for reassembling chunked notifications
+        self._frame_buf = bytearray()  # Length-prefixed frame being reassembled
+        self._frame_len = 0  # Expected frame length (0 = no frame open)
+        self._binary_cmds = True  # Cleared if the firmware rejects a batch
+        self._batch_sent_at = 0.0
         self._power_manager = None  # PowerManager instance
         self._monitoring = False  # True when monitor mode is active
         self.app = None  # Reference to TUI app (set by MeshGatewayApp)
         self.ble_thread = None  # BleThread instance (set by TUI app)
-        self._node_events: dict[str, threading.Event] = {}  # Signaled when node responds
+        # Signaled when node responds: (event, loop of the waiter)
+        self._node_events: dict[str, tuple[asyncio.Event, asyncio.AbstractEventLoop]] = {}
         self.known_nodes: set[str] = set()  # Node IDs that have actually responded with sensor data
         self.sensing_node_count = 0  # Set from BLE scan: total_mesh_devices - 1 (GATT gateway)
+        self.prov_nodes = None  # Node IDs from the provisioner's list (firmware node_list.h)
         # Reconnection state (v0.7.0 Phase 1)
         self._was_connected = False
         self._reconnecting = False
         self._last_connected_address = None
+        # History backfill after an outage (firmware history.h)
+        self._disconnected_at = None       # time.time() when the link dropped
+        self._history_cursor = {}          # {node_id: (boot_id, last_seq or None)}
+        self._history_more = {}            # {node_id: True while newer frames remain}
+        self._history_events: dict[str, threading.Event] = {}  # Signaled per frame
+        self._backfill_window = None       # (start, end) of the gap being filled
+        self._backfill_rows = []
         self._web_enabled = False  # Set True by gateway.py when --web is used
         self._last_readings = {}  # {node_id: {duty, voltage, current, power, last_seen}}
+        self._node_perf = {}      # {node_id: PERF counters + "rtt" + "at"} (firmware perf.h)
+        self._perf_interval = 60.0  # Web poll asks ALL:PERF this often (s)
+        self._bench_sink = None   # bench.py hook: fn(kind, value), bleak's thread
+        # Hot-standby gateway (firmware gw_sync.h): a second link kept warm
+        self._standby_enabled = True      # Cleared by gateway.py --no-standby
+        self._standby_supported = True    # Cleared when the firmware rejects ALL:GW
+        self._standby_client = None
+        self._standby_device = None
+        self._standby_warming = False
+        self._scan_devices = []           # Last scan result (standby candidates)
+        self._last_rx = 0.0               # time.monotonic() of the last primary notify
+        self._last_cmd = None             # Last command written to the primary
+        self._primary_lost = False        # Standby reported the active heartbeat gone
+        self._link_event = None           # Wakes _auto_reconnect_loop on a BLE drop
+        self._link_loop = None
         # Web auto-poll state (v0.7.1 Phase 3)
         self._web_poll_task = None
         self._web_poll_interval = 2.0  # seconds (adjustable 0.5–30)
@@ -157,19 +216,272 @@ class DCMonitorGateway:
             self.log("No DC Monitor gateways found")
             self.log("Tip: Make sure ESP32-C6 is powered and advertising")
 
+        self._scan_devices = nodes
         return nodes
 
+    def _decode_poll_batch(self, data: bytearray, timestamp: str) -> None:
+        """Decode a group-READ batch: header + n telemetry frames."""
+        _ver, gen, count, flags = POLL_BATCH_HDR.unpack_from(bytes(data))
+        off = POLL_BATCH_HDR.size
+        for _ in range(count):
+            frame = data[off:off + TELEMETRY_FRAME.size]
+            if len(frame) < TELEMETRY_FRAME.size or frame[0] != TELEMETRY_FRAME_V1:
+                break
+            self._decode_telemetry_frame(frame, timestamp)
+            off += TELEMETRY_FRAME.size
+        if flags & POLL_BATCH_FLAG_LAST:
+            if self._bench_sink:
+                self._bench_sink("poll_done", gen)
+            if self._power_manager:
+                self._power_manager.on_poll_complete(gen)
+
+    def _decode_telemetry_frame(self, data: bytearray, timestamp: str) -> None:
+        """Decode a binary telemetry frame (one notification, no chunking)."""
+        ver, node_num, seq, duty, vbus_raw, current_raw = TELEMETRY_FRAME.unpack(bytes(data))
+        published = ver == TELEMETRY_FRAME_PUB
+        voltage = vbus_raw * INA260_VBUS_LSB_MV / 1000.0
+        current = abs(current_raw * INA260_CURRENT_LSB_MA)  # abs for polarity, same as text path
+        power = voltage * current
+        node_id = str(node_num)
+        self._handle_sensor_reading(
+            node_id, duty, voltage, current, power,
+            f"[{timestamp}] NODE{node_id} >> D:{duty}%,V:{voltage:.3f}V,"
+            f"I:{current:.2f}mA,P:{power:.1f}mW "
+            f"({'pub' if published else 'bin'} #{seq})",
+            published=published)
+
+    def _handle_node_list(self, text: str) -> None:
+        """Gateway's node list; a PROV one is authoritative, no probing needed."""
+        match = NODES_RE.match(text)
+        if not match or match.group(1) != "PROV":
+            return
+        mask = int(match.group(4), 16)
+        ids = {str(i) for i in range(mask.bit_length()) if mask >> i & 1}
+        if ids != self.prov_nodes:
+            self.log(f"[NODES] Provisioner lists {len(ids)} node(s): "
+                     f"{', '.join(sorted(ids, key=int)) or '-'}",
+                     style="dim", _from_thread=True)
+        self.prov_nodes = ids
+
+    def _handle_perf(self, node_id: str, payload: str) -> None:
+        """Store a node's PERF / RTT counters for the dashboard."""
+        perf = self._node_perf.setdefault(node_id, {})
+        match = PERF_RE.match(payload)
+        if match:
+            perf.update(zip(PERF_FIELDS, map(int, match.groups())))
+        elif payload.startswith("RTT:"):
+            perf["rtt"] = {dst: [int(avg), int(mx)]
+                           for dst, avg, mx in PERF_RTT_RE.findall(payload)}
+        else:
+            return
+        perf["at"] = time.time()
+        if self._web_enabled:
+            try:
+                import web_server
+                loop = self.ble_thread._loop if self.ble_thread else None
+                if loop:
+                    asyncio.run_coroutine_threadsafe(
+                        web_server.broadcast_state_change(
+                            "perf_update", {"node_id": node_id, "perf": perf}),
+                        loop)
+            except Exception:
+                pass
+
+    def _decode_stats_frame(self, data: bytearray, timestamp: str) -> None:
+        """Decode a rolling window summary (min/max/mean power, energy)."""
+        (_ver, node_num, _tid, window_s, samples, duty, flags, p_min, p_max,
+         p_mean, vbus_raw, i_rms_raw, energy_uwh) = STATS_FRAME.unpack(bytes(data))
+        node_id = str(node_num)
+        self.known_nodes.add(node_id)
+        voltage = vbus_raw * INA260_VBUS_LSB_MV / 1000.0
+        i_rms = i_rms_raw * INA260_CURRENT_LSB_MA
+        steady = not flags & STATS_FLAG_DUTY_CHANGED
+        if self._power_manager and samples:
+            self._power_manager.on_stats(node_id, duty, p_mean, steady)
+        self.log(
+            f"[{timestamp}] NODE{node_id} >> STATS {window_s}s/{samples}: "
+            f"P:{p_min}/{p_mean}/{p_max}mW,V:{voltage:.3f}V,Irms:{i_rms:.2f}mA,"
+            f"E:{energy_uwh / 1000.0:.3f}mWh"
+            f"{' (partial)' if flags & STATS_FLAG_PARTIAL else ''}"
+            f"{'' if steady else ' (duty changed)'}",
+            _from_thread=True)
+
+    def _decode_history_frame(self, data: bytearray) -> None:
+        """Decode a history frame, keeping samples that fall in the backfill gap."""
+        data = bytes(data)
+        _ver, node_num, _tid, count, flags, boot_id, first_seq = HISTORY_HDR.unpack_from(data)
+        node_id = str(node_num)
+        now = time.time()
+        cursor = self._history_cursor.get(node_id)
+        if cursor and cursor[1] is not None and cursor[0] != boot_id:
+            # Node rebooted: its seqs restarted, so ask again from the oldest
+            self._history_cursor[node_id] = (boot_id, None)
+            self._history_more[node_id] = True
+        else:
+            window = self._backfill_window
+            more = bool(flags & HISTORY_FLAG_MORE)
+            off = HISTORY_HDR.size
+            for _ in range(count):
+                if len(data) < off + HISTORY_SAMPLE.size:
+                    break
+                age_ds, duty, vbus_raw, current_raw = HISTORY_SAMPLE.unpack_from(data, off)
+                off += HISTORY_SAMPLE.size
+                ts = now - age_ds / 10.0
+                if window and ts >= window[1]:
+                    more = False  # Live readings cover the rest
+                elif window and ts > window[0]:
+                    voltage = vbus_raw * INA260_VBUS_LSB_MV / 1000.0
+                    current = abs(current_raw * INA260_CURRENT_LSB_MA)
+                    self._backfill_rows.append(
+                        (ts, node_id, duty, voltage, current, voltage * current))
+            self._history_cursor[node_id] = (boot_id, (first_seq + count - 1) & 0xFFFF)
+            self._history_more[node_id] = more
+            if flags & HISTORY_FLAG_GAP:
+                self.log(f"[BACKFILL] NODE{node_id}: history overwritten, "
+                         "gap only partly filled", style="yellow", _from_thread=True)
+
+        evt = self._history_events.get(node_id)
+        if evt:
+            evt.set()
+
+    def _handle_sensor_reading(self, node_id: str, duty: int, voltage: float,
+                               current: float, power: float, log_line: str,
+                               published: bool = False) -> None:
+        """Fan a parsed reading out to PM, web/DB and the TUI (text or binary)."""
+        # Track this node as known (it actually exists and responded)
+        self.known_nodes.add(node_id)
+        if self._bench_sink:
+            self._bench_sink("reading", (node_id, duty))
+
+        # Store latest reading for web API (independent of PM)
+        self._last_readings[node_id] = {
+            "duty": duty, "voltage": voltage,
+            "current": current, "power": power,
+            "last_seen": time.time(),
+        }
+
+        # Feed PowerManager
+        if self._power_manager:
+            self._power_manager.on_sensor_data(
+                node_id, duty, voltage, current, power, published=published)
+
+        # Signal that this node responded (unblocks event-driven pacing).
+        # Notifications may arrive on bleak's thread - hop to the waiter's loop
+        armed = self._node_events.get(node_id)
+        if armed:
+            evt, loop = armed
+            loop.call_soon_threadsafe(evt.set)
+
+        # Determine if this is a user-triggered response
+        is_user_response = False
+        if node_id in self._pending_user_nodes:
+            self._pending_user_nodes.discard(node_id)
+            is_user_response = True
+        elif "*" in self._pending_user_nodes:
+            is_user_response = True
+
+        # Web dashboard: broadcast sensor data + record to DB
+        if self._web_enabled:
+            try:
+                import web_server
+                import db
+                loop = self.ble_thread._loop if self.ble_thread else None
+                if loop:
+                    asyncio.run_coroutine_threadsafe(
+                        web_server.broadcast_sensor_data(node_id, {
+                            "duty": duty, "voltage": voltage,
+                            "current": current, "power": power,
+                            "last_seen": time.time(),
+                        }, user_triggered=is_user_response),
+                        loop
+                    )
+                db.insert_reading(node_id, duty, voltage, current, power)
+            except Exception:
+                pass
+
+        # Post to TUI for UI update (always use call_from_thread — we're on bleak's thread)
+        if self.app and _HAS_TEXTUAL:
+            try:
+                msg = self.app.SensorDataMsg(
+                    node_id, duty, voltage, current, power,
+                    log_line,
+                    is_user_response=is_user_response
+                )
+                self.app.call_from_thread(self.app.post_message, msg)
+            except Exception as e:
+                print(f"  {log_line}  [post error: {e}]")
+        elif is_user_response or self._poll_show_log:
+            print(log_line)
+
+    def _split_frames(self, data: bytearray) -> list:
+        """Split one notification into complete messages.
+
+        A notification that doesn't start a length-prefixed frame (and isn't
+        continuing one) is a single unframed message. Otherwise it holds
+        back-to-back <GATT_FRAME_MARK, len> + data frames; the last may run
+        on into the next notification.
+        """
+        if not self._frame_len and not self._frame_buf and (
+                not data or data[0] != GATT_FRAME_MARK):
+            return [bytes(data)]
+
+        self._frame_buf += data
+        messages = []
+        while True:
+            if not self._frame_len:
+                if len(self._frame_buf) < GATT_FRAME_HDR.size:
+                    break
+                mark, total = GATT_FRAME_HDR.unpack_from(self._frame_buf)
+                if mark != GATT_FRAME_MARK:
+                    # Lost sync (dropped notification) - resync on the next one
+                    self._frame_buf = bytearray()
+                    break
+                del self._frame_buf[:GATT_FRAME_HDR.size]
+                self._frame_len = total
+            if len(self._frame_buf) < self._frame_len:
+                break
+            messages.append(bytes(self._frame_buf[:self._frame_len]))
+            del self._frame_buf[:self._frame_len]
+            self._frame_len = 0
+        return messages
+
     def notification_handler(self, characteristic: BleakGATTCharacteristic, data: bytearray):
         """Handle incoming notifications from GATT gateway.
 
         IMPORTANT: This runs on bleak's callback thread, NOT the Textual event loop.
         All UI updates must use call_from_thread() or log(_from_thread=True).
 
-        Messages > 20 bytes are chunked by the gateway:
+        The gateway queues its messages and packs them into notifications:
+          - A lone message that fits one notification is sent as-is
+          - Otherwise messages are length-prefixed (<GATT_FRAME_MARK, len>),
+            several may share a notification, and a long one continues as raw
+            bytes in the next notification (20-byte payload over the mesh
+            proxy, up to MTU-3 on a direct connection)
+        Older firmware chunks at 20 bytes instead:
           - Continuation chunks start with '+' (data follows after the '+')
           - Final (or only) chunk has no '+' prefix
-        We accumulate '+' chunks and process the full message on the final chunk.
         """
+        self._last_rx = time.monotonic()
+        for message in self._split_frames(data):
+            self._handle_message(message)
+
+    def _handle_message(self, data: bytes):
+        """Parse one complete message from the gateway."""
+        # Binary telemetry frame: fixed size, always a single notification
+        if len(data) == TELEMETRY_FRAME.size and data[0] in (TELEMETRY_FRAME_V1,
+                                                             TELEMETRY_FRAME_PUB):
+            self._decode_telemetry_frame(data, datetime.now().strftime("%H:%M:%S"))
+            return
+        if len(data) >= POLL_BATCH_HDR.size and data[0] == POLL_BATCH_V1:
+            self._decode_poll_batch(data, datetime.now().strftime("%H:%M:%S"))
+            return
+        if len(data) >= HISTORY_HDR.size and data[0] == HISTORY_FRAME_V1:
+            self._decode_history_frame(data)
+            return
+        if len(data) == STATS_FRAME.size and data[0] == STATS_FRAME_V1:
+            self._decode_stats_frame(data, datetime.now().strftime("%H:%M:%S"))
+            return
+
         decoded = data.decode('utf-8', errors='replace').strip()
 
         # Chunked reassembly: '+' prefix means more data follows
@@ -183,6 +495,8 @@ class DCMonitorGateway:
             self._chunk_buf = ""
 
         timestamp = datetime.now().strftime("%H:%M:%S")
+        if self._bench_sink:
+            self._bench_sink("text", decoded)
 
         # Parse vendor model responses: NODE<id>:DATA:<sensor payload>
         if ":DATA:" in decoded:
@@ -201,69 +515,62 @@ class DCMonitorGateway:
                 current = float(sensor_match.group(3))
                 power = float(sensor_match.group(4))
 
-                # Track this node as known (it actually exists and responded)
-                self.known_nodes.add(node_id)
-
-                # Store latest reading for web API (independent of PM)
-                self._last_readings[node_id] = {
-                    "duty": duty, "voltage": voltage,
-                    "current": current, "power": power,
-                    "last_seen": time.time(),
-                }
-
-                # Feed PowerManager
+                self._handle_sensor_reading(node_id, duty, voltage, current, power,
+                                            f"[{timestamp}] {node_tag} >> {payload}")
+            elif payload.startswith("ZONES:") and node_match:
+                # Zone membership (gateway asks each node once it is discovered)
                 if self._power_manager:
-                    self._power_manager.on_sensor_data(
-                        node_id, duty, voltage, current, power)
-
-                # Signal that this node responded (unblocks event-driven pacing)
-                evt = self._node_events.get(node_id)
-                if evt:
-                    evt.set()
-
-                # Determine if this is a user-triggered response
-                is_user_response = False
-                if node_id in self._pending_user_nodes:
-                    self._pending_user_nodes.discard(node_id)
-                    is_user_response = True
-                elif "*" in self._pending_user_nodes:
-                    is_user_response = True
-
-                # Web dashboard: broadcast sensor data + record to DB
-                if self._web_enabled:
                     try:
-                        import web_server
-                        import db
-                        loop = self.ble_thread._loop if self.ble_thread else None
-                        if loop:
-                            asyncio.run_coroutine_threadsafe(
-                                web_server.broadcast_sensor_data(node_id, {
-                                    "duty": duty, "voltage": voltage,
-                                    "current": current, "power": power,
-                                    "last_seen": time.time(),
-                                }, user_triggered=is_user_response),
-                                loop
-                            )
-                        db.insert_reading(node_id, duty, voltage, current, power)
-                    except Exception:
+                        self._power_manager.on_zones(node_match.group(1),
+                                                     int(payload[6:], 16))
+                    except ValueError:
                         pass
-
-                # Post to TUI for UI update (always use call_from_thread — we're on bleak's thread)
-                if self.app and _HAS_TEXTUAL:
-                    try:
-                        msg = self.app.SensorDataMsg(
-                            node_id, duty, voltage, current, power,
-                            f"[{timestamp}] {node_tag} >> {payload}",
-                            is_user_response=is_user_response
-                        )
-                        self.app.call_from_thread(self.app.post_message, msg)
-                    except Exception as e:
-                        print(f"  [{timestamp}] {node_tag} >> {payload}  [post error: {e}]")
-                elif is_user_response or self._poll_show_log:
-                    print(f"[{timestamp}] {node_tag} >> {payload}")
+                self.log(f"[{timestamp}] {node_tag} >> {payload}", style="dim",
+                         _debug=True, _from_thread=True)
+            elif payload.startswith(("PERF:", "RTT:")) and node_match:
+                self._handle_perf(node_match.group(1), payload)
+                self.log(f"[{timestamp}] {node_tag} >> {payload}", style="dim",
+                         _debug=True, _from_thread=True)
+            elif payload.startswith("LIMIT:"):
+                # Node's local limiter clamped its duty - rebalance around it
+                if self._power_manager:
+                    self._power_manager._force_evaluate = True
+                self.log(f"[{timestamp}] {node_tag} >> {payload}", style="yellow",
+                         _from_thread=True)
             else:
                 self.log(f"[{timestamp}] {node_tag} >> {payload}", _from_thread=True)
 
+        elif decoded.startswith(("PONG:", "BN:", "BENCH:")):
+            pass  # Benchmark mode (firmware bench.h), consumed by bench.py
+        elif decoded.startswith("GW:DEMOTED:"):
+            # Another node was ACTIVE too and kept the role (lower node id)
+            self.log(f"[{timestamp}] {decoded} - gateway stepped down to STANDBY",
+                     style="yellow", _from_thread=True)
+        elif decoded.startswith("GW:"):
+            # Gateway role acknowledgement (firmware gw_sync.h)
+            self.log(f"[{timestamp}] {decoded}", style="dim", _debug=True, _from_thread=True)
+        elif decoded.startswith("NODES:"):
+            self._handle_node_list(decoded)
+        elif decoded.startswith("ERROR:UNKNOWN_CMD:NODES"):
+            pass  # Older firmware: discovery falls back to probing
+        elif decoded.startswith("ERROR:UNKNOWN_CMD:GW"):
+            if self._standby_supported:
+                self._standby_supported = False
+                self.log("[STANDBY] Gateway firmware has no standby role, single link only",
+                         style="yellow", _from_thread=True)
+        elif decoded.startswith("ERROR:UNKNOWN_CMD:PM"):
+            if self._power_manager:
+                self._power_manager.on_controller_unsupported()
+        elif (decoded.startswith(("ERROR:UNKNOWN_CMD:", "ERROR:NO_COMMAND"))
+              and time.monotonic() - self._batch_sent_at < 2.0):
+            # Pre-batch firmware parsed our binary write as text
+            if self._binary_cmds:
+                self._binary_cmds = False
+                self.log("[CMD] Gateway firmware has no binary batches, using text commands",
+                         style="yellow", _from_thread=True)
+        elif decoded.startswith("PM:"):
+            # On-node controller status / acknowledgement
+            self.log(f"[{timestamp}] {decoded}", style="dim", _debug=True, _from_thread=True)
         elif decoded.startswith("ERROR:"):
             # Suppress MESH_TIMEOUT during PM polling — it's just discovery probes
             pm = self._power_manager
@@ -278,6 +585,13 @@ class DCMonitorGateway:
                     self.log(f"[{timestamp}] -> {decoded}", style="dim", _from_thread=True)
             else:
                 print(f"[{timestamp}] -> {decoded}")
+        elif decoded.startswith("LINK:"):
+            link = LINK_RE.match(decoded)
+            if link and self._power_manager:
+                self._power_manager.on_link_stats(
+                    link.group(1), int(link.group(2)), int(link.group(3)),
+                    int(link.group(4)), int(link.group(5)))
+            self.log(f"[{timestamp}] {decoded}", style="dim", _debug=True, _from_thread=True)
         elif decoded.startswith("MESH_READY"):
             self.log(f"[{timestamp}] {decoded}", _from_thread=True)
         elif decoded.startswith("TIMEOUT:"):
@@ -293,7 +607,8 @@ class DCMonitorGateway:
         """Connect to a specific node and subscribe to notifications"""
         self.log(f"Connecting to {device.name or device.address}...")
 
-        self.client = BleakClient(device.address, dangerous_use_bleak_cache=False)
+        self.client = BleakClient(device.address, dangerous_use_bleak_cache=False,
+                                  disconnected_callback=self._on_ble_disconnect)
         try:
             await self.client.connect()
         except Exception as e:
@@ -307,9 +622,17 @@ class DCMonitorGateway:
             return False
 
         self.connected_device = device
+        # The reconnect loop drops a dead link without disconnect(): don't
+        # let a frame left open on it swallow this link's first notifications
+        self._chunk_buf = ""
+        self._frame_buf = bytearray()
+        self._frame_len = 0
 
         try:
-            await self.client.start_notify(SENSOR_DATA_CHAR_UUID, self.notification_handler)
+            client = self.client
+            await self.client.start_notify(
+                SENSOR_DATA_CHAR_UUID,
+                lambda ch, data: self._route_notification(client, ch, data))
             self.log("Subscribed to sensor notifications")
         except Exception as e:
             self.log(f"Could not subscribe: {e} — skipping this device")
@@ -352,10 +675,180 @@ class DCMonitorGateway:
                 if not (pm and pm.threshold_mw is not None and pm._polling):
                     asyncio.ensure_future(self.start_web_poll(self._web_poll_interval))
 
+        if self._standby_enabled and self._standby_supported:
+            await self.send_command("ALL:GW:ACTIVE", _silent=True)
+            if self._standby_client is None:
+                asyncio.ensure_future(self._warm_standby())
+
+        # This gateway's node list (it may have none yet)
+        self.prov_nodes = None
+        await self.send_command("ALL:NODES", _silent=True)
+
+        return True
+
+    # ---- Hot-standby Gateway ----
+
+    def _route_notification(self, client, characteristic, data: bytearray):
+        """Notifications from either link: the primary gets the full parser."""
+        if client is self.client:
+            self.notification_handler(characteristic, data)
+        elif client is self._standby_client:
+            self._standby_notification(data)
+
+    def _on_ble_disconnect(self, client):
+        """bleak disconnected_callback for both links: wake the reconnect loop."""
+        if client is self._standby_client:
+            self._standby_client = None
+            self._standby_device = None
+            self.log("[STANDBY] Standby gateway link lost", style="yellow",
+                     _from_thread=True)
+        if self._link_event is not None and self._link_loop is not None:
+            self._link_loop.call_soon_threadsafe(self._link_event.set)
+
+    def _standby_notification(self, data: bytearray):
+        """Messages on the standby link: only its GW: reports matter.
+
+        They are short, so a notification holds whole messages (several
+        length-prefixed ones when they queued up).
+        """
+        data = bytes(data)
+        messages = [data]
+        if data and data[0] == GATT_FRAME_MARK:
+            messages, off = [], 0
+            while off + GATT_FRAME_HDR.size <= len(data):
+                mark, total = GATT_FRAME_HDR.unpack_from(data, off)
+                if mark != GATT_FRAME_MARK:
+                    break
+                off += GATT_FRAME_HDR.size
+                messages.append(data[off:off + total])
+                off += total
+        for msg in messages:
+            text = msg.decode('utf-8', errors='replace').strip()
+            if text.startswith("GW:SYNC:"):
+                self.log(f"[STANDBY] {text}", style="dim", _debug=True, _from_thread=True)
+            elif text.startswith("GW:LOST:"):
+                # Heartbeats stopped; only trust it if the primary went quiet too
+                if time.monotonic() - self._last_rx > self.PRIMARY_QUIET_S:
+                    self.log(f"[STANDBY] {text} - failing over", style="bold red",
+                             _from_thread=True)
+                    self._primary_lost = True
+                    if self._link_event is not None and self._link_loop is not None:
+                        self._link_loop.call_soon_threadsafe(self._link_event.set)
+
+    PRIMARY_QUIET_S = 1.0  # Primary silence that confirms a standby GW:LOST
+
+    async def _write_standby(self, cmd: str) -> bool:
+        client = self._standby_client
+        if not client or not client.is_connected:
+            return False
+        try:
+            await client.write_gatt_char(COMMAND_CHAR_UUID, cmd.encode('utf-8'))
+            return True
+        except Exception:
+            return False
+
+    async def _warm_standby(self):
+        """Connect a second gateway and mark it STANDBY (one attempt per call)."""
+        if self._standby_warming or not (self._standby_enabled and self._standby_supported):
+            return
+        self._standby_warming = True
+        try:
+            await asyncio.sleep(2.0)  # Let the primary link settle first
+            if not self._standby_supported:
+                return  # Primary rejected ALL:GW:ACTIVE
+            primary = self._last_connected_address
+            candidates = [d for d in self._scan_devices if d.address != primary]
+            if not candidates:
+                self.log("[STANDBY] No second gateway found, single link only",
+                         style="dim")
+                return
+            for device in candidates:
+                client = BleakClient(device.address, dangerous_use_bleak_cache=False,
+                                     disconnected_callback=self._on_ble_disconnect)
+                try:
+                    await client.connect()
+                    await client.start_notify(
+                        SENSOR_DATA_CHAR_UUID,
+                        lambda ch, data, c=client: self._route_notification(c, ch, data))
+                except Exception:
+                    try:
+                        await client.disconnect()
+                    except Exception:
+                        pass
+                    continue
+                if self.client is None or device.address == self._last_connected_address:
+                    # Primary changed under us - don't pair it with itself
+                    await client.disconnect()
+                    return
+                self._standby_client = client
+                self._standby_device = device
+                if await self._write_standby("ALL:GW:STANDBY"):
+                    self.log(f"[STANDBY] Warm standby: {device.name or device.address}",
+                             style="green")
+                    return
+                await self._drop_standby()
+        finally:
+            self._standby_warming = False
+
+    async def _drop_standby(self):
+        client = self._standby_client
+        self._standby_client = None
+        self._standby_device = None
+        if client:
+            try:
+                await client.disconnect()
+            except Exception:
+                pass
+
+    async def _promote_standby(self) -> bool:
+        """Make the warm standby link the primary. Returns False if there is none."""
+        client, device = self._standby_client, self._standby_device
+        self._standby_client = None
+        self._standby_device = None
+        if not client or not client.is_connected:
+            return False
+        started = time.monotonic()
+
+        self.client = client
+        self.connected_device = device
+        self._chunk_buf = ""
+        self._frame_buf = bytearray()
+        self._frame_len = 0
+        self._reconnecting = False
+        if not await self.send_command("ALL:GW:ACTIVE", _silent=True):
+            self.client = None
+            self.connected_device = None
+            return False
+        self._was_connected = True
+        self._last_connected_address = device.address
+        self.log(f"[FAILOVER] Standby {device.name or device.address} promoted "
+                 f"in {(time.monotonic() - started) * 1000:.0f} ms",
+                 style="bold green", _from_thread=True)
+
+        # Replies to requests in flight went to the old gateway: ask again
+        if self._pending_user_nodes and self._last_cmd:
+            await self.send_command(self._last_cmd, _silent=True)
+
+        if self._web_enabled:
+            try:
+                import web_server
+                loop = self.ble_thread._loop if self.ble_thread else None
+                if loop:
+                    asyncio.run_coroutine_threadsafe(
+                        web_server.broadcast_state_change("connected", {
+                            "device_name": getattr(device, 'name', None),
+                            "device_address": device.address,
+                        }),
+                        loop
+                    )
+            except Exception:
+                pass
+        asyncio.ensure_future(self._warm_standby())
         return True
 
     async def disconnect(self):
         """Disconnect from current node"""
+        await self._drop_standby()
         if self.client and self.client.is_connected:
             try:
                 await self.client.disconnect()
@@ -364,6 +857,8 @@ class DCMonitorGateway:
                 pass
             self.log("Disconnected")
         self._chunk_buf = ""  # Clear stale partial data on disconnect
+        self._frame_buf = bytearray()
+        self._frame_len = 0
 
         # Web broadcast: disconnected
         if self._web_enabled:
@@ -392,6 +887,8 @@ class DCMonitorGateway:
         async with self._ble_cmd_lock:
             try:
                 await self.client.write_gatt_char(COMMAND_CHAR_UUID, cmd.encode('utf-8'))
+                if not cmd.startswith("ALL:GW"):
+                    self._last_cmd = cmd
                 if not _silent:
                     self.log(f"Sent: {cmd}")
                 return True
@@ -400,21 +897,151 @@ class DCMonitorGateway:
                     self.log(f"Failed to send command: {e}")
                 return False
 
+    async def send_batch(self, entries, _silent: bool = False) -> bool:
+        """Send binary command entries [(opcode, target, value), ...] in one write.
+
+        target is a node bitmap (bit i = node 16 * window + i, window in the
+        opcode's high nibble) or GATT_BCMD_TARGET_ALL.
+        Returns False without sending if the firmware doesn't take batches.
+        """
+        if not self._binary_cmds or not entries:
+            return False
+        if len(entries) > GATT_BCMD_MAX_ENTRIES:
+            return False
+        if not self.client or not self.client.is_connected or self._reconnecting:
+            return False
+        payload = GATT_BCMD_HDR.pack(GATT_BCMD_V1, len(entries))
+        payload += b"".join(GATT_BCMD_ENTRY.pack(op, target, value)
+                            for op, target, value in entries)
+        async with self._ble_cmd_lock:
+            try:
+                await self.client.write_gatt_char(COMMAND_CHAR_UUID, payload)
+                self._batch_sent_at = time.monotonic()
+                if not _silent:
+                    self.log(f"Sent batch: {len(entries)} entr(ies), {len(payload)} bytes")
+                return True
+            except Exception as e:
+                if not _silent:
+                    self.log(f"Failed to send batch: {e}")
+                return False
+
+    async def set_duties(self, duties: dict, _silent: bool = False):
+        """Set several nodes' duty in one GATT write.
+
+        duties: {node_id: percent}. Nodes sharing a duty share one batch
+        entry; the gateway sends them all as one group duty-vector message,
+        so the step costs one mesh round trip. Falls back to one text DUTY
+        write per node if the firmware is too old for batches.
+        """
+        # One entry per (duty, 16-node window); large sites take several writes
+        by_duty: dict[tuple[int, int], int] = {}
+        for nid, percent in duties.items():
+            percent = max(0, min(100, int(percent)))
+            window, bit = divmod(int(nid), GATT_BCMD_WINDOW_NODES)
+            key = (percent, window)
+            by_duty[key] = by_duty.get(key, 0) | (1 << bit)
+        entries = [(GATT_BCMD_OP_DUTY | (window << GATT_BCMD_WINDOW_SHIFT), mask, duty)
+                   for (duty, window), mask in by_duty.items()]
+        sent_all = bool(entries)
+        for i in range(0, len(entries), GATT_BCMD_MAX_ENTRIES):
+            chunk = entries[i:i + GATT_BCMD_MAX_ENTRIES]
+            if not await self.send_batch(chunk, _silent=_silent):
+                sent_all = False
+                break
+        if sent_all:
+            return True
+        ok = True
+        for nid, percent in duties.items():
+            ok &= bool(await self.set_duty(nid, percent, _from_power_mgr=True,
+                                           _silent=_silent))
+        return ok
+
     async def _wait_node_response(self, node_id: str, timeout: float = 5.0):
         """Wait until a specific node responds, then return immediately.
 
-        Uses a threading.Event signaled by notification_handler (bleak thread)
-        and polled from the asyncio loop. Falls back to timeout.
+        The event is set by notification_handler (via call_soon_threadsafe
+        when it runs on bleak's thread). Falls back to timeout.
         """
-        evt = threading.Event()
-        self._node_events[node_id] = evt
+        evt = self._arm_node_response(node_id)
         try:
-            deadline = time.monotonic() + timeout
-            while not evt.is_set() and time.monotonic() < deadline:
-                await asyncio.sleep(0.1)  # Check every 100ms
-            return evt.is_set()
+            await asyncio.wait_for(evt.wait(), timeout)
+        except asyncio.TimeoutError:
+            pass
+        finally:
+            if self._node_events.get(node_id, (None,))[0] is evt:
+                self._node_events.pop(node_id, None)
+        return evt.is_set()
+
+    def _arm_node_response(self, node_id: str) -> asyncio.Event:
+        """Register a response event for node_id before sending to it."""
+        evt = asyncio.Event()
+        self._node_events[node_id] = (evt, asyncio.get_running_loop())
+        return evt
+
+    async def _wait_node_responses(self, node_ids, timeout: float = 5.0) -> set:
+        """Wait for several nodes armed with _arm_node_response().
+
+        Commands to different nodes are in flight together on the mesh
+        (one per destination), so this costs one round trip, not N.
+        Returns the set of node IDs that responded.
+        """
+        events = {nid: self._node_events[nid][0]
+                  for nid in node_ids if nid in self._node_events}
+        waiters = [asyncio.ensure_future(evt.wait()) for evt in events.values()]
+        try:
+            if waiters:
+                await asyncio.wait(waiters, timeout=timeout)
+            return {nid for nid, evt in events.items() if evt.is_set()}
+        finally:
+            for w in waiters:
+                w.cancel()
+            for nid, evt in events.items():
+                if self._node_events.get(nid, (None,))[0] is evt:
+                    self._node_events.pop(nid, None)
+
+    async def _backfill_history(self, timeout: float = 5.0):
+        """Fill the database gap left by a GATT outage from the nodes' history.
+
+        Every node keeps ~17 min of samples in RAM; each HISTORY request
+        returns one frame (up to 17 samples), so all nodes are asked together
+        each round until none reports more.
+        """
+        if not self._web_enabled or self._disconnected_at is None:
+            return
+        start, end = self._disconnected_at, time.time()
+        self._disconnected_at = None
+        self._backfill_window = (start, end)
+        self._backfill_rows = []
+        pending = sorted(self.known_nodes, key=int)
+        nodes = len(pending)
+        try:
+            while pending and self.client and self.client.is_connected:
+                max_age = int(time.time() - start) + 1
+                for nid in pending:
+                    self._history_more[nid] = False
+                    self._history_events[nid] = threading.Event()
+                    cursor = self._history_cursor.get(nid)
+                    since = "*" if cursor is None or cursor[1] is None else cursor[1]
+                    await self.send_to_node(nid, "HISTORY", f"{since}:{max_age}",
+                                            _silent=True)
+                deadline = time.monotonic() + timeout
+                while time.monotonic() < deadline and not all(
+                        self._history_events[nid].is_set() for nid in pending):
+                    await asyncio.sleep(0.1)
+                pending = [nid for nid in pending
+                           if self._history_events[nid].is_set()
+                           and self._history_more.get(nid)]
         finally:
-            self._node_events.pop(node_id, None)
+            self._backfill_window = None
+            self._history_events.clear()
+
+        rows, self._backfill_rows = self._backfill_rows, []
+        if rows:
+            import db
+            await asyncio.get_running_loop().run_in_executor(
+                None, db.insert_readings, rows)
+        self.log(f"[BACKFILL] {len(rows)} readings from {nodes} node(s) "
+                 f"for the {end - start:.0f}s gap", _from_thread=True)
 
     async def send_to_node(self, node: str, command: str, value: str = None,
                            _silent: bool = False):
@@ -423,9 +1050,10 @@ class DCMonitorGateway:
         When node is 'ALL', sends a single ALL:COMMAND which the GATT
         gateway translates to a BLE Mesh group send (0xC000).  All
         subscribed nodes receive it simultaneously — O(1) instead of O(N).
+        'Z<n>' does the same for zone n's group (0xC100 + n) and its members.
 
         Args:
-            node: Node ID (0-9) or "ALL"
+            node: Node ID (0-9), "ALL" or "Z<n>"
             command: RAMP, STOP, ON, OFF, DUTY, STATUS, READ
             value: Optional value (e.g. duty percentage)
         """
@@ -544,6 +1172,7 @@ class DCMonitorGateway:
         The poll loop yields immediately when _poll_interrupt is set,
         letting user commands take priority on the GATT characteristic.
         """
+        last_perf = 0.0
         try:
             while self._web_poll_requested:
                 # Yield if user command is pending
@@ -557,6 +1186,10 @@ class DCMonitorGateway:
 
                 if self.client and self.client.is_connected and not self._reconnecting:
                     await self.send_to_node("ALL", "READ", _silent=True)
+                    # Node health for the dashboard, much slower than readings
+                    if time.monotonic() - last_perf >= self._perf_interval:
+                        last_perf = time.monotonic()
+                        await self.send_to_node("ALL", "PERF", _silent=True)
 
                 # Interruptible sleep: wakes early if user command arrives
                 try:
@@ -579,22 +1212,46 @@ class DCMonitorGateway:
         """Monitor BLE connection health and auto-reconnect on disconnect.
 
         Runs as a background task on the BLE thread's event loop.
-        Checks connection every 2 seconds. On disconnect:
+        Checks connection every 2 seconds, or at once when bleak reports a
+        drop or the standby gateway reports the active heartbeat lost. With
+        a warm standby link that link is promoted straight away (no rescan,
+        no rediscovery: the standby node has the mesh state, gw_sync.h).
+        Otherwise, on disconnect:
         1. Logs the event
         2. Pauses PM polling
         3. Rescans for the gateway
         4. Reconnects and resubscribes
         5. Resumes PM polling
         """
+        self._link_loop = asyncio.get_running_loop()
+        self._link_event = asyncio.Event()
         while self.running:
-            await asyncio.sleep(2.0)
+            try:
+                # A BLE drop or a standby GW:LOST wakes us at once
+                await asyncio.wait_for(self._link_event.wait(), timeout=2.0)
+            except asyncio.TimeoutError:
+                pass
+            self._link_event.clear()
+
+            if self._primary_lost:
+                self._primary_lost = False
+                old = self.client
+                if old and old.is_connected and self._standby_client:
+                    self.client = None  # Its late notifications are ignored
+                    try:
+                        await old.disconnect()
+                    except Exception:
+                        pass
 
             if self.client is None or not self.client.is_connected:
+                if self._was_connected and await self._promote_standby():
+                    continue  # Hot failover: no rescan, PM keeps running
                 if self._was_connected:
                     self.log("[RECONNECT] Connection lost! Attempting reconnect...",
                              style="bold red", _from_thread=True)
                     self._was_connected = False
                     self._reconnecting = True
+                    self._disconnected_at = time.time()
 
                     # Web broadcast: connection lost, attempting reconnect
                     if self._web_enabled:
@@ -648,6 +1305,7 @@ class DCMonitorGateway:
                                     pm._paused = False
                                     self.log("[FAILOVER] PowerManager resumed",
                                              _from_thread=True)
+                                asyncio.ensure_future(self._backfill_history())
                                 connected = True
                                 break
 
@@ -668,6 +1326,7 @@ class DCMonitorGateway:
                                             pm._paused = False
                                             self.log("[RECONNECT] PowerManager resumed",
                                                      _from_thread=True)
+                                        asyncio.ensure_future(self._backfill_history())
                                         connected = True
                                         break
 
@@ -12,6 +12,7 @@ Usage:
     python gateway.py --node 0 --read       # Single sensor reading
     python gateway.py --node 0 --monitor    # Continuous monitoring
     python gateway.py --no-tui              # Plain CLI mode (legacy)
+    python gateway.py --no-standby          # One gateway link, no hot standby
 
 Commands are sent as NODE_ID:COMMAND[:VALUE] to the ESP32-C6 mesh gateway,
 which forwards them to the targeted mesh node via BLE Mesh.
@@ -55,6 +56,8 @@ def main():
                         help="Web dashboard only, no TUI")
     parser.add_argument("--web-port", type=int, default=8000,
                         help="Web dashboard port (default 8000)")
+    parser.add_argument("--no-standby", action="store_true",
+                        help="Don't keep a second gateway connected for failover")
     args = parser.parse_args()
 
     # Validate --node argument
@@ -74,6 +77,7 @@ def main():
     # Textual's app.run() manages its own event loop, so call it directly (not from asyncio.run)
     if _HAS_TEXTUAL and not is_oneshot and not args.no_tui:
         gateway = DCMonitorGateway()
+        gateway._standby_enabled = not args.no_standby
 
         # Initialize web dashboard if --web flag is set
         if args.web:
@@ -103,6 +107,9 @@ def main():
 async def _run_cli(args, node: str):
     """Run one-shot CLI commands or legacy interactive mode."""
     gateway = DCMonitorGateway()
+    gateway._standby_enabled = not args.no_standby and not (
+        args.scan or args.stop or args.ramp or args.status or args.read
+        or args.duty is not None)
 
     print("\n" + "=" * 50)
     print("  DC Monitor Mesh Gateway (Pi 5)")
@@ -171,6 +178,7 @@ def _run_web_only(args, node: str):
     from ble_thread import BleThread
 
     gateway = DCMonitorGateway()
+    gateway._standby_enabled = not args.no_standby
     gateway._web_enabled = True
     # Auto-start poll at 2s when web dashboard is active
     gateway._web_poll_requested = True
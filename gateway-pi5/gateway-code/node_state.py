@@ -17,3 +17,12 @@ class NodeState:
     last_seen: float = field(default_factory=time.monotonic)
     responsive: bool = True
     poll_gen: int = 0          # Which poll cycle this data is from
+    rtt_ms: int = 0            # Smoothed mesh RTT reported by the gateway (0 = unknown)
+    hops: int = 0              # Hops from the gateway node
+    link_timeout_ms: int = 0   # Gateway's current client timeout for this node
+    published_at: float = 0.0  # Last unsolicited (published) reading, 0 = never
+    zones: int = 0             # Zone bitmap from the node's ZONES reply (bit z = Z<z>)
+    stats_power: float = 0.0   # Mean mW over the last STATS window
+    stats_duty: int = 0        # Duty during that window (valid if stats_steady)
+    stats_steady: bool = False # Duty did not change during the window
+    stats_at: float = 0.0      # time.monotonic() of the last STATS reply, 0 = never
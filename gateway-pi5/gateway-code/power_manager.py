@@ -37,6 +37,20 @@ class PowerManager:
     COOLDOWN = 5.0         # Seconds between adjustments (give mesh time to settle)
     HEADROOM_MW = 500.0    # Target buffer below threshold (budget = threshold - headroom)
     PRIORITY_WEIGHT = 2.0  # Priority node gets this many "shares" vs 1 for normal nodes
+    POLL_DEADLINE_MIN = 1.0    # Poll wait bounds (s) when tuned from link estimates
+    POLL_DEADLINE_MAX = 3.0
+    POLL_DEADLINE_SLACK = 0.5  # Added to slowest node timeout (BLE notify + batching)
+    GROUP_REPLY_SLOT = 0.04    # Nodes answer group reads node id x this late
+                               # (firmware CONFIG_MESH_GROUP_REPLY_SLOT_MS)
+    RELAY_GAP = 0.3            # Pause after a poll before sending adjustments
+    PROFILE_ACTIVE = "FAST"      # INA260 profile while balancing (low latency)
+    PROFILE_IDLE = "BALANCED"    # Restored when PM is disabled
+    STATS_INTERVAL = 30.0  # Seconds between rolling-window summary requests
+    STATS_WINDOW = 10      # Seconds averaged by the node (firmware max 60)
+    STATS_FRESH = 45.0     # Older summaries are not used for the estimate
+    PUBLISH_FRESH = 22.0   # Published readings younger than this make a poll redundant
+                           # (node heartbeat is 5 x 2 s publish periods: one lost
+                           # heartbeat is tolerated)
 
     def __init__(self, gateway):
         self.gateway = gateway
@@ -47,9 +61,20 @@ class PowerManager:
         self._last_adjustment: float = 0
         self._force_evaluate = False  # Set True to bypass cooldown on next eval
         self._poll_generation: int = 0
+        self._poll_done: Optional[asyncio.Event] = None  # Set when this cycle is complete
+        self._poll_done_loop: Optional[asyncio.AbstractEventLoop] = None
         self._polling = False  # True while a poll cycle is active
         self._needs_bootstrap = False
         self._paused = False  # Set True by reconnect loop to pause polling
+        # Balance on the gateway node's controller (firmware "PM" command)
+        # until it turns out not to support it; then run the loop here
+        self.on_node = True
+        self._ctrl_dirty = False  # Threshold/priority not yet pushed to the node
+        # Balance one zone (bus segment) only: polls go to its group (Z<n>:READ),
+        # so only its members reply. The node controller balances every node,
+        # so a zone is always balanced from the Pi.
+        self.zone: Optional[int] = None
+        self._last_stats_request: float = 0
 
     # ---- Public API ----
 
@@ -73,6 +98,7 @@ class PowerManager:
         # (uses a flag instead of _last_adjustment=0 to survive race with
         # a concurrently-finishing _evaluate_and_adjust on the BLE thread)
         self._force_evaluate = True
+        self._ctrl_dirty = True
         self._adjusting = False  # Clear any in-progress flag
         budget = mw - self.HEADROOM_MW
         n = len([ns for ns in self.nodes.values() if ns.responsive]) or 1
@@ -85,23 +111,38 @@ class PowerManager:
         """Disable power management and restore original duty cycles."""
         self.threshold_mw = None
         self._polling = False
+        if self.on_node and self.zone is None:
+            # The node controller restores target duties itself. With a zone
+            # selected it is already off (set_zone) and the Pi drove the
+            # zone's duties, so those are restored below like Pi-side PM.
+            await self.gateway.send_to_node("ALL", "PM", "OFF", _silent=True)
+            for ns in self.nodes.values():
+                ns.commanded_duty = 0
+            await self.gateway.send_to_node(
+                "ALL", "PROFILE", self.PROFILE_IDLE, _silent=True)
+            self.gateway.log("[POWER] Threshold disabled")
+            return
         # Wait for any in-flight mesh commands to complete before restoring
         await asyncio.sleep(2.0)
-        # Restore all nodes to their target duty
+        # Restore the nodes we balanced to their target duty
         for ns in self.nodes.values():
-            if ns.commanded_duty != ns.target_duty and ns.target_duty > 0:
+            if (self._in_scope(ns) and ns.commanded_duty != ns.target_duty
+                    and ns.target_duty > 0):
                 self.gateway.log(
                     f"[POWER] Restoring node {ns.node_id}: {ns.commanded_duty}% → {ns.target_duty}%")
                 await self.gateway.set_duty(
                     ns.node_id, ns.target_duty, _from_power_mgr=True, _silent=True)
                 await self.gateway._wait_node_response(ns.node_id)
             ns.commanded_duty = 0  # Reset commanded state
+        await self.gateway.send_to_node(
+            "ALL", "PROFILE", self.PROFILE_IDLE, _silent=True)
         self.gateway.log("[POWER] Threshold disabled")
 
     def set_priority(self, node_id: str):
         """Set the priority node. Triggers immediate rebalance."""
         self.priority_node = node_id
         self._force_evaluate = True  # Force rebalance on next cycle
+        self._ctrl_dirty = True
         if self.threshold_mw:
             budget = self.threshold_mw - self.HEADROOM_MW
             responsive = [ns for ns in self.nodes.values() if ns.responsive]
@@ -119,6 +160,7 @@ class PowerManager:
         """Remove priority designation. Triggers immediate rebalance to equal shares."""
         self.priority_node = None
         self._force_evaluate = True  # Force rebalance on next cycle
+        self._ctrl_dirty = True
         if self.threshold_mw:
             budget = self.threshold_mw - self.HEADROOM_MW
             n = len([ns for ns in self.nodes.values() if ns.responsive]) or 1
@@ -127,6 +169,30 @@ class PowerManager:
         else:
             self.gateway.log("[POWER] Priority cleared")
 
+    async def set_zone(self, zone: Optional[int]):
+        """Balance only the nodes in zone (None = every node)."""
+        self.zone = zone
+        self._force_evaluate = True
+        if zone is None:
+            self._ctrl_dirty = True  # Hand balancing back to the node controller
+            self.gateway.log("[POWER] Balancing all nodes")
+            return
+        if self.on_node and self.threshold_mw is not None:
+            await self.gateway.send_to_node("ALL", "PM", "OFF", _silent=True)
+        # Refresh membership - nodes may have been reassigned on the provisioner
+        await self.gateway.send_to_node("ALL", "ZONES", _silent=True)
+        members = [ns.node_id for ns in self.nodes.values() if self._in_scope(ns)]
+        self.gateway.log(f"[POWER] Balancing zone {zone}: nodes {members}")
+
+    def _in_scope(self, ns: NodeState) -> bool:
+        return self.zone is None or bool(ns.zones & (1 << self.zone))
+
+    def on_zones(self, node_id: str, zones: int):
+        """A node's zone membership (ZONES reply)."""
+        if node_id not in self.nodes:
+            self.nodes[node_id] = NodeState(node_id=node_id)
+        self.nodes[node_id].zones = zones
+
     def set_target_duty(self, node_id: str, duty: int):
         """Record the user-requested duty for a node."""
         if node_id not in self.nodes:
@@ -146,6 +212,8 @@ class PowerManager:
             lines.append(f"Budget:    {budget:.0f} mW (headroom: {self.HEADROOM_MW:.0f} mW)")
         else:
             lines.append("Threshold: OFF")
+        if self.threshold_mw is not None:
+            lines.append(f"Control:   {'gateway node' if self.on_node else 'Pi'}")
         if self.priority_node is not None:
             lines.append(f"Priority:  node {self.priority_node}")
         else:
@@ -195,8 +263,12 @@ class PowerManager:
     # ---- Notification Hook ----
 
     def on_sensor_data(self, node_id: str, duty: int, voltage: float,
-                       current: float, power: float):
-        """Update node state from parsed sensor data."""
+                       current: float, power: float, published: bool = False):
+        """Update node state from parsed sensor data.
+
+        published: the frame went out on the telemetry group (0xC001) on the
+        node's own schedule, not as a reply to anything we sent.
+        """
         if node_id not in self.nodes:
             self.nodes[node_id] = NodeState(node_id=node_id)
 
@@ -208,18 +280,80 @@ class PowerManager:
         ns.last_seen = time.monotonic()
         ns.responsive = True
         ns.poll_gen = self._poll_generation
+        # Only telemetry-group frames prove a node publishes; replies (duty,
+        # reads) arriving between polls don't
+        if published:
+            ns.published_at = ns.last_seen
 
         # Only sync commanded_duty when PM is OFF — when PM is active,
-        # only _nudge_node() updates commanded_duty (avoids stale sensor
+        # only _nudge_nodes() updates commanded_duty (avoids stale sensor
         # data overwriting what PM just sent, which causes oscillation)
         if self.threshold_mw is None:
             ns.commanded_duty = duty
 
+        # Older gateway firmware doesn't batch: finish the cycle once every
+        # responsive node has reported
+        if all(n.poll_gen == self._poll_generation
+               for n in self.nodes.values() if n.responsive and self._in_scope(n)):
+            self._signal_poll_done()
+
         # Don't auto-sync target_duty from sensor data — it must only be set
         # by explicit user commands (set_target_duty). Auto-sync caused PM to
         # "forget" the original target after disable() because sensor data
         # reported the reduced duty, overwriting target_duty.
 
+    def on_stats(self, node_id: str, duty: int, mean_mw: float, steady: bool):
+        """Rolling window summary from the node (STATS frame)."""
+        if node_id not in self.nodes:
+            self.nodes[node_id] = NodeState(node_id=node_id)
+        ns = self.nodes[node_id]
+        ns.stats_power = mean_mw
+        ns.stats_duty = duty
+        ns.stats_steady = steady
+        ns.stats_at = time.monotonic()
+
+    def on_link_stats(self, node_id: str, rtt_ms: int, rttvar_ms: int,
+                      hops: int, timeout_ms: int):
+        """Gateway's RTT / hop estimate for a node (LINK: notification)."""
+        if node_id not in self.nodes:
+            self.nodes[node_id] = NodeState(node_id=node_id)
+        ns = self.nodes[node_id]
+        ns.rtt_ms = rtt_ms
+        ns.hops = hops
+        ns.link_timeout_ms = timeout_ms
+
+    def _poll_deadline(self) -> float:
+        """Seconds to wait for a poll cycle, from the slowest node's link timeout.
+
+        Falls back to POLL_DEADLINE_MAX until every responsive node has a
+        link estimate from the gateway.
+        """
+        live = [ns for ns in self.nodes.values()
+                if ns.responsive and self._in_scope(ns)]
+        # Replies arrive in node-id slots; the last slot bounds the spread
+        spread = max((int(ns.node_id) for ns in live if ns.node_id.isdigit()),
+                     default=0) * self.GROUP_REPLY_SLOT
+        timeouts = [ns.link_timeout_ms for ns in live]
+        if not timeouts or min(timeouts) == 0:
+            return self.POLL_DEADLINE_MAX + spread
+        deadline = max(timeouts) / 1000.0 + self.POLL_DEADLINE_SLACK
+        return max(self.POLL_DEADLINE_MIN,
+                   min(self.POLL_DEADLINE_MAX, deadline)) + spread
+
+    def on_poll_complete(self, gen: int):
+        """Gateway flushed its group-READ batch (LAST flag) for generation gen."""
+        # A poll that timed out here can still flush after the next one was
+        # sent; only the current cycle's batch completes it
+        if gen != self._poll_generation & 0xFF:
+            return
+        self._signal_poll_done()
+
+    def _signal_poll_done(self):
+        # Notifications may arrive on bleak's thread - hop to the waiter's loop
+        evt, loop = self._poll_done, self._poll_done_loop
+        if evt is not None and loop is not None:
+            loop.call_soon_threadsafe(evt.set)
+
     # ---- Internal Control Loop ----
 
     async def _bootstrap_discovery(self):
@@ -229,7 +363,21 @@ class PowerManager:
         sensing_node_count = total_mesh_devices - 1 (GATT gateway).
         We probe addresses 1..sensing_node_count. Nodes that respond with
         sensor data are sensing nodes; relays/others are ignored.
+        When the gateway has the provisioner's node list, only listed nodes
+        are read and nothing is probed.
         """
+        listed = self.gateway.prov_nodes
+        if listed is not None:
+            # The provisioner told the gateway exactly which nodes exist
+            self.gateway.log(f"[POWER] Provisioner lists {len(listed)} node(s), no probing")
+            for nid in sorted(listed, key=int):
+                if self.threshold_mw is None:
+                    return
+                if nid not in self.nodes:
+                    await self.gateway.send_to_node(nid, "READ", _silent=True)
+                    await self.gateway._wait_node_response(nid)
+            return
+
         count = self.gateway.sensing_node_count
         if count == 0:
             self.gateway.log("[POWER] No sensing nodes found in BLE scan")
@@ -281,6 +429,8 @@ class PowerManager:
                 await self._bootstrap_discovery()
                 await asyncio.sleep(2.0)
             self._polling = True
+            await self.gateway.send_to_node(
+                "ALL", "PROFILE", self.PROFILE_ACTIVE, _silent=True)
 
             # Pause web auto-poll while PM is active (PM does its own polling)
             gw = self.gateway
@@ -292,10 +442,24 @@ class PowerManager:
                 if self._paused:
                     await asyncio.sleep(1.0)
                     continue
-                await self._poll_all_nodes()
-                await self._wait_for_responses(timeout=4.0)
+                if self.on_node and self.zone is None:
+                    # Node runs the loop; readings reach us as it forwards them
+                    if self._ctrl_dirty:
+                        await self._push_controller_config()
+                    self._mark_stale_nodes()
+                    await asyncio.sleep(self.POLL_INTERVAL)
+                    continue
+                if self._telemetry_fresh():
+                    self.gateway.log("[POWER] Skip poll: published data fresh",
+                                     _debug=True)
+                else:
+                    await self._poll_all_nodes()
+                    await self._wait_for_responses(
+                        timeout=self._poll_deadline() + 1.0)
                 self._mark_stale_nodes()
-                await asyncio.sleep(1.0)  # Relay breathing gap — let radio catch up
+                await self._request_stats()
+                # Replies are slotted, so the air is quiet once the batch is in
+                await asyncio.sleep(self.RELAY_GAP)
                 await self._evaluate_and_adjust()
                 await asyncio.sleep(self.POLL_INTERVAL)
             self._polling = False
@@ -307,32 +471,87 @@ class PowerManager:
             asyncio.ensure_future(self.gateway.start_web_poll(
                 self.gateway._web_poll_interval))
 
+    async def _push_controller_config(self):
+        """Send threshold and priority to the gateway node's controller."""
+        self._ctrl_dirty = False
+        if self.threshold_mw is None:
+            return
+        await self.gateway.send_to_node(
+            "ALL", "PM", str(int(self.threshold_mw)), _silent=True)
+        if self.priority_node is not None:
+            await self.gateway.send_to_node(
+                self.priority_node, "PM", "PRIORITY", _silent=True)
+        else:
+            await self.gateway.send_to_node("ALL", "PM", "PRIORITY", _silent=True)
+
+    def on_controller_unsupported(self):
+        """Gateway firmware has no PM command: balance from the Pi instead."""
+        if not self.on_node:
+            return
+        self.on_node = False
+        self._force_evaluate = True
+        self.gateway.log("[POWER] Gateway has no on-node controller, "
+                         "balancing from the Pi", _from_thread=True)
+
+    def _telemetry_fresh(self) -> bool:
+        """True if every responsive node has published recently.
+
+        Nodes publish on change and on a heartbeat, so a recent publication
+        means our cached reading is current and ALL:READ would add nothing.
+        """
+        now = time.monotonic()
+        live = [n for n in self.nodes.values()
+                if n.responsive and n.node_id.isdigit() and self._in_scope(n)]
+        return bool(live) and all(
+            n.published_at and now - n.published_at < self.PUBLISH_FRESH
+            for n in live)
+
     async def _poll_all_nodes(self):
         """Poll all nodes with a single group READ.
 
         Sends ALL:READ which the GATT gateway translates to a BLE Mesh
         group send (0xC000).  All subscribed nodes respond individually.
+        With a zone set, Z<n>:READ goes to the zone group instead and only
+        its members reply.
         """
         self._poll_generation += 1
         if not self.nodes:
             return
-        await self.gateway.send_to_node("ALL", "READ", _silent=True)
-        await self._wait_for_responses(timeout=3.0)
+        # Arm before sending so a fast batch can't slip past the waiter
+        self._poll_done = asyncio.Event()
+        self._poll_done_loop = asyncio.get_running_loop()
+        target = "ALL" if self.zone is None else f"Z{self.zone}"
+        # The gateway numbers the batch with our generation (on_poll_complete)
+        await self.gateway.send_to_node(target, "READ",
+                                        str(self._poll_generation & 0xFF),
+                                        _silent=True)
+        await self._wait_for_responses(timeout=self._poll_deadline())
+
+    async def _request_stats(self):
+        """Ask for window averages every STATS_INTERVAL (see _estimate_mw_per_pct).
+
+        Replies arrive with the next poll's traffic; nothing waits on them.
+        """
+        now = time.monotonic()
+        if not self.nodes or now - self._last_stats_request < self.STATS_INTERVAL:
+            return
+        self._last_stats_request = now
+        target = "ALL" if self.zone is None else f"Z{self.zone}"
+        await self.gateway.send_to_node(target, "STATS", str(self.STATS_WINDOW),
+                                        _silent=True)
 
     async def _wait_for_responses(self, timeout: float = 3.0):
-        """Wait until all responsive nodes report for this poll cycle, or timeout."""
-        deadline = time.monotonic() + timeout
-        while time.monotonic() < deadline:
-            if self.threshold_mw is None:
-                return
-            all_fresh = all(
-                ns.poll_gen == self._poll_generation
-                for ns in self.nodes.values()
-                if ns.responsive
-            )
-            if all_fresh:
-                return
-            await asyncio.sleep(0.1)
+        """Wait for this poll cycle to complete, or timeout.
+
+        Completion is signaled by the gateway's batch LAST flag, or by
+        on_sensor_data() once every responsive node has reported.
+        """
+        if self.threshold_mw is None or self._poll_done is None:
+            return
+        try:
+            await asyncio.wait_for(self._poll_done.wait(), timeout)
+        except asyncio.TimeoutError:
+            pass
 
     def _mark_stale_nodes(self):
         """Mark nodes that haven't responded recently as unresponsive."""
@@ -367,7 +586,8 @@ class PowerManager:
             return
         self._force_evaluate = False  # Clear flag before evaluating
 
-        responsive = {nid: ns for nid, ns in self.nodes.items() if ns.responsive}
+        responsive = {nid: ns for nid, ns in self.nodes.items()
+                      if ns.responsive and self._in_scope(ns)}
         if not responsive:
             self.gateway.log("[PM] skip: no responsive nodes", _debug=True)
             return
@@ -461,6 +681,11 @@ class PowerManager:
         to avoid oscillation from stale sensor data lagging PM commands.
         """
         duty_value = ns.commanded_duty if ns.commanded_duty > 0 else ns.duty
+        # A window average at the current, unchanged duty beats one sample
+        if (duty_value > 0 and ns.stats_steady and ns.stats_duty == duty_value
+                and ns.stats_power > 0
+                and time.monotonic() - ns.stats_at < self.STATS_FRESH):
+            return ns.stats_power / duty_value
         if duty_value > 0 and ns.power > 0:
             return ns.power / duty_value
         # Fallback: average from other nodes that have data
@@ -473,13 +698,11 @@ class PowerManager:
             return sum(estimates) / len(estimates)
         return 50.0  # Last resort default
 
-    async def _nudge_node(self, nid: str, ns: NodeState, target_share_mw: float,
-                          all_nodes: dict) -> str | None:
-        """Nudge a single node's duty toward its target power share.
+    def _plan_nudge(self, nid: str, ns: NodeState, target_share_mw: float,
+                    all_nodes: dict) -> tuple[int, int] | None:
+        """Work out a node's new duty for its target power share.
 
-        Returns a change description string, or None if no change needed.
-        Sends the duty command once — retries happen on the next poll cycle
-        instead of blocking here (which caused cascading delays).
+        Returns (current, new_duty), or None if no change is needed.
         """
         mw_per_pct = self._estimate_mw_per_pct(ns, all_nodes)
         ideal_duty = target_share_mw / mw_per_pct
@@ -497,36 +720,57 @@ class PowerManager:
             f"ceiling={ceiling}%, clamped={new_duty}%, current={current}%",
             _debug=True)
 
-        if new_duty == current:
-            return None
-
         new_duty = max(0, min(100, new_duty))
         if new_duty == current:
             return None
+        return current, new_duty
 
-        change = f"N{nid}:{current}->{new_duty}%"
-        await self.gateway.set_duty(nid, new_duty, _from_power_mgr=True, _silent=True)
-        confirmed = await self.gateway._wait_node_response(nid)
-        # Always update commanded_duty — with mesh latency, strict confirmation
-        # often fails (response shows old duty). The next poll will self-correct
-        # if the command was truly lost.
-        ns.commanded_duty = new_duty
-        if not confirmed:
-            self.gateway.log(
-                f"[PM] N{nid} duty:{new_duty}% sent (no confirm, will verify next poll)",
-                _debug=True)
-        return change
+    async def _nudge_nodes(self, shares: list, all_nodes: dict) -> list[str]:
+        """Nudge several nodes toward their power shares in one round trip.
+
+        shares: [(nid, ns, target_share_mw, label_suffix), ...]
+        Sends every duty command first, then waits for all replies together.
+        Returns change description strings.
+        """
+        plans = []
+        for nid, ns, share_mw, suffix in shares:
+            plan = self._plan_nudge(nid, ns, share_mw, all_nodes)
+            if plan:
+                plans.append((nid, ns, plan[0], plan[1], suffix))
+        if not plans:
+            return []
+
+        # Arm before sending so fast replies aren't missed
+        for nid, *_ in plans:
+            self.gateway._arm_node_response(nid)
+        # One GATT write for the whole step; the gateway fans it out
+        await self.gateway.set_duties(
+            {nid: new_duty for nid, _ns, _current, new_duty, _suffix in plans},
+            _silent=True)
+        confirmed = await self.gateway._wait_node_responses([p[0] for p in plans])
+
+        changes = []
+        for nid, ns, current, new_duty, suffix in plans:
+            # Always update commanded_duty — with mesh latency, strict confirmation
+            # often fails (response shows old duty). The next poll will self-correct
+            # if the command was truly lost.
+            ns.commanded_duty = new_duty
+            if nid not in confirmed:
+                self.gateway.log(
+                    f"[PM] N{nid} duty:{new_duty}% sent (no confirm, will verify next poll)",
+                    _debug=True)
+            changes.append(f"N{nid}:{current}->{new_duty}%{suffix}")
+        return changes
 
     async def _balance_proportional(self, nodes: dict, budget: float):
         """Equal power shares: each node gets budget/N."""
         n = len(nodes)
         share_mw = budget / n
 
-        changes = []
-        for nid, ns in sorted(nodes.items(), key=lambda x: int(x[0]) if x[0].isdigit() else 999):
-            change = await self._nudge_node(nid, ns, share_mw, nodes)
-            if change:
-                changes.append(change)
+        changes = await self._nudge_nodes(
+            [(nid, ns, share_mw, "") for nid, ns in
+             sorted(nodes.items(), key=lambda x: int(x[0]) if x[0].isdigit() else 999)],
+            nodes)
 
         total_power = sum(ns.power for ns in nodes.values())
         if changes:
@@ -574,18 +818,11 @@ class PowerManager:
 
         non_pri_share = remaining / len(non_priority) if non_priority else 0
 
-        changes = []
-        # Nudge priority node
-        change = await self._nudge_node(self.priority_node, priority_ns,
-                                        priority_budget, nodes)
-        if change:
-            changes.append(change + "(pri)")
-
-        # Nudge non-priority nodes
-        for nid, ns in sorted(non_priority.items(), key=lambda x: int(x[0]) if x[0].isdigit() else 999):
-            change = await self._nudge_node(nid, ns, non_pri_share, nodes)
-            if change:
-                changes.append(change)
+        # Priority node first, then the rest - all in flight together
+        shares = [(self.priority_node, priority_ns, priority_budget, "(pri)")]
+        shares += [(nid, ns, non_pri_share, "") for nid, ns in
+                   sorted(non_priority.items(), key=lambda x: int(x[0]) if x[0].isdigit() else 999)]
+        changes = await self._nudge_nodes(shares, nodes)
 
         total_power = sum(ns.power for ns in nodes.values())
         if changes:
@@ -154,6 +154,10 @@ async def _execute_command(cmd: str):
                 await _gateway.start_ramp(node_id)
             elif subcmd == 'duty' and len(parts) >= 4:
                 await _gateway.set_duty(node_id, int(parts[3]))
+            elif subcmd == 'perf':
+                # Health counters; "node <id> perf rtt" for per-destination RTT
+                await _gateway.send_to_node(
+                    node_id, "PERF", parts[3] if len(parts) >= 4 else None)
             else:
                 await broadcast_log(f"Unknown sub-command: {subcmd}")
         # Change target node: "node <id>"
@@ -228,7 +232,7 @@ async def _execute_command(cmd: str):
         elif verb == 'help':
             await broadcast_log(
                 "Commands: read | r, stop | s, ramp, duty <0-100>, "
-                "node <id> <r|s|ramp|duty> [val], poll <sec> | poll stop, "
+                "node <id> <r|s|ramp|duty|perf> [val], poll <sec> | poll stop, "
                 "threshold <mW> | threshold off, priority <id> | priority off"
             )
         else:
@@ -405,6 +409,8 @@ def _build_state() -> dict:
             "commanded_duty": 0,
             "target_duty": 0,
         }
+    for nid, perf in getattr(_gateway, '_node_perf', {}).items():
+        state["nodes"].setdefault(nid, {})["perf"] = perf
 
     pm = _gateway._power_manager
     if pm: